@@ -0,0 +1,505 @@
+// Benchmark harness for mathseqc: generates synthetic MathSeq programs of a
+// given size, runs each on every engine and reports the time of each
+// compiler phase, as measured by the compiler's own -time-phases, plus the
+// run of the executable for the native backend. Every run is appended to a
+// CSV history, and each result is compared with the last run of the same
+// workload, size and engine found there.
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+namespace {
+
+struct Workload {
+    std::string name;
+    std::string description;
+    size_t defaultSize;
+    std::string (*generate)(size_t size);
+};
+
+struct Phase {
+    std::string name;
+    double wallMs = 0.0;
+    double cpuMs = 0.0;
+};
+
+struct Measurement {
+    bool success = false;
+    std::string error;
+    std::vector<Phase> phases;
+    Phase total{"total"};
+    std::string output;  // What the program printed, to check engines agree
+};
+
+// Many small functions, each called once: lexer, parser and the
+// per-function compiler passes dominate
+std::string generateParse(size_t size) {
+    std::ostringstream source;
+    source << "# " << size << " functions of straight-line arithmetic\n\n";
+    for (size_t i = 0; i < size; ++i) {
+        source << "func f" << i << "(x: int, y: int) -> int {\n"
+               << "    let a: int = x * " << (i % 97 + 2) << " + y\n"
+               << "    let b: int = a - x / " << (i % 13 + 1) << "\n"
+               << "    if b > a {\n"
+               << "        b = b % 1000\n"
+               << "    } else {\n"
+               << "        b = b + " << i << "\n"
+               << "    }\n"
+               << "    return a + b\n"
+               << "}\n\n";
+    }
+    source << "func main() -> int {\n    let total: int = 0\n";
+    for (size_t i = 0; i < size; ++i) {
+        source << "    total = (total + f" << i << "(" << i << ", total)) % 1000003\n";
+    }
+    source << "    print total\n    return 0\n}\n";
+    return source.str();
+}
+
+// `size` calls in all, made by recursive descents at most 5000 deep so
+// that no engine runs out of stack
+std::string generateRecursion(size_t size) {
+    size_t depth = std::min<size_t>(size, 5000);
+    size_t rounds = std::max<size_t>(size / std::max<size_t>(depth, 1), 1);
+    std::ostringstream source;
+    source << "func descend(n: int, acc: int) -> int {\n"
+           << "    if n == 0 {\n"
+           << "        return acc\n"
+           << "    }\n"
+           << "    return descend(n - 1, (acc * 31 + n) % 1000003)\n"
+           << "}\n\n"
+           << "func main() -> int {\n"
+           << "    let round: int = 0\n"
+           << "    let total: int = 0\n"
+           << "    while round < " << rounds << " {\n"
+           << "        total = (total + descend(" << depth << ", round)) % 1000003\n"
+           << "        round = round + 1\n"
+           << "    }\n"
+           << "    print total\n"
+           << "    return 0\n"
+           << "}\n";
+    return source.str();
+}
+
+// A sequence grown one element at a time
+std::string generateAppend(size_t size) {
+    std::ostringstream source;
+    source << "func main() -> int {\n"
+           << "    let values: sequence = []\n"
+           << "    let i: int = 0\n"
+           << "    while i < " << size << " {\n"
+           << "        values = values + [i * 7 % 1000]\n"
+           << "        i = i + 1\n"
+           << "    }\n"
+           << "    print length(values) sum(values)\n"
+           << "    return 0\n"
+           << "}\n";
+    return source.str();
+}
+
+// A lazy generate/map/filter pipeline reduced with sum
+std::string generatePipeline(size_t size) {
+    std::ostringstream source;
+    source << "func next(x: int) -> int {\n"
+           << "    return x + 1\n"
+           << "}\n\n"
+           << "func scale(x: int) -> int {\n"
+           << "    return x * 3 + 1\n"
+           << "}\n\n"
+           << "func keep(x: int) -> bool {\n"
+           << "    return x % 5 != 0\n"
+           << "}\n\n"
+           << "func main() -> int {\n"
+           << "    let naturals: sequence = generate(1, next, " << size << ")\n"
+           << "    let kept: sequence = filter(map(naturals, scale), keep)\n"
+           << "    print length(kept) sum(kept)\n"
+           << "    return 0\n"
+           << "}\n";
+    return source.str();
+}
+
+// A tight loop of integer arithmetic in main
+std::string generateArithmetic(size_t size) {
+    std::ostringstream source;
+    source << "func main() -> int {\n"
+           << "    let i: int = 0\n"
+           << "    let acc: int = 1\n"
+           << "    while i < " << size << " {\n"
+           << "        acc = (acc * 31 + i) % 1000003\n"
+           << "        if acc % 2 == 0 {\n"
+           << "            acc = acc + 3\n"
+           << "        }\n"
+           << "        i = i + 1\n"
+           << "    }\n"
+           << "    print acc\n"
+           << "    return 0\n"
+           << "}\n";
+    return source.str();
+}
+
+const std::vector<Workload> workloads = {
+    {"parse", "functions", 10000, generateParse},
+    {"recursion", "calls", 1000000, generateRecursion},
+    {"append", "appends", 200000, generateAppend},
+    {"pipeline", "elements", 1000000, generatePipeline},
+    {"arith", "iterations", 1000000, generateArithmetic},
+};
+
+const std::vector<std::string> allEngines = {"interp", "vm", "jit", "native"};
+
+std::vector<std::string> split(const std::string& text, char separator) {
+    std::vector<std::string> parts;
+    std::string part;
+    std::istringstream stream(text);
+    while (std::getline(stream, part, separator)) {
+        if (!part.empty()) parts.push_back(part);
+    }
+    return parts;
+}
+
+std::string quote(const std::string& text) {
+    return "'" + text + "'";
+}
+
+bool readFile(const std::string& filename, std::string& content) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) return false;
+    std::ostringstream buffer;
+    buffer << file.rdbuf();
+    content = buffer.str();
+    return true;
+}
+
+// The number after `"key": ` at or after `from`
+double jsonNumber(const std::string& json, const std::string& key, size_t from) {
+    size_t at = json.find("\"" + key + "\": ", from);
+    if (at == std::string::npos) return 0.0;
+    return std::strtod(json.c_str() + at + key.size() + 4, nullptr);
+}
+
+// The phases and total of a -time-phases=json report
+bool parsePhases(const std::string& json, Measurement& measurement) {
+    size_t at = 0;
+    while ((at = json.find("{\"name\": \"", at)) != std::string::npos) {
+        at += 10;
+        size_t end = json.find('"', at);
+        if (end == std::string::npos) return false;
+        Phase phase;
+        phase.name = json.substr(at, end - at);
+        phase.wallMs = jsonNumber(json, "wall_ms", end);
+        phase.cpuMs = jsonNumber(json, "cpu_ms", end);
+        measurement.phases.push_back(phase);
+        at = end;
+    }
+    size_t total = json.find("\"total\": ");
+    if (total == std::string::npos) return false;
+    measurement.total.wallMs = jsonNumber(json, "wall_ms", total);
+    measurement.total.cpuMs = jsonNumber(json, "cpu_ms", total);
+    return true;
+}
+
+double childCpuMs() {
+    rusage usage;
+    getrusage(RUSAGE_CHILDREN, &usage);
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000.0 +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000.0;
+}
+
+// Runs `command` through the shell; the wall and CPU time of the child,
+// shell included, go to `phase`
+bool runCommand(const std::string& command, Phase& phase) {
+    double cpuBefore = childCpuMs();
+    auto start = std::chrono::steady_clock::now();
+    int status = std::system(command.c_str());
+    auto stop = std::chrono::steady_clock::now();
+    phase.wallMs = std::chrono::duration<double, std::milli>(stop - start).count();
+    phase.cpuMs = childCpuMs() - cpuBefore;
+    return status == 0;
+}
+
+// The program's output with the compiler's note about the statistics file
+// removed
+std::string programOutput(const std::string& filename) {
+    std::string content;
+    readFile(filename, content);
+    std::string output;
+    std::istringstream lines(content);
+    std::string line;
+    while (std::getline(lines, line)) {
+        if (line.rfind("Statistics written to ", 0) == 0) continue;
+        output += line + "\n";
+    }
+    return output;
+}
+
+std::string firstLine(const std::string& filename) {
+    std::string content;
+    readFile(filename, content);
+    return content.substr(0, content.find('\n'));
+}
+
+Measurement measure(const std::string& compiler, const std::string& engine, const std::string& source,
+                    const std::string& base) {
+    Measurement measurement;
+    std::string statsFile = base + "." + engine + ".json";
+    std::string outputFile = base + "." + engine + ".out";
+    std::string errorFile = base + "." + engine + ".err";
+    std::string redirect = " >" + quote(outputFile) + " 2>" + quote(errorFile);
+    std::remove(statsFile.c_str());
+    Phase run;
+
+    if (engine == "native") {
+        std::string executable = base + ".exe";
+        std::string compile = quote(compiler) + " compile " + quote(source) + " -native=" + quote(executable) +
+                              " -time-phases=json -stats-file=" + quote(statsFile) + redirect;
+        if (!runCommand(compile, run)) {
+            measurement.error = "compile failed: " + firstLine(errorFile);
+            return measurement;
+        }
+        std::string stats;
+        if (!readFile(statsFile, stats) || !parsePhases(stats, measurement)) {
+            measurement.error = "no phase report";
+            return measurement;
+        }
+        Phase execute{"execute"};
+        if (!runCommand(quote(executable) + redirect, execute)) {
+            measurement.error = "run failed: " + firstLine(errorFile);
+            return measurement;
+        }
+        measurement.phases.push_back(execute);
+        measurement.total.wallMs += execute.wallMs;
+        measurement.total.cpuMs += execute.cpuMs;
+    } else {
+        std::string command = quote(compiler) + " run " + quote(source) + " -engine=" + engine +
+                              " -time-phases=json -stats-file=" + quote(statsFile) + redirect;
+        if (!runCommand(command, run)) {
+            measurement.error = "run failed: " + firstLine(errorFile);
+            return measurement;
+        }
+        std::string stats;
+        if (!readFile(statsFile, stats) || !parsePhases(stats, measurement)) {
+            measurement.error = "no phase report";
+            return measurement;
+        }
+    }
+    measurement.output = programOutput(outputFile);
+    measurement.success = true;
+    return measurement;
+}
+
+std::string key(const std::string& workload, size_t size, const std::string& engine) {
+    return workload + "," + std::to_string(size) + "," + engine;
+}
+
+// Total wall time of the latest earlier run of each workload, size and
+// engine in the history
+std::map<std::string, double> previousTotals(const std::string& filename) {
+    std::map<std::string, double> totals;
+    std::string content;
+    if (!readFile(filename, content)) return totals;
+    std::istringstream lines(content);
+    std::string line;
+    while (std::getline(lines, line)) {
+        // run,label,workload,size,engine,phase,wall_ms,cpu_ms
+        std::vector<std::string> fields;
+        std::istringstream stream(line);
+        std::string field;
+        while (std::getline(stream, field, ',')) fields.push_back(field);
+        if (fields.size() != 8 || fields[5] != "total") continue;
+        totals[fields[2] + "," + fields[3] + "," + fields[4]] = std::strtod(fields[6].c_str(), nullptr);
+    }
+    return totals;
+}
+
+std::string timestamp() {
+    std::time_t now = std::time(nullptr);
+    char text[32];
+    std::strftime(text, sizeof(text), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+    return text;
+}
+
+void usage(const char* program) {
+    std::cerr << "Usage: " << program << " [options]" << std::endl;
+    std::cerr << "Options:" << std::endl;
+    std::cerr << "  -compiler=<path>   mathseqc to measure (default: bin/mathseqc)" << std::endl;
+    std::cerr << "  -workloads=<list>  Comma-separated workloads (default: all)" << std::endl;
+    std::cerr << "  -engines=<list>    Comma-separated engines among interp, vm, jit, native (default: all)" << std::endl;
+    std::cerr << "  -scale=<factor>    Multiply every workload size (default: 1)" << std::endl;
+    std::cerr << "  -size=<name>=<n>   Set the size of one workload" << std::endl;
+    std::cerr << "  -runs=N            Runs of each measurement; the fastest is kept (default: 3)" << std::endl;
+    std::cerr << "  -workdir=<dir>     Where the generated programs go (default: build/bench)" << std::endl;
+    std::cerr << "  -results=<file>    CSV history the results are appended to (default: bench/results.csv)" << std::endl;
+    std::cerr << "  -label=<text>      Recorded with each result, e.g. a revision" << std::endl;
+    std::cerr << "  -list              List the workloads and exit" << std::endl;
+    std::cerr << "Workloads:" << std::endl;
+    for (const auto& workload : workloads) {
+        std::cerr << "  " << workload.name << " (" << workload.defaultSize << " " << workload.description << ")"
+                  << std::endl;
+    }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    std::string compiler = "bin/mathseqc";
+    std::string workdir = "build/bench";
+    std::string resultsFile = "bench/results.csv";
+    std::string label;
+    std::vector<std::string> selected;
+    std::vector<std::string> engines = allEngines;
+    std::map<std::string, size_t> sizes;
+    double scale = 1.0;
+    int runs = 3;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("-compiler=", 0) == 0) {
+            compiler = arg.substr(10);
+        } else if (arg.rfind("-workloads=", 0) == 0) {
+            selected = split(arg.substr(11), ',');
+        } else if (arg.rfind("-engines=", 0) == 0) {
+            engines = split(arg.substr(9), ',');
+        } else if (arg.rfind("-scale=", 0) == 0) {
+            scale = std::atof(arg.c_str() + 7);
+        } else if (arg.rfind("-size=", 0) == 0) {
+            std::string setting = arg.substr(6);
+            size_t equals = setting.find('=');
+            if (equals == std::string::npos) {
+                std::cerr << "Error: -size takes <name>=<n>" << std::endl;
+                return 1;
+            }
+            sizes[setting.substr(0, equals)] = std::strtoull(setting.c_str() + equals + 1, nullptr, 10);
+        } else if (arg.rfind("-runs=", 0) == 0) {
+            runs = std::atoi(arg.c_str() + 6);
+        } else if (arg.rfind("-workdir=", 0) == 0) {
+            workdir = arg.substr(9);
+        } else if (arg.rfind("-results=", 0) == 0) {
+            resultsFile = arg.substr(9);
+        } else if (arg.rfind("-label=", 0) == 0) {
+            label = arg.substr(7);
+        } else if (arg == "-list") {
+            for (const auto& workload : workloads) std::cout << workload.name << std::endl;
+            return 0;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (scale <= 0.0 || runs < 1) {
+        std::cerr << "Error: -scale and -runs must be positive" << std::endl;
+        return 1;
+    }
+    for (const auto& engine : engines) {
+        if (std::find(allEngines.begin(), allEngines.end(), engine) == allEngines.end()) {
+            std::cerr << "Error: Unknown engine '" << engine << "'" << std::endl;
+            return 1;
+        }
+    }
+    for (const auto& name : selected) {
+        bool known = std::any_of(workloads.begin(), workloads.end(),
+                                 [&](const Workload& workload) { return workload.name == name; });
+        if (!known) {
+            std::cerr << "Error: Unknown workload '" << name << "'" << std::endl;
+            return 1;
+        }
+    }
+    if (label.find(',') != std::string::npos) {
+        std::cerr << "Error: -label cannot contain a comma" << std::endl;
+        return 1;
+    }
+    mkdir(workdir.c_str(), 0755);
+
+    std::map<std::string, double> previous = previousTotals(resultsFile);
+    bool header = !std::ifstream(resultsFile).good();
+    std::ofstream results(resultsFile, std::ios::app);
+    if (!results.is_open()) {
+        std::cerr << "Error: Could not open '" << resultsFile << "'" << std::endl;
+        return 1;
+    }
+    if (header) results << "run,label,workload,size,engine,phase,wall_ms,cpu_ms\n";
+    std::string run = timestamp();
+
+    std::printf("%-10s %9s %-7s %11s %8s  %s\n", "workload", "size", "engine", "total ms", "vs last", "phases (wall ms)");
+    int failures = 0;
+    for (const auto& workload : workloads) {
+        if (!selected.empty() && std::find(selected.begin(), selected.end(), workload.name) == selected.end()) {
+            continue;
+        }
+        size_t size = sizes.count(workload.name) ? sizes[workload.name]
+                                                 : static_cast<size_t>(workload.defaultSize * scale);
+        size = std::max<size_t>(size, 1);
+        std::string base = workdir + "/" + workload.name + "_" + std::to_string(size);
+        std::string source = base + ".mathseq";
+        {
+            std::ofstream file(source);
+            file << workload.generate(size);
+            if (!file.good()) {
+                std::cerr << "Error: Could not create file '" << source << "'" << std::endl;
+                return 1;
+            }
+        }
+
+        std::string expected;
+        for (const auto& engine : engines) {
+            Measurement best;
+            for (int attempt = 0; attempt < runs; ++attempt) {
+                Measurement measurement = measure(compiler, engine, source, base);
+                if (!measurement.success) {
+                    best = measurement;
+                    break;
+                }
+                if (!best.success || measurement.total.wallMs < best.total.wallMs) best = measurement;
+            }
+            if (best.success && !expected.empty() && best.output != expected) {
+                best.success = false;
+                best.error = "output differs from " + engines.front();
+            }
+            if (!best.success) {
+                std::printf("%-10s %9zu %-7s %11s %8s  %s\n", workload.name.c_str(), size, engine.c_str(), "-", "-",
+                            best.error.c_str());
+                ++failures;
+                continue;
+            }
+            if (expected.empty()) expected = best.output;
+
+            std::string change = "-";
+            auto last = previous.find(key(workload.name, size, engine));
+            if (last != previous.end() && last->second > 0.0) {
+                char text[16];
+                std::snprintf(text, sizeof(text), "%+.1f%%", (best.total.wallMs / last->second - 1.0) * 100.0);
+                change = text;
+            }
+            std::string phases;
+            for (const auto& phase : best.phases) {
+                char text[64];
+                std::snprintf(text, sizeof(text), "%s%s %.2f", phases.empty() ? "" : ", ", phase.name.c_str(),
+                              phase.wallMs);
+                phases += text;
+            }
+            std::printf("%-10s %9zu %-7s %11.2f %8s  %s\n", workload.name.c_str(), size, engine.c_str(),
+                        best.total.wallMs, change.c_str(), phases.c_str());
+            std::fflush(stdout);
+
+            best.phases.push_back(best.total);
+            for (const auto& phase : best.phases) {
+                char times[64];
+                std::snprintf(times, sizeof(times), "%.3f,%.3f", phase.wallMs, phase.cpuMs);
+                results << run << "," << label << "," << workload.name << "," << size << "," << engine << ","
+                        << phase.name << "," << times << "\n";
+            }
+        }
+    }
+    results.flush();
+    std::cout << "Results appended to '" << resultsFile << "'" << std::endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -18,18 +18,39 @@ $TARGET = "$TARGETDIR\mathseqc.exe"
 # Source files
 $SOURCES = @(
     "$SRCDIR\main.cpp",
+    "$SRCDIR\ast.cpp",
+    "$SRCDIR\batch.cpp",
+    "$SRCDIR\bytecode_file.cpp",
     "$SRCDIR\lexer.cpp",
+    "$SRCDIR\mapped_file.cpp",
     "$SRCDIR\parser.cpp",
     "$SRCDIR\semantic.cpp",
+    "$SRCDIR\server.cpp",
+    "$SRCDIR\stats.cpp",
     "$SRCDIR\symbol_table.cpp",
+    "$SRCDIR\tac.cpp",
     "$SRCDIR\codegen.cpp",
+    "$SRCDIR\compile_cache.cpp",
+    "$SRCDIR\constant_folder.cpp",
+    "$SRCDIR\cfg.cpp",
+    "$SRCDIR\ssa.cpp",
+    "$SRCDIR\loop.cpp",
+    "$SRCDIR\inliner.cpp",
+    "$SRCDIR\jit.cpp",
     "$SRCDIR\optimizer.cpp",
-    "$SRCDIR\interpreter.cpp"
+    "$SRCDIR\interpreter.cpp",
+    "$SRCDIR\builtins.cpp",
+    "$SRCDIR\kernels.cpp",
+    "$SRCDIR\memo.cpp",
+    "$SRCDIR\native.cpp",
+    "$SRCDIR\thread_pool.cpp",
+    "$SRCDIR\value.cpp",
+    "$SRCDIR\vm.cpp"
 )
 
 # Try to find a C++ compiler
 $CXX = $null
-$CXXFLAGS = "-std=c++17 -Wall -Wextra -I$INCDIR"
+$CXXFLAGS = "-std=c++17 -Wall -Wextra -pthread -I$INCDIR"
 
 if ($Mode -eq "debug") {
     $CXXFLAGS += " -g -DDEBUG"
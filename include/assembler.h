@@ -0,0 +1,59 @@
+#ifndef ASSEMBLER_H
+#define ASSEMBLER_H
+
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Turns x86-64 assembly in the Intel syntax NativeCodeGenerator writes into
+// machine code, in process, so the JIT needs neither a toolchain nor files.
+// It knows the instructions and operand forms the generator's raw int and
+// bool code uses: moves, integer arithmetic and comparisons, set/jump on a
+// condition, calls, push/pop and lea, with register, [base+disp],
+// [rip+label] and fs:[symbol] operands. Jumps and calls are always rel32,
+// so one pass places everything and references are patched at the end;
+// the result refers to nothing outside itself and can be copied anywhere.
+// Data directives (.quad, .p2align) go straight after the code.
+class Assembler {
+public:
+    // A value for a symbol the source uses but does not define, such as an
+    // offset from the thread pointer
+    void define(const std::string& symbol, int64_t value) { symbols[symbol] = value; }
+
+    // Throws "Assembler error: ..." for anything outside the subset,
+    // naming the line
+    void assemble(std::string_view source);
+
+    const std::vector<uint8_t>& code() const { return bytes; }
+    // Offset of a label in code(), or -1
+    int64_t offsetOf(const std::string& label) const;
+
+private:
+    struct Operand;
+    struct Fixup {
+        size_t at;    // Where the rel32 goes
+        size_t end;   // The offset it is relative to: the instruction's end
+        std::string label;
+    };
+
+    std::vector<uint8_t> bytes;
+    std::unordered_map<std::string, size_t> labels;
+    std::unordered_map<std::string, int64_t> symbols;
+    std::vector<Fixup> fixups;
+    std::vector<size_t> pending;  // Fixups of the current instruction
+
+    void directive(std::string_view line);
+    void instruction(std::string_view mnemonic, const std::vector<Operand>& operands);
+    Operand parseOperand(std::string_view text) const;
+
+    void byte(uint8_t value) { bytes.push_back(value); }
+    void immediate(int64_t value, int size);
+    void rel32(const std::string& label);
+    // REX (when needed), the opcode bytes, ModRM and whatever follows it
+    void encode(int size, std::initializer_list<uint8_t> opcode, int reg, const Operand& rm);
+};
+
+#endif
@@ -1,9 +1,16 @@
 #ifndef AST_H
 #define AST_H
 
-#include <memory>
-#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <new>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 #include "token.h"
 
 enum class DataType {
@@ -22,112 +29,252 @@ inline std::string dataTypeToString(DataType type) {
     }
 }
 
+// Bump allocator for the nodes of one Program. Nodes are never destroyed
+// one by one: they hold only pointers into the same arena and interned
+// names, so dropping the arena's chunks frees the whole tree at once.
+class AstArena {
+public:
+    AstArena() = default;
+    ~AstArena();
+    AstArena(const AstArena&) = delete;
+    AstArena& operator=(const AstArena&) = delete;
+
+    void* allocate(size_t size, size_t alignment);
+
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        static_assert(std::is_trivially_destructible<T>::value, "arena nodes are never destroyed");
+        ++nodes;
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    // Copies `count` items into the arena
+    template <typename T>
+    T* copy(const T* items, size_t count) {
+        static_assert(std::is_trivially_destructible<T>::value, "arena nodes are never destroyed");
+        if (count == 0) return nullptr;
+        T* storage = static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+        for (size_t i = 0; i < count; ++i) new (&storage[i]) T(items[i]);
+        return storage;
+    }
+
+    size_t bytesUsed() const { return used; }
+    size_t nodeCount() const { return nodes; }
+
+private:
+    static constexpr size_t kChunkSize = 64 * 1024;
+
+    std::vector<char*> chunks;
+    char* cursor = nullptr;
+    char* limit = nullptr;
+    size_t used = 0;
+    size_t nodes = 0;
+};
+
+// A fixed run of arena-allocated items: children of a node, parameters
+template <typename T>
+class NodeList {
+public:
+    NodeList() = default;
+    NodeList(T* items, size_t count) : items(items), count(static_cast<uint32_t>(count)) {}
+
+    T* begin() const { return items; }
+    T* end() const { return items + count; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    T& operator[](size_t i) const { return items[i]; }
+
+private:
+    T* items = nullptr;
+    uint32_t count = 0;
+};
+
+// An identifier or literal spelling. Equal spellings are interned once per
+// Program, so nodes carry a pointer and comparing ids compares names.
+struct Name {
+    uint32_t id = 0;
+    const std::string* spelling = nullptr;
+
+    const std::string& text() const { return *spelling; }
+};
+
+class NameTable {
+public:
+    Name intern(std::string_view text);
+    size_t size() const { return spellings.size(); }
+
+private:
+    // A deque never moves what it holds, so the map's keys can view it
+    std::deque<std::string> spellings;
+    std::unordered_map<std::string_view, uint32_t> ids;
+};
+
+// Concrete node classes; SemanticAnalyzer, CodeGenerator, Interpreter and
+// ConstantFolder switch on this instead of probing with dynamic_cast
+enum class NodeKind : uint8_t {
+    BINARY, UNARY, LITERAL, VARIABLE, CALL, SEQUENCE,
+    BLOCK, DECLARATION, ASSIGNMENT, IF, WHILE, RETURN, EXPRESSION,
+    FUNCTION
+};
+
 class ASTNode {
 public:
+    NodeKind kind;
     int line = -1;
-    virtual ~ASTNode() = default;
-    virtual std::string toString() const = 0;
+
+    explicit ASTNode(NodeKind kind, int line = -1) : kind(kind), line(line) {}
+
+    std::string toString() const;  // Dispatches on kind
 };
 
 class Expr : public ASTNode {
 public:
     DataType type = DataType::UNKNOWN;
+
+    using ASTNode::ASTNode;
 };
 
 class Stmt : public ASTNode {
+public:
+    using ASTNode::ASTNode;
 };
 
+// The node as its concrete class, or nullptr when it is something else
+template <typename T, typename Node>
+T* nodeCast(Node* node) {
+    return node && node->kind == T::Kind ? static_cast<T*>(node) : nullptr;
+}
+
+template <typename T, typename Node>
+const T* nodeCast(const Node* node) {
+    return node && node->kind == T::Kind ? static_cast<const T*>(node) : nullptr;
+}
+
+// Source spelling of an operator token, for messages and dumps
+inline const char* operatorSpelling(TokenType op) {
+    switch (op) {
+        case TokenType::PLUS: return "+";
+        case TokenType::MINUS: return "-";
+        case TokenType::MULTIPLY: return "*";
+        case TokenType::DIVIDE: return "/";
+        case TokenType::MODULO: return "%";
+        case TokenType::EQUALS: return "==";
+        case TokenType::NOT_EQUALS: return "!=";
+        case TokenType::LESS: return "<";
+        case TokenType::GREATER: return ">";
+        case TokenType::LESS_EQUAL: return "<=";
+        case TokenType::GREATER_EQUAL: return ">=";
+        case TokenType::AND: return "and";
+        case TokenType::OR: return "or";
+        case TokenType::NOT: return "not";
+        default: return "?";
+    }
+}
+
 // Expressions
 class BinaryExpr : public Expr {
 public:
-    std::unique_ptr<Expr> left;
-    Token op;
-    std::unique_ptr<Expr> right;
-    
-    BinaryExpr(std::unique_ptr<Expr> left, Token op, std::unique_ptr<Expr> right)
-        : left(std::move(left)), op(op), right(std::move(right)) {
-        this->line = op.line;
-    }
-    
-    std::string toString() const override {
-        return "BinaryExpr(" + left->toString() + " " + op.lexeme + " " + right->toString() + ")";
+    static constexpr NodeKind Kind = NodeKind::BINARY;
+
+    Expr* left;
+    TokenType op;
+    Expr* right;
+
+    BinaryExpr(Expr* left, TokenType op, Expr* right, int line)
+        : Expr(Kind, line), left(left), op(op), right(right) {}
+
+    std::string toString() const {
+        return "BinaryExpr(" + left->toString() + " " + operatorSpelling(op) + " " + right->toString() + ")";
     }
 };
 
 class UnaryExpr : public Expr {
 public:
-    Token op;
-    std::unique_ptr<Expr> right;
-    
-    UnaryExpr(Token op, std::unique_ptr<Expr> right)
-        : op(op), right(std::move(right)) {
-        this->line = op.line;
-    }
-    
-    std::string toString() const override {
-        return "UnaryExpr(" + op.lexeme + " " + right->toString() + ")";
+    static constexpr NodeKind Kind = NodeKind::UNARY;
+
+    TokenType op;
+    Expr* right;
+
+    UnaryExpr(TokenType op, Expr* right, int line)
+        : Expr(Kind, line), op(op), right(right) {}
+
+    std::string toString() const {
+        return std::string("UnaryExpr(") + operatorSpelling(op) + " " + right->toString() + ")";
     }
 };
 
 class LiteralExpr : public Expr {
 public:
-    Token value;
-    
-    LiteralExpr(Token value) : value(value) {
-        this->line = value.line;
-    }
-    
-    std::string toString() const override {
-        return "LiteralExpr(" + value.lexeme + ")";
+    static constexpr NodeKind Kind = NodeKind::LITERAL;
+
+    TokenType literal;  // NUMBER, FLOAT, STRING, TRUE or FALSE
+    Name text;          // The spelling; a string's contents
+    // Decoded once by the parser for NUMBER and FLOAT tokens, so running
+    // the program never parses the text
+    long long intValue = 0;
+    double floatValue = 0.0;
+    // A NUMBER beyond 64 bits, whose value is only in `text`: a big integer
+    // at run time
+    bool exceedsInt64 = false;
+
+    LiteralExpr(TokenType literal, Name text, int line)
+        : Expr(Kind, line), literal(literal), text(text) {}
+
+    std::string toString() const {
+        return "LiteralExpr(" + text.text() + ")";
     }
 };
 
 class VariableExpr : public Expr {
 public:
-    Token name;
-    
-    VariableExpr(Token name) : name(name) {
-        this->line = name.line;
-    }
-    
-    std::string toString() const override {
-        return "VariableExpr(" + name.lexeme + ")";
+    static constexpr NodeKind Kind = NodeKind::VARIABLE;
+
+    Name name;
+    int depth = -1;  // Resolved by SemanticAnalyzer
+    int slot = -1;
+
+    VariableExpr(Name name, int line) : Expr(Kind, line), name(name) {}
+
+    std::string toString() const {
+        return "VariableExpr(" + name.text() + ")";
     }
 };
 
 class CallExpr : public Expr {
 public:
-    Token callee;
-    std::vector<std::unique_ptr<Expr>> arguments;
-    
-    CallExpr(Token callee, std::vector<std::unique_ptr<Expr>> arguments)
-        : callee(callee), arguments(std::move(arguments)) {
-        this->line = callee.line;
-    }
-    
-    std::string toString() const override {
+    static constexpr NodeKind Kind = NodeKind::CALL;
+
+    Name callee;
+    NodeList<Expr*> arguments;
+
+    CallExpr(Name callee, NodeList<Expr*> arguments, int line)
+        : Expr(Kind, line), callee(callee), arguments(arguments) {}
+
+    std::string toString() const {
         std::string argsStr = "(";
         for (size_t i = 0; i < arguments.size(); ++i) {
             if (i > 0) argsStr += ", ";
             argsStr += arguments[i]->toString();
         }
         argsStr += ")";
-        return "CallExpr(" + callee.lexeme + argsStr + ")";
+        return "CallExpr(" + callee.text() + argsStr + ")";
     }
 };
 
 class SequenceExpr : public Expr {
 public:
-    std::vector<std::unique_ptr<Expr>> elements;
-    
-    SequenceExpr(std::vector<std::unique_ptr<Expr>> elements)
-        : elements(std::move(elements)) {
+    static constexpr NodeKind Kind = NodeKind::SEQUENCE;
+
+    NodeList<Expr*> elements;
+
+    SequenceExpr(NodeList<Expr*> elements)
+        : Expr(Kind), elements(elements) {
         if (!elements.empty()) {
             this->line = elements[0]->line;
         }
     }
-    
-    std::string toString() const override {
+
+    std::string toString() const {
         std::string elementsStr = "[";
         for (size_t i = 0; i < elements.size(); ++i) {
             if (i > 0) elementsStr += ", ";
@@ -138,196 +285,192 @@ public:
     }
 };
 
+inline std::string statementsToString(const NodeList<Stmt*>& statements) {
+    std::string result = "{";
+    for (const Stmt* stmt : statements) {
+        result += stmt->toString() + "; ";
+    }
+    return result + "}";
+}
+
 // Statements
-class BlockStmt : public Stmt {  // ADDED THIS CLASS
+class BlockStmt : public Stmt {
 public:
-    std::vector<std::unique_ptr<Stmt>> statements;
-    
-    BlockStmt(std::vector<std::unique_ptr<Stmt>> statements)
-        : statements(std::move(statements)) {
+    static constexpr NodeKind Kind = NodeKind::BLOCK;
+
+    NodeList<Stmt*> statements;
+
+    BlockStmt(NodeList<Stmt*> statements)
+        : Stmt(Kind), statements(statements) {
         if (!statements.empty()) {
             this->line = statements[0]->line;
         }
     }
-    
-    std::string toString() const override {
-        std::string stmtsStr = "{";
-        for (const auto& stmt : statements) {
-            stmtsStr += stmt->toString() + "; ";
-        }
-        stmtsStr += "}";
-        return "BlockStmt" + stmtsStr;
+
+    std::string toString() const {
+        return "BlockStmt" + statementsToString(statements);
     }
 };
 
 class DeclarationStmt : public Stmt {
 public:
-    Token name;
+    static constexpr NodeKind Kind = NodeKind::DECLARATION;
+
+    Name name;
     DataType dataType;
-    std::unique_ptr<Expr> initializer;
-    
-    DeclarationStmt(Token name, DataType dataType, std::unique_ptr<Expr> initializer)
-        : name(name), dataType(dataType), initializer(std::move(initializer)) {
-        this->line = name.line;
-    }
-    
-    std::string toString() const override {
-        return "DeclarationStmt(" + name.lexeme + ":" + dataTypeToString(dataType) + 
+    Expr* initializer;
+    int depth = -1;
+    int slot = -1;
+
+    DeclarationStmt(Name name, DataType dataType, Expr* initializer, int line)
+        : Stmt(Kind, line), name(name), dataType(dataType), initializer(initializer) {}
+
+    std::string toString() const {
+        return "DeclarationStmt(" + name.text() + ":" + dataTypeToString(dataType) +
                " = " + (initializer ? initializer->toString() : "null") + ")";
     }
 };
 
 class AssignmentStmt : public Stmt {
 public:
-    Token name;
-    std::unique_ptr<Expr> value;
-    
-    AssignmentStmt(Token name, std::unique_ptr<Expr> value)
-        : name(name), value(std::move(value)) {
-        this->line = name.line;
-    }
-    
-    std::string toString() const override {
-        return "AssignmentStmt(" + name.lexeme + " = " + value->toString() + ")";
+    static constexpr NodeKind Kind = NodeKind::ASSIGNMENT;
+
+    Name name;
+    Expr* value;
+    int depth = -1;
+    int slot = -1;
+    bool appendsToSelf = false;  // `name = name + seq`, set by SemanticAnalyzer
+
+    AssignmentStmt(Name name, Expr* value, int line)
+        : Stmt(Kind, line), name(name), value(value) {}
+
+    std::string toString() const {
+        return "AssignmentStmt(" + name.text() + " = " + value->toString() + ")";
     }
 };
 
 class IfStmt : public Stmt {
 public:
-    std::unique_ptr<Expr> condition;
-    std::vector<std::unique_ptr<Stmt>> thenBranch;
-    std::vector<std::unique_ptr<Stmt>> elseBranch;
-    
-    IfStmt(std::unique_ptr<Expr> condition, 
-           std::vector<std::unique_ptr<Stmt>> thenBranch,
-           std::vector<std::unique_ptr<Stmt>> elseBranch)
-        : condition(std::move(condition)), 
-          thenBranch(std::move(thenBranch)), 
-          elseBranch(std::move(elseBranch)) {
-        if (this->condition) {
-            this->line = this->condition->line;
-        } else if (!thenBranch.empty() && thenBranch[0]) {
-            this->line = thenBranch[0]->line;
-        } else {
-            this->line = -1;
-        }
-    }
-    
-    std::string toString() const override {
-        std::string thenStr = "{";
-        for (const auto& stmt : thenBranch) {
-            thenStr += stmt->toString() + "; ";
-        }
-        thenStr += "}";
-        
-        std::string elseStr = "{";
-        for (const auto& stmt : elseBranch) {
-            elseStr += stmt->toString() + "; ";
-        }
-        elseStr += "}";
-        
-        return "IfStmt(" + condition->toString() + " then " + thenStr + " else " + elseStr + ")";
+    static constexpr NodeKind Kind = NodeKind::IF;
+
+    Expr* condition;
+    NodeList<Stmt*> thenBranch;
+    NodeList<Stmt*> elseBranch;
+
+    IfStmt(Expr* condition, NodeList<Stmt*> thenBranch, NodeList<Stmt*> elseBranch)
+        : Stmt(Kind, condition->line), condition(condition),
+          thenBranch(thenBranch), elseBranch(elseBranch) {}
+
+    std::string toString() const {
+        return "IfStmt(" + condition->toString() + " then " + statementsToString(thenBranch) +
+               " else " + statementsToString(elseBranch) + ")";
     }
 };
 
 class WhileStmt : public Stmt {
 public:
-    std::unique_ptr<Expr> condition;
-    std::vector<std::unique_ptr<Stmt>> body;
-    
-    WhileStmt(std::unique_ptr<Expr> condition, std::vector<std::unique_ptr<Stmt>> body)
-        : condition(std::move(condition)), body(std::move(body)) {
-        if (this->condition) {
-            this->line = this->condition->line;
-        } else if (!body.empty() && body[0]) {
-            this->line = body[0]->line;
-        } else {
-            this->line = -1;
-        }
-    }
-    
-    std::string toString() const override {
-        std::string bodyStr = "{";
-        for (const auto& stmt : body) {
-            bodyStr += stmt->toString() + "; ";
-        }
-        bodyStr += "}";
-        return "WhileStmt(" + condition->toString() + " " + bodyStr + ")";
+    static constexpr NodeKind Kind = NodeKind::WHILE;
+
+    Expr* condition;
+    NodeList<Stmt*> body;
+
+    WhileStmt(Expr* condition, NodeList<Stmt*> body)
+        : Stmt(Kind, condition->line), condition(condition), body(body) {}
+
+    std::string toString() const {
+        return "WhileStmt(" + condition->toString() + " " + statementsToString(body) + ")";
     }
 };
 
 class ReturnStmt : public Stmt {
 public:
-    std::unique_ptr<Expr> value;
-    
-    ReturnStmt(std::unique_ptr<Expr> value) : value(std::move(value)) {
-        if (value) {
-            this->line = value->line;
-        }
-    }
-    
-    std::string toString() const override {
+    static constexpr NodeKind Kind = NodeKind::RETURN;
+
+    Expr* value;
+
+    ReturnStmt(Expr* value) : Stmt(Kind, value ? value->line : -1), value(value) {}
+
+    std::string toString() const {
         return "ReturnStmt(" + (value ? value->toString() : "void") + ")";
     }
 };
 
 class ExpressionStmt : public Stmt {
 public:
-    std::unique_ptr<Expr> expression;
-    
-    ExpressionStmt(std::unique_ptr<Expr> expression) : expression(std::move(expression)) {
-        if (expression) {
-            this->line = expression->line;
-        }
-    }
-    
-    std::string toString() const override {
+    static constexpr NodeKind Kind = NodeKind::EXPRESSION;
+
+    Expr* expression;
+
+    ExpressionStmt(Expr* expression) : Stmt(Kind, expression->line), expression(expression) {}
+
+    std::string toString() const {
         return "ExpressionStmt(" + expression->toString() + ")";
     }
 };
 
 // Function Declaration
+struct Parameter {
+    Name name;
+    DataType type;
+    int line;
+};
+
 class FunctionDecl : public ASTNode {
 public:
-    Token name;
-    std::vector<std::pair<Token, DataType>> parameters;
+    static constexpr NodeKind Kind = NodeKind::FUNCTION;
+
+    Name name;
+    NodeList<Parameter> parameters;
     DataType returnType;
-    std::vector<std::unique_ptr<Stmt>> body;
-    
-    FunctionDecl(Token name, std::vector<std::pair<Token, DataType>> parameters,
-                 DataType returnType, std::vector<std::unique_ptr<Stmt>> body)
-        : name(name), parameters(std::move(parameters)), 
-          returnType(returnType), body(std::move(body)) {
-        this->line = name.line;
-    }
-    
-    std::string toString() const override {
+    NodeList<Stmt*> body;
+    int frameSize = 0;  // Number of local slots, parameters first
+    bool isPure = false;  // No print/input, directly or through any callee
+
+    FunctionDecl(Name name, NodeList<Parameter> parameters, DataType returnType,
+                 NodeList<Stmt*> body, int line)
+        : ASTNode(Kind, line), name(name), parameters(parameters),
+          returnType(returnType), body(body) {}
+
+    std::string toString() const {
         std::string paramsStr = "(";
         for (size_t i = 0; i < parameters.size(); ++i) {
             if (i > 0) paramsStr += ", ";
-            paramsStr += parameters[i].first.lexeme + ":" + dataTypeToString(parameters[i].second);
+            paramsStr += parameters[i].name.text() + ":" + dataTypeToString(parameters[i].type);
         }
         paramsStr += ")";
-        
-        std::string bodyStr = "{";
-        for (const auto& stmt : body) {
-            bodyStr += stmt->toString() + "; ";
-        }
-        bodyStr += "}";
-        
-        return "FunctionDecl(" + name.lexeme + paramsStr + " -> " + 
-               dataTypeToString(returnType) + " " + bodyStr + ")";
+
+        return "FunctionDecl(" + name.text() + paramsStr + " -> " +
+               dataTypeToString(returnType) + " " + statementsToString(body) + ")";
     }
 };
 
-// Program
-class Program : public ASTNode {
+// Program: owns the arena every node of the tree lives in and the names
+// they refer to
+class Program {
 public:
-    std::vector<std::unique_ptr<FunctionDecl>> functions;
-    
-    std::string toString() const override {
+    AstArena arena;
+    NameTable names;
+    std::vector<FunctionDecl*> functions;
+
+    // A node in this program's arena
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        return arena.make<T>(std::forward<Args>(args)...);
+    }
+
+    template <typename T>
+    NodeList<T> list(const T* items, size_t count) {
+        return NodeList<T>(arena.copy(items, count), count);
+    }
+
+    template <typename T>
+    NodeList<T> list(const std::vector<T>& items) {
+        return list(items.data(), items.size());
+    }
+
+    std::string toString() const {
         std::string result = "Program[\n";
-        for (const auto& func : functions) {
+        for (const FunctionDecl* func : functions) {
             result += "  " + func->toString() + "\n";
         }
         result += "]";
@@ -335,4 +478,4 @@ public:
     }
 };
 
-#endif
\ No newline at end of file
+#endif
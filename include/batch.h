@@ -0,0 +1,55 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "optimizer.h"
+#include "tac.h"
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Compiles or checks many sources at once, one job per file, on a pool of
+// worker threads. Each job runs its own Lexer, Parser, SemanticAnalyzer,
+// CodeGenerator and Optimizer; nothing in that pipeline is shared between
+// threads. What a job reports is kept with the job and written out in
+// input order once every job has finished, so the output does not depend
+// on scheduling.
+class BatchCompiler {
+public:
+    struct Options {
+        bool checkOnly = false;
+        int optimizationLevel = Optimizer::kDefaultLevel;
+        std::vector<std::pair<Optimizer::Pass, bool>> passOverrides;
+        std::string outputDirectory;  // Empty: next to each source
+        std::string cacheDirectory;   // Empty: no CompileCache
+        size_t jobs = 1;
+    };
+
+    explicit BatchCompiler(Options options);
+
+    // Number of inputs that failed; diagnostics go to `diagnostics`. A
+    // compiled input's listing goes to <stem>.asm, in the output directory
+    // if one is set, which is created when missing.
+    size_t run(const std::vector<std::string>& inputs, std::ostream& diagnostics);
+
+    // The inputs listed in `manifest`, one path per line; blank lines and
+    // lines starting with '#' are skipped. False if it cannot be read.
+    static bool readManifest(const std::string& manifest, std::vector<std::string>& inputs);
+
+    // The listing `compile` writes: a header naming the source, then one
+    // TAC instruction per line
+    static void writeListing(std::ostream& out, const std::string& inputFile, const TacModule& code);
+
+private:
+    struct Result {
+        bool success = false;
+        std::string diagnostics;
+    };
+
+    Options options;
+
+    Result compile(const std::string& inputFile) const;
+    std::string listingPath(const std::string& inputFile) const;
+};
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef BIGINT_H
+#define BIGINT_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// An arbitrary-precision integer, the value of an int that no longer fits
+// in 64 bits. Stored as a sign and a magnitude in base 2^32, least
+// significant limb first, with no high zero limbs (zero has none).
+// Division truncates toward zero and the remainder takes the sign of the
+// dividend, as for C++ integers.
+class BigInt {
+public:
+    BigInt() = default;
+    explicit BigInt(int64_t value);
+    // Decimal digits with an optional leading '-'; requires at least one
+    // digit and nothing else
+    static BigInt fromString(std::string_view digits);
+
+    bool isZero() const { return limbs.empty(); }
+    bool isNegative() const { return negative; }
+    bool fitsInt64() const;
+    int64_t toInt64() const;  // Requires fitsInt64()
+    double toDouble() const;
+
+    BigInt negated() const;
+    static BigInt add(const BigInt& left, const BigInt& right);
+    static BigInt subtract(const BigInt& left, const BigInt& right);
+    static BigInt multiply(const BigInt& left, const BigInt& right);
+    // Requires a nonzero divisor
+    static void divide(const BigInt& left, const BigInt& right, BigInt& quotient, BigInt& remainder);
+
+    // Negative, zero or positive as left is less than, equal to or greater
+    // than right
+    static int compare(const BigInt& left, const BigInt& right);
+
+    std::string toString() const;
+    void appendTo(std::string& out) const;
+
+private:
+    bool negative = false;
+    std::vector<uint32_t> limbs;
+
+    void trim();
+    static int compareMagnitude(const std::vector<uint32_t>& left, const std::vector<uint32_t>& right);
+    static std::vector<uint32_t> addMagnitude(const std::vector<uint32_t>& left, const std::vector<uint32_t>& right);
+    // Requires left >= right
+    static std::vector<uint32_t> subtractMagnitude(const std::vector<uint32_t>& left, const std::vector<uint32_t>& right);
+};
+
+#endif
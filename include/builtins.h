@@ -0,0 +1,164 @@
+#ifndef BUILTINS_H
+#define BUILTINS_H
+
+#include "thread_pool.h"
+#include "value.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A callback body that Builtins can run itself: straight-line scalar code
+// over numbered registers, the argument arriving in register 0. Operands
+// with kConstantBit set index `constants`, which hold only INT, FLOAT and
+// BOOL values. Each operator means exactly what the VM's does.
+struct InlineCallback {
+    enum class Op : uint8_t { MOVE, ADD, SUB, MUL, DIV, MOD, EQ, NE, LT, LE, GT, GE, AND, OR, NEG, NOT };
+
+    struct Step {
+        Op op;
+        uint32_t result;
+        uint32_t left;
+        uint32_t right;  // Unused by MOVE, NEG and NOT
+    };
+
+    static constexpr uint32_t kConstantBit = 0x80000000u;
+
+    uint32_t registers = 1;
+    std::vector<Step> steps;
+    std::vector<RuntimeValue> constants;
+    uint32_t result = 0;  // The returned operand
+};
+
+// Calls a user function by its index in Program::functions. Implemented by
+// each execution engine so that lazy sequences can run their callbacks.
+class FunctionInvoker {
+public:
+    virtual ~FunctionInvoker() = default;
+    virtual RuntimeValue invoke(uint32_t function, const RuntimeValue& argument) = 0;
+
+    // Whether `function` may run on a pool thread through a fork()ed
+    // invoker: it must be pure and must not touch values another thread
+    // can reach, since reference counts are not atomic
+    virtual bool isParallelSafe(uint32_t function) const { (void)function; return false; }
+
+    // Whether `function` is pure: no print or input, directly or through a
+    // callee. Only pure callbacks are deferred
+    virtual bool isPure(uint32_t function) const { (void)function; return false; }
+
+    // A new invoker with its own frames, used by one pool worker
+    virtual std::unique_ptr<FunctionInvoker> fork() { return nullptr; }
+
+    // The body of `function` when it can run without a call, or nullptr
+    virtual const InlineCallback* inlineCallback(uint32_t function) const { (void)function; return nullptr; }
+};
+
+// The builtin functions, which shadow user functions of the same name
+enum class Builtin : uint32_t {
+    PRINT, LENGTH, GET, MAP, FILTER, GENERATE, INPUT, SUM, MIN, MAX, LOAD, READ_SEQUENCE
+};
+
+// Sequence builtins shared by the interpreter and the VM.
+//
+// generate, map and filter with a pure callback do not run it: they return
+// a LAZY value describing the pipeline, and chained stages are fused so that
+// no intermediate sequence is ever built. Elements are produced when the
+// value is consumed: print, get, length (when there is a filter) and
+// strict() materialize the result once and cache it on the pipeline, so
+// each element is computed at most once. A callback with side effects runs
+// right away instead, over the whole sequence, so that its prints and
+// errors happen where the call is.
+//
+// With a thread pool, materializing a pipeline whose stages are all
+// parallel-safe and whose source holds at least kParallelThreshold scalars
+// splits the elements into chunks that run on the pool. Results are
+// concatenated in chunk order, so the output is the same as a serial run.
+//
+// A pipeline over an unboxed sequence whose callbacks all have an
+// InlineCallback skips the calls: each stage runs the callback's steps
+// over blocks of kInlineBlock elements at once, straight on the int64 or
+// double buffers, and the result comes out unboxed. A callback whose
+// operand types would need anything besides plain arithmetic, comparison
+// or logic (or raise an error other than division by zero) makes the
+// whole pipeline take the ordinary path, and so does an int result that
+// leaves 64 bits, since only the ordinary path promotes it to a BigInt.
+class Builtins {
+public:
+    static constexpr size_t kParallelThreshold = 4096;
+    static constexpr size_t kInlineBlock = 1024;
+
+    explicit Builtins(FunctionInvoker& invoker) : invoker(invoker) {}
+
+    void setThreadPool(ThreadPool* threadPool) { pool = threadPool; }
+
+    RuntimeValue length(const RuntimeValue& sequence);
+    RuntimeValue get(const RuntimeValue& sequence, const RuntimeValue& index);
+    RuntimeValue map(const RuntimeValue& sequence, uint32_t function);
+    RuntimeValue filter(const RuntimeValue& sequence, uint32_t function);
+    RuntimeValue generate(const RuntimeValue& seed, uint32_t step, const RuntimeValue& count);
+    RuntimeValue sum(const RuntimeValue& sequence);
+    RuntimeValue min(const RuntimeValue& sequence);
+    RuntimeValue max(const RuntimeValue& sequence);
+
+    // Operators on strict values, using Kernels for unboxed sequences.
+    // `+` concatenates; `-`, `*` and `/` apply elementwise to two sequences
+    // of the same length.
+    static RuntimeValue concat(const RuntimeValue& left, const RuntimeValue& right);
+    static RuntimeValue elementwise(char op, const RuntimeValue& left, const RuntimeValue& right);
+    static bool equal(const RuntimeValue& left, const RuntimeValue& right);
+
+    // The builtin called `name`, if there is one
+    static bool find(const std::string& name, Builtin& builtin);
+    // Reads one number from stdin the way the input() builtin does
+    static RuntimeValue readInput(const std::string& promptText);
+    // Where readInput reads from and prompts to (nullptr: no prompt); by
+    // default std::cin and std::cout
+    static void redirectInput(std::istream& in, std::ostream* prompts);
+
+    // Bulk ingestion into unboxed sequences. load maps the file at `path`
+    // and reads it as `format`: "text", numbers separated by whitespace or
+    // commas with `#` starting a comment, or "i64" / "f64", raw 8-byte
+    // values in native byte order. readSequence reads every number left
+    // on the input stream, in the text format and without a prompt.
+    static RuntimeValue load(const std::string& path, const std::string& format);
+    static RuntimeValue readSequence();
+    // The text format, without locale lookups; `source` names the text in
+    // errors. A sequence of ints, or of floats if any number is one.
+    static RuntimeValue parseNumbers(std::string_view text, const std::string& source);
+
+    // print formatting; lazy sequences are materialized first.
+    // formatTo appends to `out`, such as an OutputSink's line.
+    std::string format(const RuntimeValue& value);
+    void formatTo(const RuntimeValue& value, std::string& out);
+
+    // The value itself, or the materialized elements of a lazy sequence.
+    // The reference stays valid for as long as `value` is alive.
+    const RuntimeValue& strict(const RuntimeValue& value) {
+        return value.kind() == RuntimeValue::Kind::LAZY ? materialize(value.lazyValue()) : value;
+    }
+
+private:
+    FunctionInvoker& invoker;
+    ThreadPool* pool = nullptr;
+    bool inParallelRun = false;  // Nested pipelines in a callback run serially
+    std::vector<std::unique_ptr<FunctionInvoker>> workers;  // Index 0 is unused
+
+    const RuntimeValue& materialize(const LazySequence& lazy);
+    bool materializeInParallel(const LazySequence& lazy, std::vector<RuntimeValue>& elements);
+    // The stages' inline callbacks, when the whole pipeline can run inline
+    bool inlineStages(const LazySequence& lazy, std::vector<const InlineCallback*>& callbacks) const;
+    bool materializeInline(const LazySequence& lazy);
+    void applyStages(const LazySequence& lazy, FunctionInvoker& target, const RuntimeValue& source,
+                     size_t begin, size_t end, std::vector<RuntimeValue>& out);
+    RuntimeValue extreme(const RuntimeValue& sequence, bool isMax);
+    RuntimeValue addStage(const RuntimeValue& sequence, LazySequence::StageKind kind, uint32_t function);
+    // `lazy` itself, or its elements when `function` is impure
+    RuntimeValue deferIfPure(const RuntimeValue& lazy, uint32_t function);
+
+    // Feeds each element of the pipeline to sink until it returns false
+    template <typename Sink>
+    void stream(const LazySequence& lazy, Sink&& sink);
+};
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef BYTECODE_FILE_H
+#define BYTECODE_FILE_H
+
+#include "vm.h"
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+
+// Compiled programs saved for later runs: `compile -emit-bytecode=<file>`
+// writes one and `run <file>` maps it and starts the VM, without lexing,
+// parsing or generating any code.
+//
+// A file is a fixed header and four sections, each 8-byte aligned: the
+// function table, every function's instructions in the VM's own in-memory
+// layout, the constant pool, and the string table that function names and
+// string constants point into. Loading is a bulk copy per function and a
+// range check per instruction rather than a parse. Numbers are stored in
+// the byte order of the machine that wrote the file; a file from another
+// byte order or format version, or one that is cut short, is rejected.
+// Register names, which only the compiler uses, are not stored.
+class BytecodeFile {
+public:
+    static constexpr uint32_t kFormatVersion = 1;
+
+    // Whether `data` starts like a bytecode file
+    static bool recognize(std::string_view data);
+
+    // Throws std::runtime_error ("Bytecode error: ...") for a constant that
+    // cannot be stored
+    static void write(const BytecodeModule& module, std::ostream& out);
+
+    // Throws std::runtime_error ("Bytecode error: ...") when `data` is not
+    // a well-formed file of this version
+    static BytecodeModule read(std::string_view data);
+};
+
+#endif
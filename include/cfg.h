@@ -0,0 +1,45 @@
+#ifndef CFG_H
+#define CFG_H
+
+#include "tac.h"
+#include <cstdint>
+#include <vector>
+
+struct BasicBlock {
+    Operand label;                       // LABEL opening the block, if any
+    int labelLine = -1;
+    std::vector<ThreeAddressCode> code;  // The block's instructions, label excluded
+
+    int32_t fallthrough = -1;            // Next block in layout, when reachable that way
+    int32_t target = -1;                 // Block named by a trailing goto/if/ifFalse
+    std::vector<uint32_t> successors;
+    std::vector<uint32_t> predecessors;
+};
+
+// Basic blocks of one function, in layout order. Block 0 is an empty entry
+// block with no predecessors, so the function's first label can still be a
+// loop head.
+class ControlFlowGraph {
+public:
+    std::vector<BasicBlock> blocks;
+
+    // `body` is a function's instructions, after its entry label
+    static ControlFlowGraph build(const ThreeAddressCode* begin, const ThreeAddressCode* end);
+    void linearize(std::vector<ThreeAddressCode>& out) const;
+
+    // Recomputes the edges from the blocks' last instructions
+    void computeEdges();
+    // Drops blocks the entry cannot reach; returns the instructions removed
+    size_t removeUnreachable();
+    // Drops gotos to the block that follows anyway; returns how many
+    size_t removeJumpsToNext();
+    size_t instructionCount() const;
+
+    std::vector<uint32_t> reversePostorder() const;
+    // Cooper-Harvey-Kennedy; the entry's immediate dominator is itself
+    std::vector<uint32_t> immediateDominators(const std::vector<uint32_t>& order) const;
+    std::vector<std::vector<uint32_t>> dominanceFrontiers(const std::vector<uint32_t>& idom) const;
+    static bool isTerminator(TacOp op);
+};
+
+#endif
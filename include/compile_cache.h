@@ -0,0 +1,72 @@
+#ifndef COMPILE_CACHE_H
+#define COMPILE_CACHE_H
+
+#include "ast.h"
+#include "optimizer.h"
+#include "tac.h"
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// On-disk cache of optimized TAC, one entry per function, for -cache-dir.
+//
+// An entry is keyed by a hash of the compiler executable, the optimization
+// level and passes, the function's normalized AST (its tree without line
+// numbers) and the signature of every function it refers to: parameter and
+// return types and purity. So an edited function misses, and so does every
+// caller of a function whose signature changed. With inlining on, a
+// function's code also depends on the bodies of whatever it can reach in
+// the call graph, so those are part of its key too.
+//
+// Misses are lowered and optimized together, with the functions they reach
+// when inlining, and written back; hits are copied into the module as they
+// are. Entries hold temporaries and labels numbered from 0 and lines
+// relative to the function's own, and are relocated when loaded, so moving
+// a function does not invalidate it. Lines of code inlined from elsewhere
+// are then only approximate; nothing downstream reports TAC lines.
+//
+// Entries are written to a temporary file and renamed into place, so
+// several processes or BatchCompiler jobs can share a directory. A missing,
+// stale or unreadable entry is a miss.
+class CompileCache {
+public:
+    struct Stats {
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t lowered = 0;  // Functions generated and optimized, reached callees included
+    };
+
+    explicit CompileCache(std::string directory);
+
+    // The program's final TAC, as Optimizer(level, overrides) would leave
+    // it; `program` must have been analyzed (and folded, if level > 0)
+    TacModule compile(Program* program, int level,
+                      const std::vector<std::pair<Optimizer::Pass, bool>>& overrides);
+
+    const Stats& statistics() const { return stats; }
+
+private:
+    // One function's code with its own name and constant tables
+    struct Entry {
+        std::vector<std::string> names;
+        std::vector<TacConstant> constants;
+        std::vector<ThreeAddressCode> code;
+        uint32_t temps = 0;
+        uint32_t labels = 0;
+    };
+
+    std::string directory;
+    Stats stats;
+
+    std::string entryPath(uint64_t key) const;
+    bool load(uint64_t key, Entry& entry) const;
+    void store(uint64_t key, const Entry& entry) const;
+
+    // Cuts code[begin, end) out of `module` into a self-contained entry
+    static Entry extract(const TacModule& module, size_t begin, size_t end, int line);
+    // Appends `entry` to `module`, renumbering everything it refers to
+    static void append(const Entry& entry, int line, TacModule& module);
+};
+
+#endif
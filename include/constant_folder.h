@@ -0,0 +1,38 @@
+#ifndef CONSTANT_FOLDER_H
+#define CONSTANT_FOLDER_H
+
+#include "ast.h"
+#include <string>
+#include <vector>
+
+// Replaces unary and binary operators whose operands are all literals by
+// the literal they evaluate to. Runs after semantic analysis, so both the
+// interpreter and the generated code see the folded tree.
+//
+// Integer operators fold with Operators::checkedInteger, exactly as they
+// run: a result beyond 64 bits (a BigInt at run time) is left unfolded,
+// float results must be finite, and integer division or modulo by zero is
+// left to fail at run time.
+class ConstantFolder {
+public:
+    // Returns the number of operators folded
+    size_t fold(Program* program);
+
+private:
+    size_t folded = 0;
+    Program* program = nullptr;  // Folded literals go in its arena
+
+    void foldStatements(const NodeList<Stmt*>& statements);
+    void foldStatement(Stmt* stmt);
+    void foldExpression(Expr*& expr);
+
+    // The folded literal, or nullptr when the operator has to run
+    LiteralExpr* evaluateBinary(BinaryExpr* expr);
+    LiteralExpr* evaluateUnary(UnaryExpr* expr);
+
+    LiteralExpr* makeInt(long long value, int line);
+    LiteralExpr* makeFloat(double value, int line);
+    LiteralExpr* makeBool(bool value, int line);
+};
+
+#endif
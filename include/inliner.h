@@ -0,0 +1,68 @@
+#ifndef INLINER_H
+#define INLINER_H
+
+#include "tac.h"
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Replaces calls to small user functions with a copy of the callee's TAC.
+//
+// Cost model: a callee is inlined when its body, entry label and parameter
+// copies excluded, has at most maxCalleeSize instructions (kMaxCalleeSize
+// by default), for as long as the caller stays within kMaxCallerSize. Functions on a call-graph cycle,
+// passing through map/filter/generate callbacks too, are never inlined, so
+// recursion and its depth limit behave exactly as before. Callees run
+// bottom-up, so a small function's own small calls are already flattened
+// when it is copied into its callers.
+//
+// The copy gets fresh temporaries and labels, and its variables are renamed
+// to name.N, which no source identifier can clash with. Arguments become
+// assignments to the renamed param_ names where their PARAMs were, and each
+// return assigns the call's result and jumps past the copy.
+class Inliner {
+public:
+    static constexpr size_t kMaxCalleeSize = 24;
+    static constexpr size_t kMaxCallerSize = 4096;
+
+    struct Stats {
+        size_t callsInlined = 0;
+    };
+
+    explicit Inliner(TacModule& module, size_t maxCalleeSize = kMaxCalleeSize, size_t maxCallerSize = kMaxCallerSize)
+        : module(module), maxCalleeSize(maxCalleeSize), maxCallerSize(maxCallerSize) {}
+
+    Stats run();
+
+private:
+    struct Function {
+        Operand name;
+        ThreeAddressCode entry;               // The function's LABEL
+        std::vector<ThreeAddressCode> body;   // Everything after it
+        size_t parameters = 0;                // Leading x = param_x copies
+        std::vector<uint32_t> callees;        // Direct calls and callbacks
+        bool recursive = false;
+        bool inlinable = false;
+    };
+
+    TacModule& module;
+    size_t maxCalleeSize;
+    size_t maxCallerSize;
+    Stats stats;
+    std::vector<Function> functions;
+    std::unordered_map<Operand, uint32_t, OperandHash> functionIndex;  // By FUNCTION operand
+    std::unordered_map<uint32_t, uint32_t> byName;                     // By interned name
+    uint32_t copies = 0;
+
+    void split();
+    void buildCallGraph();
+    void markRecursive();
+    bool canInline(const Function& callee) const;
+    void inlineCalls(Function& caller);
+    // Appends a renamed copy of `callee`'s body; `arguments` are the
+    // positions in `out` of the PARAMs for this call
+    void expand(const Function& callee, const std::vector<size_t>& arguments, Operand result, int line,
+                std::vector<ThreeAddressCode>& out);
+};
+
+#endif
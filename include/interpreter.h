@@ -2,73 +2,116 @@
 #define INTERPRETER_H
 
 #include "ast.h"
+#include "builtins.h"
+#include "memo.h"
+#include "output.h"
+#include "value.h"
+#include <atomic>
+#include <cstdint>
 #include <unordered_map>
 #include <vector>
 #include <string>
 #include <optional>
 #include <stdexcept>
 
-class Interpreter {
+class Interpreter : public FunctionInvoker {
 public:
-    struct RuntimeValue {
-        enum class Kind { VOID, INT, FLOAT, BOOL, STRING, SEQUENCE };
-        
-        Kind kind = Kind::VOID;
-        long long intValue = 0;
-        double floatValue = 0.0;
-        bool boolValue = false;
-        std::string stringValue;
-        std::vector<RuntimeValue> sequenceValue;
-        
-        static RuntimeValue Void();
-        static RuntimeValue FromInt(long long value);
-        static RuntimeValue FromFloat(double value);
-        static RuntimeValue FromBool(bool value);
-        static RuntimeValue FromString(const std::string& value);
-        static RuntimeValue FromSequence(const std::vector<RuntimeValue>& values);
-        
-        bool isNumeric() const;
-        double asFloat() const;
-        long long asInt() const;
-        bool asBool() const;
-        bool isTruthy() const;
-        std::string toString() const;
-    };
+    using RuntimeValue = ::RuntimeValue;
     
     struct ExecutionResult {
         bool success = false;
         int exitCode = 0;
-        std::vector<std::string> outputLog;
+        std::vector<std::string> outputLog;  // Empty when printing to a sink
         std::string errorMessage;
     };
     
+    // Work done by run(), pool workers included
+    struct Counters {
+        uint64_t statements = 0;
+        uint64_t calls = 0;  // User function bodies entered; memo hits are not
+    };
+    
+    // Calls nested so deep that they would overflow the C stack are a
+    // runtime error instead of a crash, which would take down a whole serve
+    // process. How much stack a call takes depends on the statements and
+    // expressions it is nested in, so each engine measures the stack used
+    // since its outermost call against this budget: three quarters of the
+    // stack size limit, which pool threads get as well.
+    static size_t stackBudget();
+    // Throws once `depth` calls starting at `base` have used up the budget
+    static void checkStack(const char* base, size_t depth);
+    
     explicit Interpreter(Program* program);
     
     ExecutionResult run();
     
+    // Read once run() has returned
+    Counters counters() const;
+    
+    // Pure map/filter callbacks over large sequences run on the pool, each
+    // worker in its own Interpreter
+    void setThreadPool(ThreadPool* pool) { builtins.setThreadPool(pool); }
+    
+    // Calls to pure functions with scalar arguments are looked up in, and
+    // recorded into, the cache; forked workers run without it
+    void setMemoCache(MemoCache* cache) { memo = cache; }
+    
+    // Once *flag is set, the run stops with a runtime error at the next
+    // call or loop iteration; forked workers watch the same flag
+    void setInterrupt(const std::atomic<bool>* flag) { interrupt = flag; }
+    
+    // Printed lines go to `sink` as they are printed instead of into
+    // ExecutionResult::outputLog; the sink is flushed before input() reads
+    void setOutput(OutputSink* sink) { output = sink; }
+    
+    RuntimeValue invoke(uint32_t function, const RuntimeValue& argument) override;
+    bool isParallelSafe(uint32_t function) const override;
+    bool isPure(uint32_t function) const override;
+    std::unique_ptr<FunctionInvoker> fork() override;
+    
 private:
-    struct ReturnSignal : public std::exception {
-        RuntimeValue value;
-        explicit ReturnSignal(const RuntimeValue& value) : value(value) {}
-    };
+    // How a statement finished; on RETURN the value is left in returnValue
+    enum class ExecStatus { NORMAL, RETURN };
     
     Program* program;
     std::unordered_map<std::string, FunctionDecl*> functions;
-    std::vector<std::unordered_map<std::string, RuntimeValue>> scopes;
-    std::vector<std::string> outputLog;
+    std::unordered_map<std::string, uint32_t> functionIds;
+    OutputLog log;
+    OutputSink* output = nullptr;
+    std::string printBuffer;  // Reused by every print
+    Builtins builtins{*this};
+    MemoCache* memo = nullptr;
+    const std::atomic<bool>* interrupt = nullptr;
+    std::vector<bool> memoizable;  // By function id
+    Counters work;
+    std::vector<const Interpreter*> forks;  // Owned by builtins
+    
+    // Locals live in one flat stack; each call owns the window starting at
+    // frameBase, addressed by the slots SemanticAnalyzer assigned.
+    std::vector<RuntimeValue> stack;
+    size_t frameBase = 0;
+    size_t callDepth = 0;
+    const char* stackBase = nullptr;  // Where the outermost call started
+    RuntimeValue returnValue;
     
     void initializeFunctionTable();
-    void pushScope();
-    void popScope();
-    void define(const std::string& name, const RuntimeValue& value);
-    void assign(const std::string& name, const RuntimeValue& value);
-    RuntimeValue get(const std::string& name);
+    void checkInterrupt() const {
+        if (interrupt && interrupt->load(std::memory_order_relaxed)) {
+            interrupted();
+        }
+    }
+    [[noreturn]] static void interrupted();
+    RuntimeValue& local(int slot, const std::string& name);
     
     RuntimeValue executeFunction(FunctionDecl* function, const std::vector<RuntimeValue>& args);
-    void executeStatement(Stmt* stmt);
-    void executeBlock(const std::vector<std::unique_ptr<Stmt>>& statements);
+    ExecStatus executeStatement(Stmt* stmt);
+    ExecStatus executeBlock(const NodeList<Stmt*>& statements);
+    bool appendInPlace(AssignmentStmt* assignment);
     
+    // evaluateValue may return a LAZY sequence; evaluateExpression forces it
+    // and is what every operator uses
     RuntimeValue evaluateExpression(Expr* expr);
+    RuntimeValue evaluateValue(Expr* expr);
     RuntimeValue evaluateBinary(BinaryExpr* expr);
     RuntimeValue evaluateUnary(UnaryExpr* expr);
     RuntimeValue evaluateLiteral(LiteralExpr* expr);
@@ -77,6 +120,7 @@ private:
     RuntimeValue evaluateSequence(SequenceExpr* expr);
     
     RuntimeValue callUserFunction(const std::string& name, const std::vector<RuntimeValue>& args);
+    RuntimeValue callFunction(uint32_t function, const std::vector<RuntimeValue>& args);
     
     RuntimeValue handlePrint(CallExpr* expr);
     RuntimeValue handleLength(CallExpr* expr);
@@ -85,8 +129,12 @@ private:
     RuntimeValue handleFilter(CallExpr* expr);
     RuntimeValue handleGenerate(CallExpr* expr);
     RuntimeValue handleInput(CallExpr* expr);
+    RuntimeValue handleReduction(CallExpr* expr);  // sum, min, max
+    RuntimeValue handleLoad(CallExpr* expr);
+    RuntimeValue handleReadSequence(CallExpr* expr);
     
     std::string extractFunctionName(Expr* expr);
+    uint32_t extractFunctionId(Expr* expr);
 };
 
 #endif
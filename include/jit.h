@@ -0,0 +1,88 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "ast.h"
+#include "native.h"
+#include "tac.h"
+#include "value.h"
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Second tier of -engine=jit. The VM counts calls and loop back edges per
+// function; once a function reaches the threshold it asks for machine code
+// here. The function and everything it calls are lowered by the native
+// backend (NativeCodeGenerator::generateJit), assembled in memory (see
+// Assembler) and copied into an executable mapping: no files, no toolchain
+// and no link step. Only functions declared to take and return int or
+// bool, and that compute with nothing else, qualify; the VM keeps running
+// the rest.
+//
+// Compiled code has no runtime to throw from, so division by zero jumps
+// back to run(), which reports it. So does a call that would take the
+// stack past the limit run() was given, which every compiled function
+// checks on entry, and an int result beyond 64 bits,
+// which machine code cannot hold: the VM then reruns the call itself,
+// promoting to BigInt, which is safe since compiled functions are pure,
+// and keeps that function in the VM from then on. Safe to share between
+// the VM and its pool workers.
+class JitCompiler {
+public:
+    using Entry = int64_t (*)(const int64_t* args);
+
+    struct Stats {
+        size_t functions = 0;  // Entry points loaded
+        size_t units = 0;      // Code mappings made
+        size_t rejected = 0;   // Hot functions that do not qualify
+        double milliseconds = 0.0;
+    };
+
+    static constexpr uint32_t kDefaultThreshold = 1000;
+    static constexpr size_t kMaxArguments = 8;
+
+    JitCompiler(TacModule tac, Program* program, uint32_t threshold = kDefaultThreshold);
+    ~JitCompiler();
+    JitCompiler(const JitCompiler&) = delete;
+    JitCompiler& operator=(const JitCompiler&) = delete;
+
+    uint32_t threshold() const { return hotThreshold; }
+
+    // Machine code for `function` (an index in Program::functions),
+    // compiled on first request, or nullptr when it does not qualify
+    Entry entry(uint32_t function);
+
+    // The kinds compiled code assumes; a call with other arguments stays
+    // in the VM
+    const std::vector<RuntimeValue::Kind>& parameterKinds(uint32_t function) const { return parameters[function]; }
+    RuntimeValue::Kind resultKind(uint32_t function) const { return results[function]; }
+
+    enum class Outcome : int { DONE, DIVIDED_BY_ZERO, OVERFLOWED, STACK_EXHAUSTED };
+
+    // Calls compiled code, which stops with STACK_EXHAUSTED rather than
+    // push its stack pointer below `stackLimit`; `result` is set only when
+    // it is DONE
+    static Outcome run(Entry entry, const int64_t* args, const char* stackLimit, int64_t& result);
+
+    Stats statistics();
+
+private:
+    enum class State : uint8_t { UNTRIED, COMPILED, REJECTED };
+
+    TacModule tac;
+    Program* program;
+    uint32_t hotThreshold;
+    std::vector<std::vector<RuntimeValue::Kind>> parameters;
+    std::vector<RuntimeValue::Kind> results;
+
+    std::mutex mutex;  // Guards everything below
+    std::vector<State> states;
+    std::vector<Entry> entries;
+    std::vector<std::pair<void*, size_t>> mappings;
+    Stats stats;
+
+    bool compileUnit(uint32_t root);
+};
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Loops over the contiguous buffers of unboxed int64/double sequences.
+//
+// On x86 with GCC or Clang each kernel has an AVX2 version, chosen once at
+// run time from CPUID; everywhere else the scalar loops are used, which the
+// compiler may still vectorize for the baseline SSE2. Both versions give
+// identical results: sumFloat always adds in four interleaved lanes.
+class Kernels {
+public:
+    static bool hasAvx2();
+
+    static void subInt(const int64_t* a, const int64_t* b, int64_t* out, size_t n);
+    static void mulInt(const int64_t* a, const int64_t* b, int64_t* out, size_t n);
+    // Truncating division; returns false, leaving out partial, on a zero divisor
+    static bool divInt(const int64_t* a, const int64_t* b, int64_t* out, size_t n);
+
+    static void subFloat(const double* a, const double* b, double* out, size_t n);
+    static void mulFloat(const double* a, const double* b, double* out, size_t n);
+    static void divFloat(const double* a, const double* b, double* out, size_t n);
+    static void intToFloat(const int64_t* in, double* out, size_t n);
+
+    static bool equalInt(const int64_t* a, const int64_t* b, size_t n);
+
+    // Reductions; min and max require n > 0
+    static int64_t sumInt(const int64_t* in, size_t n);
+    static int64_t minInt(const int64_t* in, size_t n);
+    static int64_t maxInt(const int64_t* in, size_t n);
+    static double sumFloat(const double* in, size_t n);
+    static double minFloat(const double* in, size_t n);
+    static double maxFloat(const double* in, size_t n);
+};
+
+#endif
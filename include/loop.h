@@ -0,0 +1,69 @@
+#ifndef LOOP_H
+#define LOOP_H
+
+#include "cfg.h"
+#include "tac.h"
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Natural-loop optimizations of one function's CFG, on plain (non-SSA)
+// TAC. Loops are handled innermost first, each getting a preheader when
+// something is moved or initialized ahead of it:
+//
+//  - loop-invariant code motion of pure computations that cannot raise,
+//    since a while loop's body may not run at all; int arithmetic can
+//    overflow in native code, so it stays put
+//  - strength reduction of i * k, for a basic induction variable i, to a
+//    running sum stepped next to i's update, when i's range is known and
+//    the sum cannot overflow over it
+//  - length(s) of a sequence that is only appended to in the loop becomes
+//    a counter, initialized once and bumped after each append
+//
+// The rewrites leave copies behind for the SSA passes to propagate.
+class LoopOptimizer {
+public:
+    struct Stats {
+        size_t loops = 0;
+        size_t invariantsHoisted = 0;
+        size_t strengthReduced = 0;
+        size_t lengthsReplaced = 0;
+    };
+
+    LoopOptimizer(TacModule& module, ControlFlowGraph& cfg) : module(module), cfg(cfg) {}
+
+    Stats run();
+
+private:
+    // What a name can hold anywhere in the function; UNKNOWN when it
+    // depends on a parameter, a call or conflicting definitions
+    enum class ValueKind : uint8_t { NONE, INT, FLOAT, BOOL, SEQUENCE, UNKNOWN };
+
+    struct Loop {
+        uint32_t header;
+        std::vector<bool> contains;  // By block
+        std::vector<uint32_t> blocks;
+    };
+
+    // An instruction position, before any of this loop's edits
+    struct Site {
+        uint32_t block;
+        uint32_t index;
+    };
+
+    TacModule& module;
+    ControlFlowGraph& cfg;
+    Stats stats;
+    std::unordered_map<Operand, ValueKind, OperandHash> kinds;
+
+    void inferKinds();
+    ValueKind kindOf(Operand operand) const;
+    bool canSpeculate(const ThreeAddressCode& instr) const;
+
+    static bool dominates(const std::vector<uint32_t>& idom, uint32_t a, uint32_t b);
+    Loop naturalLoop(uint32_t header, const std::vector<uint32_t>& idom) const;
+    // True when the loop changed
+    bool optimizeLoop(const Loop& loop, const std::vector<uint32_t>& idom);
+};
+
+#endif
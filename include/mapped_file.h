@@ -0,0 +1,33 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// A whole file as one read-only buffer. On POSIX systems the file is
+// mapped into memory, so nothing is copied until a page is touched;
+// elsewhere, or if mapping fails, it is read in one go. Views returned by
+// text() stay valid until the MappedFile is closed or destroyed.
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // False if the file cannot be opened or read
+    bool open(const std::string& path);
+    void close();
+
+    std::string_view text() const { return std::string_view(data, length); }
+    bool mapped() const { return isMapped; }
+
+private:
+    const char* data = nullptr;
+    size_t length = 0;
+    bool isMapped = false;
+    std::string contents;  // The copy when the file is not mapped
+};
+
+#endif
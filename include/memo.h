@@ -0,0 +1,76 @@
+#ifndef MEMO_H
+#define MEMO_H
+
+#include "ast.h"
+#include "value.h"
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+
+// Bounded cache of results of pure functions, keyed by the function's
+// index in Program::functions and the exact values of its arguments.
+//
+// Only calls whose arguments are all scalars are cached, so a key is a
+// handful of machine words. When the table is full one entry is evicted:
+// the least recently used (LRU) or the oldest inserted (FIFO).
+class MemoCache {
+public:
+    enum class Eviction { LRU, FIFO };
+
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+    };
+
+    static constexpr size_t kMaxArguments = 4;
+    static constexpr size_t kDefaultCapacity = 1 << 16;
+
+    MemoCache(size_t capacity, Eviction eviction);
+
+    // Whether calls to `function` can be cached: pure, with at most
+    // kMaxArguments parameters, all declared int, float or bool
+    static bool isCandidate(const FunctionDecl& function);
+    static bool parseEviction(const std::string& name, Eviction& eviction);
+
+    // The cached result, or nullptr; counts a hit or a miss. Returns
+    // nullptr without counting when an argument is not a scalar.
+    const RuntimeValue* find(uint32_t function, const RuntimeValue* args, size_t count);
+    void insert(uint32_t function, const RuntimeValue* args, size_t count, RuntimeValue result);
+
+    const Stats& stats() const { return counters; }
+    size_t size() const { return index.size(); }
+    size_t capacity() const { return limit; }
+
+private:
+    struct Key {
+        uint32_t function = 0;
+        uint32_t count = 0;
+        uint8_t kinds[kMaxArguments] = {};
+        uint64_t bits[kMaxArguments] = {};
+
+        bool operator==(const Key& other) const;
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const;
+    };
+
+    struct Entry {
+        Key key;
+        RuntimeValue result;
+    };
+
+    size_t limit;
+    Eviction eviction;
+    Stats counters;
+
+    // Front is the next entry to evict
+    std::list<Entry> entries;
+    std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> index;
+
+    static bool makeKey(uint32_t function, const RuntimeValue* args, size_t count, Key& key);
+};
+
+#endif
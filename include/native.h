@@ -0,0 +1,159 @@
+#ifndef NATIVE_H
+#define NATIVE_H
+
+#include "ast.h"
+#include "tac.h"
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Lowers three-address code to x86-64 assembly for the GNU assembler
+// (Intel syntax, System V ABI). Linked with the runtime library built from
+// runtime/runtime.cpp, the result is a standalone executable that runs
+// main and prints what the program prints.
+//
+// Every value a function computes is classified before any code is
+// emitted. One that is always an int, or always a bool, is raw: a 64-bit
+// integer in one of rbx and r12-r15, handed out by a linear scan over live
+// ranges, or in an 8-byte stack slot once those run out. Everything else
+// (floats, strings, sequences, values that may still be void when read)
+// lives in a 16-byte stack slot laid out as a RuntimeValue, and the
+// runtime library does the work on it. The classification spans the
+// module: a parameter is raw when every call passes a raw argument, and a
+// call's result when every return of the callee is raw.
+//
+// User functions take each argument as a (tag, payload) pair in rdi:rsi,
+// rdx:rcx and r8:r9, then 16 bytes each on the stack, and return one in
+// rax:rdx. The callee owns its arguments. Raw arithmetic, comparisons and
+// branches are emitted inline; everything else calls the runtime. A raw
+// int has no room for a BigInt, so raw arithmetic whose result leaves 64
+// bits stops the executable with an error instead of wrapping.
+class NativeCodeGenerator {
+public:
+    // What a value is known to hold on every path; NONE only while the
+    // classification is still running
+    enum class ValueKind : uint8_t { NONE, INT, BOOL, BOXED };
+
+    struct Stats {
+        size_t functions = 0;
+        size_t inRegisters = 0;  // Raw values given a register
+        size_t spilled = 0;      // Raw values on the stack
+        size_t boxed = 0;        // Values kept as RuntimeValues
+    };
+
+    // Writes the whole program; throws "Native error: ..." for anything the
+    // backend cannot lower
+    void generate(const TacModule& tac, Program* program, std::ostream& out);
+
+    // For the JIT: writes function `root` (an index in Program::functions)
+    // and the functions it calls as position-independent code that needs no
+    // runtime or linker (it is what Assembler accepts),
+    // and returns their indices, or nothing when `root` does not qualify.
+    // Parameters take the kinds their declarations give them, and every
+    // function has to compute with raw values only, call nothing but other
+    // such functions and return its declared int or bool. Each function f
+    // gets an entry point `int64_t ms_jit_<f>(const int64_t* args)`, and the
+    // unit gets a pointer `ms_jit_trap` that division by zero calls with 0,
+    // an int result beyond 64 bits with 1, and a function entered with rsp
+    // below the limit at fs:[ms_jit_stack_limit] with 2; the loader defines
+    // that symbol as the thread-local limit's offset from the thread pointer.
+    std::vector<uint32_t> generateJit(const TacModule& tac, Program* program, uint32_t root, std::ostream& out);
+    const Stats& statistics() const { return stats; }
+
+private:
+    struct Storage {
+        ValueKind kind = ValueKind::BOXED;
+        int reg = -1;        // Raw values: index into the allocatable registers
+        int32_t offset = 0;  // Otherwise the slot is at [rbp - offset]
+    };
+
+    struct Block {
+        size_t begin;  // Instruction indices, relative to the function
+        size_t end;
+        std::vector<uint32_t> successors;
+        std::vector<uint32_t> predecessors;
+    };
+
+    struct Function {
+        std::string name;
+        uint32_t id = 0;                    // Index in Program::functions
+        size_t begin = 0;                   // Body, entry label excluded
+        size_t end = 0;
+        std::vector<Operand> params;        // param_x, empty if never read
+        std::vector<ValueKind> paramKinds;
+        ValueKind returnKind = ValueKind::NONE;
+        bool fallsThrough = true;           // The body can run off its end
+        bool pure = false;                  // No print or input, so callbacks may be deferred
+
+        std::vector<Operand> values;        // Temporaries and locals
+        std::unordered_map<Operand, uint32_t, OperandHash> valueIndex;
+        std::vector<ValueKind> kinds;       // By value index
+        std::vector<bool> forcedBoxed;      // May be read before it is written
+        std::vector<Block> blocks;
+
+        std::vector<Storage> storage;       // By value index
+        std::vector<int32_t> paramHomes;    // Slots for unread boxed parameters
+        int32_t scratch[3] = {0, 0, 0};     // Boxed operands and results
+        int32_t returnSlot = 0;
+        int32_t argumentSlots = 0;          // Outgoing argument k at [rbp - argumentSlots + 16k]
+        int32_t frameSize = 0;              // Below the saved registers
+    };
+
+    const TacModule* tac = nullptr;
+    std::vector<Function> functions;
+    std::unordered_map<std::string, uint32_t> functionIndex;
+    std::vector<std::string> strings;                   // The string pool
+    std::unordered_map<std::string, uint32_t> stringIndex;
+    std::vector<bool> constantUsed;                     // Constants emitted as images
+    std::ostream* out = nullptr;
+    Function* current = nullptr;
+    uint32_t localLabels = 0;
+    bool jit = false;  // Parameters keep their declared kinds
+    Stats stats;
+
+    void reset(const TacModule& tac, std::ostream& out);
+    void analyze(Program* program);
+    void collectFunctions(Program* program);
+    void buildBlocks(Function& function);
+    void findUninitializedReads(Function& function);
+    void inferKinds();
+    void allocate(Function& function);
+    // Which functions generateJit can compile
+    std::vector<bool> findJitFunctions(Program* program, std::vector<std::vector<uint32_t>>& callees) const;
+
+    void emitFunction(Function& function);
+    void emitInstruction(const ThreeAddressCode& instr, std::vector<Operand>& pending);
+    void emitCall(const ThreeAddressCode& instr, std::vector<Operand>& pending);
+    void emitBinary(const ThreeAddressCode& instr);
+    void emitCallbackAdapter(const Function& function);
+    void emitJitEntry(const Function& function);
+    void emitData();
+
+    // Operand helpers for the current function
+    int64_t valueOf(Operand operand) const;  // Value index, or -1
+    bool isCallback(const Function& function, Operand operand) const;
+    ValueKind kindOf(const Function& function, Operand operand) const;
+    bool isRaw(Operand operand) const;
+    long long rawConstant(Operand operand) const;
+    // A register, a memory operand or a 32-bit immediate; wider constants
+    // are loaded into `scratch` first
+    std::string rawOperand(Operand operand, const char* scratch);
+    void loadRaw(const char* reg, Operand operand);
+    void testRaw(Operand operand);  // Sets ZF when the operand is zero
+    void storeRaw(Operand result, const char* reg, ValueKind produced);
+    // Address expression of a RuntimeValue holding the operand; raw values
+    // are written to scratch slot `scratch` first
+    std::string boxedAddress(Operand operand, int scratch);
+    std::string slot(int32_t offset) const;
+    uint32_t internString(const std::string& text);
+
+    void emit(const std::string& text);
+    std::string newLocalLabel();
+    void release(const std::string& address);
+    void storePair(const std::string& address, const std::string& tag, const std::string& bits);
+    void copyInto(const std::string& address, const std::string& source);
+};
+
+#endif
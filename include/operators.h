@@ -0,0 +1,163 @@
+#ifndef OPERATORS_H
+#define OPERATORS_H
+
+#include "bigint.h"
+#include "builtins.h"
+#include "tac.h"
+#include "value.h"
+#include <climits>
+#include <stdexcept>
+
+// The operators on strict values, shared by the interpreter, the VM and
+// the native runtime so that none of them can disagree. int op int is
+// computed exactly: in 64 bits while the result fits, and as a BigInt
+// once it does not, so growth sequences never wrap or lose digits.
+namespace Operators {
+    // ADD, SUB, MUL, DIV or MOD of two 64-bit ints; false when the result
+    // does not fit or the divisor is zero. The constant folders fold with
+    // this too, so a folded operator means what the running one does.
+    inline bool checkedInteger(TacOp op, long long l, long long r, long long& result) {
+        switch (op) {
+            case TacOp::ADD: return !__builtin_add_overflow(l, r, &result);
+            case TacOp::SUB: return !__builtin_sub_overflow(l, r, &result);
+            case TacOp::MUL: return !__builtin_mul_overflow(l, r, &result);
+            case TacOp::DIV:
+                if (r == 0 || (l == LLONG_MIN && r == -1)) return false;
+                result = l / r;
+                return true;
+            default:
+                if (r == 0) return false;
+                result = r == -1 ? 0 : l % r;
+                return true;
+        }
+    }
+
+    // The slow path, for operands or results beyond 64 bits
+    inline RuntimeValue bigArithmetic(TacOp op, const BigInt& l, const BigInt& r) {
+        switch (op) {
+            case TacOp::ADD: return RuntimeValue::FromBigInt(BigInt::add(l, r));
+            case TacOp::SUB: return RuntimeValue::FromBigInt(BigInt::subtract(l, r));
+            case TacOp::MUL: return RuntimeValue::FromBigInt(BigInt::multiply(l, r));
+            default: {
+                if (r.isZero()) {
+                    throw std::runtime_error("Runtime error: division by zero");
+                }
+                BigInt quotient;
+                BigInt remainder;
+                BigInt::divide(l, r, quotient, remainder);
+                return RuntimeValue::FromBigInt(op == TacOp::DIV ? std::move(quotient) : std::move(remainder));
+            }
+        }
+    }
+
+    inline RuntimeValue integerArithmetic(TacOp op, long long l, long long r) {
+        long long result = 0;
+        if (checkedInteger(op, l, r, result)) return RuntimeValue::FromInt(result);
+        return bigArithmetic(op, BigInt(l), BigInt(r));
+    }
+
+    inline long long integerOperand(const RuntimeValue& value) {
+        if (value.kind() == RuntimeValue::Kind::INT) return value.intValue();
+        if (value.kind() == RuntimeValue::Kind::BOOL) return value.boolValue() ? 1LL : 0LL;
+        throw std::runtime_error("Runtime error: value is not numeric");
+    }
+
+    inline BigInt bigOperand(const RuntimeValue& value) {
+        if (value.kind() == RuntimeValue::Kind::BIGINT) return value.bigIntValue();
+        return BigInt(integerOperand(value));
+    }
+
+    // ADD, SUB, MUL, DIV and MOD
+    inline RuntimeValue arithmetic(TacOp op, const RuntimeValue& left, const RuntimeValue& right) {
+        using Kind = RuntimeValue::Kind;
+        if (left.kind() == Kind::SEQUENCE && right.kind() == Kind::SEQUENCE) {
+            switch (op) {
+                case TacOp::ADD: return Builtins::concat(left, right);
+                case TacOp::SUB: return Builtins::elementwise('-', left, right);
+                case TacOp::MUL: return Builtins::elementwise('*', left, right);
+                case TacOp::DIV: return Builtins::elementwise('/', left, right);
+                default: break;
+            }
+        }
+
+        bool big = left.kind() == Kind::BIGINT || right.kind() == Kind::BIGINT;
+        if (op == TacOp::MOD) {
+            if (big && left.kind() != Kind::FLOAT && right.kind() != Kind::FLOAT) {
+                return bigArithmetic(op, bigOperand(left), bigOperand(right));
+            }
+            return integerArithmetic(op, left.asInt(), right.asInt());
+        }
+
+        if (left.kind() == Kind::FLOAT || right.kind() == Kind::FLOAT) {
+            double l = left.asFloat();
+            double r = right.asFloat();
+            switch (op) {
+                case TacOp::ADD: return RuntimeValue::FromFloat(l + r);
+                case TacOp::SUB: return RuntimeValue::FromFloat(l - r);
+                case TacOp::MUL: return RuntimeValue::FromFloat(l * r);
+                default: return RuntimeValue::FromFloat(l / r);
+            }
+        }
+
+        if (big) return bigArithmetic(op, bigOperand(left), bigOperand(right));
+        return integerArithmetic(op, integerOperand(left), integerOperand(right));
+    }
+
+    // LT, LE, GT and GE
+    inline bool compare(TacOp op, const RuntimeValue& left, const RuntimeValue& right) {
+        if (left.kind() == RuntimeValue::Kind::INT && right.kind() == RuntimeValue::Kind::INT) {
+            long long l = left.intValue();
+            long long r = right.intValue();
+            switch (op) {
+                case TacOp::LT: return l < r;
+                case TacOp::LE: return l <= r;
+                case TacOp::GT: return l > r;
+                default: return l >= r;
+            }
+        }
+        if (left.isInteger() && right.isInteger()) {
+            int order = BigInt::compare(left.asBigInt(), right.asBigInt());
+            switch (op) {
+                case TacOp::LT: return order < 0;
+                case TacOp::LE: return order <= 0;
+                case TacOp::GT: return order > 0;
+                default: return order >= 0;
+            }
+        }
+        double l = left.asFloat();
+        double r = right.asFloat();
+        switch (op) {
+            case TacOp::LT: return l < r;
+            case TacOp::LE: return l <= r;
+            case TacOp::GT: return l > r;
+            default: return l >= r;
+        }
+    }
+
+    inline RuntimeValue binary(TacOp op, const RuntimeValue& left, const RuntimeValue& right) {
+        switch (op) {
+            case TacOp::EQ: return RuntimeValue::FromBool(Builtins::equal(left, right));
+            case TacOp::NE: return RuntimeValue::FromBool(!Builtins::equal(left, right));
+            case TacOp::LT:
+            case TacOp::LE:
+            case TacOp::GT:
+            case TacOp::GE:
+                return RuntimeValue::FromBool(compare(op, left, right));
+            case TacOp::AND: return RuntimeValue::FromBool(left.asBool() && right.asBool());
+            case TacOp::OR: return RuntimeValue::FromBool(left.asBool() || right.asBool());
+            default: return arithmetic(op, left, right);
+        }
+    }
+
+    inline RuntimeValue negate(const RuntimeValue& operand) {
+        if (operand.kind() == RuntimeValue::Kind::FLOAT) return RuntimeValue::FromFloat(-operand.floatValue());
+        if (operand.kind() == RuntimeValue::Kind::INT) {
+            if (operand.intValue() == LLONG_MIN) return RuntimeValue::FromBigInt(BigInt(LLONG_MIN).negated());
+            return RuntimeValue::FromInt(-operand.intValue());
+        }
+        if (operand.kind() == RuntimeValue::Kind::BIGINT) return RuntimeValue::FromBigInt(operand.bigIntValue().negated());
+        throw std::runtime_error("Runtime error: operator '-' requires numeric operands");
+    }
+}
+
+#endif
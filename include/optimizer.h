@@ -1,32 +1,99 @@
 #ifndef OPTIMIZER_H
 #define OPTIMIZER_H
 
+#include "cfg.h"
 #include "codegen.h"
+#include "inliner.h"
+#include "loop.h"
+#include "ssa.h"
+#include <functional>
+#include <ostream>
+#include <string>
 #include <vector>
-#include <unordered_set>
-#include <unordered_map>
 
+// Runs the optimization passes selected by an optimization level:
+//
+//   -O0  nothing
+//   -O1  simplify, ssa, cleanup, once each
+//   -O2  inline, then simplify, ssa and loop repeated until nothing
+//        changes (at most 4 rounds), then cleanup. The default
+//   -O3  as -O2 with a larger inlining budget and up to 8 rounds
+//
+// Passes can also be switched on or off one by one on top of the level.
+// Every run of a pass is timed, and the instructions it removed, added and
+// changed are recorded per pass.
 class Optimizer {
-private:
-    std::vector<ThreeAddressCode> code;
-    
-    // Optimization passes
-    void constantFolding();
-    void constantPropagation();
-    void deadCodeElimination();
-    void removeRedundantAssignments();
-    void algebraicSimplification();
-    
-    // Helper functions
-    bool isConstant(const std::string& value);
-    int evaluateConstant(const std::string& op, const std::string& left, const std::string& right);
-    bool isDeadTemp(const std::string& temp, size_t currentIndex);
-    
 public:
-    Optimizer(std::vector<ThreeAddressCode> code) : code(std::move(code)) {}
-    
-    std::vector<ThreeAddressCode> optimize();
+    enum class Pass : uint8_t {
+        INLINE,    // Small non-recursive calls replaced by the callee
+        SIMPLIFY,  // Algebraic identities such as x * 1
+        SSA,       // Constant and copy propagation, branch folding, DCE
+        LOOP,      // Invariant code motion, strength reduction, counters
+        CLEANUP,   // x = x removal
+        COUNT
+    };
+
+    struct PassStats {
+        size_t runs = 0;
+        double milliseconds = 0.0;
+        // Net change of each run, summed separately for the runs that
+        // shrank the code and those that grew it (strength reduction and
+        // length counters insert instructions)
+        size_t removed = 0;
+        size_t added = 0;
+        size_t changed = 0;  // Instructions the pass rewrote or inserted
+    };
+
+    static constexpr int kDefaultLevel = 2;
+
+    explicit Optimizer(TacModule module, int level = kDefaultLevel);
+
+    static const char* passName(Pass pass);
+    static bool parsePass(const std::string& name, Pass& pass);
+
+    void setPassEnabled(Pass pass, bool enabled) { enabledPasses[static_cast<size_t>(pass)] = enabled; }
+    bool isPassEnabled(Pass pass) const { return enabledPasses[static_cast<size_t>(pass)]; }
+    int level() const { return optimizationLevel; }
+
+    TacModule optimize();
+
+    const PassStats& passStats(Pass pass) const { return perPass[static_cast<size_t>(pass)]; }
+    const Inliner::Stats& inlineStatistics() const { return inlineStats; }
+    const SsaOptimizer::Stats& globalStats() const { return ssaStats; }
+    const LoopOptimizer::Stats& loopStatistics() const { return loopStats; }
+
+    // One line per pass that ran: runs, time, instructions removed and
+    // changed, and what the pass did
+    void printPassStatistics(std::ostream& out) const;
     void printOptimizedCode(std::ostream& out);
+
+private:
+    TacModule module;
+    int optimizationLevel;
+    size_t maxRounds;
+    bool enabledPasses[static_cast<size_t>(Pass::COUNT)];
+    PassStats perPass[static_cast<size_t>(Pass::COUNT)];
+
+    Inliner::Stats inlineStats;
+    SsaOptimizer::Stats ssaStats;
+    LoopOptimizer::Stats loopStats;
+
+    // Runs `pass` if it is enabled and returns how many instructions it
+    // changed, 0 when it is disabled
+    size_t runPass(Pass pass);
+
+    // The passes; each returns the instructions it changed
+    size_t inlineCalls();
+    size_t algebraicSimplification();
+    // Constant and copy propagation and dead code elimination over each
+    // function's CFG in SSA form
+    size_t globalOptimization();
+    size_t loopOptimization();
+    size_t removeRedundantAssignments();
+
+    // Calls `pass` on each function's CFG, entry label excluded, and puts
+    // the linearized result back
+    void forEachFunction(const std::function<void(ControlFlowGraph&)>& pass);
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,86 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Where the lines a program prints go, one print() at a time
+class OutputSink {
+public:
+    virtual ~OutputSink() = default;
+    // `line` has no newline
+    virtual void writeLine(std::string_view line) = 0;
+    // Makes every line so far visible, e.g. before the program reads input
+    virtual void flush() {}
+};
+
+// Keeps every line, for ExecutionResult::outputLog
+class OutputLog : public OutputSink {
+public:
+    void writeLine(std::string_view line) override { lines.emplace_back(line); }
+
+    void clear() { lines.clear(); }
+    // The lines so far, leaving the log empty
+    std::vector<std::string> take() { return std::exchange(lines, {}); }
+
+private:
+    std::vector<std::string> lines;
+};
+
+// Writes lines to a file descriptor through one large buffer, written out
+// once it holds `capacity` bytes or, by a flusher thread of its own, once
+// its oldest line has waited `interval`. A long run shows its output as it
+// goes, even while it computes without printing, and only the longest line,
+// not the whole output, is held in memory.
+class BufferedWriter : public OutputSink {
+public:
+    static constexpr size_t kDefaultCapacity = 1 << 20;
+    static constexpr std::chrono::milliseconds kDefaultInterval{100};
+
+    explicit BufferedWriter(int fd, size_t capacity = kDefaultCapacity,
+                            std::chrono::milliseconds interval = kDefaultInterval);
+    ~BufferedWriter() override;
+    BufferedWriter(const BufferedWriter&) = delete;
+    BufferedWriter& operator=(const BufferedWriter&) = delete;
+
+    void writeLine(std::string_view line) override;
+    void flush() override;
+
+    // False once a write has failed, e.g. on a closed pipe; later output
+    // is discarded
+    bool good() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return !failed;
+    }
+    uint64_t bytesWritten() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return written;
+    }
+
+private:
+    int fd;
+    size_t capacity;
+    std::chrono::milliseconds interval;
+
+    mutable std::mutex mutex;  // Guards everything below
+    std::condition_variable pending;
+    std::string buffer;
+    std::chrono::steady_clock::time_point firstLine;  // Of what buffer holds
+    uint64_t written = 0;
+    bool failed = false;
+    bool stopping = false;
+    std::thread flusher;
+
+    void writeOut();  // With mutex held
+    void flushLoop();
+};
+
+#endif
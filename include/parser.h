@@ -3,6 +3,7 @@
 
 #include "token.h"
 #include "ast.h"
+#include <initializer_list>
 #include <vector>
 #include <memory>
 #include <stdexcept>
@@ -12,55 +13,88 @@ public:
     ParseError(const std::string& message) : std::runtime_error(message) {}
 };
 
+// The lexer produced an ERROR token; what() is its lexeme
+class LexicalError : public std::runtime_error {
+public:
+    LexicalError(const std::string& lexeme) : std::runtime_error(lexeme) {}
+};
+
+// Recursive descent over a token stream pulled from the Lexer as it goes,
+// with one token of lookahead, so the token list is never materialized.
+// Tokens are handed out by reference and the lexemes the AST keeps are
+// interned, so nothing is copied per lookahead.
 class Parser {
 private:
-    std::vector<Token> tokens;
-    int current;
+    Lexer& lexer;
+    Token previousToken;
+    Token currentToken;
+    Token lookahead;             // The token after currentToken, once peeked
+    bool hasLookahead = false;
+    size_t tokensRead = 0;
+    std::string errorMessage;
+    Program* program = nullptr;  // The tree being built; nodes go in its arena
+    // Child lists under construction, innermost on top, so nested blocks
+    // and calls reuse one buffer each instead of allocating their own
+    std::vector<Stmt*> pendingStatements;
+    std::vector<Expr*> pendingExpressions;
     
-    Token advance();
-    Token peek();
-    Token peekNext();
-    Token previous();
+    Token pull();  // Next token from the lexer; throws LexicalError on ERROR
+    const Token& advance();
+    const Token& peek();
+    const Token& peekNext();
+    const Token& previous();
     bool check(TokenType type);
+    bool checkType();  // A type keyword or an identifier
     bool match(TokenType type);
-    bool match(const std::vector<TokenType>& types);
+    bool match(std::initializer_list<TokenType> types);
     bool isAtEnd();
-    Token consume(TokenType type, const std::string& message);
+    const Token& consume(TokenType type, const std::string& message);
     
-    DataType tokenToDataType(Token token);
+    DataType tokenToDataType(const Token& token);
+    // Moves pending[first..] into the arena
+    template <typename T>
+    NodeList<T> finishList(std::vector<T>& pending, size_t first);
     
     // Grammar rules
     std::unique_ptr<Program> parseProgram();
-    std::unique_ptr<FunctionDecl> parseFunction();
-    std::unique_ptr<Stmt> parseStatement();
-    std::unique_ptr<Stmt> parseDeclaration();
-    std::unique_ptr<Stmt> parseAssignment();
-    std::unique_ptr<Stmt> parsePrintStatement();
-    std::unique_ptr<Stmt> parseIfStatement();
-    std::unique_ptr<Stmt> parseWhileStatement();
-    std::unique_ptr<Stmt> parseReturnStatement();
-    std::unique_ptr<Stmt> parseExpressionStatement();
-    std::vector<std::unique_ptr<Stmt>> parseBlock();
+    FunctionDecl* parseFunction();
+    Stmt* parseStatement();
+    Stmt* parseDeclaration();
+    Stmt* parseAssignment();
+    Stmt* parsePrintStatement();
+    Stmt* parseIfStatement();
+    Stmt* parseWhileStatement();
+    Stmt* parseReturnStatement();
+    Stmt* parseExpressionStatement();
+    NodeList<Stmt*> parseBlock();
     
-    std::unique_ptr<Expr> parseExpression();
-    std::unique_ptr<Expr> parseLogicalOr();
-    std::unique_ptr<Expr> parseLogicalAnd();
-    std::unique_ptr<Expr> parseEquality();
-    std::unique_ptr<Expr> parseComparison();
-    std::unique_ptr<Expr> parseTerm();
-    std::unique_ptr<Expr> parseFactor();
-    std::unique_ptr<Expr> parseUnary();
-    std::unique_ptr<Expr> parsePrimary();
-    std::unique_ptr<Expr> parseSequence();
+    Expr* parseExpression();
+    Expr* parseLogicalOr();
+    Expr* parseLogicalAnd();
+    Expr* parseEquality();
+    Expr* parseComparison();
+    Expr* parseTerm();
+    Expr* parseFactor();
+    Expr* parseUnary();
+    Expr* parsePrimary();
+    Expr* parseSequence();
     
-    std::vector<std::pair<Token, DataType>> parseParameters();
-    std::vector<std::unique_ptr<Expr>> parseArguments();
+    NodeList<Parameter> parseParameters();
+    NodeList<Expr*> parseArguments();
+    
+    Name intern(const Token& token) { return program->names.intern(token.lexeme); }
     
     void synchronize();
     
 public:
-    Parser(std::vector<Token> tokens);
+    explicit Parser(Lexer& lexer);
+    // A parse error gives nullptr, with the message left in error();
+    // lexical errors propagate as LexicalError
     std::unique_ptr<Program> parse();
+    const std::string& error() const { return errorMessage; }
+    
+    // Tokens pulled from the lexer so far, END_OF_FILE included
+    size_t tokenCount() const { return tokensRead; }
 };
 
 #endif
\ No newline at end of file
@@ -5,6 +5,7 @@
 #include "symbol_table.h"
 #include <vector>
 #include <string>
+#include <unordered_map>
 #include <unordered_set>
 #include <stdexcept>
 
@@ -22,6 +23,13 @@ private:
     DataType currentFunctionReturnType;
     bool inFunction;
     bool hasReturnStatement;
+
+    // Call graph for purity inference; function names passed to map/filter/
+    // generate count as calls too
+    FunctionDecl* currentFunction = nullptr;
+    std::unordered_map<std::string, FunctionDecl*> functionDecls;
+    std::unordered_map<FunctionDecl*, std::vector<FunctionDecl*>> callees;
+    std::unordered_set<FunctionDecl*> impure;
     
     void addError(const std::string& message, int line = -1);
     void addWarning(const std::string& message, int line = -1);
@@ -51,6 +59,7 @@ private:
     bool canCoerce(DataType from, DataType to);
     
     void checkMainFunction(Program* program);
+    void inferPurity(Program* program);
     
 public:
     SemanticAnalyzer() : currentFunctionReturnType(DataType::VOID), 
@@ -0,0 +1,148 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "ast.h"
+#include "memo.h"
+#include "optimizer.h"
+#include "thread_pool.h"
+#include "vm.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <istream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// `mathseqc serve`: one long-lived process answering compile, check and
+// run requests, on stdin or a Unix socket, so that an editor or a request
+// handler pays for process startup once.
+//
+// A request is one line, a verb and key=value fields, followed by the raw
+// bytes its length fields announce:
+//
+//     run source=<n> [input=<n>] [engine=interp|vm] [timeout=<ms>] [O=<0-3>] [id=<token>]
+//     compile source=<n> [engine=interp|vm] [O=<0-3>] [id=<token>]
+//     check source=<n> [id=<token>]
+//     stats
+//     quit        (ends the session: stdin, or one socket connection)
+//     shutdown    (also stops accepting connections)
+//
+// Each is answered with one line of JSON. For run it carries the
+// Interpreter::ExecutionResult - "success", "exitCode", "output" (the
+// output log) and "error" - with the program's diagnostics, whether it
+// came from the cache, whether it timed out and the milliseconds taken.
+// input() reads the request's input bytes, never the connection.
+//
+// Programs are kept in an LRU cache keyed by a hash of the source and the
+// optimization level: the analyzed, folded Program with its arena and
+// names, its diagnostics, its bytecode once the VM has needed it, and its
+// memo cache with -memoize. One ThreadPool serves every request. Timed
+// runs are watched by one thread that sets the engine's interrupt flag
+// when time is up; the engine then stops at its next call or loop
+// iteration.
+class CompileServer {
+public:
+    struct Options {
+        std::string engine = "interp";  // interp or vm
+        int optimizationLevel = Optimizer::kDefaultLevel;
+        std::vector<std::pair<Optimizer::Pass, bool>> passOverrides;
+        size_t threads = 1;
+        size_t programCapacity = kDefaultCapacity;
+        uint64_t timeoutMs = 0;  // Per run unless a request says otherwise; 0: none
+        bool memoize = false;
+        size_t memoSize = MemoCache::kDefaultCapacity;
+        MemoCache::Eviction memoEviction = MemoCache::Eviction::LRU;
+    };
+
+    struct Stats {
+        uint64_t requests = 0;
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        uint64_t timeouts = 0;
+    };
+
+    static constexpr size_t kDefaultCapacity = 64;
+
+    explicit CompileServer(Options options);
+    ~CompileServer();
+    CompileServer(const CompileServer&) = delete;
+    CompileServer& operator=(const CompileServer&) = delete;
+
+    // Answers requests from `in` until it ends, quits or shuts down
+    void serve(std::istream& in, std::ostream& out);
+
+    // Accepts connections on a Unix socket at `path`, one at a time, until
+    // a shutdown request; false with `error` set if it cannot listen
+    bool listen(const std::string& path, std::string& error);
+
+    const Stats& statistics() const { return counters; }
+
+private:
+    struct CompiledProgram {
+        uint64_t key = 0;
+        std::string source;
+        int level = 0;
+        std::unique_ptr<Program> program;
+        bool valid = false;  // Parsed and analyzed without errors
+        std::vector<std::string> diagnostics;
+        std::shared_ptr<const BytecodeModule> bytecode;
+        std::unique_ptr<MemoCache> memo;
+    };
+
+    struct Request {
+        std::string verb;
+        std::string id;
+        std::string source;
+        std::string input;
+        std::string engine;
+        int level = 0;
+        uint64_t timeoutMs = 0;
+    };
+
+    Options options;
+    ThreadPool pool;
+    Stats counters;
+
+    // Front is the least recently used
+    std::list<CompiledProgram> programs;
+    std::unordered_map<uint64_t, std::list<CompiledProgram>::iterator> index;
+
+    // The watchdog, started by the first timed run
+    std::thread watchdog;
+    std::mutex watchMutex;
+    std::condition_variable watchSignal;
+    bool armed = false;
+    bool stopping = false;
+    std::chrono::steady_clock::time_point deadline;
+    std::atomic<bool> interrupted{false};
+
+    enum class Outcome { CONTINUE, QUIT, SHUTDOWN };
+
+    Outcome session(std::istream& in, std::ostream& out);
+    // Reads the rest of the request that starts with `line`; false with
+    // `error` set if it is malformed. `lost` means its payload could not be
+    // read either, so the session cannot go on.
+    bool readRequest(std::istream& in, const std::string& line, Request& request, std::string& error,
+                     bool& lost) const;
+    std::string answer(const Request& request);
+
+    CompiledProgram& lookup(const std::string& source, int level, bool& cached);
+    void compile(CompiledProgram& entry) const;
+    // The bytecode for the VM, built on first use; throws Bytecode errors
+    const std::shared_ptr<const BytecodeModule>& bytecode(CompiledProgram& entry) const;
+
+    void arm(uint64_t milliseconds);
+    void disarm();
+    void watch();
+};
+
+#endif
@@ -0,0 +1,124 @@
+#ifndef SSA_H
+#define SSA_H
+
+#include "cfg.h"
+#include "tac.h"
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Global optimizations of one function on its CFG in SSA form.
+//
+// SSA is kept as an overlay: every use and definition in the TAC is tagged
+// with the SSA value it reads or writes, and phis live beside the blocks,
+// while the instructions keep their original operands. Rewrites only
+// ever put a constant, or a variable whose reaching definition is the
+// same SSA value, in place of a use, so leaving SSA is just dropping the
+// overlay.
+//
+// Variables that are mutated in place (the targets of STORE, APPEND and
+// EXTEND) stay out of SSA and are left untouched.
+class SsaOptimizer {
+public:
+    struct Stats {
+        size_t constantsPropagated = 0;  // Uses and definitions replaced by constants
+        size_t copiesPropagated = 0;     // Uses rewritten to the original of a copy
+        size_t branchesFolded = 0;
+        size_t instructionsRemoved = 0;  // Dead or unreachable
+    };
+
+    SsaOptimizer(TacModule& module, ControlFlowGraph& cfg) : module(module), cfg(cfg) {}
+
+    // Sparse conditional constant propagation, copy propagation and
+    // dead code elimination, in that order
+    Stats run();
+
+private:
+    static constexpr uint32_t kNoValue = UINT32_MAX;
+
+    struct Value {
+        Operand base;
+        uint32_t block;
+        int32_t index;  // Instruction index, or phi index when phi is set
+        bool phi = false;
+        bool entry = false;  // The value a name holds on entry
+    };
+
+    struct Phi {
+        Operand base;
+        uint32_t value = kNoValue;
+        // (predecessor block, value) pairs; keyed by block so they survive
+        // the edges being recomputed
+        std::vector<std::pair<uint32_t, uint32_t>> args;
+    };
+
+    struct InstrValues {
+        uint32_t def = kNoValue;
+        uint32_t uses[2] = {kNoValue, kNoValue};
+        // Earliest copy source still reaching this use, if any
+        uint32_t copies[2] = {kNoValue, kNoValue};
+    };
+
+    struct Uses {
+        uint32_t values[2] = {kNoValue, kNoValue};
+    };
+
+    struct Lattice {
+        enum State : uint8_t { TOP, CONSTANT, BOTTOM } state = TOP;
+        Operand constant;
+    };
+
+    struct User {
+        uint32_t block;
+        uint32_t index;
+        bool phi;
+    };
+
+    TacModule& module;
+    ControlFlowGraph& cfg;
+    Stats stats;
+
+    std::unordered_set<Operand, OperandHash> unversioned;
+    std::vector<Value> values;
+    std::vector<std::vector<Phi>> phis;
+    std::vector<std::vector<InstrValues>> info;
+    std::unordered_map<Operand, std::vector<uint32_t>, OperandHash> stacks;
+    std::unordered_map<Operand, uint32_t, OperandHash> entryValues;
+    std::vector<uint32_t> copySource;
+    std::vector<Uses> defUses;  // What each instruction value reads, after rewriting
+
+    std::vector<Lattice> lattice;
+    std::vector<std::vector<User>> users;
+    std::vector<bool> blockExecutable;
+    std::unordered_set<uint64_t> edgeExecutable;  // from << 32 | to
+
+    static bool definesResult(TacOp op);
+    static bool readsArg(TacOp op, int k);
+    bool versioned(Operand operand) const;
+
+    void buildSsa();
+    void placePhis(const std::vector<std::vector<uint32_t>>& frontiers);
+    void rename(const std::vector<uint32_t>& idom);
+    uint32_t newValue(Operand base, uint32_t block, int32_t index, bool phi);
+    uint32_t current(Operand base);
+    uint32_t copyCandidate(uint32_t value);
+
+    void propagateConstants();
+    Lattice operandValue(Operand operand, uint32_t value) const;
+    Lattice evaluate(const ThreeAddressCode& instr, const InstrValues& values);
+    bool fold(TacOp op, const TacConstant& left, const TacConstant& right, Operand& result);
+    bool foldUnary(TacOp op, const TacConstant& operand, Operand& result);
+    void visitPhi(uint32_t block, uint32_t index, std::vector<uint32_t>& ssaWork);
+    void visitInstruction(uint32_t block, uint32_t index, std::vector<uint32_t>& ssaWork,
+                          std::vector<std::pair<uint32_t, uint32_t>>& flowWork);
+    void visitTerminator(uint32_t block, std::vector<std::pair<uint32_t, uint32_t>>& flowWork);
+    void lower(uint32_t value, const Lattice& result, std::vector<uint32_t>& ssaWork);
+
+    void rewrite(std::vector<std::vector<bool>>& removed);
+    // Drops the instructions marked in `removed`, keeping `info` aligned
+    void compact(const std::vector<std::vector<bool>>& removed);
+    void eliminateDeadCode();
+};
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Resource usage of the whole process at one moment. Allocations are the
+// calls to the global operator new made since counting was enabled; peak
+// RSS is the high-water mark so far, in kilobytes. Where the platform has
+// no such figure it reads 0.
+struct ResourceSample {
+    double wallMs = 0.0;
+    double cpuMs = 0.0;  // Summed over all threads
+    uint64_t peakRssKb = 0;
+    uint64_t allocations = 0;
+    uint64_t allocatedBytes = 0;
+
+    static ResourceSample now();
+};
+
+// `text` with the characters a JSON string cannot hold escaped
+std::string escapeJson(const std::string& text);
+
+// Per-phase report behind -stats and -time-phases. Each phase runs from
+// its begin() to the next begin() or end(); counters are named totals
+// recorded along the way, reported in the order they were first set.
+//
+// A disabled PhaseStats records nothing, so the driver can call it
+// unconditionally.
+class PhaseStats {
+public:
+    enum class Format { TEXT, JSON };
+
+    struct Phase {
+        std::string name;
+        double wallMs = 0.0;
+        double cpuMs = 0.0;
+        uint64_t peakRssKb = 0;  // At the end of the phase
+        uint64_t allocations = 0;
+        uint64_t allocatedBytes = 0;
+    };
+
+    struct Counter {
+        std::string key;    // The JSON name
+        std::string label;  // The text one
+        uint64_t value = 0;
+    };
+
+    explicit PhaseStats(bool enabled = false);
+
+    bool enabled() const { return active; }
+
+    void begin(const std::string& phase);
+    void end();
+    void setCounter(const std::string& key, const std::string& label, uint64_t value);
+
+    // Everything, or with timesOnly just the wall and CPU time per phase
+    void print(std::ostream& out, Format format, bool timesOnly = false) const;
+
+    // Turns on counting in the global operator new for the rest of the
+    // process; off by default so that ordinary runs pay one load per
+    // allocation
+    static void countAllocations();
+
+private:
+    bool active;
+    bool inPhase = false;
+    ResourceSample start;
+    ResourceSample phaseStart;
+    ResourceSample finish;
+    std::vector<Phase> phases;
+    std::vector<Counter> counters;
+
+    void printText(std::ostream& out, bool timesOnly) const;
+    void printJson(std::ostream& out, bool timesOnly) const;
+};
+
+#endif
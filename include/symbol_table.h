@@ -13,9 +13,11 @@ struct Symbol {
     bool isInitialized;
     bool isConstant;
     int scopeDepth;
+    int slot;  // Frame slot for function locals, -1 for globals
     
-    Symbol(const std::string& name, DataType type, bool initialized = false, bool constant = false, int depth = 0)
-        : name(name), type(type), isInitialized(initialized), isConstant(constant), scopeDepth(depth) {}
+    Symbol(const std::string& name, DataType type, bool initialized = false, bool constant = false, int depth = 0,
+           int slot = -1)
+        : name(name), type(type), isInitialized(initialized), isConstant(constant), scopeDepth(depth), slot(slot) {}
 };
 
 class SymbolTable {
@@ -28,11 +30,12 @@ public:
     SymbolTable(int depth = 0, SymbolTable* parent = nullptr) 
         : parent(parent), scopeDepth(depth) {}
     
-    bool insert(const std::string& name, DataType type, bool initialized = false, bool constant = false) {
+    bool insert(const std::string& name, DataType type, bool initialized = false, bool constant = false,
+                int slot = -1) {
         if (symbols.find(name) != symbols.end()) {
             return false; // Symbol already exists in current scope
         }
-        symbols.emplace(name, Symbol(name, type, initialized, constant, scopeDepth));
+        symbols.emplace(name, Symbol(name, type, initialized, constant, scopeDepth, slot));
         return true;
     }
     
@@ -81,8 +84,14 @@ private:
     SymbolTable* current;
     int currentDepth;
     
+    // Frame slot allocation for the function being analyzed. Slots are
+    // released when their scope closes so sibling blocks share them.
+    std::vector<int> slotMarks;
+    int nextSlot;
+    int maxSlots;
+    
 public:
-    SymbolTableManager() : currentDepth(0) {
+    SymbolTableManager() : current(nullptr), currentDepth(0), nextSlot(0), maxSlots(0) {
         enterScope(); // Global scope
     }
     
@@ -91,21 +100,44 @@ public:
         current = newTable.get();
         tables.push_back(std::move(newTable));
         currentDepth++;
+        slotMarks.push_back(nextSlot);
     }
     
     void exitScope() {
         if (current && current->getParent()) {
             current = current->getParent();
             currentDepth--;
+            nextSlot = slotMarks.back();
+            slotMarks.pop_back();
         }
     }
     
+    // Start allocating slots for a new function frame
+    void beginFrame() {
+        nextSlot = 0;
+        maxSlots = 0;
+    }
+    
+    int getFrameSize() const { return maxSlots; }
+    
     SymbolTable* getCurrentScope() { return current; }
     
     bool declareSymbol(const std::string& name, DataType type, bool initialized = false, bool constant = false) {
         return current->insert(name, type, initialized, constant);
     }
     
+    // Declares a function local and gives it the next free frame slot
+    bool declareLocal(const std::string& name, DataType type, bool initialized = false) {
+        if (!current->insert(name, type, initialized, false, nextSlot)) {
+            return false;
+        }
+        nextSlot++;
+        if (nextSlot > maxSlots) {
+            maxSlots = nextSlot;
+        }
+        return true;
+    }
+    
     Symbol* lookupSymbol(const std::string& name) {
         return current->lookup(name);
     }
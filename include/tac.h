@@ -0,0 +1,153 @@
+#ifndef TAC_H
+#define TAC_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Three-address code. An instruction is an opcode and three 32-bit
+// operands; names, constants and labels live in the TacModule that owns
+// the instruction stream, so passes compare integers instead of strings.
+
+enum class TacOp : uint8_t {
+    LABEL,      // result:                 a jump target, or a function entry
+    GOTO,       // goto result
+    IF_FALSE,   // ifFalse arg1 goto result
+    IF,         // if arg1 goto result
+    PARAM,      // param arg1
+    CALL,       // result = call arg1, arg2 (argument count)
+    RETURN,     // return [arg1]
+    ASSIGN,     // result = arg1
+    NEW_SEQ,    // result = []
+    STORE,      // result[arg2] = arg1
+    APPEND,     // append result, arg1
+    EXTEND,     // extend result, arg1
+    ADD, SUB, MUL, DIV, MOD,
+    EQ, NE, LT, LE, GT, GE,
+    AND, OR,
+    NEG, NOT    // result = op arg1
+};
+
+// Source spelling of a binary or unary operator, e.g. "+" for ADD
+const char* tacOpSymbol(TacOp op);
+bool isBinaryTacOp(TacOp op);
+// Shortest text that reads back as `value` and still has a decimal point,
+// which is how every stage tells float literals from integers
+std::string formatFloatLiteral(double value);
+
+// A tagged index: the top three bits say what the low 29 index.
+class Operand {
+public:
+    enum class Kind : uint8_t {
+        NONE,       // unused slot
+        TEMP,       // compiler temporary t<index>
+        VARIABLE,   // named local; index into TacModule::names
+        CONSTANT,   // index into TacModule::constants
+        LABEL,      // L<index>
+        FUNCTION,   // function or builtin; index into TacModule::names
+        IMMEDIATE   // small count or position, e.g. a call's argument count
+    };
+
+    static constexpr uint32_t kIndexBits = 29;
+    static constexpr uint32_t kIndexMask = (1u << kIndexBits) - 1;
+
+    Operand() = default;
+
+    static Operand make(Kind kind, uint32_t index) {
+        return Operand((static_cast<uint32_t>(kind) << kIndexBits) | (index & kIndexMask));
+    }
+    static Operand temp(uint32_t index) { return make(Kind::TEMP, index); }
+    static Operand label(uint32_t index) { return make(Kind::LABEL, index); }
+    static Operand immediate(uint32_t value) { return make(Kind::IMMEDIATE, value); }
+
+    Kind kind() const { return static_cast<Kind>(bits >> kIndexBits); }
+    uint32_t index() const { return bits & kIndexMask; }
+    uint32_t raw() const { return bits; }
+
+    bool empty() const { return bits == 0; }
+    bool isTemp() const { return kind() == Kind::TEMP; }
+    bool isConstant() const { return kind() == Kind::CONSTANT; }
+    // Temporaries and variables: the operands that name storage
+    bool isValue() const { return kind() == Kind::TEMP || kind() == Kind::VARIABLE; }
+
+    bool operator==(const Operand& other) const { return bits == other.bits; }
+    bool operator!=(const Operand& other) const { return bits != other.bits; }
+
+private:
+    explicit Operand(uint32_t bits) : bits(bits) {}
+    uint32_t bits = 0;
+};
+
+struct OperandHash {
+    size_t operator()(const Operand& operand) const { return operand.raw(); }
+};
+
+struct ThreeAddressCode {
+    TacOp op;
+    Operand result;
+    Operand arg1;
+    Operand arg2;
+    int line;
+
+    ThreeAddressCode(TacOp op, Operand arg1, Operand arg2, Operand result, int line = -1)
+        : op(op), result(result), arg1(arg1), arg2(arg2), line(line) {}
+};
+
+struct TacConstant {
+    enum class Kind : uint8_t { INT, FLOAT, BOOL, STRING, BIGINT };
+
+    Kind kind;
+    long long intValue = 0;   // Also 0/1 for BOOL
+    double floatValue = 0.0;
+    std::string text;         // Spelling in listings; the contents for STRING, the digits for BIGINT
+};
+
+class StringInterner {
+public:
+    uint32_t intern(const std::string& text);
+    // Index of an already interned string, or -1
+    int64_t find(const std::string& text) const;
+    const std::string& text(uint32_t index) const { return strings[index]; }
+    size_t size() const { return strings.size(); }
+
+private:
+    std::vector<std::string> strings;
+    std::unordered_map<std::string, uint32_t> index;
+};
+
+struct TacModule {
+    StringInterner names;
+    std::vector<TacConstant> constants;
+    std::vector<ThreeAddressCode> code;
+    uint32_t tempCount = 0;
+    uint32_t labelCount = 0;
+
+    Operand newTemp() { return Operand::temp(tempCount++); }
+    Operand newLabel() { return Operand::label(labelCount++); }
+    Operand variable(const std::string& name);
+    Operand function(const std::string& name);
+
+    // Equal constants share one pool entry; `text` is kept from the first
+    Operand intConstant(long long value, const std::string& text);
+    Operand intConstant(long long value) { return intConstant(value, std::to_string(value)); }
+    Operand floatConstant(double value, const std::string& text);
+    Operand floatConstant(double value) { return floatConstant(value, formatFloatLiteral(value)); }
+    Operand boolConstant(bool value);
+    Operand stringConstant(const std::string& value);
+    // An int literal beyond 64 bits, by its decimal digits
+    Operand bigIntConstant(const std::string& digits);
+
+    const TacConstant& constant(Operand operand) const { return constants[operand.index()]; }
+    bool isIntConstant(Operand operand, long long value) const;
+    const std::string& name(Operand operand) const { return names.text(operand.index()); }
+
+    std::string operandToString(Operand operand) const;
+    std::string toString(const ThreeAddressCode& instr) const;
+
+private:
+    Operand addConstant(TacConstant constant, const std::string& key);
+    std::unordered_map<std::string, uint32_t> constantIndex;
+};
+
+#endif
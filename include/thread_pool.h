@@ -0,0 +1,57 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing pool for batches of independent tasks.
+//
+// run() splits the task indices into one contiguous block per worker. A
+// worker takes tasks from the back of its own deque and, once that is
+// empty, steals from the front of the others. The calling thread takes part
+// as worker 0, so a pool of N threads starts N - 1 of its own, on first use.
+class ThreadPool {
+public:
+    using Task = std::function<void(size_t worker, size_t index)>;
+
+    explicit ThreadPool(size_t threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const { return threadCount; }
+
+    // Calls task(worker, index) for every index in [0, count) and returns
+    // once all of them have finished. Tasks must not throw.
+    void run(size_t count, const Task& task);
+
+private:
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<size_t> tasks;
+    };
+
+    size_t threadCount;
+    std::vector<std::thread> threads;
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    const Task* current = nullptr;
+    uint64_t generation = 0;
+    size_t remaining = 0;
+    bool stopping = false;
+
+    void workerLoop(size_t worker);
+    bool runOne(size_t worker);
+};
+
+#endif
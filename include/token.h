@@ -4,7 +4,7 @@
 #define TOKEN_H
 
 #include <string>
-#include <unordered_map>
+#include <string_view>
 #include <vector>
 
 enum class TokenType {
@@ -29,32 +29,35 @@ enum class TokenType {
     END_OF_FILE, ERROR
 };
 
+// The lexeme is a view into the source the Lexer ran over (or a string
+// literal), so tokens are cheap to copy but must not outlive that source
 struct Token {
     TokenType type;
-    std::string lexeme;
+    std::string_view lexeme;
     int line;
     int column;
     
-    Token(TokenType t, const std::string& l, int ln = 1, int col = 1) 
+    Token(TokenType t, std::string_view l, int ln = 1, int col = 1) 
         : type(t), lexeme(l), line(ln), column(col) {}
     
     std::string toString() const {
         return "Token(" + std::to_string(static_cast<int>(type)) + 
-               ", '" + lexeme + "', line=" + std::to_string(line) + 
+               ", '" + std::string(lexeme) + "', line=" + std::to_string(line) + 
                ", col=" + std::to_string(column) + ")";
     }
 };
 
+// Scans a source buffer it does not own. Tokens can be pulled one at a
+// time with nextToken(), which returns END_OF_FILE once the input is used
+// up, or all at once with tokenize().
 class Lexer {
 private:
-    std::string source;
-    int start;
-    int current;
+    std::string_view source;
+    size_t start;
+    size_t current;
     int line;
     int column;
     
-    static std::unordered_map<std::string, TokenType> keywords;
-    
     char advance();
     char peek();
     char peekNext();
@@ -64,10 +67,11 @@ private:
     Token stringLiteral();
     Token number();
     Token identifier();
-    TokenType checkKeyword(int start, int length, const char* rest, TokenType type);
+    TokenType identifierType();
+    TokenType checkKeyword(size_t offset, size_t length, const char* rest, TokenType type);
     
 public:
-    Lexer(const std::string& source);
+    explicit Lexer(std::string_view source);
     Token nextToken();
     std::vector<Token> tokenize();
 };
@@ -0,0 +1,251 @@
+#ifndef VALUE_H
+#define VALUE_H
+
+#include "bigint.h"
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Runtime value shared by the interpreter and the bytecode VM.
+//
+// Scalars are stored inline in a 16-byte tagged union. Strings and
+// sequences live in reference-counted heap blocks, so copying a value is
+// O(1); the block is cloned on the first write while it is shared.
+//
+// An int that does not fit in 64 bits is a BIGINT, held the same way and
+// never modified. FromBigInt gives an INT whenever the value fits, so the
+// two kinds never overlap and a BIGINT is never zero.
+//
+// A sequence whose elements are all INT or all FLOAT is stored unboxed, as
+// a plain int64_t/double buffer that Kernels operates on directly. Asking
+// for the boxed elements (sequenceValue, mutableSequence) converts the
+// block to boxed storage for good; sequenceSize/sequenceAt never do.
+// Reference counts are not atomic: a value must not be shared between
+// threads.
+struct LazySequence;
+
+class RuntimeValue {
+public:
+    enum class Kind : uint8_t { VOID, INT, FLOAT, BOOL, STRING, SEQUENCE, LAZY, BIGINT };
+    enum class SequenceLayout : uint8_t { BOXED, INT64, FLOAT64 };
+
+    RuntimeValue() noexcept : tag(Kind::VOID) { payload.intValue = 0; }
+    RuntimeValue(const RuntimeValue& other) noexcept : tag(other.tag), payload(other.payload) { retain(); }
+    RuntimeValue(RuntimeValue&& other) noexcept : tag(other.tag), payload(other.payload) {
+        other.tag = Kind::VOID;
+    }
+    ~RuntimeValue() { release(); }
+
+    RuntimeValue& operator=(const RuntimeValue& other) noexcept {
+        if (this != &other) {
+            other.retain();
+            release();
+            tag = other.tag;
+            payload = other.payload;
+        }
+        return *this;
+    }
+
+    RuntimeValue& operator=(RuntimeValue&& other) noexcept {
+        if (this != &other) {
+            release();
+            tag = other.tag;
+            payload = other.payload;
+            other.tag = Kind::VOID;
+        }
+        return *this;
+    }
+
+    static RuntimeValue Void() { return RuntimeValue(); }
+    static RuntimeValue FromInt(long long value);
+    static RuntimeValue FromFloat(double value);
+    static RuntimeValue FromBool(bool value);
+    static RuntimeValue FromString(std::string value);
+    static RuntimeValue FromSequence(std::vector<RuntimeValue> values);  // Unboxes if it can
+    static RuntimeValue FromInts(std::vector<int64_t> values);
+    static RuntimeValue FromFloats(std::vector<double> values);
+    static RuntimeValue FromLazy(LazySequence* lazy);  // Takes ownership
+    static RuntimeValue FromBigInt(BigInt value);       // INT if it fits
+
+    Kind kind() const { return tag; }
+    long long intValue() const { return payload.intValue; }
+    double floatValue() const { return payload.floatValue; }
+    bool boolValue() const { return payload.boolValue; }
+    const std::string& stringValue() const;
+    const std::vector<RuntimeValue>& sequenceValue() const;
+    const LazySequence& lazyValue() const { return *payload.lazy; }
+    const BigInt& bigIntValue() const;
+
+    SequenceLayout sequenceLayout() const;
+    size_t sequenceSize() const;
+    RuntimeValue sequenceAt(size_t index) const;
+    const std::vector<int64_t>& intElements() const;   // INT64 layout only
+    const std::vector<double>& floatElements() const;  // FLOAT64 layout only
+
+    // Writable access to the elements; copies them first if shared
+    std::vector<RuntimeValue>& mutableSequence();
+
+    // Shared sequence blocks cloned by a write so far, by every thread
+    static uint64_t sequenceCopies();
+
+    // In-place growth that keeps an unboxed layout when the new elements
+    // fit it. An empty sequence takes the layout of what is added.
+    void appendElement(RuntimeValue element);
+    void appendSequence(const RuntimeValue& tail);
+
+    bool isInteger() const { return tag == Kind::INT || tag == Kind::BIGINT; }
+    bool isNumeric() const { return tag == Kind::INT || tag == Kind::FLOAT || tag == Kind::BIGINT; }
+    double asFloat() const;
+    long long asInt() const;  // Throws for a BIGINT
+    BigInt asBigInt() const;  // INT, BIGINT or BOOL
+    bool asBool() const;
+    bool isTruthy() const;
+    std::string toString() const;
+    // Appends the same text to `out`, without building a string per element
+    void appendTo(std::string& out) const;
+
+private:
+    struct StringData;
+    struct SequenceData;
+    struct BigIntData;
+
+    Kind tag;
+    union {
+        long long intValue;
+        double floatValue;
+        bool boolValue;
+        StringData* string;
+        SequenceData* sequence;
+        LazySequence* lazy;
+        BigIntData* bigInt;
+    } payload;
+
+    inline void retain() const;
+    inline void release();
+    SequenceData& uniqueSequence();
+    void boxSequence() const;
+};
+
+static_assert(sizeof(RuntimeValue) == 16, "RuntimeValue should stay two words");
+
+struct RuntimeValue::StringData {
+    uint32_t refCount;
+    std::string value;
+};
+
+struct RuntimeValue::BigIntData {
+    uint32_t refCount;
+    BigInt value;
+};
+
+struct RuntimeValue::SequenceData {
+    uint32_t refCount;
+    SequenceLayout layout;
+    std::vector<RuntimeValue> elements;  // BOXED
+    std::vector<int64_t> ints;           // INT64
+    std::vector<double> floats;          // FLOAT64
+};
+
+// A deferred sequence built by generate/map/filter: a source followed by
+// fused map and filter stages. The source is either an existing sequence
+// or `count` terms of seed, step(seed), step(step(seed)), ... Builtins
+// evaluates it on demand; function ids index Program::functions.
+struct LazySequence {
+    enum class StageKind : uint8_t { MAP, FILTER };
+    struct Stage {
+        StageKind kind;
+        uint32_t function;
+    };
+    
+    uint32_t refCount = 1;
+    RuntimeValue source;  // The sequence, or the seed when generated
+    bool generated = false;
+    uint32_t stepFunction = 0;
+    long long count = 0;
+    std::vector<Stage> stages;
+    
+    // Filled the first time the whole sequence is needed
+    mutable RuntimeValue materialized;
+    
+    bool hasFilter() const {
+        for (const auto& stage : stages) {
+            if (stage.kind == StageKind::FILTER) return true;
+        }
+        return false;
+    }
+};
+
+inline void RuntimeValue::retain() const {
+    if (tag == Kind::STRING) {
+        ++payload.string->refCount;
+    } else if (tag == Kind::SEQUENCE) {
+        ++payload.sequence->refCount;
+    } else if (tag == Kind::LAZY) {
+        ++payload.lazy->refCount;
+    } else if (tag == Kind::BIGINT) {
+        ++payload.bigInt->refCount;
+    }
+}
+
+inline void RuntimeValue::release() {
+    if (tag == Kind::STRING) {
+        if (--payload.string->refCount == 0) delete payload.string;
+    } else if (tag == Kind::SEQUENCE) {
+        if (--payload.sequence->refCount == 0) delete payload.sequence;
+    } else if (tag == Kind::LAZY) {
+        if (--payload.lazy->refCount == 0) delete payload.lazy;
+    } else if (tag == Kind::BIGINT) {
+        if (--payload.bigInt->refCount == 0) delete payload.bigInt;
+    }
+    tag = Kind::VOID;
+}
+
+inline const std::string& RuntimeValue::stringValue() const {
+    return payload.string->value;
+}
+
+inline const BigInt& RuntimeValue::bigIntValue() const {
+    return payload.bigInt->value;
+}
+
+inline const std::vector<RuntimeValue>& RuntimeValue::sequenceValue() const {
+    if (payload.sequence->layout != SequenceLayout::BOXED) boxSequence();
+    return payload.sequence->elements;
+}
+
+inline RuntimeValue::SequenceLayout RuntimeValue::sequenceLayout() const {
+    return payload.sequence->layout;
+}
+
+inline size_t RuntimeValue::sequenceSize() const {
+    switch (payload.sequence->layout) {
+        case SequenceLayout::INT64: return payload.sequence->ints.size();
+        case SequenceLayout::FLOAT64: return payload.sequence->floats.size();
+        default: return payload.sequence->elements.size();
+    }
+}
+
+inline RuntimeValue RuntimeValue::sequenceAt(size_t index) const {
+    switch (payload.sequence->layout) {
+        case SequenceLayout::INT64: return FromInt(payload.sequence->ints[index]);
+        case SequenceLayout::FLOAT64: return FromFloat(payload.sequence->floats[index]);
+        default: return payload.sequence->elements[index];
+    }
+}
+
+inline const std::vector<int64_t>& RuntimeValue::intElements() const {
+    return payload.sequence->ints;
+}
+
+inline const std::vector<double>& RuntimeValue::floatElements() const {
+    return payload.sequence->floats;
+}
+
+inline std::vector<RuntimeValue>& RuntimeValue::mutableSequence() {
+    SequenceData& data = uniqueSequence();
+    if (data.layout != SequenceLayout::BOXED) boxSequence();
+    return data.elements;
+}
+
+#endif
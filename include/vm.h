@@ -0,0 +1,163 @@
+#ifndef VM_H
+#define VM_H
+
+#include "ast.h"
+#include "builtins.h"
+#include "codegen.h"
+#include "interpreter.h"
+#include "jit.h"
+#include "memo.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Register bytecode executed by the VirtualMachine. Every operand is a
+// 32-bit index: either a register in the current frame or, when the high
+// bit is set, an entry in the function's constant pool.
+enum class OpCode : uint8_t {
+    MOVE,           // a = b
+    NEW_SEQ,        // a = []
+    SEQ_STORE,      // a[c] = b
+    APPEND,         // a += [b], in place when a is uniquely owned
+    EXTEND,         // a += b
+    ADD, SUB, MUL, DIV, MOD,
+    EQ, NE, LT, LE, GT, GE,
+    AND, OR,
+    NEG, NOT,       // a = op b
+    JUMP,           // goto a
+    JUMP_IF_FALSE,  // if !b goto a
+    JUMP_IF_TRUE,   // if b goto a
+    PARAM,          // push b
+    CALL,           // a = functions[b](c args)
+    CALL_BUILTIN,   // a = builtin b(c args)
+    RETURN,         // return b
+    RETURN_VOID
+};
+
+struct Instruction {
+    OpCode op;
+    uint32_t a;
+    uint32_t b;
+    uint32_t c;
+};
+
+struct BytecodeFunction {
+    std::string name;
+    uint32_t numParams = 0;
+    uint32_t numRegisters = 0;
+    std::vector<Instruction> code;
+    std::vector<Interpreter::RuntimeValue> constants;
+    std::vector<std::string> registerNames;
+    
+    // No print or input, directly or through a callee
+    bool pure = false;
+    // Pure, and neither it nor its callees hold shared heap constants
+    bool parallelSafe = false;
+    // Calls may be answered from a MemoCache
+    bool memoizable = false;
+    // Set for a one-parameter, straight-line scalar body that map and
+    // filter can run without calling it
+    std::shared_ptr<const InlineCallback> inlineCallback;
+};
+
+struct BytecodeModule {
+    std::vector<BytecodeFunction> functions;
+    std::unordered_map<std::string, uint32_t> functionIndex;
+};
+
+// Lowers three-address code into register bytecode. Function boundaries and
+// parameter order come from the Program, since the TAC stream only carries
+// labels.
+class BytecodeCompiler {
+private:
+    BytecodeModule module;
+
+    void compileFunction(FunctionDecl* function, const TacModule& tac,
+                         size_t begin, size_t end);
+    void markParallelSafe(Program* program);
+
+public:
+    BytecodeModule compile(const TacModule& tac, Program* program);
+
+    // What compile() sets as the function's inlineCallback; also used for
+    // modules read back from a BytecodeFile
+    static std::shared_ptr<const InlineCallback> buildInlineCallback(const BytecodeFunction& function);
+};
+
+class VirtualMachine : public FunctionInvoker {
+public:
+    using RuntimeValue = Interpreter::RuntimeValue;
+    using ExecutionResult = Interpreter::ExecutionResult;
+
+    explicit VirtualMachine(BytecodeModule module);
+    // Runs a module shared with other machines, such as one kept compiled
+    // across runs
+    explicit VirtualMachine(std::shared_ptr<const BytecodeModule> module);
+
+    ExecutionResult run();
+    void printBytecode(std::ostream& out) const;
+    
+    // Bytecode function bodies entered by run(), pool workers included;
+    // memo hits, calls made from machine code and callbacks run inline
+    // are not. Read once run() has returned.
+    uint64_t calls() const;
+    
+    // Parallel-safe map/filter callbacks over large sequences run on the
+    // pool, each worker in its own VirtualMachine sharing this module
+    void setThreadPool(ThreadPool* pool) { builtins.setThreadPool(pool); }
+    void setMemoCache(MemoCache* cache) { memo = cache; }
+    // Tiered execution: functions that get hot run as machine code
+    void setJit(JitCompiler* compiler);
+    // Once *flag is set, the run stops with a runtime error at the next
+    // call or loop back edge; forked workers watch the same flag. Machine
+    // code from the JIT runs to completion.
+    void setInterrupt(const std::atomic<bool>* flag) { interrupt = flag; }
+    // As Interpreter::setOutput
+    void setOutput(OutputSink* sink) { output = sink; }
+    
+    RuntimeValue invoke(uint32_t function, const RuntimeValue& argument) override;
+    bool isParallelSafe(uint32_t function) const override;
+    bool isPure(uint32_t function) const override;
+    std::unique_ptr<FunctionInvoker> fork() override;
+    const InlineCallback* inlineCallback(uint32_t function) const override;
+
+    static constexpr uint32_t kConstantBit = 0x80000000u;
+
+private:
+    std::shared_ptr<const BytecodeModule> module;
+    std::vector<RuntimeValue> registers;
+    std::vector<RuntimeValue> argStack;
+    OutputLog log;
+    OutputSink* output = nullptr;
+    std::string printBuffer;
+    Builtins builtins{*this};
+    MemoCache* memo = nullptr;
+    JitCompiler* jit = nullptr;
+    const std::atomic<bool>* interrupt = nullptr;
+    std::vector<uint32_t> hotness;  // Calls and loop back edges, per function
+    std::vector<JitCompiler::Entry> compiled;
+    std::vector<bool> promoted;    // Already asked the JIT
+    uint64_t callsEntered = 0;
+    std::vector<const VirtualMachine*> forks;  // Owned by builtins
+
+    size_t frameTop = 0;
+    size_t callDepth = 0;
+    const char* stackBase = nullptr;  // See Interpreter::stackBudget
+
+    // Arguments are taken from argStack[argBase, argBase + argCount) and
+    // popped before the call returns.
+    RuntimeValue execute(uint32_t functionIndex, size_t argBase, uint32_t argCount);
+    // execute, going through the memo cache when there is one
+    RuntimeValue call(uint32_t functionIndex, size_t argBase, uint32_t argCount);
+    RuntimeValue callBuiltin(Builtin builtin, size_t argBase, uint32_t argCount);
+    // Runs the function's machine code when the arguments have the kinds
+    // it was compiled for
+    bool callCompiled(uint32_t functionIndex, size_t argBase, uint32_t argCount, RuntimeValue& result);
+    uint32_t lookupFunction(const RuntimeValue& reference);
+};
+
+#endif
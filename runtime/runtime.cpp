@@ -0,0 +1,328 @@
+// Runtime library for executables built by the native backend
+// (NativeCodeGenerator). Generated code keeps every value it cannot hold
+// as a raw integer in a 16-byte slot laid out as a RuntimeValue and calls
+// the entry points below on the slots' addresses; they run the same
+// operators and builtins as the VM, so both print the same thing.
+//
+// Slots are plain memory to the generated code, so ownership is passed
+// explicitly: an entry point that takes a `result` slot releases what it
+// held and stores a new value, one that takes arguments for a builtin
+// consumes them, and everything else only reads its operands.
+#include "../include/builtins.h"
+#include "../include/operators.h"
+#include "../include/value.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <pthread.h>
+#include <stdexcept>
+#include <string>
+
+namespace {
+    using Kind = RuntimeValue::Kind;
+
+    struct MsValue {
+        uint64_t tag;
+        uint64_t bits;
+    };
+    static_assert(sizeof(MsValue) == sizeof(RuntimeValue), "slots are RuntimeValues");
+
+    // The generated code's view of a slot, and back
+    RuntimeValue& slot(MsValue* value) {
+        return *reinterpret_cast<RuntimeValue*>(value);
+    }
+
+    RuntimeValue take(MsValue* value) {
+        RuntimeValue taken = std::move(slot(value));
+        return taken;
+    }
+
+    MsValue detach(RuntimeValue value) {
+        MsValue raw;
+        alignas(RuntimeValue) unsigned char storage[sizeof(RuntimeValue)];
+        new (storage) RuntimeValue(std::move(value));
+        std::memcpy(&raw, storage, sizeof(raw));
+        return raw;
+    }
+
+    [[noreturn]] void fatal(const char* message) {
+        std::cout.flush();
+        std::fprintf(stderr, "%s\n", message);
+        std::_Exit(1);
+    }
+}
+
+extern "C" {
+    // Emitted by the generator
+    extern const char* const ms_string_texts[];
+    extern const uint64_t ms_string_lengths[];
+    extern const uint64_t ms_string_count;
+    extern const char* const ms_function_names[];
+    extern MsValue (*const ms_function_table[])(uint64_t tag, uint64_t bits);
+    extern const uint64_t ms_function_count;
+    extern const uint8_t ms_function_pure[];
+    extern MsValue ms_string_pool[];
+    MsValue ms_fn_main();
+}
+
+namespace {
+    // Callbacks of map, filter and generate go through the function table
+    class NativeInvoker : public FunctionInvoker {
+    public:
+        RuntimeValue invoke(uint32_t function, const RuntimeValue& argument) override {
+            MsValue pair = detach(argument);
+            MsValue returned = ms_function_table[function](pair.tag, pair.bits);
+            return take(&returned);
+        }
+
+        bool isPure(uint32_t function) const override {
+            return ms_function_pure[function] != 0;
+        }
+    };
+
+    NativeInvoker invoker;
+    Builtins builtins(invoker);
+
+    uint32_t lookupFunction(const RuntimeValue& reference) {
+        if (reference.kind() != Kind::STRING) {
+            throw std::runtime_error("Runtime error: expected function identifier");
+        }
+        const std::string& name = reference.stringValue();
+        for (uint64_t f = 0; f < ms_function_count; ++f) {
+            if (name == ms_function_names[f]) return static_cast<uint32_t>(f);
+        }
+        throw std::runtime_error("Runtime error: Undefined function '" + name + "'");
+    }
+
+    RuntimeValue callBuiltin(Builtin builtin, RuntimeValue* args, uint32_t argCount) {
+        switch (builtin) {
+            case Builtin::PRINT: {
+                // Streamed as it runs; the VM collects the lines instead
+                std::string line;
+                for (uint32_t i = 0; i < argCount; ++i) {
+                    if (i > 0) line += " ";
+                    line += builtins.format(args[i]);
+                }
+                std::cout << line << "\n";
+                return RuntimeValue::Void();
+            }
+            case Builtin::LENGTH:
+                if (argCount != 1) {
+                    throw std::runtime_error("Runtime error: length expects 1 argument");
+                }
+                return builtins.length(args[0]);
+            case Builtin::GET:
+                if (argCount != 2) {
+                    throw std::runtime_error("Runtime error: get expects 2 arguments");
+                }
+                return builtins.get(args[0], builtins.strict(args[1]));
+            case Builtin::MAP:
+                if (argCount != 2) {
+                    throw std::runtime_error("Runtime error: map expects 2 arguments");
+                }
+                return builtins.map(args[0], lookupFunction(args[1]));
+            case Builtin::FILTER:
+                if (argCount != 2) {
+                    throw std::runtime_error("Runtime error: filter expects 2 arguments");
+                }
+                return builtins.filter(args[0], lookupFunction(args[1]));
+            case Builtin::GENERATE:
+                if (argCount != 3) {
+                    throw std::runtime_error("Runtime error: generate expects 3 arguments");
+                }
+                return builtins.generate(args[0], lookupFunction(args[1]), builtins.strict(args[2]));
+            case Builtin::SUM:
+            case Builtin::MIN:
+            case Builtin::MAX: {
+                const char* name = builtin == Builtin::SUM ? "sum" : builtin == Builtin::MIN ? "min" : "max";
+                if (argCount != 1) {
+                    throw std::runtime_error(std::string("Runtime error: ") + name + " expects 1 argument");
+                }
+                if (builtin == Builtin::SUM) return builtins.sum(args[0]);
+                return builtin == Builtin::MIN ? builtins.min(args[0]) : builtins.max(args[0]);
+            }
+            case Builtin::INPUT: {
+                if (argCount > 1) {
+                    throw std::runtime_error("Runtime error: input expects at most 1 argument");
+                }
+                std::string promptText = argCount == 1 ? builtins.format(args[0]) : "";
+                std::cout.flush();
+                return Builtins::readInput(promptText);
+            }
+            case Builtin::LOAD:
+                if (argCount < 1 || argCount > 2) {
+                    throw std::runtime_error("Runtime error: load expects 1 or 2 arguments");
+                }
+                return Builtins::load(builtins.format(args[0]), argCount == 2 ? builtins.format(args[1]) : "text");
+            case Builtin::READ_SEQUENCE:
+                if (argCount != 0) {
+                    throw std::runtime_error("Runtime error: read_sequence expects no arguments");
+                }
+                std::cout.flush();
+                return Builtins::readSequence();
+        }
+        return RuntimeValue::Void();
+    }
+
+    void* runMain(void*) {
+        MsValue returned = ms_fn_main();
+        RuntimeValue value = take(&returned);
+        std::cout.flush();
+        // main's value is the exit code, as the VM reports it
+        try {
+            long long code = value.kind() == Kind::VOID ? 0 : value.asInt();
+            return reinterpret_cast<void*>(static_cast<intptr_t>(code));
+        } catch (const std::exception& error) {
+            fatal(error.what());
+        }
+    }
+}
+
+extern "C" {
+    void ms_release(MsValue* value) {
+        slot(value).~RuntimeValue();
+        value->tag = 0;
+    }
+
+    void ms_retain(MsValue* value) {
+        // The generated code has copied the slot; leaking a copy gives it
+        // the reference
+        detach(slot(value));
+    }
+
+    void ms_assign(MsValue* result, const MsValue* source) {
+        slot(result) = slot(const_cast<MsValue*>(source));
+    }
+
+    void ms_binary(uint32_t op, MsValue* result, const MsValue* left, const MsValue* right) {
+        try {
+            const RuntimeValue& l = builtins.strict(slot(const_cast<MsValue*>(left)));
+            const RuntimeValue& r = builtins.strict(slot(const_cast<MsValue*>(right)));
+            RuntimeValue value = Operators::binary(static_cast<TacOp>(op), l, r);
+            slot(result) = std::move(value);
+        } catch (const std::exception& error) {
+            fatal(error.what());
+        }
+    }
+
+    void ms_unary(uint32_t op, MsValue* result, const MsValue* operand) {
+        try {
+            const RuntimeValue& value = builtins.strict(slot(const_cast<MsValue*>(operand)));
+            RuntimeValue computed = static_cast<TacOp>(op) == TacOp::NEG
+                ? Operators::negate(value)
+                : RuntimeValue::FromBool(!value.asBool());
+            slot(result) = std::move(computed);
+        } catch (const std::exception& error) {
+            fatal(error.what());
+        }
+    }
+
+    bool ms_truthy(const MsValue* value) {
+        try {
+            return builtins.strict(slot(const_cast<MsValue*>(value))).asBool();
+        } catch (const std::exception& error) {
+            fatal(error.what());
+        }
+    }
+
+    void ms_new_seq(MsValue* result) {
+        slot(result) = RuntimeValue::FromSequence({});
+    }
+
+    void ms_store(MsValue* sequence, uint32_t index, const MsValue* element) {
+        try {
+            RuntimeValue value = builtins.strict(slot(const_cast<MsValue*>(element)));
+            RuntimeValue& target = slot(sequence);
+            // Literals store their elements in order, which keeps an
+            // all-int or all-float literal unboxed
+            if (index == target.sequenceSize()) {
+                target.appendElement(std::move(value));
+                return;
+            }
+            auto& elements = target.mutableSequence();
+            if (index >= elements.size()) {
+                elements.resize(index + 1);
+            }
+            elements[index] = std::move(value);
+        } catch (const std::exception& error) {
+            fatal(error.what());
+        }
+    }
+
+    void ms_append(uint32_t op, MsValue* sequence, const MsValue* element) {
+        try {
+            RuntimeValue& target = slot(sequence);
+            if (target.kind() == Kind::LAZY) {
+                RuntimeValue elements = builtins.strict(target);
+                target = std::move(elements);
+            }
+            // Take the element first: appending s to itself must not make
+            // the sequence contain its own storage
+            RuntimeValue value = builtins.strict(slot(const_cast<MsValue*>(element)));
+            if (target.kind() != Kind::SEQUENCE) {
+                throw std::runtime_error("Runtime error: value is not numeric");
+            }
+            if (static_cast<TacOp>(op) == TacOp::APPEND) {
+                target.appendElement(std::move(value));
+                return;
+            }
+            if (value.kind() != Kind::SEQUENCE) {
+                throw std::runtime_error("Runtime error: value is not numeric");
+            }
+            target.appendSequence(value);
+        } catch (const std::exception& error) {
+            fatal(error.what());
+        }
+    }
+
+    void ms_builtin(uint32_t builtin, MsValue* result, MsValue* args, uint32_t argCount) {
+        try {
+            RuntimeValue taken[3];
+            uint32_t kept = argCount < 3 ? argCount : 3;
+            for (uint32_t i = 0; i < kept; ++i) taken[i] = take(&args[i]);
+            RuntimeValue value;
+            if (static_cast<Builtin>(builtin) == Builtin::PRINT && argCount > 3) {
+                std::vector<RuntimeValue> all(taken, taken + kept);
+                for (uint32_t i = kept; i < argCount; ++i) all.push_back(take(&args[i]));
+                value = callBuiltin(Builtin::PRINT, all.data(), argCount);
+            } else {
+                for (uint32_t i = kept; i < argCount; ++i) take(&args[i]);
+                value = callBuiltin(static_cast<Builtin>(builtin), taken, argCount);
+            }
+            slot(result) = std::move(value);
+        } catch (const std::exception& error) {
+            fatal(error.what());
+        }
+    }
+
+    [[noreturn]] void ms_divide_by_zero() {
+        fatal("Runtime error: division by zero");
+    }
+
+    [[noreturn]] void ms_integer_overflow() {
+        fatal("Runtime error: integer overflow in native code (the VM promotes such results to big integers)");
+    }
+}
+
+int main() {
+    for (uint64_t s = 0; s < ms_string_count; ++s) {
+        new (&ms_string_pool[s]) RuntimeValue(
+            RuntimeValue::FromString(std::string(ms_string_texts[s], ms_string_lengths[s])));
+    }
+
+    // Deep recursion runs on a thread with a stack to match the VM's
+    // growable frames
+    pthread_attr_t attributes;
+    pthread_attr_init(&attributes);
+    pthread_attr_setstacksize(&attributes, size_t(512) << 20);
+    pthread_t thread;
+    void* status = nullptr;
+    if (pthread_create(&thread, &attributes, runMain, nullptr) != 0) {
+        return static_cast<int>(reinterpret_cast<intptr_t>(runMain(nullptr)));
+    }
+    pthread_join(thread, &status);
+    return static_cast<int>(reinterpret_cast<intptr_t>(status));
+}
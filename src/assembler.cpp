@@ -0,0 +1,509 @@
+#include "../include/assembler.h"
+#include <charconv>
+#include <stdexcept>
+
+struct Assembler::Operand {
+    enum class Kind : uint8_t { REGISTER, MEMORY, IMMEDIATE, LABEL };
+
+    Kind kind = Kind::IMMEDIATE;
+    int size = 0;       // In bytes; 0 for memory whose width is not stated
+    int reg = -1;       // The register, or the base of a memory operand (-1: none)
+    bool rip = false;   // [rip+label]
+    bool fs = false;    // fs:[...]
+    int64_t value = 0;  // The immediate, or the displacement
+    std::string label;  // A jump target, or what [rip+...] refers to
+};
+
+namespace {
+    struct Register {
+        int number;
+        int size;
+    };
+
+    // No ah-bh: every byte register from 4 up needs a REX prefix
+    const std::unordered_map<std::string_view, Register>& registers() {
+        static const std::unordered_map<std::string_view, Register> table = [] {
+            static const char* const wide[] = {"rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi"};
+            static const char* const half[] = {"eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi"};
+            static const char* const low[] = {"al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil"};
+            static const char* const numbered[] = {"8", "9", "10", "11", "12", "13", "14", "15"};
+            static std::vector<std::string> names;
+            names.reserve(24);
+            std::unordered_map<std::string_view, Register> map;
+            for (int r = 0; r < 8; ++r) {
+                map.emplace(wide[r], Register{r, 8});
+                map.emplace(half[r], Register{r, 4});
+                map.emplace(low[r], Register{r, 1});
+                names.push_back(std::string("r") + numbered[r]);
+                names.push_back(std::string("r") + numbered[r] + "d");
+                names.push_back(std::string("r") + numbered[r] + "b");
+            }
+            for (size_t n = 0; n < names.size(); ++n) {
+                static const int sizes[] = {8, 4, 1};
+                map.emplace(names[n], Register{8 + static_cast<int>(n / 3), sizes[n % 3]});
+            }
+            return map;
+        }();
+        return table;
+    }
+
+    // The condition code of a jcc or setcc suffix, or -1
+    int conditionCode(std::string_view suffix) {
+        static const std::unordered_map<std::string_view, int> codes = {
+            {"o", 0},   {"no", 1},  {"b", 2},   {"c", 2},   {"nae", 2}, {"ae", 3},  {"nb", 3},  {"nc", 3},
+            {"e", 4},   {"z", 4},   {"ne", 5},  {"nz", 5},  {"be", 6},  {"na", 6},  {"a", 7},   {"nbe", 7},
+            {"s", 8},   {"ns", 9},  {"p", 10},  {"pe", 10}, {"np", 11}, {"po", 11}, {"l", 12},  {"nge", 12},
+            {"ge", 13}, {"nl", 13}, {"le", 14}, {"ng", 14}, {"g", 15},  {"nle", 15},
+        };
+        auto it = codes.find(suffix);
+        return it == codes.end() ? -1 : it->second;
+    }
+
+    // The /digit of add, or, and, sub, xor and cmp
+    int arithmeticCode(std::string_view mnemonic) {
+        static const std::unordered_map<std::string_view, int> codes = {
+            {"add", 0}, {"or", 1}, {"and", 4}, {"sub", 5}, {"xor", 6}, {"cmp", 7},
+        };
+        auto it = codes.find(mnemonic);
+        return it == codes.end() ? -1 : it->second;
+    }
+
+    std::string_view trim(std::string_view text) {
+        while (!text.empty() && (text.front() == ' ' || text.front() == '\t')) text.remove_prefix(1);
+        while (!text.empty() && (text.back() == ' ' || text.back() == '\t' || text.back() == '\r')) text.remove_suffix(1);
+        return text;
+    }
+
+    bool parseInteger(std::string_view text, int64_t& value) {
+        if (text.empty()) return false;
+        auto parsed = std::from_chars(text.data(), text.data() + text.size(), value);
+        if (parsed.ec == std::errc() && parsed.ptr == text.data() + text.size()) return true;
+        // .quad also takes the unsigned spelling of negative bit patterns
+        uint64_t bits = 0;
+        parsed = std::from_chars(text.data(), text.data() + text.size(), bits);
+        if (parsed.ec != std::errc() || parsed.ptr != text.data() + text.size()) return false;
+        value = static_cast<int64_t>(bits);
+        return true;
+    }
+
+    bool fits8(int64_t value) { return value >= INT8_MIN && value <= INT8_MAX; }
+    bool fits32(int64_t value) { return value >= INT32_MIN && value <= INT32_MAX; }
+
+    [[noreturn]] void fail(const std::string& what) {
+        throw std::runtime_error(what);
+    }
+}
+
+void Assembler::assemble(std::string_view source) {
+    while (!source.empty()) {
+        size_t newline = source.find('\n');
+        std::string_view line = trim(source.substr(0, newline));
+        source.remove_prefix(newline == std::string_view::npos ? source.size() : newline + 1);
+        if (line.empty()) continue;
+        try {
+            if (line.back() == ':') {
+                std::string name(line.substr(0, line.size() - 1));
+                if (!labels.emplace(name, bytes.size()).second) fail("label defined twice");
+                continue;
+            }
+            if (line.front() == '.') {
+                directive(line);
+                continue;
+            }
+            size_t space = line.find(' ');
+            std::string_view mnemonic = line.substr(0, space);
+            std::vector<Operand> operands;
+            if (space != std::string_view::npos) {
+                std::string_view rest = line.substr(space + 1);
+                while (!rest.empty()) {
+                    size_t comma = rest.find(',');
+                    operands.push_back(parseOperand(trim(rest.substr(0, comma))));
+                    rest.remove_prefix(comma == std::string_view::npos ? rest.size() : comma + 1);
+                }
+            }
+            pending.clear();
+            instruction(mnemonic, operands);
+            for (size_t fixup : pending) fixups[fixup].end = bytes.size();
+        } catch (const std::runtime_error& error) {
+            throw std::runtime_error("Assembler error: " + std::string(error.what()) + " in '" + std::string(line) + "'");
+        }
+    }
+
+    for (const Fixup& fixup : fixups) {
+        auto target = labels.find(fixup.label);
+        if (target == labels.end()) {
+            throw std::runtime_error("Assembler error: undefined label '" + fixup.label + "'");
+        }
+        int64_t distance = static_cast<int64_t>(target->second) - static_cast<int64_t>(fixup.end);
+        for (int b = 0; b < 4; ++b) bytes[fixup.at + b] = static_cast<uint8_t>(static_cast<uint64_t>(distance) >> (8 * b));
+    }
+    fixups.clear();
+}
+
+int64_t Assembler::offsetOf(const std::string& label) const {
+    auto it = labels.find(label);
+    return it == labels.end() ? -1 : static_cast<int64_t>(it->second);
+}
+
+void Assembler::directive(std::string_view line) {
+    size_t space = line.find(' ');
+    std::string_view name = line.substr(0, space);
+    std::string_view rest = space == std::string_view::npos ? std::string_view() : trim(line.substr(space + 1));
+    if (name == ".intel_syntax" || name == ".text" || name == ".data" || name == ".bss" || name == ".section" ||
+        name == ".globl" || name == ".type" || name == ".size") {
+        return;  // One image, nothing exported
+    }
+    if (name == ".quad" || name == ".byte") {
+        int size = name == ".quad" ? 8 : 1;
+        while (!rest.empty()) {
+            size_t comma = rest.find(',');
+            int64_t value = 0;
+            if (!parseInteger(trim(rest.substr(0, comma)), value)) fail("expected a number");
+            immediate(value, size);
+            rest.remove_prefix(comma == std::string_view::npos ? rest.size() : comma + 1);
+        }
+        return;
+    }
+    int64_t count = 0;
+    if (!parseInteger(rest, count) || count < 0 || count > (1 << 20)) fail("bad directive operand");
+    if (name == ".p2align") {
+        if (count > 12) fail("alignment too large");
+        while (bytes.size() % (size_t(1) << count) != 0) byte(0);
+        return;
+    }
+    if (name == ".zero") {
+        bytes.resize(bytes.size() + static_cast<size_t>(count), 0);
+        return;
+    }
+    fail("unknown directive");
+}
+
+Assembler::Operand Assembler::parseOperand(std::string_view text) const {
+    Operand operand;
+    static const std::pair<std::string_view, int> widths[] = {{"qword ptr ", 8}, {"dword ptr ", 4}, {"byte ptr ", 1}};
+    for (const auto& width : widths) {
+        if (text.substr(0, width.first.size()) == width.first) {
+            operand.size = width.second;
+            text.remove_prefix(width.first.size());
+            break;
+        }
+    }
+    if (text.substr(0, 3) == "fs:") {
+        operand.fs = true;
+        text.remove_prefix(3);
+    }
+    if (!text.empty() && text.front() == '[') {
+        if (text.back() != ']') fail("unterminated memory operand");
+        operand.kind = Operand::Kind::MEMORY;
+        std::string_view inside = text.substr(1, text.size() - 2);
+        bool negative = false;
+        while (!inside.empty()) {
+            size_t next = inside.find_first_of("+-", 1);
+            std::string_view term = trim(inside.substr(0, next));
+            if (!term.empty() && (term.front() == '+' || term.front() == '-')) {
+                negative = term.front() == '-';
+                term = trim(term.substr(1));
+            }
+            inside.remove_prefix(next == std::string_view::npos ? inside.size() : next);
+            int64_t number = 0;
+            auto reg = registers().find(term);
+            if (term == "rip" && !negative && operand.reg < 0 && !operand.rip) {
+                operand.rip = true;
+            } else if (reg != registers().end() && reg->second.size == 8 && !negative && operand.reg < 0 && !operand.rip) {
+                operand.reg = reg->second.number;
+            } else if (parseInteger(term, number)) {
+                operand.value += negative ? -number : number;
+            } else if (symbols.count(std::string(term))) {
+                int64_t value = symbols.at(std::string(term));
+                operand.value += negative ? -value : value;
+            } else if (operand.rip && operand.label.empty() && !negative) {
+                operand.label = std::string(term);
+            } else {
+                fail("unsupported memory operand");
+            }
+            negative = false;
+        }
+        if (!fits32(operand.value) || (operand.rip && operand.label.empty()) || (operand.fs && operand.rip)) {
+            fail("unsupported memory operand");
+        }
+        return operand;
+    }
+    if (operand.size != 0 || operand.fs) fail("expected a memory operand");
+
+    auto reg = registers().find(text);
+    if (reg != registers().end()) {
+        operand.kind = Operand::Kind::REGISTER;
+        operand.reg = reg->second.number;
+        operand.size = reg->second.size;
+        return operand;
+    }
+    if (parseInteger(text, operand.value)) return operand;
+    if (text.empty()) fail("missing operand");
+    operand.kind = Operand::Kind::LABEL;
+    operand.label = std::string(text);
+    return operand;
+}
+
+void Assembler::immediate(int64_t value, int size) {
+    for (int b = 0; b < size; ++b) byte(static_cast<uint8_t>(static_cast<uint64_t>(value) >> (8 * b)));
+}
+
+void Assembler::rel32(const std::string& label) {
+    pending.push_back(fixups.size());
+    fixups.push_back(Fixup{bytes.size(), 0, label});
+    immediate(0, 4);
+}
+
+void Assembler::encode(int size, std::initializer_list<uint8_t> opcode, int reg, const Operand& rm) {
+    using Kind = Operand::Kind;
+    if (rm.kind == Kind::MEMORY && rm.fs) byte(0x64);
+    // sil, dil, spl and bpl exist only with a REX prefix; without one those
+    // encodings mean dh, bh, ah and ch
+    bool byteRegister = (rm.kind == Kind::REGISTER && rm.size == 1 && rm.reg >= 4) || (size == 1 && reg >= 4);
+    uint8_t rex = 0x40 | (size == 8 ? 0x08 : 0) | (reg >= 8 ? 0x04 : 0) | (rm.reg >= 8 ? 0x01 : 0);
+    if (rex != 0x40 || byteRegister) byte(rex);
+    for (uint8_t b : opcode) byte(b);
+
+    uint8_t field = static_cast<uint8_t>((reg & 7) << 3);
+    if (rm.kind == Kind::REGISTER) {
+        byte(0xC0 | field | (rm.reg & 7));
+        return;
+    }
+    if (rm.kind != Kind::MEMORY) fail("expected a register or memory operand");
+    if (rm.rip) {
+        byte(0x05 | field);
+        pending.push_back(fixups.size());
+        fixups.push_back(Fixup{bytes.size(), 0, rm.label});
+        immediate(0, 4);
+        // [rip+label+disp] moves the target, not the end
+        if (rm.value != 0) fail("unsupported memory operand");
+        return;
+    }
+    if (rm.reg < 0) {
+        byte(0x04 | field);
+        byte(0x25);  // SIB: no base, no index, disp32
+        immediate(rm.value, 4);
+        return;
+    }
+    int base = rm.reg & 7;
+    // rbp and r13 as a base always take a displacement; rsp and r12 need a SIB
+    int mod = rm.value == 0 && base != 5 ? 0 : fits8(rm.value) ? 1 : 2;
+    byte(static_cast<uint8_t>(mod << 6) | field | base);
+    if (base == 4) byte(0x24);
+    if (mod == 1) immediate(rm.value, 1);
+    if (mod == 2) immediate(rm.value, 4);
+}
+
+void Assembler::instruction(std::string_view mnemonic, const std::vector<Operand>& operands) {
+    using Kind = Operand::Kind;
+    auto count = [&](size_t expected) {
+        if (operands.size() != expected) fail("wrong number of operands");
+    };
+    auto isRm = [](const Operand& operand) { return operand.kind == Kind::REGISTER || operand.kind == Kind::MEMORY; };
+    // The width of a two-operand instruction: its registers, or the width
+    // its memory operand states
+    auto widthOf = [&](const Operand& destination, const Operand& source) {
+        int size = destination.size;
+        if (source.kind == Kind::REGISTER) {
+            if (destination.kind == Kind::REGISTER && destination.size != source.size) fail("operand sizes differ");
+            if (destination.kind == Kind::MEMORY && size != 0 && size != source.size) fail("operand sizes differ");
+            size = source.size;
+        }
+        if (size != 1 && size != 4 && size != 8) fail("unsupported operand size");
+        return size;
+    };
+    auto immediateOperand = [&](const Operand& operand, int size) {
+        if (size == 1) {
+            if (operand.value < INT8_MIN || operand.value > UINT8_MAX) fail("immediate out of range");
+            immediate(operand.value, 1);
+        } else {
+            if (size == 4 ? operand.value < INT32_MIN || operand.value > UINT32_MAX : !fits32(operand.value)) {
+                fail("immediate out of range");
+            }
+            immediate(operand.value, 4);
+        }
+    };
+
+    if (mnemonic == "ret" || mnemonic == "leave" || mnemonic == "cqo" || mnemonic == "nop") {
+        count(0);
+        if (mnemonic == "cqo") byte(0x48);
+        byte(mnemonic == "ret" ? 0xC3 : mnemonic == "leave" ? 0xC9 : mnemonic == "cqo" ? 0x99 : 0x90);
+        return;
+    }
+    if (mnemonic == "push" || mnemonic == "pop") {
+        count(1);
+        const Operand& reg = operands[0];
+        if (reg.kind != Kind::REGISTER || reg.size != 8) fail("expected a 64-bit register");
+        if (reg.reg >= 8) byte(0x41);
+        byte(static_cast<uint8_t>((mnemonic == "push" ? 0x50 : 0x58) + (reg.reg & 7)));
+        return;
+    }
+    if (mnemonic == "jmp" || mnemonic == "call") {
+        count(1);
+        bool jump = mnemonic == "jmp";
+        if (operands[0].kind == Kind::LABEL) {
+            byte(jump ? 0xE9 : 0xE8);
+            rel32(operands[0].label);
+        } else if (operands[0].kind == Kind::MEMORY && (operands[0].size == 0 || operands[0].size == 8)) {
+            encode(4, {0xFF}, jump ? 4 : 2, operands[0]);
+        } else {
+            fail("unsupported target");
+        }
+        return;
+    }
+    if (mnemonic.size() > 1 && mnemonic[0] == 'j') {
+        int condition = conditionCode(mnemonic.substr(1));
+        count(1);
+        if (condition < 0 || operands[0].kind != Kind::LABEL) fail("unsupported jump");
+        byte(0x0F);
+        byte(static_cast<uint8_t>(0x80 + condition));
+        rel32(operands[0].label);
+        return;
+    }
+    if (mnemonic.size() > 3 && mnemonic.substr(0, 3) == "set") {
+        int condition = conditionCode(mnemonic.substr(3));
+        count(1);
+        if (condition < 0 || !isRm(operands[0]) || (operands[0].size != 1 && operands[0].size != 0)) {
+            fail("unsupported setcc");
+        }
+        encode(1, {0x0F, static_cast<uint8_t>(0x90 + condition)}, 0, operands[0]);
+        return;
+    }
+
+    int code = arithmeticCode(mnemonic);
+    if (code >= 0) {
+        count(2);
+        const Operand& destination = operands[0];
+        const Operand& source = operands[1];
+        if (!isRm(destination)) fail("unsupported destination");
+        int size = widthOf(destination, source);
+        uint8_t base = static_cast<uint8_t>(code << 3);
+        if (source.kind == Kind::REGISTER) {
+            encode(size, {static_cast<uint8_t>(base | (size == 1 ? 0 : 1))}, source.reg, destination);
+        } else if (source.kind == Kind::MEMORY && destination.kind == Kind::REGISTER) {
+            encode(size, {static_cast<uint8_t>(base | (size == 1 ? 2 : 3))}, destination.reg, source);
+        } else if (source.kind == Kind::IMMEDIATE) {
+            if (size == 1) {
+                encode(1, {0x80}, code, destination);
+                immediateOperand(source, 1);
+            } else if (fits8(source.value)) {
+                encode(size, {0x83}, code, destination);
+                immediate(source.value, 1);
+            } else {
+                encode(size, {0x81}, code, destination);
+                immediateOperand(source, 4);
+            }
+        } else {
+            fail("unsupported operands");
+        }
+        return;
+    }
+    if (mnemonic == "mov") {
+        count(2);
+        const Operand& destination = operands[0];
+        const Operand& source = operands[1];
+        if (!isRm(destination)) fail("unsupported destination");
+        int size = widthOf(destination, source);
+        if (source.kind == Kind::REGISTER) {
+            encode(size, {static_cast<uint8_t>(size == 1 ? 0x88 : 0x89)}, source.reg, destination);
+        } else if (source.kind == Kind::MEMORY && destination.kind == Kind::REGISTER) {
+            encode(size, {static_cast<uint8_t>(size == 1 ? 0x8A : 0x8B)}, destination.reg, source);
+        } else if (source.kind == Kind::IMMEDIATE) {
+            if (size == 8 && destination.kind == Kind::REGISTER && !fits32(source.value)) {
+                // What GNU as turns it into: movabs
+                byte(static_cast<uint8_t>(0x48 | (destination.reg >= 8 ? 0x01 : 0)));
+                byte(static_cast<uint8_t>(0xB8 + (destination.reg & 7)));
+                immediate(source.value, 8);
+                return;
+            }
+            if (size == 4 && destination.kind == Kind::REGISTER) {
+                if (destination.reg >= 8) byte(0x41);
+                byte(static_cast<uint8_t>(0xB8 + (destination.reg & 7)));
+                immediateOperand(source, 4);
+                return;
+            }
+            encode(size, {static_cast<uint8_t>(size == 1 ? 0xC6 : 0xC7)}, 0, destination);
+            immediateOperand(source, size == 1 ? 1 : 4);
+        } else {
+            fail("unsupported operands");
+        }
+        return;
+    }
+    if (mnemonic == "movabs") {
+        count(2);
+        const Operand& destination = operands[0];
+        if (destination.kind != Kind::REGISTER || destination.size != 8 || operands[1].kind != Kind::IMMEDIATE) {
+            fail("unsupported operands");
+        }
+        byte(static_cast<uint8_t>(0x48 | (destination.reg >= 8 ? 0x01 : 0)));
+        byte(static_cast<uint8_t>(0xB8 + (destination.reg & 7)));
+        immediate(operands[1].value, 8);
+        return;
+    }
+    if (mnemonic == "movzx") {
+        count(2);
+        const Operand& destination = operands[0];
+        const Operand& source = operands[1];
+        if (destination.kind != Kind::REGISTER || destination.size == 1 || !isRm(source) ||
+            (source.size != 1 && !(source.kind == Kind::MEMORY && source.size == 0))) {
+            fail("unsupported operands");
+        }
+        encode(destination.size, {0x0F, 0xB6}, destination.reg, source);
+        return;
+    }
+    if (mnemonic == "test") {
+        count(2);
+        const Operand& destination = operands[0];
+        const Operand& source = operands[1];
+        if (!isRm(destination)) fail("unsupported destination");
+        int size = widthOf(destination, source);
+        if (source.kind == Kind::REGISTER) {
+            encode(size, {static_cast<uint8_t>(size == 1 ? 0x84 : 0x85)}, source.reg, destination);
+        } else if (source.kind == Kind::IMMEDIATE) {
+            encode(size, {static_cast<uint8_t>(size == 1 ? 0xF6 : 0xF7)}, 0, destination);
+            immediateOperand(source, size == 1 ? 1 : 4);
+        } else {
+            fail("unsupported operands");
+        }
+        return;
+    }
+    if (mnemonic == "imul") {
+        if (operands.size() < 2 || operands[0].kind != Kind::REGISTER || operands[0].size == 1 || !isRm(operands[1])) {
+            fail("unsupported operands");
+        }
+        int size = widthOf(operands[0], operands[1]);
+        if (operands.size() == 2) {
+            encode(size, {0x0F, 0xAF}, operands[0].reg, operands[1]);
+            return;
+        }
+        count(3);
+        if (operands[2].kind != Kind::IMMEDIATE) fail("unsupported operands");
+        if (fits8(operands[2].value)) {
+            encode(size, {0x6B}, operands[0].reg, operands[1]);
+            immediate(operands[2].value, 1);
+        } else {
+            encode(size, {0x69}, operands[0].reg, operands[1]);
+            immediateOperand(operands[2], 4);
+        }
+        return;
+    }
+    if (mnemonic == "neg" || mnemonic == "not" || mnemonic == "idiv") {
+        count(1);
+        const Operand& operand = operands[0];
+        if (!isRm(operand) || (operand.size != 1 && operand.size != 4 && operand.size != 8)) {
+            fail("unsupported operand");
+        }
+        int digit = mnemonic == "neg" ? 3 : mnemonic == "not" ? 2 : 7;
+        encode(operand.size, {static_cast<uint8_t>(operand.size == 1 ? 0xF6 : 0xF7)}, digit, operand);
+        return;
+    }
+    if (mnemonic == "lea") {
+        count(2);
+        if (operands[0].kind != Kind::REGISTER || operands[0].size != 8 || operands[1].kind != Kind::MEMORY) {
+            fail("unsupported operands");
+        }
+        encode(8, {0x8D}, operands[0].reg, operands[1]);
+        return;
+    }
+    fail("unknown instruction");
+}
@@ -0,0 +1,57 @@
+#include "../include/ast.h"
+
+AstArena::~AstArena() {
+    for (char* chunk : chunks) delete[] chunk;
+}
+
+void* AstArena::allocate(size_t size, size_t alignment) {
+    uintptr_t address = reinterpret_cast<uintptr_t>(cursor);
+    uintptr_t aligned = (address + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1);
+    if (!cursor || aligned + size > reinterpret_cast<uintptr_t>(limit)) {
+        // Oversized requests get a chunk of their own
+        size_t chunkSize = size + alignment > kChunkSize ? size + alignment : kChunkSize;
+        char* chunk = new char[chunkSize];
+        chunks.push_back(chunk);
+        cursor = chunk;
+        limit = chunk + chunkSize;
+        address = reinterpret_cast<uintptr_t>(cursor);
+        aligned = (address + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1);
+    }
+    cursor = reinterpret_cast<char*>(aligned + size);
+    used += size;
+    return reinterpret_cast<void*>(aligned);
+}
+
+Name NameTable::intern(std::string_view text) {
+    Name name;
+    auto found = ids.find(text);
+    if (found != ids.end()) {
+        name.id = found->second;
+    } else {
+        name.id = static_cast<uint32_t>(spellings.size());
+        spellings.emplace_back(text);
+        ids.emplace(spellings.back(), name.id);
+    }
+    name.spelling = &spellings[name.id];
+    return name;
+}
+
+std::string ASTNode::toString() const {
+    switch (kind) {
+        case NodeKind::BINARY: return static_cast<const BinaryExpr*>(this)->toString();
+        case NodeKind::UNARY: return static_cast<const UnaryExpr*>(this)->toString();
+        case NodeKind::LITERAL: return static_cast<const LiteralExpr*>(this)->toString();
+        case NodeKind::VARIABLE: return static_cast<const VariableExpr*>(this)->toString();
+        case NodeKind::CALL: return static_cast<const CallExpr*>(this)->toString();
+        case NodeKind::SEQUENCE: return static_cast<const SequenceExpr*>(this)->toString();
+        case NodeKind::BLOCK: return static_cast<const BlockStmt*>(this)->toString();
+        case NodeKind::DECLARATION: return static_cast<const DeclarationStmt*>(this)->toString();
+        case NodeKind::ASSIGNMENT: return static_cast<const AssignmentStmt*>(this)->toString();
+        case NodeKind::IF: return static_cast<const IfStmt*>(this)->toString();
+        case NodeKind::WHILE: return static_cast<const WhileStmt*>(this)->toString();
+        case NodeKind::RETURN: return static_cast<const ReturnStmt*>(this)->toString();
+        case NodeKind::EXPRESSION: return static_cast<const ExpressionStmt*>(this)->toString();
+        case NodeKind::FUNCTION: return static_cast<const FunctionDecl*>(this)->toString();
+    }
+    return "";
+}
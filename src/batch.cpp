@@ -0,0 +1,151 @@
+#include "../include/batch.h"
+#include "../include/codegen.h"
+#include "../include/compile_cache.h"
+#include "../include/constant_folder.h"
+#include "../include/mapped_file.h"
+#include "../include/parser.h"
+#include "../include/semantic.h"
+#include "../include/thread_pool.h"
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+BatchCompiler::BatchCompiler(Options options) : options(std::move(options)) {}
+
+size_t BatchCompiler::run(const std::vector<std::string>& inputs, std::ostream& diagnostics) {
+    // Made once up front, so that a bad path is one error rather than one
+    // per input
+    if (!options.checkOnly && !options.outputDirectory.empty()) {
+        std::error_code error;
+        std::filesystem::create_directories(options.outputDirectory, error);
+        if (error) {
+            diagnostics << "Error: Could not create output directory '" << options.outputDirectory
+                        << "': " << error.message() << "\n";
+            return inputs.size();
+        }
+    }
+
+    std::vector<Result> results(inputs.size());
+    ThreadPool pool(options.jobs);
+    pool.run(inputs.size(), [&](size_t, size_t index) {
+        try {
+            results[index] = compile(inputs[index]);
+        } catch (const std::exception& e) {
+            results[index].success = false;
+            results[index].diagnostics += inputs[index] + ": Unexpected error during compilation: " + e.what() + "\n";
+        }
+    });
+
+    size_t failures = 0;
+    for (const auto& result : results) {
+        diagnostics << result.diagnostics;
+        if (!result.success) ++failures;
+    }
+    return failures;
+}
+
+BatchCompiler::Result BatchCompiler::compile(const std::string& inputFile) const {
+    Result result;
+    std::ostringstream report;
+
+    MappedFile source;
+    if (!source.open(inputFile)) {
+        result.diagnostics = "Error: Could not open file '" + inputFile + "'\n";
+        return result;
+    }
+    if (source.text().empty()) {
+        result.diagnostics = inputFile + ": Error: Empty source\n";
+        return result;
+    }
+
+    Lexer lexer(source.text());
+    Parser parser(lexer);
+    std::unique_ptr<Program> program;
+    try {
+        program = parser.parse();
+    } catch (const LexicalError& e) {
+        result.diagnostics = inputFile + ": Lexical error: " + e.what() + "\n";
+        return result;
+    }
+    if (!program) {
+        result.diagnostics = inputFile + ": Parse Error: " + parser.error() + "\n";
+        return result;
+    }
+
+    SemanticAnalyzer semantic;
+    bool semanticSuccess = semantic.analyze(program.get());
+    for (const auto& warning : semantic.getWarnings()) report << inputFile << ": " << warning << "\n";
+    for (const auto& error : semantic.getErrors()) report << inputFile << ": " << error << "\n";
+    result.diagnostics = report.str();
+    if (!semanticSuccess || options.checkOnly) {
+        result.success = semanticSuccess;
+        return result;
+    }
+
+    if (options.optimizationLevel > 0) {
+        ConstantFolder folder;
+        folder.fold(program.get());
+    }
+    TacModule code;
+    if (!options.cacheDirectory.empty()) {
+        CompileCache cache(options.cacheDirectory);
+        code = cache.compile(program.get(), options.optimizationLevel, options.passOverrides);
+    } else {
+        CodeGenerator codegen;
+        code = codegen.generate(program.get());
+
+        Optimizer optimizer(code, options.optimizationLevel);
+        bool anyPass = false;
+        for (const auto& choice : options.passOverrides) {
+            optimizer.setPassEnabled(choice.first, choice.second);
+        }
+        for (size_t p = 0; p < static_cast<size_t>(Optimizer::Pass::COUNT); ++p) {
+            anyPass = anyPass || optimizer.isPassEnabled(static_cast<Optimizer::Pass>(p));
+        }
+        if (anyPass) code = optimizer.optimize();
+    }
+
+    std::string outputFile = listingPath(inputFile);
+    std::ofstream output(outputFile);
+    if (!output.is_open()) {
+        result.diagnostics += "Error: Could not create file '" + outputFile + "'\n";
+        return result;
+    }
+    writeListing(output, inputFile, code);
+    result.success = static_cast<bool>(output);
+    return result;
+}
+
+std::string BatchCompiler::listingPath(const std::string& inputFile) const {
+    size_t slash = inputFile.find_last_of("/\\");
+    size_t nameStart = slash == std::string::npos ? 0 : slash + 1;
+    size_t dot = inputFile.find_last_of('.');
+    size_t stemEnd = dot == std::string::npos || dot < nameStart ? inputFile.size() : dot;
+
+    std::string stem = inputFile.substr(nameStart, stemEnd - nameStart);
+    std::string directory = options.outputDirectory.empty() ? inputFile.substr(0, nameStart)
+                                                            : options.outputDirectory + "/";
+    return directory + stem + ".asm";
+}
+
+bool BatchCompiler::readManifest(const std::string& manifest, std::vector<std::string>& inputs) {
+    std::ifstream file(manifest);
+    if (!file.is_open()) return false;
+    std::string line;
+    while (std::getline(file, line)) {
+        size_t begin = line.find_first_not_of(" \t\r");
+        if (begin == std::string::npos || line[begin] == '#') continue;
+        size_t end = line.find_last_not_of(" \t\r");
+        inputs.push_back(line.substr(begin, end - begin + 1));
+    }
+    return true;
+}
+
+void BatchCompiler::writeListing(std::ostream& out, const std::string& inputFile, const TacModule& code) {
+    out << "; MathSeq Compiler Output" << std::endl;
+    out << "; Source: " << inputFile << std::endl;
+    out << "; =======================" << std::endl << std::endl;
+    for (const auto& instr : code.code) {
+        out << code.toString(instr) << std::endl;
+    }
+}
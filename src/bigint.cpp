@@ -0,0 +1,268 @@
+#include "../include/bigint.h"
+#include <algorithm>
+#include <cstdio>
+
+BigInt::BigInt(int64_t value) {
+    negative = value < 0;
+    // Two's complement negation in unsigned arithmetic, so INT64_MIN works
+    uint64_t magnitude = negative ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+    while (magnitude != 0) {
+        limbs.push_back(static_cast<uint32_t>(magnitude));
+        magnitude >>= 32;
+    }
+}
+
+BigInt BigInt::fromString(std::string_view digits) {
+    BigInt result;
+    bool negative = !digits.empty() && digits[0] == '-';
+    if (negative) digits.remove_prefix(1);
+    // Nine decimal digits at a time: multiply by 10^k and add the chunk
+    size_t first = digits.size() % 9 == 0 ? 9 : digits.size() % 9;
+    for (size_t at = 0; at < digits.size(); at = at == 0 ? first : at + 9) {
+        size_t length = at == 0 ? first : 9;
+        uint32_t chunk = 0;
+        uint32_t scale = 1;
+        for (size_t i = 0; i < length; ++i) {
+            chunk = chunk * 10 + static_cast<uint32_t>(digits[at + i] - '0');
+            scale *= 10;
+        }
+        uint64_t carry = chunk;
+        for (uint32_t& limb : result.limbs) {
+            carry += uint64_t(limb) * scale;
+            limb = static_cast<uint32_t>(carry);
+            carry >>= 32;
+        }
+        if (carry != 0) result.limbs.push_back(static_cast<uint32_t>(carry));
+    }
+    result.negative = negative;
+    result.trim();
+    return result;
+}
+
+void BigInt::trim() {
+    while (!limbs.empty() && limbs.back() == 0) limbs.pop_back();
+    if (limbs.empty()) negative = false;
+}
+
+bool BigInt::fitsInt64() const {
+    if (limbs.size() > 2) return false;
+    uint64_t magnitude = 0;
+    for (size_t i = limbs.size(); i-- > 0;) magnitude = (magnitude << 32) | limbs[i];
+    return negative ? magnitude <= (uint64_t(1) << 63) : magnitude < (uint64_t(1) << 63);
+}
+
+int64_t BigInt::toInt64() const {
+    uint64_t magnitude = 0;
+    for (size_t i = limbs.size(); i-- > 0;) magnitude = (magnitude << 32) | limbs[i];
+    return static_cast<int64_t>(negative ? 0 - magnitude : magnitude);
+}
+
+double BigInt::toDouble() const {
+    double result = 0.0;
+    for (size_t i = limbs.size(); i-- > 0;) result = result * 4294967296.0 + limbs[i];
+    return negative ? -result : result;
+}
+
+BigInt BigInt::negated() const {
+    BigInt result = *this;
+    if (!result.isZero()) result.negative = !negative;
+    return result;
+}
+
+int BigInt::compareMagnitude(const std::vector<uint32_t>& left, const std::vector<uint32_t>& right) {
+    if (left.size() != right.size()) return left.size() < right.size() ? -1 : 1;
+    for (size_t i = left.size(); i-- > 0;) {
+        if (left[i] != right[i]) return left[i] < right[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+std::vector<uint32_t> BigInt::addMagnitude(const std::vector<uint32_t>& left, const std::vector<uint32_t>& right) {
+    const std::vector<uint32_t>& longer = left.size() >= right.size() ? left : right;
+    const std::vector<uint32_t>& shorter = left.size() >= right.size() ? right : left;
+    std::vector<uint32_t> sum(longer.size() + 1);
+    uint64_t carry = 0;
+    for (size_t i = 0; i < longer.size(); ++i) {
+        carry += uint64_t(longer[i]) + (i < shorter.size() ? shorter[i] : 0);
+        sum[i] = static_cast<uint32_t>(carry);
+        carry >>= 32;
+    }
+    sum[longer.size()] = static_cast<uint32_t>(carry);
+    return sum;
+}
+
+std::vector<uint32_t> BigInt::subtractMagnitude(const std::vector<uint32_t>& left, const std::vector<uint32_t>& right) {
+    std::vector<uint32_t> difference(left.size());
+    int64_t borrow = 0;
+    for (size_t i = 0; i < left.size(); ++i) {
+        int64_t digit = int64_t(left[i]) - (i < right.size() ? right[i] : 0) - borrow;
+        borrow = digit < 0 ? 1 : 0;
+        difference[i] = static_cast<uint32_t>(digit + (borrow << 32));
+    }
+    return difference;
+}
+
+BigInt BigInt::add(const BigInt& left, const BigInt& right) {
+    BigInt result;
+    if (left.negative == right.negative) {
+        result.limbs = addMagnitude(left.limbs, right.limbs);
+        result.negative = left.negative;
+    } else if (compareMagnitude(left.limbs, right.limbs) >= 0) {
+        result.limbs = subtractMagnitude(left.limbs, right.limbs);
+        result.negative = left.negative;
+    } else {
+        result.limbs = subtractMagnitude(right.limbs, left.limbs);
+        result.negative = right.negative;
+    }
+    result.trim();
+    return result;
+}
+
+BigInt BigInt::subtract(const BigInt& left, const BigInt& right) {
+    return add(left, right.negated());
+}
+
+BigInt BigInt::multiply(const BigInt& left, const BigInt& right) {
+    BigInt result;
+    if (left.isZero() || right.isZero()) return result;
+    result.limbs.assign(left.limbs.size() + right.limbs.size(), 0);
+    for (size_t i = 0; i < left.limbs.size(); ++i) {
+        uint64_t carry = 0;
+        for (size_t j = 0; j < right.limbs.size(); ++j) {
+            carry += uint64_t(left.limbs[i]) * right.limbs[j] + result.limbs[i + j];
+            result.limbs[i + j] = static_cast<uint32_t>(carry);
+            carry >>= 32;
+        }
+        result.limbs[i + right.limbs.size()] = static_cast<uint32_t>(carry);
+    }
+    result.negative = left.negative != right.negative;
+    result.trim();
+    return result;
+}
+
+void BigInt::divide(const BigInt& left, const BigInt& right, BigInt& quotient, BigInt& remainder) {
+    BigInt q;
+    BigInt r;
+    if (compareMagnitude(left.limbs, right.limbs) < 0) {
+        r = left;
+    } else if (right.limbs.size() == 1) {
+        uint64_t divisor = right.limbs[0];
+        uint64_t rest = 0;
+        q.limbs.resize(left.limbs.size());
+        for (size_t i = left.limbs.size(); i-- > 0;) {
+            uint64_t current = (rest << 32) | left.limbs[i];
+            q.limbs[i] = static_cast<uint32_t>(current / divisor);
+            rest = current % divisor;
+        }
+        r.limbs.push_back(static_cast<uint32_t>(rest));
+    } else {
+        // Knuth's algorithm D: normalize so the divisor's top limb has its
+        // high bit set, then estimate each quotient limb from the top two
+        // limbs of the running remainder
+        const std::vector<uint32_t>& u = left.limbs;
+        const std::vector<uint32_t>& v = right.limbs;
+        size_t m = u.size();
+        size_t n = v.size();
+        int shift = __builtin_clz(v[n - 1]);
+        std::vector<uint32_t> vn(n);
+        std::vector<uint32_t> un(m + 1);
+        for (size_t i = n; i-- > 0;) {
+            uint64_t wide = (uint64_t(v[i]) << 32 | (i > 0 ? v[i - 1] : 0)) << shift;
+            vn[i] = static_cast<uint32_t>(wide >> 32);
+        }
+        un[m] = static_cast<uint32_t>((uint64_t(u[m - 1]) << shift) >> 32);
+        for (size_t i = m; i-- > 0;) {
+            uint64_t wide = (uint64_t(u[i]) << 32 | (i > 0 ? u[i - 1] : 0)) << shift;
+            un[i] = static_cast<uint32_t>(wide >> 32);
+        }
+
+        const uint64_t base = uint64_t(1) << 32;
+        q.limbs.assign(m - n + 1, 0);
+        for (size_t j = m - n + 1; j-- > 0;) {
+            uint64_t numerator = uint64_t(un[j + n]) << 32 | un[j + n - 1];
+            uint64_t qhat = numerator / vn[n - 1];
+            uint64_t rhat = numerator % vn[n - 1];
+            while (qhat >= base || qhat * vn[n - 2] > (rhat << 32 | un[j + n - 2])) {
+                --qhat;
+                rhat += vn[n - 1];
+                if (rhat >= base) break;
+            }
+
+            int64_t borrow = 0;
+            int64_t t = 0;
+            for (size_t i = 0; i < n; ++i) {
+                uint64_t product = qhat * vn[i];
+                t = int64_t(un[i + j]) - borrow - int64_t(product & 0xFFFFFFFFu);
+                un[i + j] = static_cast<uint32_t>(t);
+                borrow = int64_t(product >> 32) - (t >> 32);
+            }
+            t = int64_t(un[j + n]) - borrow;
+            un[j + n] = static_cast<uint32_t>(t);
+
+            q.limbs[j] = static_cast<uint32_t>(qhat);
+            if (t < 0) {
+                // The estimate was one too large: add the divisor back
+                --q.limbs[j];
+                uint64_t carry = 0;
+                for (size_t i = 0; i < n; ++i) {
+                    carry += uint64_t(un[i + j]) + vn[i];
+                    un[i + j] = static_cast<uint32_t>(carry);
+                    carry >>= 32;
+                }
+                un[j + n] = static_cast<uint32_t>(un[j + n] + carry);
+            }
+        }
+
+        r.limbs.resize(n);
+        for (size_t i = 0; i < n; ++i) {
+            uint64_t wide = (uint64_t(un[i + 1]) << 32 | un[i]) >> shift;
+            r.limbs[i] = static_cast<uint32_t>(wide);
+        }
+    }
+    q.negative = left.negative != right.negative;
+    r.negative = left.negative;
+    q.trim();
+    r.trim();
+    quotient = std::move(q);
+    remainder = std::move(r);
+}
+
+int BigInt::compare(const BigInt& left, const BigInt& right) {
+    if (left.negative != right.negative) return left.negative ? -1 : 1;
+    int magnitude = compareMagnitude(left.limbs, right.limbs);
+    return left.negative ? -magnitude : magnitude;
+}
+
+std::string BigInt::toString() const {
+    std::string result;
+    appendTo(result);
+    return result;
+}
+
+void BigInt::appendTo(std::string& out) const {
+    if (isZero()) {
+        out += '0';
+        return;
+    }
+    // Peel off nine decimal digits at a time, lowest first
+    std::vector<uint32_t> rest = limbs;
+    std::vector<uint32_t> chunks;
+    while (!rest.empty()) {
+        uint64_t remainder = 0;
+        for (size_t i = rest.size(); i-- > 0;) {
+            uint64_t current = (remainder << 32) | rest[i];
+            rest[i] = static_cast<uint32_t>(current / 1000000000u);
+            remainder = current % 1000000000u;
+        }
+        chunks.push_back(static_cast<uint32_t>(remainder));
+        while (!rest.empty() && rest.back() == 0) rest.pop_back();
+    }
+    if (negative) out += '-';
+    char digits[16];
+    int length = std::snprintf(digits, sizeof(digits), "%u", chunks.back());
+    out.append(digits, static_cast<size_t>(length));
+    for (size_t i = chunks.size() - 1; i-- > 0;) {
+        length = std::snprintf(digits, sizeof(digits), "%09u", chunks[i]);
+        out.append(digits, static_cast<size_t>(length));
+    }
+}
@@ -0,0 +1,1091 @@
+#include "../include/builtins.h"
+#include "../include/kernels.h"
+#include "../include/mapped_file.h"
+#include "../include/operators.h"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace {
+    using Kind = RuntimeValue::Kind;
+    using StageKind = LazySequence::StageKind;
+
+    bool isSequence(const RuntimeValue& value) {
+        return value.kind() == Kind::SEQUENCE || value.kind() == Kind::LAZY;
+    }
+
+    bool isScalar(const RuntimeValue& value) {
+        return value.kind() == Kind::INT || value.kind() == Kind::FLOAT || value.kind() == Kind::BOOL;
+    }
+
+    // One register of an inline callback over a block: INT and BOOL (as
+    // 0/1) are held in `ints`, FLOAT in `floats`
+    enum class ColumnKind : uint8_t { NONE, INT, FLOAT, BOOL };
+
+    struct Column {
+        ColumnKind kind = ColumnKind::NONE;
+        std::vector<int64_t> ints;
+        std::vector<double> floats;
+    };
+
+    using Op = InlineCallback::Op;
+
+    // Thrown when an inline step's int result leaves 64 bits; the pipeline
+    // then runs its callbacks the ordinary way, which promotes to BigInt
+    struct InlineOverflow {};
+
+    // No element of data is further than this from zero
+    uint64_t magnitudeBound(const int64_t* data, size_t n) {
+        if (n == 0) return 0;
+        int64_t low = Kernels::minInt(data, n);
+        int64_t high = Kernels::maxInt(data, n);
+        // Negated in unsigned arithmetic, so INT64_MIN gives 2^63
+        uint64_t below = low < 0 ? 0 - static_cast<uint64_t>(low) : 0;
+        uint64_t above = high > 0 ? static_cast<uint64_t>(high) : 0;
+        return std::max(below, above);
+    }
+
+    // The kind an operator yields for these operand kinds, or NONE where
+    // the VM would raise or compare printed forms
+    ColumnKind resultKind(Op op, ColumnKind left, ColumnKind right) {
+        bool anyFloat = left == ColumnKind::FLOAT || right == ColumnKind::FLOAT;
+        switch (op) {
+            case Op::MOVE:
+                return left;
+            case Op::ADD:
+            case Op::SUB:
+            case Op::MUL:
+            case Op::DIV:
+                return anyFloat ? ColumnKind::FLOAT : ColumnKind::INT;
+            case Op::MOD:
+                return ColumnKind::INT;
+            case Op::EQ:
+            case Op::NE:
+                return left == right && left != ColumnKind::FLOAT ? ColumnKind::BOOL : ColumnKind::NONE;
+            case Op::NEG:
+                return left == ColumnKind::BOOL ? ColumnKind::NONE : left;
+            default:
+                return ColumnKind::BOOL;
+        }
+    }
+
+    ColumnKind columnKind(const RuntimeValue& value) {
+        switch (value.kind()) {
+            case Kind::INT: return ColumnKind::INT;
+            case Kind::FLOAT: return ColumnKind::FLOAT;
+            case Kind::BOOL: return ColumnKind::BOOL;
+            default: return ColumnKind::NONE;
+        }
+    }
+
+    // Runs a chain of inline callbacks over blocks of an unboxed sequence
+    class InlinePipeline {
+    public:
+        InlinePipeline(const LazySequence& lazy, const std::vector<const InlineCallback*>& callbacks)
+            : lazy(lazy), callbacks(callbacks) {}
+
+        // Types every step ahead of time; false if any would leave the
+        // operators this class implements
+        bool check(ColumnKind source, ColumnKind& result) const {
+            ColumnKind current = source;
+            for (size_t s = 0; s < callbacks.size(); ++s) {
+                const InlineCallback& callback = *callbacks[s];
+                std::vector<ColumnKind> kinds(callback.registers, ColumnKind::NONE);
+                kinds[0] = current;
+                auto kindOf = [&](uint32_t operand) {
+                    return (operand & InlineCallback::kConstantBit)
+                               ? columnKind(callback.constants[operand & ~InlineCallback::kConstantBit])
+                               : kinds[operand];
+                };
+                for (const auto& step : callback.steps) {
+                    bool unary = step.op == Op::MOVE || step.op == Op::NEG || step.op == Op::NOT;
+                    ColumnKind left = kindOf(step.left);
+                    ColumnKind right = unary ? left : kindOf(step.right);
+                    if (left == ColumnKind::NONE || right == ColumnKind::NONE) return false;
+                    kinds[step.result] = resultKind(step.op, left, right);
+                    if (kinds[step.result] == ColumnKind::NONE) return false;
+                }
+                ColumnKind returned = kindOf(callback.result);
+                if (returned == ColumnKind::NONE) return false;
+                if (lazy.stages[s].kind == StageKind::MAP) current = returned;
+            }
+            result = current;
+            return true;
+        }
+
+        // Appends the pipeline's output for source elements [begin, end)
+        void run(const RuntimeValue& source, size_t begin, size_t end, Column& out) {
+            bool isFloat = source.sequenceLayout() == RuntimeValue::SequenceLayout::FLOAT64;
+            for (size_t block = begin; block < end; block += Builtins::kInlineBlock) {
+                size_t n = std::min(end - block, Builtins::kInlineBlock);
+                Column current;
+                if (isFloat) {
+                    current.kind = ColumnKind::FLOAT;
+                    const double* data = source.floatElements().data() + block;
+                    current.floats.assign(data, data + n);
+                } else {
+                    current.kind = ColumnKind::INT;
+                    const int64_t* data = source.intElements().data() + block;
+                    current.ints.assign(data, data + n);
+                }
+                for (size_t s = 0; s < callbacks.size() && n > 0; ++s) {
+                    n = runStage(s, current, n);
+                }
+                if (current.kind == ColumnKind::FLOAT) {
+                    out.floats.insert(out.floats.end(), current.floats.begin(), current.floats.begin() + n);
+                } else {
+                    out.ints.insert(out.ints.end(), current.ints.begin(), current.ints.begin() + n);
+                }
+            }
+        }
+
+    private:
+        const LazySequence& lazy;
+        const std::vector<const InlineCallback*>& callbacks;
+        std::vector<Column> registers;
+        std::vector<Column> constants;
+        std::vector<double> leftFloats, rightFloats;
+
+        // Runs stage s over the first n elements of `current`, leaving its
+        // output there; returns how many elements remain
+        size_t runStage(size_t s, Column& current, size_t n) {
+            const InlineCallback& callback = *callbacks[s];
+            registers.assign(callback.registers, Column());
+            constants.assign(callback.constants.size(), Column());
+            for (size_t c = 0; c < callback.constants.size(); ++c) {
+                const RuntimeValue& value = callback.constants[c];
+                constants[c].kind = columnKind(value);
+                if (value.kind() == Kind::FLOAT) {
+                    constants[c].floats.assign(n, value.floatValue());
+                } else {
+                    constants[c].ints.assign(n, value.kind() == Kind::BOOL ? value.boolValue() : value.intValue());
+                }
+            }
+
+            bool isFilter = lazy.stages[s].kind == StageKind::FILTER;
+            registers[0] = current;
+            for (const auto& step : callback.steps) {
+                execute(step, n);
+            }
+            const Column& returned = operand(callback.result);
+            if (!isFilter) {
+                current = returned;
+                return n;
+            }
+
+            std::vector<bool> keep(n);
+            if (returned.kind == ColumnKind::FLOAT) {
+                for (size_t i = 0; i < n; ++i) keep[i] = returned.floats[i] != 0.0;
+            } else {
+                for (size_t i = 0; i < n; ++i) keep[i] = returned.ints[i] != 0;
+            }
+            size_t kept = 0;
+            for (size_t i = 0; i < n; ++i) {
+                if (!keep[i]) continue;
+                if (current.kind == ColumnKind::FLOAT) {
+                    current.floats[kept] = current.floats[i];
+                } else {
+                    current.ints[kept] = current.ints[i];
+                }
+                ++kept;
+            }
+            return kept;
+        }
+
+        const Column& operand(uint32_t operand) const {
+            return (operand & InlineCallback::kConstantBit) ? constants[operand & ~InlineCallback::kConstantBit]
+                                                             : registers[operand];
+        }
+
+        // The column as doubles, converting through `scratch` unless it
+        // already holds them
+        static const double* floatsOf(const Column& column, size_t n, std::vector<double>& scratch) {
+            if (column.kind == ColumnKind::FLOAT) return column.floats.data();
+            scratch.resize(n);
+            for (size_t i = 0; i < n; ++i) scratch[i] = static_cast<double>(column.ints[i]);
+            return scratch.data();
+        }
+
+        static bool truthy(const Column& column, size_t i) {
+            return column.kind == ColumnKind::FLOAT ? column.floats[i] != 0.0 : column.ints[i] != 0;
+        }
+
+        void execute(const InlineCallback::Step& step, size_t n) {
+            const Column& left = operand(step.left);
+            bool unary = step.op == Op::MOVE || step.op == Op::NEG || step.op == Op::NOT;
+            const Column& right = unary ? left : operand(step.right);
+            Column result;
+            result.kind = resultKind(step.op, left.kind, right.kind);
+            if (result.kind == ColumnKind::FLOAT) {
+                result.floats.resize(n);
+            } else {
+                result.ints.resize(n);
+            }
+            double* f = result.floats.data();
+            int64_t* r = result.ints.data();
+            bool overflow = false;
+
+            switch (step.op) {
+                case Op::MOVE:
+                    result = left;
+                    break;
+                case Op::ADD:
+                case Op::SUB:
+                case Op::MUL:
+                case Op::DIV: {
+                    if (result.kind == ColumnKind::FLOAT) {
+                        const double* a = floatsOf(left, n, leftFloats);
+                        const double* b = floatsOf(right, n, rightFloats);
+                        switch (step.op) {
+                            case Op::ADD: for (size_t i = 0; i < n; ++i) f[i] = a[i] + b[i]; break;
+                            case Op::SUB: for (size_t i = 0; i < n; ++i) f[i] = a[i] - b[i]; break;
+                            case Op::MUL: for (size_t i = 0; i < n; ++i) f[i] = a[i] * b[i]; break;
+                            default: for (size_t i = 0; i < n; ++i) f[i] = a[i] / b[i]; break;
+                        }
+                        break;
+                    }
+                    const int64_t* a = left.ints.data();
+                    const int64_t* b = right.ints.data();
+                    switch (step.op) {
+                        case Op::ADD:
+                            for (size_t i = 0; i < n; ++i) overflow |= __builtin_add_overflow(a[i], b[i], &r[i]);
+                            break;
+                        case Op::SUB:
+                            for (size_t i = 0; i < n; ++i) overflow |= __builtin_sub_overflow(a[i], b[i], &r[i]);
+                            break;
+                        case Op::MUL:
+                            for (size_t i = 0; i < n; ++i) overflow |= __builtin_mul_overflow(a[i], b[i], &r[i]);
+                            break;
+                        default:
+                            for (size_t i = 0; i < n; ++i) {
+                                if (b[i] == 0) throw std::runtime_error("Runtime error: division by zero");
+                                if (b[i] == -1) {
+                                    overflow |= __builtin_sub_overflow(int64_t(0), a[i], &r[i]);
+                                } else {
+                                    r[i] = a[i] / b[i];
+                                }
+                            }
+                            break;
+                    }
+                    break;
+                }
+                case Op::MOD: {
+                    // asInt truncates floats
+                    auto value = [](const Column& column, size_t i) -> int64_t {
+                        return column.kind == ColumnKind::FLOAT ? static_cast<int64_t>(column.floats[i]) : column.ints[i];
+                    };
+                    for (size_t i = 0; i < n; ++i) {
+                        int64_t b = value(right, i);
+                        if (b == 0) throw std::runtime_error("Runtime error: division by zero");
+                        r[i] = b == -1 ? 0 : value(left, i) % b;
+                    }
+                    break;
+                }
+                case Op::EQ:
+                    for (size_t i = 0; i < n; ++i) r[i] = left.ints[i] == right.ints[i];
+                    break;
+                case Op::NE:
+                    for (size_t i = 0; i < n; ++i) r[i] = left.ints[i] != right.ints[i];
+                    break;
+                case Op::LT:
+                case Op::LE:
+                case Op::GT:
+                case Op::GE: {
+                    if (left.kind == ColumnKind::INT && right.kind == ColumnKind::INT) {
+                        const int64_t* a = left.ints.data();
+                        const int64_t* b = right.ints.data();
+                        switch (step.op) {
+                            case Op::LT: for (size_t i = 0; i < n; ++i) r[i] = a[i] < b[i]; break;
+                            case Op::LE: for (size_t i = 0; i < n; ++i) r[i] = a[i] <= b[i]; break;
+                            case Op::GT: for (size_t i = 0; i < n; ++i) r[i] = a[i] > b[i]; break;
+                            default: for (size_t i = 0; i < n; ++i) r[i] = a[i] >= b[i]; break;
+                        }
+                        break;
+                    }
+                    const double* a = floatsOf(left, n, leftFloats);
+                    const double* b = floatsOf(right, n, rightFloats);
+                    switch (step.op) {
+                        case Op::LT: for (size_t i = 0; i < n; ++i) r[i] = a[i] < b[i]; break;
+                        case Op::LE: for (size_t i = 0; i < n; ++i) r[i] = a[i] <= b[i]; break;
+                        case Op::GT: for (size_t i = 0; i < n; ++i) r[i] = a[i] > b[i]; break;
+                        default: for (size_t i = 0; i < n; ++i) r[i] = a[i] >= b[i]; break;
+                    }
+                    break;
+                }
+                case Op::AND:
+                    for (size_t i = 0; i < n; ++i) r[i] = truthy(left, i) && truthy(right, i);
+                    break;
+                case Op::OR:
+                    for (size_t i = 0; i < n; ++i) r[i] = truthy(left, i) || truthy(right, i);
+                    break;
+                case Op::NEG:
+                    if (result.kind == ColumnKind::FLOAT) {
+                        for (size_t i = 0; i < n; ++i) f[i] = -left.floats[i];
+                    } else {
+                        for (size_t i = 0; i < n; ++i) overflow |= __builtin_sub_overflow(int64_t(0), left.ints[i], &r[i]);
+                    }
+                    break;
+                case Op::NOT:
+                    for (size_t i = 0; i < n; ++i) r[i] = !truthy(left, i);
+                    break;
+            }
+            if (overflow) throw InlineOverflow();
+            registers[step.result] = std::move(result);
+        }
+    };
+}
+
+template <typename Sink>
+void Builtins::stream(const LazySequence& lazy, Sink&& sink) {
+    auto emit = [&](RuntimeValue value) -> bool {
+        for (const auto& stage : lazy.stages) {
+            if (stage.kind == StageKind::MAP) {
+                value = invoker.invoke(stage.function, value);
+            } else if (!invoker.invoke(stage.function, value).asBool()) {
+                return true;  // Dropped; keep going
+            }
+        }
+        return sink(std::move(value));
+    };
+
+    if (lazy.generated) {
+        RuntimeValue current = lazy.source;
+        for (long long i = 0; i < lazy.count; ++i) {
+            // The next term is only computed once it is actually wanted
+            if (i > 0) current = invoker.invoke(lazy.stepFunction, current);
+            if (!emit(current)) return;
+        }
+        return;
+    }
+
+    // Hold our own reference: callbacks cannot free the source under us
+    RuntimeValue source = lazy.source;
+    for (size_t i = 0; i < source.sequenceSize(); ++i) {
+        if (!emit(source.sequenceAt(i))) return;
+    }
+}
+
+const RuntimeValue& Builtins::materialize(const LazySequence& lazy) {
+    if (lazy.materialized.kind() == Kind::SEQUENCE) {
+        return lazy.materialized;
+    }
+
+    if (materializeInline(lazy)) {
+        return lazy.materialized;
+    }
+
+    std::vector<RuntimeValue> elements;
+    if (materializeInParallel(lazy, elements)) {
+        lazy.materialized = RuntimeValue::FromSequence(std::move(elements));
+        return lazy.materialized;
+    }
+
+    if (!lazy.hasFilter()) {
+        elements.reserve(static_cast<size_t>(lazy.generated ? std::max(lazy.count, 0LL)
+                                                            : static_cast<long long>(lazy.source.sequenceSize())));
+    }
+    stream(lazy, [&](RuntimeValue value) {
+        // Elements of the result are strict too, so it can be compared
+        // and printed like any other sequence
+        elements.push_back(value.kind() == Kind::LAZY ? strict(value) : std::move(value));
+        return true;
+    });
+    lazy.materialized = RuntimeValue::FromSequence(std::move(elements));
+    return lazy.materialized;
+}
+
+void Builtins::applyStages(const LazySequence& lazy, FunctionInvoker& target, const RuntimeValue& source,
+                           size_t begin, size_t end, std::vector<RuntimeValue>& out) {
+    for (size_t i = begin; i < end; ++i) {
+        RuntimeValue value = source.sequenceAt(i);
+        bool keep = true;
+        for (const auto& stage : lazy.stages) {
+            if (stage.kind == StageKind::MAP) {
+                value = target.invoke(stage.function, value);
+            } else if (!target.invoke(stage.function, value).asBool()) {
+                keep = false;
+                break;
+            }
+        }
+        if (keep) out.push_back(std::move(value));
+    }
+}
+
+bool Builtins::materializeInParallel(const LazySequence& lazy, std::vector<RuntimeValue>& elements) {
+    if (!pool || pool->size() < 2 || inParallelRun || lazy.stages.empty()) return false;
+    if (lazy.generated ? lazy.count < static_cast<long long>(kParallelThreshold)
+                       : lazy.source.sequenceSize() < kParallelThreshold) {
+        return false;
+    }
+    for (const auto& stage : lazy.stages) {
+        if (!invoker.isParallelSafe(stage.function)) return false;
+    }
+
+    // Each step depends on the previous term, so a generated source is
+    // produced serially; only the stages run in parallel
+    RuntimeValue source = lazy.source;
+    if (lazy.generated) {
+        if (!isScalar(source)) return false;
+        std::vector<RuntimeValue> terms;
+        terms.reserve(static_cast<size_t>(lazy.count));
+        terms.push_back(source);
+        for (long long i = 1; i < lazy.count; ++i) {
+            terms.push_back(invoker.invoke(lazy.stepFunction, terms.back()));
+        }
+        source = RuntimeValue::FromSequence(std::move(terms));
+    }
+
+    // Scalars carry no reference count, so workers can read them freely.
+    // Unboxed sequences hold nothing else, and sequenceAt never writes.
+    const size_t total = source.sequenceSize();
+    if (source.sequenceLayout() == RuntimeValue::SequenceLayout::BOXED) {
+        for (const auto& element : source.sequenceValue()) {
+            if (!isScalar(element)) return false;
+        }
+    }
+
+    while (workers.size() < pool->size()) {
+        workers.push_back(workers.empty() ? nullptr : invoker.fork());
+        if (workers.size() > 1 && !workers.back()) {
+            workers.clear();
+            return false;
+        }
+    }
+
+    // Several chunks per worker so that stealing can even out slow ones
+    size_t grain = std::max<size_t>(1024, total / (pool->size() * 8));
+    size_t chunks = (total + grain - 1) / grain;
+    std::vector<std::vector<RuntimeValue>> results(chunks);
+    std::vector<std::exception_ptr> errors(chunks);
+
+    inParallelRun = true;
+    pool->run(chunks, [&](size_t worker, size_t chunk) {
+        FunctionInvoker& target = worker == 0 ? invoker : *workers[worker];
+        size_t begin = chunk * grain;
+        size_t end = std::min(total, begin + grain);
+        try {
+            results[chunk].reserve(end - begin);
+            applyStages(lazy, target, source, begin, end, results[chunk]);
+        } catch (...) {
+            errors[chunk] = std::current_exception();
+        }
+    });
+    inParallelRun = false;
+
+    // Report the error a serial run would have hit first
+    for (const auto& error : errors) {
+        if (error) std::rethrow_exception(error);
+    }
+
+    size_t kept = 0;
+    for (const auto& chunk : results) kept += chunk.size();
+    elements.reserve(kept);
+    for (auto& chunk : results) {
+        for (auto& value : chunk) {
+            elements.push_back(value.kind() == Kind::LAZY ? strict(value) : std::move(value));
+        }
+    }
+    return true;
+}
+
+bool Builtins::inlineStages(const LazySequence& lazy, std::vector<const InlineCallback*>& callbacks) const {
+    if (lazy.generated || lazy.stages.empty()) return false;
+    RuntimeValue::SequenceLayout layout = lazy.source.sequenceLayout();
+    if (layout != RuntimeValue::SequenceLayout::INT64 && layout != RuntimeValue::SequenceLayout::FLOAT64) return false;
+    callbacks.clear();
+    for (const auto& stage : lazy.stages) {
+        const InlineCallback* callback = invoker.inlineCallback(stage.function);
+        if (!callback) return false;
+        callbacks.push_back(callback);
+    }
+    ColumnKind result = ColumnKind::NONE;
+    ColumnKind source = layout == RuntimeValue::SequenceLayout::FLOAT64 ? ColumnKind::FLOAT : ColumnKind::INT;
+    return InlinePipeline(lazy, callbacks).check(source, result);
+}
+
+bool Builtins::materializeInline(const LazySequence& lazy) {
+    std::vector<const InlineCallback*> callbacks;
+    if (!inlineStages(lazy, callbacks)) return false;
+    ColumnKind resultKind = ColumnKind::NONE;
+    ColumnKind sourceKind = lazy.source.sequenceLayout() == RuntimeValue::SequenceLayout::FLOAT64 ? ColumnKind::FLOAT
+                                                                                                   : ColumnKind::INT;
+    InlinePipeline(lazy, callbacks).check(sourceKind, resultKind);
+
+    // The steps touch no reference counts, so chunks of a large source
+    // can run on the pool like any parallel-safe pipeline
+    const RuntimeValue& source = lazy.source;
+    const size_t total = source.sequenceSize();
+    Column out;
+    try {
+        if (pool && pool->size() > 1 && !inParallelRun && total >= kParallelThreshold) {
+            size_t grain = std::max<size_t>(kInlineBlock * 4, total / (pool->size() * 8));
+            size_t chunks = (total + grain - 1) / grain;
+            std::vector<Column> results(chunks);
+            std::vector<std::exception_ptr> errors(chunks);
+            pool->run(chunks, [&](size_t, size_t chunk) {
+                size_t begin = chunk * grain;
+                try {
+                    InlinePipeline(lazy, callbacks).run(source, begin, std::min(total, begin + grain), results[chunk]);
+                } catch (...) {
+                    errors[chunk] = std::current_exception();
+                }
+            });
+            for (const auto& error : errors) {
+                if (error) std::rethrow_exception(error);
+            }
+            for (const auto& chunk : results) {
+                out.ints.insert(out.ints.end(), chunk.ints.begin(), chunk.ints.end());
+                out.floats.insert(out.floats.end(), chunk.floats.begin(), chunk.floats.end());
+            }
+        } else {
+            InlinePipeline(lazy, callbacks).run(source, 0, total, out);
+        }
+    } catch (const InlineOverflow&) {
+        return false;
+    }
+
+    if (out.ints.empty() && out.floats.empty()) {
+        lazy.materialized = RuntimeValue::FromSequence({});
+    } else if (resultKind == ColumnKind::FLOAT) {
+        lazy.materialized = RuntimeValue::FromFloats(std::move(out.floats));
+    } else if (resultKind == ColumnKind::INT) {
+        lazy.materialized = RuntimeValue::FromInts(std::move(out.ints));
+    } else {
+        std::vector<RuntimeValue> elements;
+        elements.reserve(out.ints.size());
+        for (int64_t value : out.ints) elements.push_back(RuntimeValue::FromBool(value != 0));
+        lazy.materialized = RuntimeValue::FromSequence(std::move(elements));
+    }
+    return true;
+}
+
+RuntimeValue Builtins::addStage(const RuntimeValue& sequence, StageKind kind, uint32_t function) {
+    auto* lazy = new LazySequence();
+    if (sequence.kind() == Kind::LAZY && sequence.lazyValue().materialized.kind() != Kind::SEQUENCE) {
+        // Fuse with the existing pipeline instead of building its output
+        const LazySequence& inner = sequence.lazyValue();
+        lazy->source = inner.source;
+        lazy->generated = inner.generated;
+        lazy->stepFunction = inner.stepFunction;
+        lazy->count = inner.count;
+        lazy->stages = inner.stages;
+    } else {
+        lazy->source = strict(sequence);
+    }
+    lazy->stages.push_back(LazySequence::Stage{kind, function});
+    return RuntimeValue::FromLazy(lazy);
+}
+
+RuntimeValue Builtins::length(const RuntimeValue& sequence) {
+    if (sequence.kind() == Kind::SEQUENCE) {
+        return RuntimeValue::FromInt(static_cast<long long>(sequence.sequenceSize()));
+    }
+    if (sequence.kind() != Kind::LAZY) {
+        throw std::runtime_error("Runtime error: length expects a sequence");
+    }
+
+    // Without a filter the length is known up front
+    const LazySequence& lazy = sequence.lazyValue();
+    if (!lazy.hasFilter() && lazy.materialized.kind() != Kind::SEQUENCE) {
+        if (lazy.generated) {
+            return RuntimeValue::FromInt(std::max(lazy.count, 0LL));
+        }
+        return RuntimeValue::FromInt(static_cast<long long>(lazy.source.sequenceSize()));
+    }
+    return RuntimeValue::FromInt(static_cast<long long>(materialize(lazy).sequenceSize()));
+}
+
+RuntimeValue Builtins::get(const RuntimeValue& sequence, const RuntimeValue& index) {
+    if (!isSequence(sequence)) {
+        throw std::runtime_error("Runtime error: get expects a sequence as the first argument");
+    }
+
+    long long idx = index.asInt();
+    const RuntimeValue& elements = strict(sequence);
+    if (idx < 0 || static_cast<size_t>(idx) >= elements.sequenceSize()) {
+        throw std::runtime_error("Runtime error: sequence index out of range");
+    }
+    return elements.sequenceAt(static_cast<size_t>(idx));
+}
+
+RuntimeValue Builtins::map(const RuntimeValue& sequence, uint32_t function) {
+    if (!isSequence(sequence)) {
+        throw std::runtime_error("Runtime error: map expects a sequence as the first argument");
+    }
+    return deferIfPure(addStage(sequence, StageKind::MAP, function), function);
+}
+
+RuntimeValue Builtins::filter(const RuntimeValue& sequence, uint32_t function) {
+    if (!isSequence(sequence)) {
+        throw std::runtime_error("Runtime error: filter expects a sequence as the first argument");
+    }
+    return deferIfPure(addStage(sequence, StageKind::FILTER, function), function);
+}
+
+RuntimeValue Builtins::generate(const RuntimeValue& seed, uint32_t step, const RuntimeValue& count) {
+    if (!count.isNumeric()) {
+        throw std::runtime_error("Runtime error: generate expects a numeric term count");
+    }
+    auto* lazy = new LazySequence();
+    lazy->source = strict(seed);
+    lazy->generated = true;
+    lazy->stepFunction = step;
+    lazy->count = count.asInt();
+    return deferIfPure(RuntimeValue::FromLazy(lazy), step);
+}
+
+RuntimeValue Builtins::deferIfPure(const RuntimeValue& lazy, uint32_t function) {
+    if (invoker.isPure(function)) return lazy;
+    return materialize(lazy.lazyValue());
+}
+
+bool Builtins::find(const std::string& name, Builtin& builtin) {
+    static const std::unordered_map<std::string, Builtin> builtins = {
+        {"print", Builtin::PRINT},
+        {"length", Builtin::LENGTH},
+        {"get", Builtin::GET},
+        {"map", Builtin::MAP},
+        {"filter", Builtin::FILTER},
+        {"generate", Builtin::GENERATE},
+        {"input", Builtin::INPUT},
+        {"sum", Builtin::SUM},
+        {"min", Builtin::MIN},
+        {"max", Builtin::MAX},
+        {"load", Builtin::LOAD},
+        {"read_sequence", Builtin::READ_SEQUENCE}
+    };
+    auto it = builtins.find(name);
+    if (it == builtins.end()) return false;
+    builtin = it->second;
+    return true;
+}
+
+namespace {
+    std::istream* inputStream = &std::cin;
+    std::ostream* promptStream = &std::cout;
+}
+
+void Builtins::redirectInput(std::istream& in, std::ostream* prompts) {
+    inputStream = &in;
+    promptStream = prompts;
+}
+
+RuntimeValue Builtins::readInput(const std::string& promptText) {
+    if (promptStream) {
+        if (!promptText.empty()) {
+            *promptStream << promptText << " ";
+        }
+        *promptStream << "> " << std::flush;
+    }
+    
+    std::string line;
+    if (!std::getline(*inputStream, line)) {
+        return RuntimeValue::FromInt(0);
+    }
+    
+    auto trim = [](std::string& s) {
+        size_t start = s.find_first_not_of(" \t\r\n");
+        size_t end = s.find_last_not_of(" \t\r\n");
+        if (start == std::string::npos) {
+            s.clear();
+            return;
+        }
+        s = s.substr(start, end - start + 1);
+    };
+    
+    trim(line);
+    if (line.empty()) {
+        return RuntimeValue::FromInt(0);
+    }
+    
+    try {
+        size_t idx = 0;
+        long long value = std::stoll(line, &idx, 10);
+        if (idx == line.length()) {
+            return RuntimeValue::FromInt(value);
+        }
+    } catch (...) {
+        // Fall through to floating-point parsing
+    }
+    
+    try {
+        double value = std::stod(line);
+        return RuntimeValue::FromInt(static_cast<long long>(value));
+    } catch (...) {
+        return RuntimeValue::FromInt(0);
+    }
+}
+
+namespace {
+    bool isSeparator(char c) {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == ',';
+    }
+}
+
+RuntimeValue Builtins::parseNumbers(std::string_view text, const std::string& source) {
+    // Ints until the first float, then everything as doubles. An int beyond
+    // 64 bits boxes the ints read so far, so that it stays exact.
+    std::vector<int64_t> ints;
+    std::vector<RuntimeValue> boxed;
+    std::vector<double> floats;
+    bool anyFloat = false;
+    bool anyBig = false;
+    const char* cursor = text.data();
+    const char* end = cursor + text.size();
+    while (cursor < end) {
+        if (isSeparator(*cursor)) {
+            ++cursor;
+            continue;
+        }
+        if (*cursor == '#') {
+            const char* newline = static_cast<const char*>(std::memchr(cursor, '\n', end - cursor));
+            cursor = newline ? newline : end;
+            continue;
+        }
+        const char* start = cursor;
+        while (cursor < end && !isSeparator(*cursor) && *cursor != '#') ++cursor;
+        // from_chars takes no leading '+'
+        const char* digits = *start == '+' && cursor - start > 1 ? start + 1 : start;
+
+        int64_t intValue = 0;
+        auto parsed = std::from_chars(digits, cursor, intValue);
+        if (parsed.ec == std::errc() && parsed.ptr == cursor) {
+            if (anyFloat) {
+                floats.push_back(static_cast<double>(intValue));
+            } else if (anyBig) {
+                boxed.push_back(RuntimeValue::FromInt(intValue));
+            } else {
+                ints.push_back(intValue);
+            }
+            continue;
+        }
+        if (parsed.ec == std::errc::result_out_of_range && parsed.ptr == cursor) {
+            BigInt bigValue = BigInt::fromString(std::string_view(digits, cursor - digits));
+            if (anyFloat) {
+                floats.push_back(bigValue.toDouble());
+                continue;
+            }
+            if (!anyBig) {
+                anyBig = true;
+                boxed.reserve(ints.size() + 1);
+                for (int64_t value : ints) boxed.push_back(RuntimeValue::FromInt(value));
+                ints = {};
+            }
+            boxed.push_back(RuntimeValue::FromBigInt(std::move(bigValue)));
+            continue;
+        }
+        double floatValue = 0.0;
+        auto parsedFloat = std::from_chars(digits, cursor, floatValue);
+        if (parsedFloat.ec != std::errc() || parsedFloat.ptr != cursor) {
+            size_t line = 1 + static_cast<size_t>(std::count(text.data(), start, '\n'));
+            throw std::runtime_error("Runtime error: '" + std::string(start, cursor) + "' is not a number (" +
+                                     source + ":" + std::to_string(line) + ")");
+        }
+        if (!anyFloat) {
+            anyFloat = true;
+            if (anyBig) {
+                floats.reserve(boxed.size() + 1);
+                for (const RuntimeValue& value : boxed) floats.push_back(value.asFloat());
+                boxed = {};
+            } else {
+                floats.assign(ints.begin(), ints.end());
+                ints = {};
+            }
+        }
+        floats.push_back(floatValue);
+    }
+    if (anyFloat) return RuntimeValue::FromFloats(std::move(floats));
+    if (anyBig) return RuntimeValue::FromSequence(std::move(boxed));
+    return RuntimeValue::FromInts(std::move(ints));
+}
+
+RuntimeValue Builtins::load(const std::string& path, const std::string& format) {
+    bool isText = format == "text";
+    if (!isText && format != "i64" && format != "f64") {
+        throw std::runtime_error("Runtime error: load format must be \"text\", \"i64\" or \"f64\", not \"" + format + "\"");
+    }
+    MappedFile file;
+    if (!file.open(path)) {
+        throw std::runtime_error("Runtime error: cannot open '" + path + "'");
+    }
+    std::string_view data = file.text();
+    if (isText) return parseNumbers(data, path);
+
+    if (data.size() % 8 != 0) {
+        throw std::runtime_error("Runtime error: '" + path + "' is not a whole number of 8-byte values");
+    }
+    size_t count = data.size() / 8;
+    if (format == "i64") {
+        std::vector<int64_t> ints(count);
+        if (count > 0) std::memcpy(ints.data(), data.data(), data.size());
+        return RuntimeValue::FromInts(std::move(ints));
+    }
+    std::vector<double> floats(count);
+    if (count > 0) std::memcpy(floats.data(), data.data(), data.size());
+    return RuntimeValue::FromFloats(std::move(floats));
+}
+
+RuntimeValue Builtins::readSequence() {
+    std::string text;
+    char chunk[1 << 16];
+    while (inputStream->read(chunk, sizeof(chunk)) || inputStream->gcount() > 0) {
+        text.append(chunk, static_cast<size_t>(inputStream->gcount()));
+    }
+    return parseNumbers(text, "input");
+}
+
+std::string Builtins::format(const RuntimeValue& value) {
+    std::string result;
+    formatTo(value, result);
+    return result;
+}
+
+void Builtins::formatTo(const RuntimeValue& value, std::string& out) {
+    if (value.kind() == Kind::SEQUENCE && value.sequenceLayout() == RuntimeValue::SequenceLayout::BOXED) {
+        out += '[';
+        bool first = true;
+        for (const auto& element : value.sequenceValue()) {
+            if (!first) out += ", ";
+            first = false;
+            formatTo(element, out);
+        }
+        out += ']';
+        return;
+    }
+    if (value.kind() != Kind::LAZY) {
+        value.appendTo(out);
+        return;
+    }
+
+    // Materialized, so that printing again or reading it later does not
+    // run the callbacks a second time
+    formatTo(materialize(value.lazyValue()), out);
+}
+
+RuntimeValue Builtins::sum(const RuntimeValue& sequence) {
+    const RuntimeValue& values = strict(sequence);
+    if (values.kind() != Kind::SEQUENCE) {
+        throw std::runtime_error("Runtime error: sum expects a sequence");
+    }
+    const size_t count = values.sequenceSize();
+    switch (values.sequenceLayout()) {
+        case RuntimeValue::SequenceLayout::INT64: {
+            // The wrapping kernel is exact when no partial sum can leave
+            // 64 bits; otherwise the checked loop below promotes
+            const int64_t* data = values.intElements().data();
+            if (count == 0 || magnitudeBound(data, count) <= static_cast<uint64_t>(INT64_MAX) / count) {
+                return RuntimeValue::FromInt(Kernels::sumInt(data, count));
+            }
+            break;
+        }
+        case RuntimeValue::SequenceLayout::FLOAT64:
+            return RuntimeValue::FromFloat(Kernels::sumFloat(values.floatElements().data(), count));
+        default:
+            break;
+    }
+
+    // Mixed or large ints: exact in 64 bits, then as a BigInt, and a float
+    // once any float is seen
+    long long intTotal = 0;
+    BigInt bigTotal;
+    double floatTotal = 0.0;
+    bool isBig = false;
+    bool isFloat = false;
+    for (size_t i = 0; i < count; ++i) {
+        RuntimeValue element = values.sequenceAt(i);
+        if (!element.isNumeric()) {
+            throw std::runtime_error("Runtime error: sum expects a sequence of numbers");
+        }
+        long long next = 0;
+        if (isFloat || element.kind() == Kind::FLOAT) {
+            if (!isFloat) floatTotal = isBig ? bigTotal.toDouble() : static_cast<double>(intTotal);
+            isFloat = true;
+            floatTotal += element.asFloat();
+        } else if (!isBig && element.kind() == Kind::INT &&
+                   !__builtin_add_overflow(intTotal, element.intValue(), &next)) {
+            intTotal = next;
+        } else {
+            if (!isBig) bigTotal = BigInt(intTotal);
+            isBig = true;
+            bigTotal = BigInt::add(bigTotal, element.asBigInt());
+        }
+    }
+    if (isFloat) return RuntimeValue::FromFloat(floatTotal);
+    return isBig ? RuntimeValue::FromBigInt(std::move(bigTotal)) : RuntimeValue::FromInt(intTotal);
+}
+
+RuntimeValue Builtins::min(const RuntimeValue& sequence) {
+    return extreme(sequence, false);
+}
+
+RuntimeValue Builtins::max(const RuntimeValue& sequence) {
+    return extreme(sequence, true);
+}
+
+RuntimeValue Builtins::extreme(const RuntimeValue& sequence, bool isMax) {
+    const char* name = isMax ? "max" : "min";
+    const RuntimeValue& values = strict(sequence);
+    if (values.kind() != Kind::SEQUENCE) {
+        throw std::runtime_error(std::string("Runtime error: ") + name + " expects a sequence");
+    }
+    size_t count = values.sequenceSize();
+    if (count == 0) {
+        throw std::runtime_error(std::string("Runtime error: ") + name + " of an empty sequence");
+    }
+
+    switch (values.sequenceLayout()) {
+        case RuntimeValue::SequenceLayout::INT64: {
+            const int64_t* data = values.intElements().data();
+            return RuntimeValue::FromInt(isMax ? Kernels::maxInt(data, count) : Kernels::minInt(data, count));
+        }
+        case RuntimeValue::SequenceLayout::FLOAT64: {
+            const double* data = values.floatElements().data();
+            return RuntimeValue::FromFloat(isMax ? Kernels::maxFloat(data, count) : Kernels::minFloat(data, count));
+        }
+        default:
+            break;
+    }
+
+    const auto& elements = values.sequenceValue();
+    const RuntimeValue* best = nullptr;
+    for (const auto& element : elements) {
+        if (!element.isNumeric()) {
+            throw std::runtime_error(std::string("Runtime error: ") + name + " expects a sequence of numbers");
+        }
+        if (!best || Operators::compare(isMax ? TacOp::GT : TacOp::LT, element, *best)) {
+            best = &element;
+        }
+    }
+    return *best;
+}
+
+RuntimeValue Builtins::concat(const RuntimeValue& left, const RuntimeValue& right) {
+    using Layout = RuntimeValue::SequenceLayout;
+    if (left.sequenceSize() == 0) return right;
+    if (right.sequenceSize() == 0) return left;
+
+    if (left.sequenceLayout() == Layout::INT64 && right.sequenceLayout() == Layout::INT64) {
+        std::vector<int64_t> combined;
+        combined.reserve(left.sequenceSize() + right.sequenceSize());
+        combined.insert(combined.end(), left.intElements().begin(), left.intElements().end());
+        combined.insert(combined.end(), right.intElements().begin(), right.intElements().end());
+        return RuntimeValue::FromInts(std::move(combined));
+    }
+    if (left.sequenceLayout() == Layout::FLOAT64 && right.sequenceLayout() == Layout::FLOAT64) {
+        std::vector<double> combined;
+        combined.reserve(left.sequenceSize() + right.sequenceSize());
+        combined.insert(combined.end(), left.floatElements().begin(), left.floatElements().end());
+        combined.insert(combined.end(), right.floatElements().begin(), right.floatElements().end());
+        return RuntimeValue::FromFloats(std::move(combined));
+    }
+
+    std::vector<RuntimeValue> combined;
+    combined.reserve(left.sequenceSize() + right.sequenceSize());
+    for (size_t i = 0; i < left.sequenceSize(); ++i) combined.push_back(left.sequenceAt(i));
+    for (size_t i = 0; i < right.sequenceSize(); ++i) combined.push_back(right.sequenceAt(i));
+    return RuntimeValue::FromSequence(std::move(combined));
+}
+
+RuntimeValue Builtins::elementwise(char op, const RuntimeValue& left, const RuntimeValue& right) {
+    using Layout = RuntimeValue::SequenceLayout;
+    const size_t count = left.sequenceSize();
+    if (right.sequenceSize() != count) {
+        throw std::runtime_error(std::string("Runtime error: operator '") + op +
+                                 "' requires sequences of the same length");
+    }
+
+    Layout leftLayout = left.sequenceLayout();
+    Layout rightLayout = right.sequenceLayout();
+    bool exact = true;
+    if (leftLayout == Layout::INT64 && rightLayout == Layout::INT64) {
+        // The kernels wrap, so they run only where the operand ranges rule
+        // out a result beyond 64 bits; the loop at the end promotes
+        const int64_t* a = left.intElements().data();
+        const int64_t* b = right.intElements().data();
+        uint64_t boundA = magnitudeBound(a, count);
+        uint64_t boundB = magnitudeBound(b, count);
+        uint64_t product = 0;
+        if (op == '-') {
+            exact = boundA <= (uint64_t(1) << 62) && boundB <= (uint64_t(1) << 62);
+        } else if (op == '*') {
+            exact = !__builtin_mul_overflow(boundA, boundB, &product) && product <= static_cast<uint64_t>(INT64_MAX);
+        } else {
+            exact = boundA <= static_cast<uint64_t>(INT64_MAX);
+        }
+    }
+    if (leftLayout == Layout::INT64 && rightLayout == Layout::INT64 && exact) {
+        std::vector<int64_t> out(count);
+        const int64_t* a = left.intElements().data();
+        const int64_t* b = right.intElements().data();
+        if (op == '-') {
+            Kernels::subInt(a, b, out.data(), count);
+        } else if (op == '*') {
+            Kernels::mulInt(a, b, out.data(), count);
+        } else if (!Kernels::divInt(a, b, out.data(), count)) {
+            throw std::runtime_error("Runtime error: division by zero");
+        }
+        return RuntimeValue::FromInts(std::move(out));
+    }
+
+    if (leftLayout != Layout::BOXED && rightLayout != Layout::BOXED && exact) {
+        // One side is float: widen the int side, then use the float kernels
+        std::vector<double> widened;
+        auto asDoubles = [&](const RuntimeValue& side) -> const double* {
+            if (side.sequenceLayout() == Layout::FLOAT64) return side.floatElements().data();
+            widened.resize(count);
+            Kernels::intToFloat(side.intElements().data(), widened.data(), count);
+            return widened.data();
+        };
+        const double* a = asDoubles(left);
+        const double* b = asDoubles(right);
+        std::vector<double> out(count);
+        if (op == '-') {
+            Kernels::subFloat(a, b, out.data(), count);
+        } else if (op == '*') {
+            Kernels::mulFloat(a, b, out.data(), count);
+        } else {
+            Kernels::divFloat(a, b, out.data(), count);
+        }
+        return RuntimeValue::FromFloats(std::move(out));
+    }
+
+    std::vector<RuntimeValue> out;
+    out.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        RuntimeValue a = left.sequenceAt(i);
+        RuntimeValue b = right.sequenceAt(i);
+        if (!a.isNumeric() || !b.isNumeric()) {
+            throw std::runtime_error(std::string("Runtime error: operator '") + op + "' requires numeric operands");
+        }
+        if (a.isInteger() && b.isInteger()) {
+            TacOp tacOp = op == '-' ? TacOp::SUB : op == '*' ? TacOp::MUL : TacOp::DIV;
+            out.push_back(Operators::arithmetic(tacOp, a, b));
+        } else {
+            double x = a.asFloat();
+            double y = b.asFloat();
+            out.push_back(RuntimeValue::FromFloat(op == '-' ? x - y : op == '*' ? x * y : x / y));
+        }
+    }
+    return RuntimeValue::FromSequence(std::move(out));
+}
+
+bool Builtins::equal(const RuntimeValue& left, const RuntimeValue& right) {
+    if (left.kind() == Kind::INT && right.kind() == Kind::INT) {
+        return left.intValue() == right.intValue();
+    }
+    if (left.kind() == Kind::BOOL && right.kind() == Kind::BOOL) {
+        return left.boolValue() == right.boolValue();
+    }
+    if (left.kind() == Kind::SEQUENCE && right.kind() == Kind::SEQUENCE &&
+        left.sequenceLayout() == RuntimeValue::SequenceLayout::INT64 &&
+        right.sequenceLayout() == RuntimeValue::SequenceLayout::INT64) {
+        return left.sequenceSize() == right.sequenceSize() &&
+               Kernels::equalInt(left.intElements().data(), right.intElements().data(), left.sequenceSize());
+    }
+    // Everything else compares by its printed form
+    return left.toString() == right.toString();
+}
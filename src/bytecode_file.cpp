@@ -0,0 +1,384 @@
+#include "../include/bytecode_file.h"
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
+
+namespace {
+    using RuntimeValue = Interpreter::RuntimeValue;
+    using Kind = RuntimeValue::Kind;
+
+    constexpr char kMagic[8] = {'M', 'S', 'Q', 'B', 'Y', 'T', 'E', 'S'};
+    constexpr uint32_t kByteOrder = 0x01020304u;
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t byteOrder;
+        uint64_t functionCount;
+        uint64_t functionsOffset;
+        uint64_t codeOffset;
+        uint64_t codeCount;
+        uint64_t constantsOffset;
+        uint64_t constantCount;
+        uint64_t stringsOffset;
+        uint64_t stringsSize;
+    };
+
+    // FunctionRecord::flags
+    constexpr uint32_t kParallelSafe = 1;
+    constexpr uint32_t kMemoizable = 2;
+    constexpr uint32_t kPure = 4;
+
+    struct FunctionRecord {
+        uint32_t nameOffset;
+        uint32_t nameSize;
+        uint32_t numParams;
+        uint32_t numRegisters;
+        uint64_t codeBegin;  // In instructions, into the code section
+        uint32_t codeCount;
+        uint32_t constantBegin;
+        uint32_t constantCount;
+        uint32_t flags;
+    };
+
+    // An INT's value, a FLOAT's bits, 0 or 1 for a BOOL, or a STRING's
+    // offset in the string table
+    struct ConstantRecord {
+        uint8_t kind;
+        uint8_t padding[3];
+        uint32_t stringSize;
+        uint64_t bits;
+    };
+
+    static_assert(std::is_trivially_copyable<Header>::value && std::is_trivially_copyable<FunctionRecord>::value &&
+                      std::is_trivially_copyable<ConstantRecord>::value &&
+                      std::is_trivially_copyable<Instruction>::value,
+                  "sections are copied as raw bytes");
+    static_assert(sizeof(Instruction) == 16 && sizeof(FunctionRecord) == 40 && sizeof(ConstantRecord) == 16,
+                  "the record layout is part of the format");
+    // Renumbering opcodes or builtins changes what stored code means
+    static_assert(static_cast<int>(OpCode::RETURN_VOID) == 27 && static_cast<int>(Builtin::READ_SEQUENCE) == 11,
+                  "bump BytecodeFile::kFormatVersion along with the numbering");
+
+    constexpr uint64_t kAlignment = 8;
+
+    void pad(std::string& buffer) {
+        buffer.append((kAlignment - buffer.size() % kAlignment) % kAlignment, '\0');
+    }
+
+    template <typename T>
+    void append(std::string& buffer, const T* records, size_t count) {
+        buffer.append(reinterpret_cast<const char*>(records), count * sizeof(T));
+        pad(buffer);
+    }
+
+    [[noreturn]] void malformed(const std::string& what) {
+        throw std::runtime_error("Bytecode error: " + what);
+    }
+
+    // The `count` records of a section at `offset`, checked to lie within
+    // `data`
+    void checkSection(std::string_view data, uint64_t offset, uint64_t count, uint64_t size, const char* name) {
+        if (offset % kAlignment != 0 || offset > data.size() || count > (data.size() - offset) / size) {
+            malformed(std::string("truncated ") + name + " section");
+        }
+    }
+}
+
+bool BytecodeFile::recognize(std::string_view data) {
+    return data.size() >= sizeof(kMagic) && std::memcmp(data.data(), kMagic, sizeof(kMagic)) == 0;
+}
+
+void BytecodeFile::write(const BytecodeModule& module, std::ostream& out) {
+    std::vector<FunctionRecord> functions;
+    std::vector<Instruction> code;
+    std::vector<ConstantRecord> constants;
+    std::string strings;
+    std::unordered_map<std::string, uint32_t> interned;
+
+    auto intern = [&](const std::string& text) {
+        auto it = interned.find(text);
+        if (it != interned.end()) return it->second;
+        uint32_t offset = static_cast<uint32_t>(strings.size());
+        strings += text;
+        interned.emplace(text, offset);
+        return offset;
+    };
+
+    for (const auto& function : module.functions) {
+        FunctionRecord record{};
+        record.nameOffset = intern(function.name);
+        record.nameSize = static_cast<uint32_t>(function.name.size());
+        record.numParams = function.numParams;
+        record.numRegisters = function.numRegisters;
+        record.codeBegin = code.size();
+        record.codeCount = static_cast<uint32_t>(function.code.size());
+        record.constantBegin = static_cast<uint32_t>(constants.size());
+        record.constantCount = static_cast<uint32_t>(function.constants.size());
+        record.flags = (function.parallelSafe ? kParallelSafe : 0) | (function.memoizable ? kMemoizable : 0) |
+                       (function.pure ? kPure : 0);
+        functions.push_back(record);
+        for (const auto& instr : function.code) {
+            // Field by field, so that the padding is written as zeros
+            Instruction copy;
+            std::memset(&copy, 0, sizeof(copy));
+            copy.op = instr.op;
+            copy.a = instr.a;
+            copy.b = instr.b;
+            copy.c = instr.c;
+            code.push_back(copy);
+        }
+
+        for (const auto& value : function.constants) {
+            ConstantRecord constant{};
+            constant.kind = static_cast<uint8_t>(value.kind());
+            switch (value.kind()) {
+                case Kind::INT:
+                    constant.bits = static_cast<uint64_t>(value.intValue());
+                    break;
+                case Kind::FLOAT: {
+                    double number = value.floatValue();
+                    std::memcpy(&constant.bits, &number, sizeof(number));
+                    break;
+                }
+                case Kind::BOOL:
+                    constant.bits = value.boolValue() ? 1 : 0;
+                    break;
+                case Kind::STRING:
+                    constant.bits = intern(value.stringValue());
+                    constant.stringSize = static_cast<uint32_t>(value.stringValue().size());
+                    break;
+                case Kind::BIGINT: {
+                    // Kept as its decimal digits in the string table
+                    std::string digits = value.bigIntValue().toString();
+                    constant.bits = intern(digits);
+                    constant.stringSize = static_cast<uint32_t>(digits.size());
+                    break;
+                }
+                default:
+                    throw std::runtime_error("Bytecode error: Cannot store constant '" + value.toString() +
+                                             "' of function '" + function.name + "'");
+            }
+            constants.push_back(constant);
+        }
+    }
+
+    std::string buffer(sizeof(Header), '\0');
+    pad(buffer);
+    Header header{};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kFormatVersion;
+    header.byteOrder = kByteOrder;
+    header.functionCount = functions.size();
+    header.functionsOffset = buffer.size();
+    append(buffer, functions.data(), functions.size());
+    header.codeOffset = buffer.size();
+    header.codeCount = code.size();
+    append(buffer, code.data(), code.size());
+    header.constantsOffset = buffer.size();
+    header.constantCount = constants.size();
+    append(buffer, constants.data(), constants.size());
+    header.stringsOffset = buffer.size();
+    header.stringsSize = strings.size();
+    append(buffer, strings.data(), strings.size());
+    std::memcpy(&buffer[0], &header, sizeof(header));
+
+    out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+}
+
+BytecodeModule BytecodeFile::read(std::string_view data) {
+    Header header;
+    if (!recognize(data)) malformed("not a bytecode file");
+    if (data.size() < sizeof(header)) malformed("truncated header");
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (header.byteOrder != kByteOrder) malformed("file written with another byte order");
+    if (header.version != kFormatVersion) {
+        malformed("format version " + std::to_string(header.version) + ", expected " +
+                  std::to_string(kFormatVersion));
+    }
+    checkSection(data, header.functionsOffset, header.functionCount, sizeof(FunctionRecord), "function");
+    checkSection(data, header.codeOffset, header.codeCount, sizeof(Instruction), "code");
+    checkSection(data, header.constantsOffset, header.constantCount, sizeof(ConstantRecord), "constant");
+    checkSection(data, header.stringsOffset, header.stringsSize, 1, "string");
+    const char* strings = data.data() + header.stringsOffset;
+
+    auto text = [&](uint64_t offset, uint64_t size) {
+        if (offset > header.stringsSize || size > header.stringsSize - offset) malformed("string out of range");
+        return std::string(strings + offset, size);
+    };
+
+    BytecodeModule module;
+    module.functions.resize(header.functionCount);
+    for (size_t f = 0; f < module.functions.size(); ++f) {
+        FunctionRecord record;
+        std::memcpy(&record, data.data() + header.functionsOffset + f * sizeof(record), sizeof(record));
+        BytecodeFunction& function = module.functions[f];
+        function.name = text(record.nameOffset, record.nameSize);
+        if (!module.functionIndex.emplace(function.name, static_cast<uint32_t>(f)).second) {
+            malformed("function '" + function.name + "' defined twice");
+        }
+        if (record.numParams > record.numRegisters || record.codeBegin > header.codeCount ||
+            record.codeCount > header.codeCount - record.codeBegin || record.constantBegin > header.constantCount ||
+            record.constantCount > header.constantCount - record.constantBegin) {
+            malformed("function '" + function.name + "' out of range");
+        }
+        function.numParams = record.numParams;
+        function.numRegisters = record.numRegisters;
+        function.parallelSafe = (record.flags & kParallelSafe) != 0;
+        function.memoizable = (record.flags & kMemoizable) != 0;
+        function.pure = (record.flags & kPure) != 0;
+
+        function.code.resize(record.codeCount);
+        std::memcpy(function.code.data(), data.data() + header.codeOffset + record.codeBegin * sizeof(Instruction),
+                    record.codeCount * sizeof(Instruction));
+
+        function.constants.reserve(record.constantCount);
+        for (uint32_t k = 0; k < record.constantCount; ++k) {
+            ConstantRecord constant;
+            std::memcpy(&constant,
+                        data.data() + header.constantsOffset + (record.constantBegin + k) * sizeof(constant),
+                        sizeof(constant));
+            switch (static_cast<Kind>(constant.kind)) {
+                case Kind::INT:
+                    function.constants.push_back(RuntimeValue::FromInt(static_cast<long long>(constant.bits)));
+                    break;
+                case Kind::FLOAT: {
+                    double number;
+                    std::memcpy(&number, &constant.bits, sizeof(number));
+                    function.constants.push_back(RuntimeValue::FromFloat(number));
+                    break;
+                }
+                case Kind::BOOL:
+                    function.constants.push_back(RuntimeValue::FromBool(constant.bits != 0));
+                    break;
+                case Kind::STRING:
+                    function.constants.push_back(RuntimeValue::FromString(text(constant.bits, constant.stringSize)));
+                    break;
+                case Kind::BIGINT: {
+                    std::string digits = text(constant.bits, constant.stringSize);
+                    size_t sign = !digits.empty() && digits[0] == '-' ? 1 : 0;
+                    if (digits.size() == sign || digits.find_first_not_of("0123456789", sign) != std::string::npos) {
+                        malformed("invalid big integer constant in function '" + function.name + "'");
+                    }
+                    function.constants.push_back(RuntimeValue::FromBigInt(BigInt::fromString(digits)));
+                    break;
+                }
+                default:
+                    malformed("unknown constant kind in function '" + function.name + "'");
+            }
+        }
+    }
+
+    // Every operand must name a register of its frame, a constant, an
+    // instruction or a function that exists, and no path may run off the
+    // end of the code. A call pops the arguments its PARAMs pushed, so the
+    // number pushed at each instruction is followed through the jumps: it
+    // must be the same on every path there, and cover what a call takes.
+    for (const auto& function : module.functions) {
+        auto fail = [&](size_t pc) {
+            malformed("invalid instruction " + std::to_string(pc) + " in function '" + function.name + "'");
+        };
+        auto target = [&](uint32_t operand) { return operand < function.numRegisters; };
+        auto value = [&](uint32_t operand) {
+            return (operand & VirtualMachine::kConstantBit)
+                ? (operand & ~VirtualMachine::kConstantBit) < function.constants.size()
+                : operand < function.numRegisters;
+        };
+        for (size_t pc = 0; pc < function.code.size(); ++pc) {
+            const Instruction& instr = function.code[pc];
+            bool valid = false;
+            switch (instr.op) {
+                case OpCode::MOVE:
+                case OpCode::SEQ_STORE:
+                case OpCode::APPEND:
+                case OpCode::EXTEND:
+                case OpCode::NEG:
+                case OpCode::NOT:
+                    valid = target(instr.a) && value(instr.b);
+                    break;
+                case OpCode::NEW_SEQ:
+                    valid = target(instr.a);
+                    break;
+                case OpCode::ADD: case OpCode::SUB: case OpCode::MUL: case OpCode::DIV: case OpCode::MOD:
+                case OpCode::EQ: case OpCode::NE: case OpCode::LT: case OpCode::LE: case OpCode::GT:
+                case OpCode::GE: case OpCode::AND: case OpCode::OR:
+                    valid = target(instr.a) && value(instr.b) && value(instr.c);
+                    break;
+                case OpCode::JUMP:
+                    valid = instr.a < function.code.size();
+                    break;
+                case OpCode::JUMP_IF_FALSE:
+                case OpCode::JUMP_IF_TRUE:
+                    valid = instr.a < function.code.size() && value(instr.b);
+                    break;
+                case OpCode::PARAM:
+                case OpCode::RETURN:
+                    valid = value(instr.b);
+                    break;
+                case OpCode::CALL:
+                    valid = target(instr.a) && instr.b < module.functions.size();
+                    break;
+                case OpCode::CALL_BUILTIN:
+                    valid = target(instr.a) && instr.b <= static_cast<uint32_t>(Builtin::READ_SEQUENCE);
+                    break;
+                case OpCode::RETURN_VOID:
+                    valid = true;
+                    break;
+            }
+            if (!valid) fail(pc);
+        }
+        if (function.code.empty()) {
+            malformed("function '" + function.name + "' has no code");
+        }
+
+        constexpr int64_t kUnreached = -1;
+        std::vector<int64_t> pushed(function.code.size(), kUnreached);
+        std::vector<size_t> pending{0};
+        pushed[0] = 0;
+        auto flow = [&](size_t from, size_t to, int64_t depth) {
+            if (to >= function.code.size()) fail(from);
+            if (pushed[to] == kUnreached) {
+                pushed[to] = depth;
+                pending.push_back(to);
+            } else if (pushed[to] != depth) {
+                fail(to);
+            }
+        };
+        while (!pending.empty()) {
+            size_t pc = pending.back();
+            pending.pop_back();
+            const Instruction& instr = function.code[pc];
+            int64_t depth = pushed[pc];
+            switch (instr.op) {
+                case OpCode::RETURN:
+                case OpCode::RETURN_VOID:
+                    break;
+                case OpCode::JUMP:
+                    flow(pc, instr.a, depth);
+                    break;
+                case OpCode::JUMP_IF_FALSE:
+                case OpCode::JUMP_IF_TRUE:
+                    flow(pc, instr.a, depth);
+                    flow(pc, pc + 1, depth);
+                    break;
+                case OpCode::PARAM:
+                    flow(pc, pc + 1, depth + 1);
+                    break;
+                case OpCode::CALL:
+                case OpCode::CALL_BUILTIN:
+                    if (instr.c > depth) fail(pc);
+                    flow(pc, pc + 1, depth - instr.c);
+                    break;
+                default:
+                    flow(pc, pc + 1, depth);
+                    break;
+            }
+        }
+    }
+
+    for (auto& function : module.functions) {
+        function.inlineCallback = BytecodeCompiler::buildInlineCallback(function);
+    }
+    return module;
+}
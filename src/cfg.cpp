@@ -0,0 +1,202 @@
+#include "../include/cfg.h"
+#include <algorithm>
+#include <unordered_map>
+
+bool ControlFlowGraph::isTerminator(TacOp op) {
+    return op == TacOp::GOTO || op == TacOp::IF || op == TacOp::IF_FALSE || op == TacOp::RETURN;
+}
+
+ControlFlowGraph ControlFlowGraph::build(const ThreeAddressCode* begin, const ThreeAddressCode* end) {
+    ControlFlowGraph cfg;
+    cfg.blocks.emplace_back();  // Entry
+    cfg.blocks.emplace_back();
+
+    for (const ThreeAddressCode* instr = begin; instr != end; ++instr) {
+        if (instr->op == TacOp::LABEL) {
+            if (!cfg.blocks.back().code.empty() || !cfg.blocks.back().label.empty()) {
+                cfg.blocks.emplace_back();
+            }
+            cfg.blocks.back().label = instr->result;
+            cfg.blocks.back().labelLine = instr->line;
+            continue;
+        }
+        cfg.blocks.back().code.push_back(*instr);
+        if (isTerminator(instr->op) && instr + 1 != end && instr[1].op != TacOp::LABEL) {
+            cfg.blocks.emplace_back();
+        }
+    }
+
+    cfg.computeEdges();
+    return cfg;
+}
+
+void ControlFlowGraph::linearize(std::vector<ThreeAddressCode>& out) const {
+    for (const auto& block : blocks) {
+        if (!block.label.empty()) {
+            out.push_back(ThreeAddressCode(TacOp::LABEL, Operand(), Operand(), block.label, block.labelLine));
+        }
+        out.insert(out.end(), block.code.begin(), block.code.end());
+    }
+}
+
+void ControlFlowGraph::computeEdges() {
+    std::unordered_map<Operand, uint32_t, OperandHash> labels;
+    for (uint32_t b = 0; b < blocks.size(); ++b) {
+        if (!blocks[b].label.empty()) labels[blocks[b].label] = b;
+        blocks[b].successors.clear();
+        blocks[b].predecessors.clear();
+    }
+
+    for (uint32_t b = 0; b < blocks.size(); ++b) {
+        BasicBlock& block = blocks[b];
+        int32_t next = b + 1 < blocks.size() ? static_cast<int32_t>(b + 1) : -1;
+        block.fallthrough = next;
+        block.target = -1;
+
+        if (!block.code.empty()) {
+            const ThreeAddressCode& last = block.code.back();
+            if (last.op == TacOp::GOTO || last.op == TacOp::IF || last.op == TacOp::IF_FALSE) {
+                auto it = labels.find(last.result);
+                block.target = it == labels.end() ? -1 : static_cast<int32_t>(it->second);
+                if (last.op == TacOp::GOTO) block.fallthrough = -1;
+            } else if (last.op == TacOp::RETURN) {
+                block.fallthrough = -1;
+            }
+        }
+
+        if (block.fallthrough >= 0) block.successors.push_back(block.fallthrough);
+        if (block.target >= 0 && block.target != block.fallthrough) block.successors.push_back(block.target);
+    }
+
+    for (uint32_t b = 0; b < blocks.size(); ++b) {
+        for (uint32_t successor : blocks[b].successors) {
+            blocks[successor].predecessors.push_back(b);
+        }
+    }
+}
+
+size_t ControlFlowGraph::removeUnreachable() {
+    std::vector<bool> reachable(blocks.size(), false);
+    std::vector<uint32_t> work{0};
+    reachable[0] = true;
+    while (!work.empty()) {
+        uint32_t b = work.back();
+        work.pop_back();
+        for (uint32_t successor : blocks[b].successors) {
+            if (!reachable[successor]) {
+                reachable[successor] = true;
+                work.push_back(successor);
+            }
+        }
+    }
+
+    if (std::find(reachable.begin(), reachable.end(), false) == reachable.end()) return 0;
+
+    size_t removed = 0;
+    std::vector<BasicBlock> kept;
+    kept.reserve(blocks.size());
+    for (uint32_t b = 0; b < blocks.size(); ++b) {
+        if (reachable[b]) {
+            kept.push_back(std::move(blocks[b]));
+        } else {
+            removed += blocks[b].code.size();
+        }
+    }
+    blocks = std::move(kept);
+    computeEdges();
+    return removed;
+}
+
+size_t ControlFlowGraph::removeJumpsToNext() {
+    size_t removed = 0;
+    for (uint32_t b = 0; b + 1 < blocks.size(); ++b) {
+        auto& code = blocks[b].code;
+        if (!code.empty() && code.back().op == TacOp::GOTO && blocks[b].target == static_cast<int32_t>(b + 1)) {
+            code.pop_back();
+            ++removed;
+        }
+    }
+    if (removed) computeEdges();
+    return removed;
+}
+
+size_t ControlFlowGraph::instructionCount() const {
+    size_t count = 0;
+    for (const auto& block : blocks) count += block.code.size();
+    return count;
+}
+
+std::vector<uint32_t> ControlFlowGraph::reversePostorder() const {
+    std::vector<uint32_t> order;
+    std::vector<bool> visited(blocks.size(), false);
+    // Explicit stack of (block, next successor to try)
+    std::vector<std::pair<uint32_t, size_t>> stack{{0, 0}};
+    visited[0] = true;
+    while (!stack.empty()) {
+        auto& top = stack.back();
+        const BasicBlock& block = blocks[top.first];
+        if (top.second < block.successors.size()) {
+            uint32_t successor = block.successors[top.second++];
+            if (!visited[successor]) {
+                visited[successor] = true;
+                stack.emplace_back(successor, 0);
+            }
+        } else {
+            order.push_back(top.first);
+            stack.pop_back();
+        }
+    }
+    std::reverse(order.begin(), order.end());
+    return order;
+}
+
+std::vector<uint32_t> ControlFlowGraph::immediateDominators(const std::vector<uint32_t>& order) const {
+    constexpr uint32_t kUndefined = UINT32_MAX;
+    std::vector<uint32_t> position(blocks.size(), kUndefined);
+    for (uint32_t i = 0; i < order.size(); ++i) position[order[i]] = i;
+
+    std::vector<uint32_t> idom(blocks.size(), kUndefined);
+    idom[0] = 0;
+    auto intersect = [&](uint32_t a, uint32_t b) {
+        while (a != b) {
+            while (position[a] > position[b]) a = idom[a];
+            while (position[b] > position[a]) b = idom[b];
+        }
+        return a;
+    };
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (uint32_t b : order) {
+            if (b == 0) continue;
+            uint32_t dominator = kUndefined;
+            for (uint32_t predecessor : blocks[b].predecessors) {
+                if (idom[predecessor] == kUndefined) continue;
+                dominator = dominator == kUndefined ? predecessor : intersect(predecessor, dominator);
+            }
+            if (dominator != idom[b]) {
+                idom[b] = dominator;
+                changed = true;
+            }
+        }
+    }
+    return idom;
+}
+
+std::vector<std::vector<uint32_t>> ControlFlowGraph::dominanceFrontiers(const std::vector<uint32_t>& idom) const {
+    std::vector<std::vector<uint32_t>> frontiers(blocks.size());
+    for (uint32_t b = 0; b < blocks.size(); ++b) {
+        if (blocks[b].predecessors.size() < 2) continue;
+        for (uint32_t predecessor : blocks[b].predecessors) {
+            uint32_t runner = predecessor;
+            while (runner != idom[b] && idom[runner] != UINT32_MAX) {
+                auto& frontier = frontiers[runner];
+                if (frontier.empty() || frontier.back() != b) frontier.push_back(b);
+                if (runner == 0) break;
+                runner = idom[runner];
+            }
+        }
+    }
+    return frontiers;
+}
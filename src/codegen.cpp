@@ -1,51 +1,68 @@
 #include "../include/codegen.h"
 #include <iostream>
 
-std::string CodeGenerator::newTemp() {
-    return "t" + std::to_string(tempCounter++);
+Operand CodeGenerator::variableName(Name name, int slot) {
+    // A shadowing declaration lives in a different frame slot; give it a
+    // distinct TAC name so the flat per-function namespace stays correct
+    if (slot < 0) return module.variable(name.text());
+    auto inserted = slotNames.emplace(name.text(), slot);
+    if (inserted.first->second == slot) return module.variable(name.text());
+    return module.variable(name.text() + "." + std::to_string(slot));
 }
 
-std::string CodeGenerator::newLabel() {
-    return "L" + std::to_string(labelCounter++);
+void CodeGenerator::emit(TacOp op, Operand arg1, Operand arg2, Operand result, int line) {
+    module.code.push_back(ThreeAddressCode(op, arg1, arg2, result, line));
 }
 
-std::vector<ThreeAddressCode> CodeGenerator::generate(Program* program) {
-    intermediateCode.clear();
-    tempCounter = 0;
-    labelCounter = 0;
+TacModule CodeGenerator::generate(Program* program) {
+    module = TacModule();
     
     generateProgram(program);
-    return intermediateCode;
+    return module;
+}
+
+TacModule CodeGenerator::generate(const std::vector<FunctionDecl*>& functions) {
+    module = TacModule();
+    
+    for (FunctionDecl* function : functions) {
+        generateFunction(function);
+    }
+    return module;
 }
 
 void CodeGenerator::generateProgram(Program* program) {
     // Generate code for each function
     for (auto& function : program->functions) {
-        generateFunction(function.get());
+        generateFunction(function);
     }
 }
 
 void CodeGenerator::generateFunction(FunctionDecl* function) {
     // Function label
-    intermediateCode.push_back(ThreeAddressCode("LABEL", "", "", function->name.lexeme, function->line));
+    emit(TacOp::LABEL, Operand(), Operand(), module.function(function->name.text()), function->line);
     
     // Enter function scope
     symbolManager.enterScope();
+    slotNames.clear();
+    for (size_t i = 0; i < function->parameters.size(); ++i) {
+        slotNames[function->parameters[i].name.text()] = static_cast<int>(i);
+    }
     
     // Allocate space for parameters
     for (const auto& param : function->parameters) {
-        symbolManager.declareSymbol(param.first.lexeme, param.second, true);
-        intermediateCode.push_back(ThreeAddressCode("ASSIGN", "param_" + param.first.lexeme, "", param.first.lexeme, param.first.line));
+        symbolManager.declareSymbol(param.name.text(), param.type, true);
+        emit(TacOp::ASSIGN, module.variable("param_" + param.name.text()), Operand(),
+             module.variable(param.name.text()), param.line);
     }
     
     // Generate function body
     for (auto& stmt : function->body) {
-        generateStatement(stmt.get());
+        generateStatement(stmt);
     }
     
     // Add implicit return for void functions
     if (function->returnType == DataType::VOID) {
-        intermediateCode.push_back(ThreeAddressCode("RETURN", "", "", "", function->line));
+        emit(TacOp::RETURN, Operand(), Operand(), Operand(), function->line);
     }
     
     // Exit function scope
@@ -53,194 +70,238 @@ void CodeGenerator::generateFunction(FunctionDecl* function) {
 }
 
 void CodeGenerator::generateStatement(Stmt* stmt) {
-    if (auto decl = dynamic_cast<DeclarationStmt*>(stmt)) {
-        generateDeclaration(decl);
-    } else if (auto assign = dynamic_cast<AssignmentStmt*>(stmt)) {
-        generateAssignment(assign);
-    } else if (auto ifStmt = dynamic_cast<IfStmt*>(stmt)) {
-        generateIfStatement(ifStmt);
-    } else if (auto whileStmt = dynamic_cast<WhileStmt*>(stmt)) {
-        generateWhileStatement(whileStmt);
-    } else if (auto returnStmt = dynamic_cast<ReturnStmt*>(stmt)) {
-        generateReturnStatement(returnStmt);
-    } else if (auto exprStmt = dynamic_cast<ExpressionStmt*>(stmt)) {
-        generateExpressionStatement(exprStmt);
+    switch (stmt->kind) {
+        case NodeKind::DECLARATION:
+            generateDeclaration(static_cast<DeclarationStmt*>(stmt));
+            break;
+        case NodeKind::ASSIGNMENT:
+            generateAssignment(static_cast<AssignmentStmt*>(stmt));
+            break;
+        case NodeKind::IF:
+            generateIfStatement(static_cast<IfStmt*>(stmt));
+            break;
+        case NodeKind::WHILE:
+            generateWhileStatement(static_cast<WhileStmt*>(stmt));
+            break;
+        case NodeKind::RETURN:
+            generateReturnStatement(static_cast<ReturnStmt*>(stmt));
+            break;
+        case NodeKind::EXPRESSION:
+            generateExpressionStatement(static_cast<ExpressionStmt*>(stmt));
+            break;
+        case NodeKind::BLOCK:
+            symbolManager.enterScope();
+            for (Stmt* inner : static_cast<BlockStmt*>(stmt)->statements) {
+                generateStatement(inner);
+            }
+            symbolManager.exitScope();
+            break;
+        default:
+            break;
     }
 }
 
 void CodeGenerator::generateDeclaration(DeclarationStmt* decl) {
-    symbolManager.declareSymbol(decl->name.lexeme, decl->dataType);
+    symbolManager.declareSymbol(decl->name.text(), decl->dataType);
     
     if (decl->initializer) {
-        std::string value = generateExpression(decl->initializer.get());
-        intermediateCode.push_back(ThreeAddressCode("ASSIGN", value, "", decl->name.lexeme, decl->line));
-        symbolManager.markSymbolInitialized(decl->name.lexeme);
+        Operand value = generateExpression(decl->initializer);
+        emit(TacOp::ASSIGN, value, Operand(), variableName(decl->name, decl->slot), decl->line);
+        symbolManager.markSymbolInitialized(decl->name.text());
     }
 }
 
 void CodeGenerator::generateAssignment(AssignmentStmt* assign) {
-    std::string value = generateExpression(assign->value.get());
-    intermediateCode.push_back(ThreeAddressCode("ASSIGN", value, "", assign->name.lexeme, assign->line));
-    symbolManager.markSymbolInitialized(assign->name.lexeme);
+    if (assign->appendsToSelf) {
+        generateAppend(assign);
+        symbolManager.markSymbolInitialized(assign->name.text());
+        return;
+    }
+    
+    Operand value = generateExpression(assign->value);
+    emit(TacOp::ASSIGN, value, Operand(), variableName(assign->name, assign->slot), assign->line);
+    symbolManager.markSymbolInitialized(assign->name.text());
+}
+
+void CodeGenerator::generateAppend(AssignmentStmt* assign) {
+    Operand target = variableName(assign->name, assign->slot);
+    Expr* tail = static_cast<BinaryExpr*>(assign->value)->right;
+    
+    // s = s + [a, b] appends the elements directly, without building [a, b]
+    if (auto literal = nodeCast<SequenceExpr>(tail)) {
+        std::vector<Operand> elements;
+        for (auto& element : literal->elements) {
+            elements.push_back(generateExpression(element));
+        }
+        for (Operand element : elements) {
+            emit(TacOp::APPEND, element, Operand(), target, assign->line);
+        }
+        return;
+    }
+    
+    Operand value = generateExpression(tail);
+    emit(TacOp::EXTEND, value, Operand(), target, assign->line);
 }
 
 void CodeGenerator::generateIfStatement(IfStmt* ifStmt) {
-    std::string condition = generateExpression(ifStmt->condition.get());
-    std::string elseLabel = newLabel();
-    std::string endLabel = newLabel();
+    Operand condition = generateExpression(ifStmt->condition);
+    Operand elseLabel = module.newLabel();
+    Operand endLabel = module.newLabel();
     
     // If condition is false, jump to else
-    intermediateCode.push_back(ThreeAddressCode("IF_FALSE", condition, "", elseLabel, ifStmt->line));
+    emit(TacOp::IF_FALSE, condition, Operand(), elseLabel, ifStmt->line);
     
     // Then branch
     symbolManager.enterScope();
     for (auto& stmt : ifStmt->thenBranch) {
-        generateStatement(stmt.get());
+        generateStatement(stmt);
     }
     symbolManager.exitScope();
     
-    intermediateCode.push_back(ThreeAddressCode("GOTO", "", "", endLabel, ifStmt->line));
+    emit(TacOp::GOTO, Operand(), Operand(), endLabel, ifStmt->line);
     
     // Else branch
-    intermediateCode.push_back(ThreeAddressCode("LABEL", "", "", elseLabel, ifStmt->line));
+    emit(TacOp::LABEL, Operand(), Operand(), elseLabel, ifStmt->line);
     symbolManager.enterScope();
     for (auto& stmt : ifStmt->elseBranch) {
-        generateStatement(stmt.get());
+        generateStatement(stmt);
     }
     symbolManager.exitScope();
     
-    intermediateCode.push_back(ThreeAddressCode("LABEL", "", "", endLabel, ifStmt->line));
+    emit(TacOp::LABEL, Operand(), Operand(), endLabel, ifStmt->line);
 }
 
 void CodeGenerator::generateWhileStatement(WhileStmt* whileStmt) {
-    std::string startLabel = newLabel();
-    std::string conditionLabel = newLabel();
-    std::string endLabel = newLabel();
+    Operand startLabel = module.newLabel();
+    Operand conditionLabel = module.newLabel();
+    Operand endLabel = module.newLabel();
     
-    intermediateCode.push_back(ThreeAddressCode("GOTO", "", "", conditionLabel, whileStmt->line));
-    intermediateCode.push_back(ThreeAddressCode("LABEL", "", "", startLabel, whileStmt->line));
+    emit(TacOp::GOTO, Operand(), Operand(), conditionLabel, whileStmt->line);
+    emit(TacOp::LABEL, Operand(), Operand(), startLabel, whileStmt->line);
     
     // Loop body
     symbolManager.enterScope();
     for (auto& stmt : whileStmt->body) {
-        generateStatement(stmt.get());
+        generateStatement(stmt);
     }
     symbolManager.exitScope();
     
-    intermediateCode.push_back(ThreeAddressCode("LABEL", "", "", conditionLabel, whileStmt->line));
-    std::string condition = generateExpression(whileStmt->condition.get());
-    intermediateCode.push_back(ThreeAddressCode("IF", condition, "", startLabel, whileStmt->line));
+    emit(TacOp::LABEL, Operand(), Operand(), conditionLabel, whileStmt->line);
+    Operand condition = generateExpression(whileStmt->condition);
+    emit(TacOp::IF, condition, Operand(), startLabel, whileStmt->line);
     
-    intermediateCode.push_back(ThreeAddressCode("LABEL", "", "", endLabel, whileStmt->line));
+    emit(TacOp::LABEL, Operand(), Operand(), endLabel, whileStmt->line);
 }
 
 void CodeGenerator::generateReturnStatement(ReturnStmt* returnStmt) {
     if (returnStmt->value) {
-        std::string value = generateExpression(returnStmt->value.get());
-        intermediateCode.push_back(ThreeAddressCode("RETURN", value, "", "", returnStmt->line));
+        Operand value = generateExpression(returnStmt->value);
+        emit(TacOp::RETURN, value, Operand(), Operand(), returnStmt->line);
     } else {
-        intermediateCode.push_back(ThreeAddressCode("RETURN", "", "", "", returnStmt->line));
+        emit(TacOp::RETURN, Operand(), Operand(), Operand(), returnStmt->line);
     }
 }
 
 void CodeGenerator::generateExpressionStatement(ExpressionStmt* exprStmt) {
-    generateExpression(exprStmt->expression.get()); // Result discarded
+    generateExpression(exprStmt->expression); // Result discarded
 }
 
-std::string CodeGenerator::generateExpression(Expr* expr) {
-    if (auto binary = dynamic_cast<BinaryExpr*>(expr)) {
-        return generateBinaryExpression(binary);
-    } else if (auto unary = dynamic_cast<UnaryExpr*>(expr)) {
-        return generateUnaryExpression(unary);
-    } else if (auto literal = dynamic_cast<LiteralExpr*>(expr)) {
-        return generateLiteralExpression(literal);
-    } else if (auto variable = dynamic_cast<VariableExpr*>(expr)) {
-        return generateVariableExpression(variable);
-    } else if (auto call = dynamic_cast<CallExpr*>(expr)) {
-        return generateCallExpression(call);
-    } else if (auto sequence = dynamic_cast<SequenceExpr*>(expr)) {
-        return generateSequenceExpression(sequence);
+Operand CodeGenerator::generateExpression(Expr* expr) {
+    switch (expr->kind) {
+        case NodeKind::BINARY: return generateBinaryExpression(static_cast<BinaryExpr*>(expr));
+        case NodeKind::UNARY: return generateUnaryExpression(static_cast<UnaryExpr*>(expr));
+        case NodeKind::LITERAL: return generateLiteralExpression(static_cast<LiteralExpr*>(expr));
+        case NodeKind::VARIABLE: return generateVariableExpression(static_cast<VariableExpr*>(expr));
+        case NodeKind::CALL: return generateCallExpression(static_cast<CallExpr*>(expr));
+        case NodeKind::SEQUENCE: return generateSequenceExpression(static_cast<SequenceExpr*>(expr));
+        default: return Operand();
     }
-    return "error";
 }
 
-std::string CodeGenerator::generateBinaryExpression(BinaryExpr* binaryExpr) {
-    std::string left = generateExpression(binaryExpr->left.get());
-    std::string right = generateExpression(binaryExpr->right.get());
-    std::string result = newTemp();
-    std::string op = getOperatorTAC(binaryExpr->op.type);
+Operand CodeGenerator::generateBinaryExpression(BinaryExpr* binaryExpr) {
+    Operand left = generateExpression(binaryExpr->left);
+    Operand right = generateExpression(binaryExpr->right);
+    Operand result = module.newTemp();
     
-    intermediateCode.push_back(ThreeAddressCode(op, left, right, result, binaryExpr->line));
+    emit(getOperatorTAC(binaryExpr->op, false), left, right, result, binaryExpr->line);
     return result;
 }
 
-std::string CodeGenerator::generateUnaryExpression(UnaryExpr* unaryExpr) {
-    std::string expr = generateExpression(unaryExpr->right.get());
-    std::string result = newTemp();
-    std::string op = getOperatorTAC(unaryExpr->op.type);
+Operand CodeGenerator::generateUnaryExpression(UnaryExpr* unaryExpr) {
+    Operand expr = generateExpression(unaryExpr->right);
+    Operand result = module.newTemp();
     
-    intermediateCode.push_back(ThreeAddressCode(op, expr, "", result, unaryExpr->line));
+    emit(getOperatorTAC(unaryExpr->op, true), expr, Operand(), result, unaryExpr->line);
     return result;
 }
 
-std::string CodeGenerator::generateLiteralExpression(LiteralExpr* literalExpr) {
-    return literalExpr->value.lexeme;
+Operand CodeGenerator::generateLiteralExpression(LiteralExpr* literalExpr) {
+    switch (literalExpr->literal) {
+        case TokenType::NUMBER:
+            if (literalExpr->exceedsInt64) return module.bigIntConstant(literalExpr->text.text());
+            return module.intConstant(literalExpr->intValue, literalExpr->text.text());
+        case TokenType::FLOAT:
+            return module.floatConstant(literalExpr->floatValue, literalExpr->text.text());
+        case TokenType::TRUE:
+        case TokenType::FALSE:
+            return module.boolConstant(literalExpr->literal == TokenType::TRUE);
+        default:
+            return module.stringConstant(literalExpr->text.text());
+    }
 }
 
-std::string CodeGenerator::generateVariableExpression(VariableExpr* varExpr) {
-    return varExpr->name.lexeme;
+Operand CodeGenerator::generateVariableExpression(VariableExpr* varExpr) {
+    return variableName(varExpr->name, varExpr->slot);
 }
 
-std::string CodeGenerator::generateCallExpression(CallExpr* callExpr) {
-    std::string result = newTemp();
-    std::string args;
+Operand CodeGenerator::generateCallExpression(CallExpr* callExpr) {
+    Operand result = module.newTemp();
     
     // Generate arguments
     for (size_t i = 0; i < callExpr->arguments.size(); ++i) {
-        std::string arg = generateExpression(callExpr->arguments[i].get());
-        intermediateCode.push_back(ThreeAddressCode("PARAM", arg, "", "", callExpr->line));
-        if (!args.empty()) args += ", ";
-        args += arg;
+        Operand arg = generateExpression(callExpr->arguments[i]);
+        emit(TacOp::PARAM, arg, Operand(), Operand(), callExpr->line);
     }
     
-    intermediateCode.push_back(ThreeAddressCode("CALL", callExpr->callee.lexeme, args, result, callExpr->line));
+    // arg2 carries the parameter count so nested calls can be unwound
+    Operand argCount = Operand::immediate(static_cast<uint32_t>(callExpr->arguments.size()));
+    emit(TacOp::CALL, module.function(callExpr->callee.text()), argCount, result, callExpr->line);
     return result;
 }
 
-std::string CodeGenerator::generateSequenceExpression(SequenceExpr* seqExpr) {
-    std::string result = newTemp();
-    intermediateCode.push_back(ThreeAddressCode("ASSIGN", "[]", "", result, seqExpr->line));
+Operand CodeGenerator::generateSequenceExpression(SequenceExpr* seqExpr) {
+    Operand result = module.newTemp();
+    emit(TacOp::NEW_SEQ, Operand(), Operand(), result, seqExpr->line);
     
     for (size_t i = 0; i < seqExpr->elements.size(); ++i) {
-        std::string element = generateExpression(seqExpr->elements[i].get());
-        intermediateCode.push_back(ThreeAddressCode("STORE", element, std::to_string(i), result, seqExpr->line));
+        Operand element = generateExpression(seqExpr->elements[i]);
+        emit(TacOp::STORE, element, Operand::immediate(static_cast<uint32_t>(i)), result, seqExpr->line);
     }
     
     return result;
 }
 
-std::string CodeGenerator::getOperatorTAC(TokenType op) {
+TacOp CodeGenerator::getOperatorTAC(TokenType op, bool unary) {
     switch (op) {
-        case TokenType::PLUS: return "+";
-        case TokenType::MINUS: return "-";
-        case TokenType::MULTIPLY: return "*";
-        case TokenType::DIVIDE: return "/";
-        case TokenType::MODULO: return "%";
-        case TokenType::EQUALS: return "==";
-        case TokenType::NOT_EQUALS: return "!=";
-        case TokenType::LESS: return "<";
-        case TokenType::LESS_EQUAL: return "<=";
-        case TokenType::GREATER: return ">";
-        case TokenType::GREATER_EQUAL: return ">=";
-        case TokenType::AND: return "&&";
-        case TokenType::OR: return "||";
-        case TokenType::NOT: return "!";
-        default: return "?";
+        case TokenType::PLUS: return TacOp::ADD;
+        case TokenType::MINUS: return unary ? TacOp::NEG : TacOp::SUB;
+        case TokenType::MULTIPLY: return TacOp::MUL;
+        case TokenType::DIVIDE: return TacOp::DIV;
+        case TokenType::MODULO: return TacOp::MOD;
+        case TokenType::EQUALS: return TacOp::EQ;
+        case TokenType::NOT_EQUALS: return TacOp::NE;
+        case TokenType::LESS: return TacOp::LT;
+        case TokenType::LESS_EQUAL: return TacOp::LE;
+        case TokenType::GREATER: return TacOp::GT;
+        case TokenType::GREATER_EQUAL: return TacOp::GE;
+        case TokenType::AND: return TacOp::AND;
+        case TokenType::OR: return TacOp::OR;
+        default: return TacOp::NOT;
     }
 }
 
 void CodeGenerator::printCode(std::ostream& out) {
-    for (const auto& code : intermediateCode) {
-        out << code.toString() << std::endl;
+    for (const auto& code : module.code) {
+        out << module.toString(code) << std::endl;
     }
 }
\ No newline at end of file
@@ -0,0 +1,681 @@
+#include "../include/compile_cache.h"
+#include "../include/codegen.h"
+#include "../include/mapped_file.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+    constexpr char kMagic[8] = {'M', 'S', 'Q', 'C', 'A', 'C', 'H', 'E'};
+    constexpr uint32_t kFormatVersion = 2;
+    constexpr int kNoLine = std::numeric_limits<int>::min();
+
+    // FNV-1a; strings are length-prefixed so that concatenations differ
+    struct Hasher {
+        uint64_t value = 1469598103934665603ULL;
+
+        void bytes(const void* data, size_t size) {
+            const unsigned char* p = static_cast<const unsigned char*>(data);
+            for (size_t i = 0; i < size; ++i) {
+                value ^= p[i];
+                value *= 1099511628211ULL;
+            }
+        }
+        void number(uint64_t n) { bytes(&n, sizeof(n)); }
+        void text(const std::string& s) {
+            number(s.size());
+            bytes(s.data(), s.size());
+        }
+    };
+
+    // Stands for the compiler version: a rebuilt compiler starts with a
+    // cold cache
+    uint64_t compilerIdentity() {
+        static const uint64_t identity = [] {
+            Hasher hasher;
+            std::ifstream self("/proc/self/exe", std::ios::binary);
+            if (self.is_open()) {
+                char buffer[1 << 16];
+                while (self.read(buffer, sizeof(buffer)) || self.gcount() > 0) {
+                    hasher.bytes(buffer, static_cast<size_t>(self.gcount()));
+                }
+            } else {
+                hasher.text(__DATE__ " " __TIME__);
+            }
+            return hasher.value;
+        }();
+        return identity;
+    }
+
+    // The tree of a function in preorder, minus line numbers and what
+    // SemanticAnalyzer derives from it; collects the names it refers to
+    class Normalizer {
+    public:
+        Normalizer(Hasher& hasher, std::vector<std::string>& references) : hasher(hasher), references(references) {}
+
+        void function(const FunctionDecl* function) {
+            hasher.text(function->name.text());
+            hasher.number(static_cast<uint64_t>(function->returnType));
+            hasher.number(function->parameters.size());
+            for (const auto& param : function->parameters) {
+                hasher.text(param.name.text());
+                hasher.number(static_cast<uint64_t>(param.type));
+            }
+            statements(function->body);
+        }
+
+    private:
+        Hasher& hasher;
+        std::vector<std::string>& references;
+
+        void statements(const NodeList<Stmt*>& list) {
+            hasher.number(list.size());
+            for (const Stmt* stmt : list) statement(stmt);
+        }
+
+        void statement(const Stmt* stmt) {
+            hasher.number(static_cast<uint64_t>(stmt->kind));
+            switch (stmt->kind) {
+                case NodeKind::BLOCK:
+                    statements(static_cast<const BlockStmt*>(stmt)->statements);
+                    break;
+                case NodeKind::DECLARATION: {
+                    auto decl = static_cast<const DeclarationStmt*>(stmt);
+                    hasher.text(decl->name.text());
+                    hasher.number(static_cast<uint64_t>(decl->dataType));
+                    expression(decl->initializer);
+                    break;
+                }
+                case NodeKind::ASSIGNMENT: {
+                    auto assignment = static_cast<const AssignmentStmt*>(stmt);
+                    hasher.text(assignment->name.text());
+                    expression(assignment->value);
+                    break;
+                }
+                case NodeKind::IF: {
+                    auto ifStmt = static_cast<const IfStmt*>(stmt);
+                    expression(ifStmt->condition);
+                    statements(ifStmt->thenBranch);
+                    statements(ifStmt->elseBranch);
+                    break;
+                }
+                case NodeKind::WHILE: {
+                    auto whileStmt = static_cast<const WhileStmt*>(stmt);
+                    expression(whileStmt->condition);
+                    statements(whileStmt->body);
+                    break;
+                }
+                case NodeKind::RETURN:
+                    expression(static_cast<const ReturnStmt*>(stmt)->value);
+                    break;
+                case NodeKind::EXPRESSION:
+                    expression(static_cast<const ExpressionStmt*>(stmt)->expression);
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        void expression(const Expr* expr) {
+            if (!expr) {
+                hasher.number(0xff);
+                return;
+            }
+            hasher.number(static_cast<uint64_t>(expr->kind));
+            switch (expr->kind) {
+                case NodeKind::BINARY: {
+                    auto binary = static_cast<const BinaryExpr*>(expr);
+                    hasher.number(static_cast<uint64_t>(binary->op));
+                    expression(binary->left);
+                    expression(binary->right);
+                    break;
+                }
+                case NodeKind::UNARY: {
+                    auto unary = static_cast<const UnaryExpr*>(expr);
+                    hasher.number(static_cast<uint64_t>(unary->op));
+                    expression(unary->right);
+                    break;
+                }
+                case NodeKind::LITERAL: {
+                    auto literal = static_cast<const LiteralExpr*>(expr);
+                    hasher.number(static_cast<uint64_t>(literal->literal));
+                    hasher.text(literal->text.text());
+                    break;
+                }
+                case NodeKind::VARIABLE: {
+                    // Callbacks of map/filter/generate are passed by name
+                    const std::string& name = static_cast<const VariableExpr*>(expr)->name.text();
+                    hasher.text(name);
+                    references.push_back(name);
+                    break;
+                }
+                case NodeKind::CALL: {
+                    auto call = static_cast<const CallExpr*>(expr);
+                    hasher.text(call->callee.text());
+                    references.push_back(call->callee.text());
+                    hasher.number(call->arguments.size());
+                    for (const Expr* argument : call->arguments) expression(argument);
+                    break;
+                }
+                case NodeKind::SEQUENCE: {
+                    auto sequence = static_cast<const SequenceExpr*>(expr);
+                    hasher.number(sequence->elements.size());
+                    for (const Expr* element : sequence->elements) expression(element);
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+    };
+
+    std::string signatureOf(const FunctionDecl* function) {
+        std::string signature = function->name.text() + "(";
+        for (size_t i = 0; i < function->parameters.size(); ++i) {
+            if (i > 0) signature += ",";
+            signature += dataTypeToString(function->parameters[i].type);
+        }
+        signature += ")->" + dataTypeToString(function->returnType);
+        if (function->isPure) signature += " pure";
+        return signature;
+    }
+
+    bool isFunctionEntry(const ThreeAddressCode& instr) {
+        return instr.op == TacOp::LABEL && instr.result.kind() == Operand::Kind::FUNCTION;
+    }
+
+    // Entries are raw records in host byte order; the cache never
+    // leaves the machine that wrote it
+    class Writer {
+    public:
+        template <typename T>
+        void put(T value) {
+            static_assert(std::is_trivially_copyable<T>::value, "raw records only");
+            const char* bytes = reinterpret_cast<const char*>(&value);
+            buffer.append(bytes, sizeof(T));
+        }
+        void text(const std::string& s) {
+            put(static_cast<uint32_t>(s.size()));
+            buffer += s;
+        }
+        const std::string& data() const { return buffer; }
+
+    private:
+        std::string buffer;
+    };
+
+    class Reader {
+    public:
+        explicit Reader(std::string_view data) : data(data) {}
+
+        template <typename T>
+        bool get(T& value) {
+            if (data.size() - offset < sizeof(T)) return false;
+            std::memcpy(&value, data.data() + offset, sizeof(T));
+            offset += sizeof(T);
+            return true;
+        }
+        bool text(std::string& s) {
+            uint32_t size = 0;
+            if (!get(size) || data.size() - offset < size) return false;
+            s.assign(data.data() + offset, size);
+            offset += size;
+            return true;
+        }
+        bool atEnd() const { return offset == data.size(); }
+        size_t remaining() const { return data.size() - offset; }
+
+    private:
+        std::string_view data;
+        size_t offset = 0;
+    };
+}
+
+CompileCache::CompileCache(std::string directory) : directory(std::move(directory)) {
+#ifdef _WIN32
+    _mkdir(this->directory.c_str());
+#else
+    mkdir(this->directory.c_str(), 0777);
+#endif
+}
+
+TacModule CompileCache::compile(Program* program, int level,
+                                const std::vector<std::pair<Optimizer::Pass, bool>>& overrides) {
+    auto configure = [&](Optimizer& optimizer) {
+        for (const auto& choice : overrides) {
+            optimizer.setPassEnabled(choice.first, choice.second);
+        }
+    };
+    Optimizer settings(TacModule(), level);
+    configure(settings);
+    uint64_t passes = 0;
+    for (size_t p = 0; p < static_cast<size_t>(Optimizer::Pass::COUNT); ++p) {
+        if (settings.isPassEnabled(static_cast<Optimizer::Pass>(p))) passes |= 1ULL << p;
+    }
+    const bool inlining = settings.isPassEnabled(Optimizer::Pass::INLINE);
+
+    const std::vector<FunctionDecl*>& functions = program->functions;
+    const size_t count = functions.size();
+    std::unordered_map<std::string, uint32_t> byName;
+    for (uint32_t f = 0; f < count; ++f) byName.emplace(functions[f]->name.text(), f);
+
+    std::vector<uint64_t> bodies(count);
+    std::vector<std::string> signatures(count);
+    std::vector<std::vector<uint32_t>> callees(count);
+    for (uint32_t f = 0; f < count; ++f) {
+        Hasher hasher;
+        std::vector<std::string> references;
+        Normalizer(hasher, references).function(functions[f]);
+        bodies[f] = hasher.value;
+        signatures[f] = signatureOf(functions[f]);
+        for (const auto& name : references) {
+            auto it = byName.find(name);
+            if (it != byName.end()) callees[f].push_back(it->second);
+        }
+        std::sort(callees[f].begin(), callees[f].end());
+        callees[f].erase(std::unique(callees[f].begin(), callees[f].end()), callees[f].end());
+    }
+
+    // Everything reachable from `roots`, the roots included
+    auto reach = [&](const std::vector<uint32_t>& roots) {
+        std::vector<bool> seen(count, false);
+        std::vector<uint32_t> pending = roots;
+        std::vector<uint32_t> reached;
+        while (!pending.empty()) {
+            uint32_t f = pending.back();
+            pending.pop_back();
+            if (seen[f]) continue;
+            seen[f] = true;
+            reached.push_back(f);
+            for (uint32_t callee : callees[f]) pending.push_back(callee);
+        }
+        std::sort(reached.begin(), reached.end());
+        return reached;
+    };
+
+    // Named rather than positional, so reordering the source changes nothing
+    auto byNameOrder = [&](uint32_t a, uint32_t b) {
+        return functions[a]->name.text() < functions[b]->name.text();
+    };
+
+    // With inlining, a function's code depends on the body of everything it
+    // can reach. Rather than walk the graph once per function, give each
+    // strongly connected component of the call graph one hash over its own
+    // members and the hashes of the components it calls, callees first
+    // (Tarjan's algorithm finishes them in that order)
+    std::vector<uint64_t> reachable(count);
+    if (inlining) {
+        std::vector<int> order(count, -1);
+        std::vector<int> low(count, 0);
+        std::vector<int> component(count, -1);
+        std::vector<uint32_t> stack;
+        int visited = 0;
+        int components = 0;
+        std::function<void(uint32_t)> visit = [&](uint32_t f) {
+            order[f] = low[f] = visited++;
+            stack.push_back(f);
+            for (uint32_t callee : callees[f]) {
+                if (order[callee] < 0) {
+                    visit(callee);
+                    low[f] = std::min(low[f], low[callee]);
+                } else if (component[callee] < 0) {
+                    low[f] = std::min(low[f], order[callee]);
+                }
+            }
+            if (low[f] != order[f]) return;
+
+            std::vector<uint32_t> members;
+            uint32_t member;
+            do {
+                member = stack.back();
+                stack.pop_back();
+                component[member] = components;
+                members.push_back(member);
+            } while (member != f);
+            std::vector<uint64_t> below;
+            for (uint32_t m : members) {
+                for (uint32_t callee : callees[m]) {
+                    if (component[callee] != components) below.push_back(reachable[callee]);
+                }
+            }
+            ++components;
+
+            std::sort(members.begin(), members.end(), byNameOrder);
+            std::sort(below.begin(), below.end());
+            below.erase(std::unique(below.begin(), below.end()), below.end());
+            Hasher hasher;
+            for (uint32_t m : members) {
+                hasher.text(signatures[m]);
+                hasher.number(bodies[m]);
+            }
+            for (uint64_t hash : below) hasher.number(hash);
+            for (uint32_t m : members) reachable[m] = hasher.value;
+        };
+        for (uint32_t f = 0; f < count; ++f) {
+            if (order[f] < 0) visit(f);
+        }
+    }
+
+    std::vector<uint64_t> keys(count);
+    for (uint32_t f = 0; f < count; ++f) {
+        Hasher hasher;
+        hasher.number(compilerIdentity());
+        hasher.number(kFormatVersion);
+        hasher.number(static_cast<uint64_t>(settings.level()));
+        hasher.number(passes);
+        hasher.number(bodies[f]);
+        hasher.text(signatures[f]);
+        if (inlining) {
+            hasher.number(reachable[f]);
+        } else {
+            std::vector<uint32_t> dependencies = callees[f];
+            std::sort(dependencies.begin(), dependencies.end(), byNameOrder);
+            for (uint32_t dependency : dependencies) hasher.text(signatures[dependency]);
+        }
+        keys[f] = hasher.value;
+    }
+
+    std::vector<Entry> entries(count);
+    std::vector<uint32_t> missing;
+    for (uint32_t f = 0; f < count; ++f) {
+        if (load(keys[f], entries[f])) {
+            ++stats.hits;
+        } else {
+            ++stats.misses;
+            missing.push_back(f);
+        }
+    }
+
+    if (!missing.empty()) {
+        std::vector<uint32_t> lowered = inlining ? reach(missing) : missing;
+        std::vector<FunctionDecl*> subset;
+        for (uint32_t f : lowered) subset.push_back(functions[f]);
+        stats.lowered += subset.size();
+
+        CodeGenerator codegen;
+        TacModule code = codegen.generate(subset);
+        if (passes != 0) {
+            Optimizer optimizer(std::move(code), level);
+            configure(optimizer);
+            code = optimizer.optimize();
+        }
+
+        std::vector<bool> wanted(count, false);
+        for (uint32_t f : missing) wanted[f] = true;
+        for (size_t begin = 0; begin < code.code.size();) {
+            size_t end = begin + 1;
+            while (end < code.code.size() && !isFunctionEntry(code.code[end])) ++end;
+            if (isFunctionEntry(code.code[begin])) {
+                auto it = byName.find(code.name(code.code[begin].result));
+                if (it != byName.end() && wanted[it->second]) {
+                    uint32_t f = it->second;
+                    entries[f] = extract(code, begin, end, functions[f]->line);
+                    store(keys[f], entries[f]);
+                    wanted[f] = false;
+                }
+            }
+            begin = end;
+        }
+        for (uint32_t f : missing) {
+            if (wanted[f]) {
+                throw std::runtime_error("Cache error: no code for function '" + functions[f]->name.text() + "'");
+            }
+        }
+    }
+
+    TacModule module;
+    for (uint32_t f = 0; f < count; ++f) {
+        append(entries[f], functions[f]->line, module);
+    }
+    return module;
+}
+
+CompileCache::Entry CompileCache::extract(const TacModule& module, size_t begin, size_t end, int line) {
+    Entry entry;
+    std::unordered_map<uint32_t, uint32_t> names;
+    std::unordered_map<uint32_t, uint32_t> constants;
+    std::unordered_map<uint32_t, uint32_t> temps;
+    std::unordered_map<uint32_t, uint32_t> labels;
+
+    auto local = [&](Operand operand) {
+        uint32_t index = operand.index();
+        switch (operand.kind()) {
+            case Operand::Kind::TEMP:
+                index = temps.emplace(index, static_cast<uint32_t>(temps.size())).first->second;
+                break;
+            case Operand::Kind::LABEL:
+                index = labels.emplace(index, static_cast<uint32_t>(labels.size())).first->second;
+                break;
+            case Operand::Kind::VARIABLE:
+            case Operand::Kind::FUNCTION: {
+                auto inserted = names.emplace(index, static_cast<uint32_t>(entry.names.size()));
+                if (inserted.second) entry.names.push_back(module.names.text(index));
+                index = inserted.first->second;
+                break;
+            }
+            case Operand::Kind::CONSTANT: {
+                auto inserted = constants.emplace(index, static_cast<uint32_t>(entry.constants.size()));
+                if (inserted.second) entry.constants.push_back(module.constants[index]);
+                index = inserted.first->second;
+                break;
+            }
+            default:
+                return operand;
+        }
+        return Operand::make(operand.kind(), index);
+    };
+
+    for (size_t i = begin; i < end; ++i) {
+        const ThreeAddressCode& instr = module.code[i];
+        entry.code.emplace_back(instr.op, local(instr.arg1), local(instr.arg2), local(instr.result),
+                                instr.line < 0 ? kNoLine : instr.line - line);
+    }
+    entry.temps = static_cast<uint32_t>(temps.size());
+    entry.labels = static_cast<uint32_t>(labels.size());
+    return entry;
+}
+
+void CompileCache::append(const Entry& entry, int line, TacModule& module) {
+    std::vector<uint32_t> names;
+    for (const auto& name : entry.names) names.push_back(module.names.intern(name));
+    std::vector<uint32_t> constants;
+    for (const auto& constant : entry.constants) {
+        Operand operand;
+        switch (constant.kind) {
+            case TacConstant::Kind::INT: operand = module.intConstant(constant.intValue, constant.text); break;
+            case TacConstant::Kind::FLOAT: operand = module.floatConstant(constant.floatValue, constant.text); break;
+            case TacConstant::Kind::BOOL: operand = module.boolConstant(constant.intValue != 0); break;
+            case TacConstant::Kind::STRING: operand = module.stringConstant(constant.text); break;
+            case TacConstant::Kind::BIGINT: operand = module.bigIntConstant(constant.text); break;
+        }
+        constants.push_back(operand.index());
+    }
+
+    const uint32_t tempBase = module.tempCount;
+    const uint32_t labelBase = module.labelCount;
+    auto relocate = [&](Operand operand) {
+        switch (operand.kind()) {
+            case Operand::Kind::TEMP: return Operand::temp(tempBase + operand.index());
+            case Operand::Kind::LABEL: return Operand::label(labelBase + operand.index());
+            case Operand::Kind::VARIABLE:
+            case Operand::Kind::FUNCTION: return Operand::make(operand.kind(), names[operand.index()]);
+            case Operand::Kind::CONSTANT: return Operand::make(operand.kind(), constants[operand.index()]);
+            default: return operand;
+        }
+    };
+
+    for (const auto& instr : entry.code) {
+        module.code.emplace_back(instr.op, relocate(instr.arg1), relocate(instr.arg2), relocate(instr.result),
+                                 instr.line == kNoLine ? -1 : instr.line + line);
+    }
+    module.tempCount += entry.temps;
+    module.labelCount += entry.labels;
+}
+
+std::string CompileCache::entryPath(uint64_t key) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.tac", static_cast<unsigned long long>(key));
+    return directory + "/" + name;
+}
+
+// An entry in a shared directory may be cut short, damaged or written by
+// someone else, so anything that does not check out is a miss: the payload
+// must match its checksum, every count must fit in the bytes left, and every
+// operand must stay within the entry's own tables.
+bool CompileCache::load(uint64_t key, Entry& entry) const {
+    MappedFile file;
+    if (!file.open(entryPath(key))) return false;
+    Reader in(file.text());
+
+    char magic[sizeof(kMagic)] = {};
+    uint32_t version = 0;
+    uint64_t stored = 0;
+    uint64_t checksum = 0;
+    for (char& c : magic) {
+        if (!in.get(c)) return false;
+    }
+    if (std::memcmp(magic, kMagic, sizeof(kMagic)) != 0 || !in.get(version) || version != kFormatVersion ||
+        !in.get(stored) || stored != key || !in.get(checksum)) {
+        return false;
+    }
+    Hasher payload;
+    payload.bytes(file.text().data() + file.text().size() - in.remaining(), in.remaining());
+    if (payload.value != checksum) return false;
+
+    // Smallest encodings: a length prefix, a constant with empty text, an
+    // instruction
+    constexpr size_t kNameBytes = sizeof(uint32_t);
+    constexpr size_t kConstantBytes = sizeof(uint8_t) + sizeof(int64_t) + sizeof(double) + sizeof(uint32_t);
+    constexpr size_t kInstructionBytes = sizeof(uint8_t) + 3 * sizeof(uint32_t) + sizeof(int32_t);
+
+    Entry loaded;
+    uint32_t count = 0;
+    if (!in.get(count) || count > in.remaining() / kNameBytes) return false;
+    loaded.names.resize(count);
+    for (auto& name : loaded.names) {
+        if (!in.text(name)) return false;
+    }
+
+    if (!in.get(count) || count > in.remaining() / kConstantBytes) return false;
+    loaded.constants.resize(count);
+    for (auto& constant : loaded.constants) {
+        uint8_t kind = 0;
+        int64_t intValue = 0;
+        if (!in.get(kind) || kind > static_cast<uint8_t>(TacConstant::Kind::BIGINT) || !in.get(intValue) ||
+            !in.get(constant.floatValue) || !in.text(constant.text)) {
+            return false;
+        }
+        constant.kind = static_cast<TacConstant::Kind>(kind);
+        constant.intValue = intValue;
+        if (constant.kind == TacConstant::Kind::BIGINT) {
+            size_t sign = !constant.text.empty() && constant.text[0] == '-' ? 1 : 0;
+            if (constant.text.size() == sign ||
+                constant.text.find_first_not_of("0123456789", sign) != std::string::npos) {
+                return false;
+            }
+        }
+    }
+
+    if (!in.get(loaded.temps) || !in.get(loaded.labels) || !in.get(count) ||
+        count > in.remaining() / kInstructionBytes) {
+        return false;
+    }
+    // Each operand names at most one temporary or label
+    if (loaded.temps > 3ull * count || loaded.labels > 3ull * count) return false;
+    loaded.code.reserve(count);
+    auto operand = [](uint32_t raw) {
+        return Operand::make(static_cast<Operand::Kind>(raw >> Operand::kIndexBits), raw & Operand::kIndexMask);
+    };
+    for (uint32_t i = 0; i < count; ++i) {
+        uint8_t op = 0;
+        uint32_t result = 0, arg1 = 0, arg2 = 0;
+        int32_t line = 0;
+        if (!in.get(op) || op > static_cast<uint8_t>(TacOp::NOT) || !in.get(result) || !in.get(arg1) ||
+            !in.get(arg2) || !in.get(line)) {
+            return false;
+        }
+        loaded.code.emplace_back(static_cast<TacOp>(op), operand(arg1), operand(arg2), operand(result), line);
+    }
+    if (!in.atEnd()) return false;
+
+    for (const auto& instr : loaded.code) {
+        for (Operand operand : {instr.result, instr.arg1, instr.arg2}) {
+            uint32_t index = operand.index();
+            switch (operand.kind()) {
+                case Operand::Kind::NONE:
+                case Operand::Kind::IMMEDIATE: break;
+                case Operand::Kind::TEMP: if (index >= loaded.temps) return false; break;
+                case Operand::Kind::LABEL: if (index >= loaded.labels) return false; break;
+                case Operand::Kind::VARIABLE:
+                case Operand::Kind::FUNCTION: if (index >= loaded.names.size()) return false; break;
+                case Operand::Kind::CONSTANT: if (index >= loaded.constants.size()) return false; break;
+                default: return false;
+            }
+        }
+    }
+    entry = std::move(loaded);
+    return true;
+}
+
+void CompileCache::store(uint64_t key, const Entry& entry) const {
+    Writer out;
+    out.put(static_cast<uint32_t>(entry.names.size()));
+    for (const auto& name : entry.names) out.text(name);
+    out.put(static_cast<uint32_t>(entry.constants.size()));
+    for (const auto& constant : entry.constants) {
+        out.put(static_cast<uint8_t>(constant.kind));
+        out.put(static_cast<int64_t>(constant.intValue));
+        out.put(constant.floatValue);
+        out.text(constant.text);
+    }
+    out.put(entry.temps);
+    out.put(entry.labels);
+    out.put(static_cast<uint32_t>(entry.code.size()));
+    for (const auto& instr : entry.code) {
+        out.put(static_cast<uint8_t>(instr.op));
+        out.put(instr.result.raw());
+        out.put(instr.arg1.raw());
+        out.put(instr.arg2.raw());
+        out.put(static_cast<int32_t>(instr.line));
+    }
+    Hasher payload;
+    payload.bytes(out.data().data(), out.data().size());
+    Writer header;
+    for (char c : kMagic) header.put(c);
+    header.put(static_cast<uint32_t>(kFormatVersion));
+    header.put(key);
+    header.put(payload.value);
+
+    // Unique to this thread of this process
+    std::string path = entryPath(key);
+    std::string temporary = path + ".tmp" + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+#ifndef _WIN32
+    temporary += "." + std::to_string(getpid());
+#endif
+    {
+        std::ofstream file(temporary, std::ios::binary);
+        if (!file.is_open()) return;
+        file.write(header.data().data(), static_cast<std::streamsize>(header.data().size()));
+        file.write(out.data().data(), static_cast<std::streamsize>(out.data().size()));
+        if (!file) {
+            file.close();
+            std::remove(temporary.c_str());
+            return;
+        }
+    }
+    if (std::rename(temporary.c_str(), path.c_str()) != 0) std::remove(temporary.c_str());
+}
@@ -0,0 +1,241 @@
+#include "../include/constant_folder.h"
+#include "../include/codegen.h"
+#include "../include/operators.h"
+#include "../include/tac.h"
+#include <climits>
+#include <cmath>
+
+namespace {
+    enum class LiteralKind { INT, FLOAT, BOOL, OTHER };
+
+    LiteralKind kindOf(const LiteralExpr* literal) {
+        switch (literal->literal) {
+            case TokenType::NUMBER: return literal->exceedsInt64 ? LiteralKind::OTHER : LiteralKind::INT;
+            case TokenType::FLOAT: return LiteralKind::FLOAT;
+            case TokenType::TRUE:
+            case TokenType::FALSE: return LiteralKind::BOOL;
+            default: return LiteralKind::OTHER;
+        }
+    }
+
+    double numericValue(const LiteralExpr* literal) {
+        return literal->literal == TokenType::FLOAT
+            ? literal->floatValue
+            : static_cast<double>(literal->intValue);
+    }
+}
+
+size_t ConstantFolder::fold(Program* program) {
+    folded = 0;
+    if (!program) return 0;
+    this->program = program;
+    for (auto& function : program->functions) {
+        foldStatements(function->body);
+    }
+    this->program = nullptr;
+    return folded;
+}
+
+void ConstantFolder::foldStatements(const NodeList<Stmt*>& statements) {
+    for (Stmt* stmt : statements) {
+        foldStatement(stmt);
+    }
+}
+
+void ConstantFolder::foldStatement(Stmt* stmt) {
+    switch (stmt->kind) {
+        case NodeKind::BLOCK:
+            foldStatements(static_cast<BlockStmt*>(stmt)->statements);
+            break;
+        case NodeKind::DECLARATION: {
+            auto declaration = static_cast<DeclarationStmt*>(stmt);
+            if (declaration->initializer) foldExpression(declaration->initializer);
+            break;
+        }
+        case NodeKind::ASSIGNMENT:
+            foldExpression(static_cast<AssignmentStmt*>(stmt)->value);
+            break;
+        case NodeKind::IF: {
+            auto ifStmt = static_cast<IfStmt*>(stmt);
+            foldExpression(ifStmt->condition);
+            foldStatements(ifStmt->thenBranch);
+            foldStatements(ifStmt->elseBranch);
+            break;
+        }
+        case NodeKind::WHILE: {
+            auto whileStmt = static_cast<WhileStmt*>(stmt);
+            foldExpression(whileStmt->condition);
+            foldStatements(whileStmt->body);
+            break;
+        }
+        case NodeKind::RETURN: {
+            auto returnStmt = static_cast<ReturnStmt*>(stmt);
+            if (returnStmt->value) foldExpression(returnStmt->value);
+            break;
+        }
+        case NodeKind::EXPRESSION:
+            foldExpression(static_cast<ExpressionStmt*>(stmt)->expression);
+            break;
+        default:
+            break;
+    }
+}
+
+void ConstantFolder::foldExpression(Expr*& expr) {
+    LiteralExpr* literal = nullptr;
+    switch (expr->kind) {
+        case NodeKind::BINARY: {
+            auto binary = static_cast<BinaryExpr*>(expr);
+            foldExpression(binary->left);
+            foldExpression(binary->right);
+            literal = evaluateBinary(binary);
+            break;
+        }
+        case NodeKind::UNARY: {
+            auto unary = static_cast<UnaryExpr*>(expr);
+            foldExpression(unary->right);
+            literal = evaluateUnary(unary);
+            break;
+        }
+        case NodeKind::CALL:
+            for (Expr*& argument : static_cast<CallExpr*>(expr)->arguments) {
+                foldExpression(argument);
+            }
+            break;
+        case NodeKind::SEQUENCE:
+            for (Expr*& element : static_cast<SequenceExpr*>(expr)->elements) {
+                foldExpression(element);
+            }
+            break;
+        default:
+            break;
+    }
+
+    // The replaced operator stays in the arena until the program goes
+    if (literal) {
+        expr = literal;
+        ++folded;
+    }
+}
+
+LiteralExpr* ConstantFolder::evaluateBinary(BinaryExpr* expr) {
+    auto left = nodeCast<LiteralExpr>(expr->left);
+    auto right = nodeCast<LiteralExpr>(expr->right);
+    if (!left || !right) return nullptr;
+
+    LiteralKind leftKind = kindOf(left);
+    LiteralKind rightKind = kindOf(right);
+    bool numeric = (leftKind == LiteralKind::INT || leftKind == LiteralKind::FLOAT) &&
+                   (rightKind == LiteralKind::INT || rightKind == LiteralKind::FLOAT);
+    bool integers = leftKind == LiteralKind::INT && rightKind == LiteralKind::INT;
+    bool booleans = leftKind == LiteralKind::BOOL && rightKind == LiteralKind::BOOL;
+    int line = expr->line;
+
+    switch (expr->op) {
+        case TokenType::PLUS:
+        case TokenType::MINUS:
+        case TokenType::MULTIPLY:
+        case TokenType::DIVIDE: {
+            if (!numeric) return nullptr;
+            TokenType op = expr->op;
+            if (integers) {
+                // A result beyond 64 bits is a BigInt, made at run time
+                long long result = 0;
+                TacOp tacOp = CodeGenerator::getOperatorTAC(op, false);
+                if (!Operators::checkedInteger(tacOp, left->intValue, right->intValue, result)) return nullptr;
+                return makeInt(result, line);
+            }
+            double a = numericValue(left);
+            double b = numericValue(right);
+            double result = op == TokenType::PLUS ? a + b
+                : op == TokenType::MINUS ? a - b
+                : op == TokenType::MULTIPLY ? a * b
+                : a / b;
+            return std::isfinite(result) ? makeFloat(result, line) : nullptr;
+        }
+        case TokenType::MODULO: {
+            long long result = 0;
+            if (!integers || !Operators::checkedInteger(TacOp::MOD, left->intValue, right->intValue, result)) {
+                return nullptr;
+            }
+            return makeInt(result, line);
+        }
+        case TokenType::LESS:
+        case TokenType::LESS_EQUAL:
+        case TokenType::GREATER:
+        case TokenType::GREATER_EQUAL: {
+            if (!numeric) return nullptr;
+            TacOp tacOp = CodeGenerator::getOperatorTAC(expr->op, false);
+            if (integers) {
+                long long a = left->intValue;
+                long long b = right->intValue;
+                return makeBool(tacOp == TacOp::LT ? a < b : tacOp == TacOp::LE ? a <= b
+                                : tacOp == TacOp::GT ? a > b : a >= b, line);
+            }
+            double a = numericValue(left);
+            double b = numericValue(right);
+            return makeBool(tacOp == TacOp::LT ? a < b : tacOp == TacOp::LE ? a <= b
+                            : tacOp == TacOp::GT ? a > b : a >= b, line);
+        }
+        case TokenType::EQUALS:
+        case TokenType::NOT_EQUALS: {
+            // Floats and mixed operands compare by their printed form at run
+            // time, so only integers and booleans are folded
+            bool equal;
+            if (integers) {
+                equal = left->intValue == right->intValue;
+            } else if (booleans) {
+                equal = left->literal == right->literal;
+            } else {
+                return nullptr;
+            }
+            return makeBool(expr->op == TokenType::EQUALS ? equal : !equal, line);
+        }
+        case TokenType::AND:
+        case TokenType::OR: {
+            if (!booleans) return nullptr;
+            bool a = left->literal == TokenType::TRUE;
+            bool b = right->literal == TokenType::TRUE;
+            return makeBool(expr->op == TokenType::AND ? (a && b) : (a || b), line);
+        }
+        default:
+            return nullptr;
+    }
+}
+
+LiteralExpr* ConstantFolder::evaluateUnary(UnaryExpr* expr) {
+    auto operand = nodeCast<LiteralExpr>(expr->right);
+    if (!operand) return nullptr;
+
+    LiteralKind kind = kindOf(operand);
+    if (expr->op == TokenType::MINUS) {
+        if (kind == LiteralKind::INT) {
+            return operand->intValue == LLONG_MIN ? nullptr : makeInt(-operand->intValue, expr->line);
+        }
+        if (kind == LiteralKind::FLOAT) return makeFloat(-operand->floatValue, expr->line);
+    } else if (expr->op == TokenType::NOT && kind == LiteralKind::BOOL) {
+        return makeBool(operand->literal != TokenType::TRUE, expr->line);
+    }
+    return nullptr;
+}
+
+LiteralExpr* ConstantFolder::makeInt(long long value, int line) {
+    auto literal = program->make<LiteralExpr>(TokenType::NUMBER, program->names.intern(std::to_string(value)), line);
+    literal->intValue = value;
+    literal->type = DataType::INT;
+    return literal;
+}
+
+LiteralExpr* ConstantFolder::makeFloat(double value, int line) {
+    auto literal = program->make<LiteralExpr>(TokenType::FLOAT, program->names.intern(formatFloatLiteral(value)), line);
+    literal->floatValue = value;
+    literal->type = DataType::FLOAT;
+    return literal;
+}
+
+LiteralExpr* ConstantFolder::makeBool(bool value, int line) {
+    auto literal = program->make<LiteralExpr>(
+        value ? TokenType::TRUE : TokenType::FALSE, program->names.intern(value ? "true" : "false"), line);
+    literal->type = DataType::BOOL;
+    return literal;
+}
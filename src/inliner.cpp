@@ -0,0 +1,284 @@
+#include "../include/inliner.h"
+#include <functional>
+#include <unordered_set>
+
+namespace {
+    bool isFunctionEntry(const ThreeAddressCode& instr) {
+        return instr.op == TacOp::LABEL && instr.result.kind() == Operand::Kind::FUNCTION;
+    }
+
+    bool isJump(TacOp op) {
+        return op == TacOp::GOTO || op == TacOp::IF_FALSE || op == TacOp::IF;
+    }
+}
+
+Inliner::Stats Inliner::run() {
+    split();
+    buildCallGraph();
+    markRecursive();
+
+    // Callees first, so their own calls are flattened before they are copied
+    std::vector<uint8_t> state(functions.size(), 0);
+    std::function<void(uint32_t)> visit = [&](uint32_t f) {
+        state[f] = 1;
+        for (uint32_t callee : functions[f].callees) {
+            if (state[callee] == 0) visit(callee);
+        }
+        inlineCalls(functions[f]);
+        functions[f].inlinable = canInline(functions[f]);
+        state[f] = 2;
+    };
+    for (uint32_t f = 0; f < functions.size(); ++f) {
+        if (state[f] == 0) visit(f);
+    }
+
+    // Reassemble in the original order; anything ahead of the first
+    // function entry was kept in place by split()
+    for (const Function& function : functions) {
+        module.code.push_back(function.entry);
+        module.code.insert(module.code.end(), function.body.begin(), function.body.end());
+    }
+    return stats;
+}
+
+void Inliner::split() {
+    std::vector<ThreeAddressCode> code = std::move(module.code);
+    module.code.clear();
+
+    size_t i = 0;
+    while (i < code.size() && !isFunctionEntry(code[i])) {
+        module.code.push_back(code[i++]);
+    }
+    while (i < code.size()) {
+        Function function{code[i].result, code[i], {}, 0, {}, false, false};
+        size_t end = i + 1;
+        while (end < code.size() && !isFunctionEntry(code[end])) ++end;
+        function.body.assign(code.begin() + i + 1, code.begin() + end);
+
+        // The code generator copies each param_x into x first, in order
+        while (function.parameters < function.body.size()) {
+            const ThreeAddressCode& instr = function.body[function.parameters];
+            if (instr.op != TacOp::ASSIGN || instr.arg1.kind() != Operand::Kind::VARIABLE ||
+                module.name(instr.arg1).compare(0, 6, "param_") != 0) break;
+            ++function.parameters;
+        }
+
+        uint32_t index = static_cast<uint32_t>(functions.size());
+        functionIndex.emplace(function.name, index);
+        byName.emplace(function.name.index(), index);
+        functions.push_back(std::move(function));
+        i = end;
+    }
+}
+
+void Inliner::buildCallGraph() {
+    for (Function& function : functions) {
+        std::unordered_set<Operand, OperandHash> written;
+        for (const auto& instr : function.body) {
+            if (instr.result.isValue()) written.insert(instr.result);
+        }
+
+        std::unordered_set<uint32_t> seen;
+        auto add = [&](Operand operand, bool callback) {
+            if (callback && (operand.kind() != Operand::Kind::VARIABLE || written.count(operand))) return;
+            auto it = byName.find(operand.index());
+            if (it != byName.end() && seen.insert(it->second).second) {
+                function.callees.push_back(it->second);
+            }
+        };
+        for (const auto& instr : function.body) {
+            if (instr.op == TacOp::CALL) add(instr.arg1, false);
+            add(instr.arg1, true);
+            add(instr.arg2, true);
+        }
+    }
+}
+
+void Inliner::markRecursive() {
+    for (uint32_t f = 0; f < functions.size(); ++f) {
+        std::vector<bool> reached(functions.size(), false);
+        std::vector<uint32_t> pending(functions[f].callees);
+        while (!pending.empty() && !functions[f].recursive) {
+            uint32_t g = pending.back();
+            pending.pop_back();
+            if (reached[g]) continue;
+            reached[g] = true;
+            if (g == f) functions[f].recursive = true;
+            pending.insert(pending.end(), functions[g].callees.begin(), functions[g].callees.end());
+        }
+    }
+}
+
+bool Inliner::canInline(const Function& callee) const {
+    if (callee.recursive || callee.body.empty()) return false;
+    if (callee.body.size() - callee.parameters > maxCalleeSize) return false;
+    // Falling off the end returns void, which a copy could not reproduce
+    if (callee.body.back().op != TacOp::RETURN) return false;
+
+    // Either every return has a value or none has
+    bool valued = !callee.body.back().arg1.empty();
+    std::unordered_map<Operand, size_t, OperandHash> labels;
+    for (size_t i = 0; i < callee.body.size(); ++i) {
+        const ThreeAddressCode& instr = callee.body[i];
+        if (instr.op == TacOp::RETURN && instr.arg1.empty() == valued) return false;
+        if (instr.op == TacOp::LABEL) labels[instr.result] = i;
+    }
+
+    // A fresh frame starts with every local unset, while a copy inside a
+    // caller's loop would see the previous iteration's values. Only a
+    // callee that writes each local before reading it on every path is
+    // safe; that is checked over forward jumps, and a loop disqualifies
+    std::unordered_set<Operand, OperandHash> assigned;
+    std::unordered_map<Operand, std::unordered_set<Operand, OperandHash>, OperandHash> incoming;
+    bool reachable = true;
+    auto merge = [&](Operand label, const std::unordered_set<Operand, OperandHash>& set) {
+        auto it = incoming.find(label);
+        if (it == incoming.end()) {
+            incoming.emplace(label, set);
+            return;
+        }
+        for (auto name = it->second.begin(); name != it->second.end();) {
+            name = set.count(*name) ? std::next(name) : it->second.erase(name);
+        }
+    };
+    auto reads = [&](Operand operand) {
+        return operand.kind() == Operand::Kind::VARIABLE && !assigned.count(operand) &&
+               module.name(operand).compare(0, 6, "param_") != 0 && !byName.count(operand.index());
+    };
+    for (size_t i = 0; i < callee.body.size(); ++i) {
+        const ThreeAddressCode& instr = callee.body[i];
+        if (instr.op == TacOp::LABEL) {
+            auto it = incoming.find(instr.result);
+            if (!reachable) {
+                assigned = it == incoming.end() ? std::unordered_set<Operand, OperandHash>() : it->second;
+            } else if (it != incoming.end()) {
+                merge(instr.result, assigned);
+                assigned = incoming[instr.result];
+            }
+            reachable = true;
+            continue;
+        }
+        if (!reachable) continue;
+        if (isJump(instr.op)) {
+            auto target = labels.find(instr.result);
+            if (target == labels.end() || target->second < i) return false;
+            if (reads(instr.arg1)) return false;
+            merge(instr.result, assigned);
+            if (instr.op == TacOp::GOTO) reachable = false;
+            continue;
+        }
+        if (instr.op == TacOp::CALL) {
+            if (instr.result.isValue()) assigned.insert(instr.result);
+            continue;
+        }
+        if (reads(instr.arg1) || (isBinaryTacOp(instr.op) && reads(instr.arg2))) return false;
+        bool inPlace = instr.op == TacOp::STORE || instr.op == TacOp::APPEND || instr.op == TacOp::EXTEND;
+        if (inPlace && reads(instr.result)) return false;
+        if (instr.result.isValue()) assigned.insert(instr.result);
+        if (instr.op == TacOp::RETURN) reachable = false;
+    }
+    return true;
+}
+
+void Inliner::inlineCalls(Function& caller) {
+    std::unordered_set<Operand, OperandHash> written;
+    for (const auto& instr : caller.body) {
+        if (instr.result.isValue()) written.insert(instr.result);
+    }
+
+    std::vector<ThreeAddressCode> out;
+    out.reserve(caller.body.size());
+    std::vector<size_t> params;  // Positions in `out` of PARAMs not yet consumed
+    for (const auto& instr : caller.body) {
+        if (instr.op == TacOp::PARAM) {
+            params.push_back(out.size());
+            out.push_back(instr);
+            continue;
+        }
+        if (instr.op != TacOp::CALL) {
+            out.push_back(instr);
+            continue;
+        }
+
+        size_t argCount = instr.arg2.empty() ? 0 : instr.arg2.index();
+        std::vector<size_t> arguments(params.end() - argCount, params.end());
+        params.resize(params.size() - argCount);
+
+        auto it = functionIndex.find(instr.arg1);
+        const Function* callee = it == functionIndex.end() ? nullptr : &functions[it->second];
+        bool inlinable = callee && callee->inlinable && callee != &caller && argCount == callee->parameters &&
+                         out.size() + callee->body.size() <= maxCallerSize;
+        // Callbacks the callee passes on are found by name, which the
+        // caller must not have taken for a local
+        for (size_t i = 0; inlinable && i < callee->body.size(); ++i) {
+            for (Operand operand : {callee->body[i].arg1, callee->body[i].arg2}) {
+                if (operand.kind() == Operand::Kind::VARIABLE && byName.count(operand.index()) &&
+                    written.count(operand)) {
+                    inlinable = false;
+                }
+            }
+        }
+        if (!inlinable) {
+            out.push_back(instr);
+            continue;
+        }
+
+        expand(*callee, arguments, instr.result, instr.line, out);
+        ++stats.callsInlined;
+    }
+    caller.body = std::move(out);
+}
+
+void Inliner::expand(const Function& callee, const std::vector<size_t>& arguments, Operand result, int line,
+                     std::vector<ThreeAddressCode>& out) {
+    std::string suffix = "." + std::to_string(++copies);
+    std::unordered_map<Operand, Operand, OperandHash> renamed;
+    auto rename = [&](Operand operand) -> Operand {
+        switch (operand.kind()) {
+            case Operand::Kind::TEMP:
+            case Operand::Kind::LABEL:
+            case Operand::Kind::VARIABLE:
+                break;
+            default:
+                return operand;
+        }
+        auto it = renamed.find(operand);
+        if (it != renamed.end()) return it->second;
+        Operand fresh = operand;
+        if (operand.isTemp()) {
+            fresh = module.newTemp();
+        } else if (operand.kind() == Operand::Kind::LABEL) {
+            fresh = module.newLabel();
+        } else if (!byName.count(operand.index())) {
+            fresh = module.variable(module.name(operand) + suffix);
+        } else {
+            // A function name passed on as a callback; see inlineCalls()
+            bool written = false;
+            for (const auto& instr : callee.body) written = written || instr.result == operand;
+            if (written) fresh = module.variable(module.name(operand) + suffix);
+        }
+        renamed.emplace(operand, fresh);
+        return fresh;
+    };
+
+    // Each argument is assigned where it was pushed, so it is evaluated at
+    // the same point as before
+    for (size_t k = 0; k < arguments.size(); ++k) {
+        ThreeAddressCode& param = out[arguments[k]];
+        param = ThreeAddressCode(TacOp::ASSIGN, param.arg1, Operand(), rename(callee.body[k].arg1), param.line);
+    }
+
+    Operand end = module.newLabel();
+    for (const auto& instr : callee.body) {
+        if (instr.op == TacOp::RETURN) {
+            if (!instr.arg1.empty() && result.isValue()) {
+                out.emplace_back(TacOp::ASSIGN, rename(instr.arg1), Operand(), result, instr.line);
+            }
+            out.emplace_back(TacOp::GOTO, Operand(), Operand(), end, line);
+            continue;
+        }
+        out.emplace_back(instr.op, rename(instr.arg1), rename(instr.arg2), rename(instr.result), instr.line);
+    }
+    // The jump to a label that follows it is left for the CFG to drop
+    out.emplace_back(TacOp::LABEL, Operand(), Operand(), end, line);
+}
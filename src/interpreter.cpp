@@ -1,128 +1,13 @@
 #include "../include/interpreter.h"
+#include "../include/codegen.h"
+#include "../include/operators.h"
 #include <iostream>
 #include <sstream>
 #include <cmath>
-
-namespace {
-    Interpreter::RuntimeValue ensureNumeric(const Interpreter::RuntimeValue& value, const std::string& op) {
-        if (value.kind != Interpreter::RuntimeValue::Kind::INT &&
-            value.kind != Interpreter::RuntimeValue::Kind::FLOAT) {
-            throw std::runtime_error("Runtime error: operator '" + op + "' requires numeric operands");
-        }
-        return value;
-    }
-}
-
-Interpreter::RuntimeValue Interpreter::RuntimeValue::Void() {
-    return RuntimeValue();
-}
-
-Interpreter::RuntimeValue Interpreter::RuntimeValue::FromInt(long long value) {
-    RuntimeValue v;
-    v.kind = Kind::INT;
-    v.intValue = value;
-    v.floatValue = static_cast<double>(value);
-    return v;
-}
-
-Interpreter::RuntimeValue Interpreter::RuntimeValue::FromFloat(double value) {
-    RuntimeValue v;
-    v.kind = Kind::FLOAT;
-    v.floatValue = value;
-    v.intValue = static_cast<long long>(value);
-    return v;
-}
-
-Interpreter::RuntimeValue Interpreter::RuntimeValue::FromBool(bool value) {
-    RuntimeValue v;
-    v.kind = Kind::BOOL;
-    v.boolValue = value;
-    return v;
-}
-
-Interpreter::RuntimeValue Interpreter::RuntimeValue::FromString(const std::string& value) {
-    RuntimeValue v;
-    v.kind = Kind::STRING;
-    v.stringValue = value;
-    return v;
-}
-
-Interpreter::RuntimeValue Interpreter::RuntimeValue::FromSequence(const std::vector<RuntimeValue>& values) {
-    RuntimeValue v;
-    v.kind = Kind::SEQUENCE;
-    v.sequenceValue = values;
-    return v;
-}
-
-bool Interpreter::RuntimeValue::isNumeric() const {
-    return kind == Kind::INT || kind == Kind::FLOAT;
-}
-
-double Interpreter::RuntimeValue::asFloat() const {
-    if (kind == Kind::FLOAT) return floatValue;
-    if (kind == Kind::INT) return static_cast<double>(intValue);
-    if (kind == Kind::BOOL) return boolValue ? 1.0 : 0.0;
-    throw std::runtime_error("Runtime error: value is not numeric");
-}
-
-long long Interpreter::RuntimeValue::asInt() const {
-    if (kind == Kind::INT) return intValue;
-    if (kind == Kind::FLOAT) return static_cast<long long>(floatValue);
-    if (kind == Kind::BOOL) return boolValue ? 1LL : 0LL;
-    throw std::runtime_error("Runtime error: value is not an integer");
-}
-
-bool Interpreter::RuntimeValue::asBool() const {
-    if (kind == Kind::BOOL) return boolValue;
-    if (isNumeric()) return asFloat() != 0.0;
-    return isTruthy();
-}
-
-bool Interpreter::RuntimeValue::isTruthy() const {
-    switch (kind) {
-        case Kind::VOID:
-            return false;
-        case Kind::BOOL:
-            return boolValue;
-        case Kind::INT:
-            return intValue != 0;
-        case Kind::FLOAT:
-            return std::abs(floatValue) > 1e-9;
-        case Kind::STRING:
-            return !stringValue.empty();
-        case Kind::SEQUENCE:
-            return !sequenceValue.empty();
-    }
-    return false;
-}
-
-std::string Interpreter::RuntimeValue::toString() const {
-    switch (kind) {
-        case Kind::VOID:
-            return "void";
-        case Kind::INT:
-            return std::to_string(intValue);
-        case Kind::FLOAT: {
-            std::ostringstream oss;
-            oss << floatValue;
-            return oss.str();
-        }
-        case Kind::BOOL:
-            return boolValue ? "true" : "false";
-        case Kind::STRING:
-            return stringValue;
-        case Kind::SEQUENCE: {
-            std::string result = "[";
-            for (size_t i = 0; i < sequenceValue.size(); ++i) {
-                if (i > 0) result += ", ";
-                result += sequenceValue[i].toString();
-            }
-            result += "]";
-            return result;
-        }
-    }
-    return "";
-}
+#include <algorithm>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
 
 Interpreter::Interpreter(Program* program)
     : program(program) {
@@ -132,7 +17,9 @@ Interpreter::Interpreter(Program* program)
 void Interpreter::initializeFunctionTable() {
     if (!program) return;
     for (auto& func : program->functions) {
-        functions[func->name.lexeme] = func.get();
+        functions[func->name.text()] = func;
+        functionIds[func->name.text()] = static_cast<uint32_t>(functionIds.size());
+        memoizable.push_back(MemoCache::isCandidate(*func));
     }
 }
 
@@ -150,237 +37,230 @@ Interpreter::ExecutionResult Interpreter::run() {
     }
     
     try {
-        outputLog.clear();
-        scopes.clear();
+        log.clear();
+        stack.clear();
+        frameBase = 0;
+        callDepth = 0;
         RuntimeValue returnValue = executeFunction(it->second, {});
         result.success = true;
-        if (returnValue.kind == RuntimeValue::Kind::VOID) {
+        if (returnValue.kind() == RuntimeValue::Kind::VOID) {
             result.exitCode = 0;
         } else {
             result.exitCode = static_cast<int>(returnValue.asInt());
         }
-        result.outputLog = outputLog;
+        result.outputLog = log.take();
     } catch (const std::exception& e) {
         result.errorMessage = e.what();
-        result.outputLog = outputLog;
+        result.outputLog = log.take();
     }
     
     return result;
 }
 
-void Interpreter::pushScope() {
-    scopes.emplace_back();
+Interpreter::Counters Interpreter::counters() const {
+    Counters total = work;
+    for (const Interpreter* worker : forks) {
+        Counters counted = worker->counters();
+        total.statements += counted.statements;
+        total.calls += counted.calls;
+    }
+    return total;
 }
 
-void Interpreter::popScope() {
-    if (!scopes.empty()) {
-        scopes.pop_back();
-    }
+size_t Interpreter::stackBudget() {
+    static const size_t budget = [] {
+        size_t limit = 8u << 20;  // What glibc gives threads when unlimited
+#ifndef _WIN32
+        rlimit stack;
+        if (getrlimit(RLIMIT_STACK, &stack) == 0 && stack.rlim_cur != RLIM_INFINITY) {
+            limit = static_cast<size_t>(stack.rlim_cur);
+        }
+#else
+        limit = 1u << 20;
+#endif
+        return limit / 4 * 3;
+    }();
+    return budget;
 }
 
-void Interpreter::define(const std::string& name, const RuntimeValue& value) {
-    if (scopes.empty()) {
-        pushScope();
+void Interpreter::checkStack(const char* base, size_t depth) {
+    char marker;
+    // The stack grows down
+    uintptr_t used = reinterpret_cast<uintptr_t>(base) - reinterpret_cast<uintptr_t>(&marker);
+    if (used > stackBudget()) {
+        throw std::runtime_error("Runtime error: call depth exceeds the stack limit (" + std::to_string(depth) +
+                                 " calls deep)");
     }
-    scopes.back()[name] = value;
 }
 
-void Interpreter::assign(const std::string& name, const RuntimeValue& value) {
-    for (auto it = scopes.rbegin(); it != scopes.rend(); ++it) {
-        auto found = it->find(name);
-        if (found != it->end()) {
-            found->second = value;
-            return;
-        }
-    }
-    // Implicit define if not found (defensive)
-    define(name, value);
+void Interpreter::interrupted() {
+    throw std::runtime_error("Runtime error: Execution interrupted");
 }
 
-Interpreter::RuntimeValue Interpreter::get(const std::string& name) {
-    for (auto it = scopes.rbegin(); it != scopes.rend(); ++it) {
-        auto found = it->find(name);
-        if (found != it->end()) {
-            return found->second;
-        }
+Interpreter::RuntimeValue& Interpreter::local(int slot, const std::string& name) {
+    if (slot < 0 || frameBase + static_cast<size_t>(slot) >= stack.size()) {
+        throw std::runtime_error("Runtime error: Undefined variable '" + name + "'");
     }
-    throw std::runtime_error("Runtime error: Undefined variable '" + name + "'");
+    return stack[frameBase + static_cast<size_t>(slot)];
 }
 
 Interpreter::RuntimeValue Interpreter::executeFunction(FunctionDecl* function, const std::vector<RuntimeValue>& args) {
-    pushScope();
+    ++work.calls;
+    checkInterrupt();
+    char marker;
+    if (callDepth == 0) {
+        stackBase = &marker;
+    } else {
+        checkStack(stackBase, callDepth);
+    }
+    ++callDepth;
+    const size_t savedBase = frameBase;
+    const size_t base = stack.size();
+    size_t frameSize = std::max(static_cast<size_t>(function->frameSize), function->parameters.size());
+    stack.resize(base + frameSize);
     
-    for (size_t i = 0; i < function->parameters.size(); ++i) {
-        RuntimeValue value = RuntimeValue::Void();
-        if (i < args.size()) {
-            value = args[i];
-        }
-        define(function->parameters[i].first.lexeme, value);
+    for (size_t i = 0; i < function->parameters.size() && i < args.size(); ++i) {
+        stack[base + i] = args[i];
     }
+    frameBase = base;
     
-    try {
-        for (auto& stmt : function->body) {
-            executeStatement(stmt.get());
-        }
-    } catch (const ReturnSignal& signal) {
-        popScope();
-        return signal.value;
-    } catch (...) {
-        popScope();
-        throw;
+    // A runtime error abandons the whole run, and run() resets the stack
+    // and the depth, so the frame only needs unwinding on the normal path
+    RuntimeValue result;
+    if (executeBlock(function->body) == ExecStatus::RETURN) {
+        result = std::move(returnValue);
     }
     
-    popScope();
-    return RuntimeValue::Void();
+    stack.resize(base);
+    frameBase = savedBase;
+    --callDepth;
+    return result;
 }
 
-void Interpreter::executeBlock(const std::vector<std::unique_ptr<Stmt>>& statements) {
-    pushScope();
-    try {
-        for (const auto& stmt : statements) {
-            executeStatement(stmt.get());
+Interpreter::ExecStatus Interpreter::executeBlock(const NodeList<Stmt*>& statements) {
+    for (Stmt* stmt : statements) {
+        if (executeStatement(stmt) == ExecStatus::RETURN) {
+            return ExecStatus::RETURN;
         }
-    } catch (...) {
-        popScope();
-        throw;
     }
-    popScope();
+    return ExecStatus::NORMAL;
 }
 
-void Interpreter::executeStatement(Stmt* stmt) {
-    if (auto decl = dynamic_cast<DeclarationStmt*>(stmt)) {
-        RuntimeValue value = RuntimeValue::Void();
-        if (decl->initializer) {
-            value = evaluateExpression(decl->initializer.get());
+Interpreter::ExecStatus Interpreter::executeStatement(Stmt* stmt) {
+    ++work.statements;
+    switch (stmt->kind) {
+        case NodeKind::DECLARATION: {
+            auto decl = static_cast<DeclarationStmt*>(stmt);
+            RuntimeValue value = RuntimeValue::Void();
+            if (decl->initializer) {
+                value = evaluateValue(decl->initializer);
+            }
+            local(decl->slot, decl->name.text()) = std::move(value);
+            break;
         }
-        define(decl->name.lexeme, value);
-    } else if (auto assignment = dynamic_cast<AssignmentStmt*>(stmt)) {
-        RuntimeValue value = evaluateExpression(assignment->value.get());
-        assign(assignment->name.lexeme, value);
-    } else if (auto ifStmt = dynamic_cast<IfStmt*>(stmt)) {
-        RuntimeValue condition = evaluateExpression(ifStmt->condition.get());
-        if (condition.asBool()) {
-            pushScope();
-            for (auto& inner : ifStmt->thenBranch) {
-                executeStatement(inner.get());
+        case NodeKind::ASSIGNMENT: {
+            auto assignment = static_cast<AssignmentStmt*>(stmt);
+            if (assignment->appendsToSelf && appendInPlace(assignment)) {
+                return ExecStatus::NORMAL;
             }
-            popScope();
-        } else if (!ifStmt->elseBranch.empty()) {
-            pushScope();
-            for (auto& inner : ifStmt->elseBranch) {
-                executeStatement(inner.get());
+            RuntimeValue value = evaluateValue(assignment->value);
+            local(assignment->slot, assignment->name.text()) = std::move(value);
+            break;
+        }
+        case NodeKind::IF: {
+            auto ifStmt = static_cast<IfStmt*>(stmt);
+            RuntimeValue condition = evaluateExpression(ifStmt->condition);
+            if (condition.asBool()) {
+                return executeBlock(ifStmt->thenBranch);
             }
-            popScope();
+            return executeBlock(ifStmt->elseBranch);
         }
-    } else if (auto whileStmt = dynamic_cast<WhileStmt*>(stmt)) {
-        while (evaluateExpression(whileStmt->condition.get()).asBool()) {
-            pushScope();
-            for (auto& inner : whileStmt->body) {
-                executeStatement(inner.get());
+        case NodeKind::WHILE: {
+            auto whileStmt = static_cast<WhileStmt*>(stmt);
+            while (evaluateExpression(whileStmt->condition).asBool()) {
+                checkInterrupt();
+                if (executeBlock(whileStmt->body) == ExecStatus::RETURN) {
+                    return ExecStatus::RETURN;
+                }
             }
-            popScope();
+            break;
         }
-    } else if (auto returnStmt = dynamic_cast<ReturnStmt*>(stmt)) {
-        RuntimeValue value = RuntimeValue::Void();
-        if (returnStmt->value) {
-            value = evaluateExpression(returnStmt->value.get());
+        case NodeKind::RETURN: {
+            auto returnStmt = static_cast<ReturnStmt*>(stmt);
+            returnValue = RuntimeValue::Void();
+            if (returnStmt->value) {
+                returnValue = evaluateValue(returnStmt->value);
+            }
+            return ExecStatus::RETURN;
         }
-        throw ReturnSignal(value);
-    } else if (auto exprStmt = dynamic_cast<ExpressionStmt*>(stmt)) {
-        evaluateExpression(exprStmt->expression.get());
-    } else if (auto blockStmt = dynamic_cast<BlockStmt*>(stmt)) {
-        executeBlock(blockStmt->statements);
+        case NodeKind::EXPRESSION:
+            evaluateValue(static_cast<ExpressionStmt*>(stmt)->expression);
+            break;
+        case NodeKind::BLOCK:
+            return executeBlock(static_cast<BlockStmt*>(stmt)->statements);
+        default:
+            break;
     }
+    return ExecStatus::NORMAL;
 }
 
-Interpreter::RuntimeValue Interpreter::evaluateExpression(Expr* expr) {
-    if (auto binary = dynamic_cast<BinaryExpr*>(expr)) {
-        return evaluateBinary(binary);
-    } else if (auto unary = dynamic_cast<UnaryExpr*>(expr)) {
-        return evaluateUnary(unary);
-    } else if (auto literal = dynamic_cast<LiteralExpr*>(expr)) {
-        return evaluateLiteral(literal);
-    } else if (auto variable = dynamic_cast<VariableExpr*>(expr)) {
-        return evaluateVariable(variable);
-    } else if (auto call = dynamic_cast<CallExpr*>(expr)) {
-        return evaluateCall(call);
-    } else if (auto sequence = dynamic_cast<SequenceExpr*>(expr)) {
-        return evaluateSequence(sequence);
+bool Interpreter::appendInPlace(AssignmentStmt* assignment) {
+    if (local(assignment->slot, assignment->name.text()).kind() != RuntimeValue::Kind::SEQUENCE) {
+        return false;
     }
-    return RuntimeValue::Void();
-}
-
-Interpreter::RuntimeValue Interpreter::evaluateBinary(BinaryExpr* expr) {
-    RuntimeValue left = evaluateExpression(expr->left.get());
-    RuntimeValue right = evaluateExpression(expr->right.get());
-    TokenType op = expr->op.type;
     
-    auto performNumeric = [&](auto func) -> RuntimeValue {
-        bool useFloat = left.kind == RuntimeValue::Kind::FLOAT || right.kind == RuntimeValue::Kind::FLOAT;
-        double leftVal = left.asFloat();
-        double rightVal = right.asFloat();
-        double value = func(leftVal, rightVal);
-        if (useFloat) {
-            return RuntimeValue::FromFloat(value);
+    // The right-hand side is fully evaluated before the target changes, so
+    // `s = s + [length(s)]` still sees the old s
+    Expr* rhs = static_cast<BinaryExpr*>(assignment->value)->right;
+    if (auto literal = nodeCast<SequenceExpr>(rhs)) {
+        if (literal->elements.size() == 1) {
+            RuntimeValue element = evaluateExpression(literal->elements[0]);
+            local(assignment->slot, assignment->name.text()).appendElement(std::move(element));
+            return true;
         }
-        return RuntimeValue::FromInt(static_cast<long long>(value));
-    };
-    
-    switch (op) {
-        case TokenType::PLUS:
-            if (left.kind == RuntimeValue::Kind::SEQUENCE && right.kind == RuntimeValue::Kind::SEQUENCE) {
-                std::vector<RuntimeValue> combined = left.sequenceValue;
-                combined.insert(combined.end(), right.sequenceValue.begin(), right.sequenceValue.end());
-                return RuntimeValue::FromSequence(combined);
-            }
-            return performNumeric([](double a, double b) { return a + b; });
-        case TokenType::MINUS:
-            return performNumeric([](double a, double b) { return a - b; });
-        case TokenType::MULTIPLY:
-            return performNumeric([](double a, double b) { return a * b; });
-        case TokenType::DIVIDE:
-            return performNumeric([](double a, double b) { return a / b; });
-        case TokenType::MODULO: {
-            long long l = left.asInt();
-            long long r = right.asInt();
-            if (r == 0) {
-                throw std::runtime_error("Runtime error: division by zero");
-            }
-            return RuntimeValue::FromInt(l % r);
-        }
-        case TokenType::EQUALS:
-            return RuntimeValue::FromBool(left.toString() == right.toString());
-        case TokenType::NOT_EQUALS:
-            return RuntimeValue::FromBool(left.toString() != right.toString());
-        case TokenType::LESS:
-            return RuntimeValue::FromBool(left.asFloat() < right.asFloat());
-        case TokenType::LESS_EQUAL:
-            return RuntimeValue::FromBool(left.asFloat() <= right.asFloat());
-        case TokenType::GREATER:
-            return RuntimeValue::FromBool(left.asFloat() > right.asFloat());
-        case TokenType::GREATER_EQUAL:
-            return RuntimeValue::FromBool(left.asFloat() >= right.asFloat());
-        case TokenType::AND:
-            return RuntimeValue::FromBool(left.asBool() && right.asBool());
-        case TokenType::OR:
-            return RuntimeValue::FromBool(left.asBool() || right.asBool());
-        default:
-            break;
     }
     
-    return RuntimeValue::Void();
+    RuntimeValue tail = evaluateExpression(rhs);
+    if (tail.kind() != RuntimeValue::Kind::SEQUENCE) {
+        throw std::runtime_error("Runtime error: value is not numeric");
+    }
+    local(assignment->slot, assignment->name.text()).appendSequence(tail);
+    return true;
+}
+
+Interpreter::RuntimeValue Interpreter::evaluateExpression(Expr* expr) {
+    RuntimeValue value = evaluateValue(expr);
+    if (value.kind() == RuntimeValue::Kind::LAZY) {
+        return builtins.strict(value);
+    }
+    return value;
+}
+
+Interpreter::RuntimeValue Interpreter::evaluateValue(Expr* expr) {
+    switch (expr->kind) {
+        case NodeKind::BINARY: return evaluateBinary(static_cast<BinaryExpr*>(expr));
+        case NodeKind::UNARY: return evaluateUnary(static_cast<UnaryExpr*>(expr));
+        case NodeKind::LITERAL: return evaluateLiteral(static_cast<LiteralExpr*>(expr));
+        case NodeKind::VARIABLE: return evaluateVariable(static_cast<VariableExpr*>(expr));
+        case NodeKind::CALL: return evaluateCall(static_cast<CallExpr*>(expr));
+        case NodeKind::SEQUENCE: return evaluateSequence(static_cast<SequenceExpr*>(expr));
+        default: return RuntimeValue::Void();
+    }
+}
+
+Interpreter::RuntimeValue Interpreter::evaluateBinary(BinaryExpr* expr) {
+    RuntimeValue left = evaluateExpression(expr->left);
+    RuntimeValue right = evaluateExpression(expr->right);
+    // The same operators as compiled code, so int op int stays exact
+    return Operators::binary(CodeGenerator::getOperatorTAC(expr->op, false), left, right);
 }
 
 Interpreter::RuntimeValue Interpreter::evaluateUnary(UnaryExpr* expr) {
-    RuntimeValue value = evaluateExpression(expr->right.get());
+    RuntimeValue value = evaluateExpression(expr->right);
     
-    switch (expr->op.type) {
+    switch (expr->op) {
         case TokenType::MINUS:
-            ensureNumeric(value, "-");
-            if (value.kind == RuntimeValue::Kind::FLOAT) {
-                return RuntimeValue::FromFloat(-value.floatValue);
-            }
-            return RuntimeValue::FromInt(-value.intValue);
+            return Operators::negate(value);
         case TokenType::NOT:
             return RuntimeValue::FromBool(!value.asBool());
         default:
@@ -391,17 +271,20 @@ Interpreter::RuntimeValue Interpreter::evaluateUnary(UnaryExpr* expr) {
 }
 
 Interpreter::RuntimeValue Interpreter::evaluateLiteral(LiteralExpr* expr) {
-    switch (expr->value.type) {
+    switch (expr->literal) {
         case TokenType::NUMBER:
-            return RuntimeValue::FromInt(std::stoll(expr->value.lexeme));
+            // Built afresh like a string literal, so that pool threads
+            // never share it
+            if (expr->exceedsInt64) return RuntimeValue::FromBigInt(BigInt::fromString(expr->text.text()));
+            return RuntimeValue::FromInt(expr->intValue);
         case TokenType::FLOAT:
-            return RuntimeValue::FromFloat(std::stod(expr->value.lexeme));
+            return RuntimeValue::FromFloat(expr->floatValue);
         case TokenType::TRUE:
             return RuntimeValue::FromBool(true);
         case TokenType::FALSE:
             return RuntimeValue::FromBool(false);
         case TokenType::STRING:
-            return RuntimeValue::FromString(expr->value.lexeme);
+            return RuntimeValue::FromString(expr->text.text());
         default:
             break;
     }
@@ -409,11 +292,11 @@ Interpreter::RuntimeValue Interpreter::evaluateLiteral(LiteralExpr* expr) {
 }
 
 Interpreter::RuntimeValue Interpreter::evaluateVariable(VariableExpr* expr) {
-    return get(expr->name.lexeme);
+    return local(expr->slot, expr->name.text());
 }
 
 Interpreter::RuntimeValue Interpreter::evaluateCall(CallExpr* expr) {
-    const std::string funcName = expr->callee.lexeme;
+    const std::string& funcName = expr->callee.text();
     
     if (funcName == "print") {
         return handlePrint(expr);
@@ -429,12 +312,18 @@ Interpreter::RuntimeValue Interpreter::evaluateCall(CallExpr* expr) {
         return handleGenerate(expr);
     } else if (funcName == "input") {
         return handleInput(expr);
+    } else if (funcName == "sum" || funcName == "min" || funcName == "max") {
+        return handleReduction(expr);
+    } else if (funcName == "load") {
+        return handleLoad(expr);
+    } else if (funcName == "read_sequence") {
+        return handleReadSequence(expr);
     }
     
     std::vector<RuntimeValue> args;
     args.reserve(expr->arguments.size());
     for (auto& arg : expr->arguments) {
-        args.push_back(evaluateExpression(arg.get()));
+        args.push_back(evaluateValue(arg));
     }
     return callUserFunction(funcName, args);
 }
@@ -443,27 +332,44 @@ Interpreter::RuntimeValue Interpreter::evaluateSequence(SequenceExpr* expr) {
     std::vector<RuntimeValue> values;
     values.reserve(expr->elements.size());
     for (auto& element : expr->elements) {
-        values.push_back(evaluateExpression(element.get()));
+        values.push_back(evaluateExpression(element));
     }
-    return RuntimeValue::FromSequence(values);
+    return RuntimeValue::FromSequence(std::move(values));
 }
 
 Interpreter::RuntimeValue Interpreter::callUserFunction(const std::string& name, const std::vector<RuntimeValue>& args) {
-    auto it = functions.find(name);
-    if (it == functions.end()) {
+    auto it = functionIds.find(name);
+    if (it == functionIds.end()) {
         throw std::runtime_error("Runtime error: Undefined function '" + name + "'");
     }
-    return executeFunction(it->second, args);
+    return callFunction(it->second, args);
+}
+
+Interpreter::RuntimeValue Interpreter::callFunction(uint32_t function, const std::vector<RuntimeValue>& args) {
+    FunctionDecl* decl = program->functions[function];
+    if (!memo || !memoizable[function]) {
+        return executeFunction(decl, args);
+    }
+    if (const RuntimeValue* cached = memo->find(function, args.data(), args.size())) {
+        return *cached;
+    }
+    RuntimeValue result = executeFunction(decl, args);
+    memo->insert(function, args.data(), args.size(), result);
+    return result;
 }
 
 Interpreter::RuntimeValue Interpreter::handlePrint(CallExpr* expr) {
-    std::string line;
+    // A print in a callback of this one's arguments finds the buffer taken
+    // and uses its own
+    std::string line = std::move(printBuffer);
+    line.clear();
     for (size_t i = 0; i < expr->arguments.size(); ++i) {
-        RuntimeValue value = evaluateExpression(expr->arguments[i].get());
-        if (i > 0) line += " ";
-        line += value.toString();
+        RuntimeValue value = evaluateValue(expr->arguments[i]);
+        if (i > 0) line += ' ';
+        builtins.formatTo(value, line);
     }
-    outputLog.push_back(line);
+    (output ? *output : log).writeLine(line);
+    printBuffer = std::move(line);
     return RuntimeValue::Void();
 }
 
@@ -471,143 +377,119 @@ Interpreter::RuntimeValue Interpreter::handleLength(CallExpr* expr) {
     if (expr->arguments.size() != 1) {
         throw std::runtime_error("Runtime error: length expects 1 argument");
     }
-    RuntimeValue sequence = evaluateExpression(expr->arguments[0].get());
-    if (sequence.kind != RuntimeValue::Kind::SEQUENCE) {
-        throw std::runtime_error("Runtime error: length expects a sequence");
-    }
-    return RuntimeValue::FromInt(static_cast<long long>(sequence.sequenceValue.size()));
+    return builtins.length(evaluateValue(expr->arguments[0]));
 }
 
 Interpreter::RuntimeValue Interpreter::handleGet(CallExpr* expr) {
     if (expr->arguments.size() != 2) {
         throw std::runtime_error("Runtime error: get expects 2 arguments");
     }
-    RuntimeValue sequence = evaluateExpression(expr->arguments[0].get());
-    RuntimeValue index = evaluateExpression(expr->arguments[1].get());
-    
-    if (sequence.kind != RuntimeValue::Kind::SEQUENCE) {
-        throw std::runtime_error("Runtime error: get expects a sequence as the first argument");
-    }
-    
-    long long idx = index.asInt();
-    if (idx < 0 || static_cast<size_t>(idx) >= sequence.sequenceValue.size()) {
-        throw std::runtime_error("Runtime error: sequence index out of range");
-    }
-    
-    return sequence.sequenceValue[static_cast<size_t>(idx)];
+    RuntimeValue sequence = evaluateValue(expr->arguments[0]);
+    RuntimeValue index = evaluateExpression(expr->arguments[1]);
+    return builtins.get(sequence, index);
 }
 
 Interpreter::RuntimeValue Interpreter::handleMap(CallExpr* expr) {
     if (expr->arguments.size() != 2) {
         throw std::runtime_error("Runtime error: map expects 2 arguments");
     }
-    
-    RuntimeValue sequence = evaluateExpression(expr->arguments[0].get());
-    if (sequence.kind != RuntimeValue::Kind::SEQUENCE) {
-        throw std::runtime_error("Runtime error: map expects a sequence as the first argument");
-    }
-    
-    std::string mapperName = extractFunctionName(expr->arguments[1].get());
-    std::vector<RuntimeValue> result;
-    result.reserve(sequence.sequenceValue.size());
-    
-    for (const auto& item : sequence.sequenceValue) {
-        result.push_back(callUserFunction(mapperName, {item}));
-    }
-    
-    return RuntimeValue::FromSequence(result);
+    RuntimeValue sequence = evaluateValue(expr->arguments[0]);
+    return builtins.map(sequence, extractFunctionId(expr->arguments[1]));
 }
 
 Interpreter::RuntimeValue Interpreter::handleFilter(CallExpr* expr) {
     if (expr->arguments.size() != 2) {
         throw std::runtime_error("Runtime error: filter expects 2 arguments");
     }
-    
-    RuntimeValue sequence = evaluateExpression(expr->arguments[0].get());
-    if (sequence.kind != RuntimeValue::Kind::SEQUENCE) {
-        throw std::runtime_error("Runtime error: filter expects a sequence as the first argument");
-    }
-    
-    std::string predicateName = extractFunctionName(expr->arguments[1].get());
-    std::vector<RuntimeValue> result;
-    
-    for (const auto& item : sequence.sequenceValue) {
-        RuntimeValue keep = callUserFunction(predicateName, {item});
-        if (keep.asBool()) {
-            result.push_back(item);
-        }
-    }
-    
-    return RuntimeValue::FromSequence(result);
+    RuntimeValue sequence = evaluateValue(expr->arguments[0]);
+    return builtins.filter(sequence, extractFunctionId(expr->arguments[1]));
 }
 
 Interpreter::RuntimeValue Interpreter::handleGenerate(CallExpr* expr) {
-    // Placeholder: return empty sequence if generate is invoked
-    std::vector<RuntimeValue> args;
-    args.reserve(expr->arguments.size());
-    for (auto& arg : expr->arguments) {
-        args.push_back(evaluateExpression(arg.get()));
+    if (expr->arguments.size() != 3) {
+        throw std::runtime_error("Runtime error: generate expects 3 arguments");
+    }
+    RuntimeValue seed = evaluateExpression(expr->arguments[0]);
+    uint32_t step = extractFunctionId(expr->arguments[1]);
+    RuntimeValue count = evaluateExpression(expr->arguments[2]);
+    return builtins.generate(seed, step, count);
+}
+
+Interpreter::RuntimeValue Interpreter::handleReduction(CallExpr* expr) {
+    const std::string& name = expr->callee.text();
+    if (expr->arguments.size() != 1) {
+        throw std::runtime_error("Runtime error: " + name + " expects 1 argument");
     }
-    (void)args;
-    return RuntimeValue::FromSequence({});
+    RuntimeValue sequence = evaluateValue(expr->arguments[0]);
+    if (name == "sum") return builtins.sum(sequence);
+    if (name == "min") return builtins.min(sequence);
+    return builtins.max(sequence);
+}
+
+Interpreter::RuntimeValue Interpreter::invoke(uint32_t function, const RuntimeValue& argument) {
+    return callFunction(function, {argument});
+}
+
+bool Interpreter::isParallelSafe(uint32_t function) const {
+    // String literals are built afresh on every evaluation, so a pure
+    // function shares nothing with the other workers
+    return program->functions[function]->isPure;
+}
+
+bool Interpreter::isPure(uint32_t function) const {
+    return program->functions[function]->isPure;
+}
+
+std::unique_ptr<FunctionInvoker> Interpreter::fork() {
+    auto worker = std::make_unique<Interpreter>(program);
+    worker->setInterrupt(interrupt);
+    forks.push_back(worker.get());
+    return worker;
 }
 
 std::string Interpreter::extractFunctionName(Expr* expr) {
-    if (auto variable = dynamic_cast<VariableExpr*>(expr)) {
-        return variable->name.lexeme;
+    if (auto variable = nodeCast<VariableExpr>(expr)) {
+        return variable->name.text();
     }
     throw std::runtime_error("Runtime error: expected function identifier");
 }
 
+uint32_t Interpreter::extractFunctionId(Expr* expr) {
+    std::string name = extractFunctionName(expr);
+    auto it = functionIds.find(name);
+    if (it == functionIds.end()) {
+        throw std::runtime_error("Runtime error: Undefined function '" + name + "'");
+    }
+    return it->second;
+}
+
 Interpreter::RuntimeValue Interpreter::handleInput(CallExpr* expr) {
     if (expr->arguments.size() > 1) {
         throw std::runtime_error("Runtime error: input expects at most 1 argument");
     }
     
+    std::string promptText;
     if (!expr->arguments.empty()) {
-        RuntimeValue prompt = evaluateExpression(expr->arguments[0].get());
-        std::string promptText = prompt.toString();
-        if (!promptText.empty()) {
-            std::cout << promptText << " ";
-        }
+        RuntimeValue prompt = evaluateExpression(expr->arguments[0]);
+        promptText = prompt.toString();
     }
-    std::cout << "> " << std::flush;
-    
-    std::string line;
-    if (!std::getline(std::cin, line)) {
-        return RuntimeValue::FromInt(0);
-    }
-    
-    auto trim = [](std::string& s) {
-        size_t start = s.find_first_not_of(" \t\r\n");
-        size_t end = s.find_last_not_of(" \t\r\n");
-        if (start == std::string::npos) {
-            s.clear();
-            return;
-        }
-        s = s.substr(start, end - start + 1);
-    };
-    
-    trim(line);
-    if (line.empty()) {
-        return RuntimeValue::FromInt(0);
-    }
-    
-    try {
-        size_t idx = 0;
-        long long value = std::stoll(line, &idx, 10);
-        if (idx == line.length()) {
-            return RuntimeValue::FromInt(value);
-        }
-    } catch (...) {
-        // Fall through to floating-point parsing
-    }
-    
-    try {
-        double value = std::stod(line);
-        return RuntimeValue::FromInt(static_cast<long long>(value));
-    } catch (...) {
-        return RuntimeValue::FromInt(0);
+    if (output) output->flush();
+    return Builtins::readInput(promptText);
+}
+
+Interpreter::RuntimeValue Interpreter::handleLoad(CallExpr* expr) {
+    if (expr->arguments.empty() || expr->arguments.size() > 2) {
+        throw std::runtime_error("Runtime error: load expects 1 or 2 arguments");
     }
+    std::string path = evaluateExpression(expr->arguments[0]).toString();
+    std::string format = expr->arguments.size() == 2 ? evaluateExpression(expr->arguments[1]).toString() : "text";
+    return Builtins::load(path, format);
 }
 
+Interpreter::RuntimeValue Interpreter::handleReadSequence(CallExpr* expr) {
+    if (!expr->arguments.empty()) {
+        throw std::runtime_error("Runtime error: read_sequence expects no arguments");
+    }
+    if (output) output->flush();
+    return Builtins::readSequence();
+}
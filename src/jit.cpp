@@ -0,0 +1,148 @@
+#include "../include/jit.h"
+#include "../include/assembler.h"
+#include <chrono>
+#include <csetjmp>
+#include <cstring>
+#include <sstream>
+#if defined(__x86_64__) && !defined(_WIN32)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    using Kind = RuntimeValue::Kind;
+
+    // The innermost run() on this thread
+    thread_local std::jmp_buf* trapTarget = nullptr;
+    // Compiled code compares rsp with this on entry to every function
+    thread_local const char* stackLimit = nullptr;
+
+    // Called by compiled code with the Outcome it ran into, less one
+    [[noreturn]] void trap(int reason) {
+        std::longjmp(*trapTarget, reason + 1);
+    }
+
+    Kind kindOf(DataType type) {
+        if (type == DataType::INT) return Kind::INT;
+        return type == DataType::BOOL ? Kind::BOOL : Kind::VOID;
+    }
+}
+
+JitCompiler::JitCompiler(TacModule tac, Program* program, uint32_t threshold)
+    : tac(std::move(tac)), program(program), hotThreshold(threshold) {
+    size_t count = program ? program->functions.size() : 0;
+    parameters.resize(count);
+    results.resize(count);
+    states.assign(count, State::UNTRIED);
+    entries.assign(count, nullptr);
+    for (size_t f = 0; f < count; ++f) {
+        const FunctionDecl& decl = *program->functions[f];
+        for (const auto& param : decl.parameters) parameters[f].push_back(kindOf(param.type));
+        results[f] = kindOf(decl.returnType);
+    }
+}
+
+JitCompiler::~JitCompiler() {
+#if defined(__x86_64__) && !defined(_WIN32)
+    for (const auto& mapping : mappings) munmap(mapping.first, mapping.second);
+#endif
+}
+
+JitCompiler::Entry JitCompiler::entry(uint32_t function) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (function >= states.size()) return nullptr;
+    if (states[function] == State::UNTRIED) {
+        auto start = std::chrono::steady_clock::now();
+        if (!compileUnit(function)) {
+            states[function] = State::REJECTED;
+            ++stats.rejected;
+        }
+        stats.milliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+    return entries[function];
+}
+
+bool JitCompiler::compileUnit(uint32_t root) {
+#if !defined(__x86_64__) || defined(_WIN32)
+    // The generated code is x86-64 following the System V ABI
+    (void)root;
+    return false;
+#else
+    if (parameters[root].size() > kMaxArguments) return false;
+
+    // Every thread's copy of stackLimit sits at the same offset from its
+    // thread pointer, which compiled code reads as fs:[offset]
+    uintptr_t threadPointer = 0;
+    asm("mov %%fs:0, %0" : "=r"(threadPointer));
+    int64_t limitOffset = static_cast<int64_t>(reinterpret_cast<uintptr_t>(&stackLimit) - threadPointer);
+    if (limitOffset < INT32_MIN || limitOffset > INT32_MAX) return false;
+
+    std::vector<uint32_t> unit;
+    Assembler assembler;
+    {
+        std::ostringstream text;
+        NativeCodeGenerator generator;
+        try {
+            unit = generator.generateJit(tac, program, root, text);
+            if (unit.empty()) return false;
+            assembler.define("ms_jit_stack_limit", limitOffset);
+            assembler.assemble(text.str());
+        } catch (const std::exception&) {
+            return false;
+        }
+    }
+    const std::vector<uint8_t>& code = assembler.code();
+    int64_t trapOffset = assembler.offsetOf("ms_jit_trap");
+    if (trapOffset < 0 || trapOffset % 8 != 0) return false;
+
+    // Written while writable, then made executable and read-only
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t size = (code.size() + page - 1) / page * page;
+    void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) return false;
+    auto* bytes = static_cast<uint8_t*>(memory);
+    std::memcpy(bytes, code.data(), code.size());
+    void (*handler)(int) = trap;
+    std::memcpy(bytes + trapOffset, &handler, sizeof(handler));
+    if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, size);
+        return false;
+    }
+    mappings.emplace_back(memory, size);
+    ++stats.units;
+
+    for (uint32_t f : unit) {
+        if (states[f] == State::COMPILED) continue;
+        int64_t offset = assembler.offsetOf("ms_jit_" + program->functions[f]->name.text());
+        if (offset < 0) continue;
+        entries[f] = reinterpret_cast<Entry>(bytes + offset);
+        states[f] = State::COMPILED;
+        ++stats.functions;
+    }
+    return states[root] == State::COMPILED;
+#endif
+}
+
+JitCompiler::Outcome JitCompiler::run(Entry entry, const int64_t* args, const char* limit, int64_t& result) {
+    // Compiled code owns nothing, so unwinding it is just restoring the
+    // registers setjmp saved
+    std::jmp_buf target;
+    std::jmp_buf* outer = trapTarget;
+    const char* outerLimit = stackLimit;
+    trapTarget = &target;
+    stackLimit = limit;
+    if (int trapped = setjmp(target)) {
+        trapTarget = outer;
+        stackLimit = outerLimit;
+        return static_cast<Outcome>(trapped);
+    }
+    result = entry(args);
+    trapTarget = outer;
+    stackLimit = outerLimit;
+    return Outcome::DONE;
+}
+
+JitCompiler::Stats JitCompiler::statistics() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
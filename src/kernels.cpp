@@ -0,0 +1,277 @@
+#include "../include/kernels.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define MATHSEQ_AVX2 1
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+
+namespace {
+    // Integer sums wrap like the hardware instead of hitting signed overflow
+    int64_t wrappingAdd(int64_t a, int64_t b) {
+        return static_cast<int64_t>(static_cast<uint64_t>(a) + static_cast<uint64_t>(b));
+    }
+
+    int64_t wrappingSub(int64_t a, int64_t b) {
+        return static_cast<int64_t>(static_cast<uint64_t>(a) - static_cast<uint64_t>(b));
+    }
+
+    int64_t wrappingMul(int64_t a, int64_t b) {
+        return static_cast<int64_t>(static_cast<uint64_t>(a) * static_cast<uint64_t>(b));
+    }
+
+    void subIntScalar(const int64_t* a, const int64_t* b, int64_t* out, size_t begin, size_t n) {
+        for (size_t i = begin; i < n; ++i) out[i] = wrappingSub(a[i], b[i]);
+    }
+
+    void subFloatScalar(const double* a, const double* b, double* out, size_t begin, size_t n) {
+        for (size_t i = begin; i < n; ++i) out[i] = a[i] - b[i];
+    }
+
+    void mulFloatScalar(const double* a, const double* b, double* out, size_t begin, size_t n) {
+        for (size_t i = begin; i < n; ++i) out[i] = a[i] * b[i];
+    }
+
+    void divFloatScalar(const double* a, const double* b, double* out, size_t begin, size_t n) {
+        for (size_t i = begin; i < n; ++i) out[i] = a[i] / b[i];
+    }
+
+    bool equalIntScalar(const int64_t* a, const int64_t* b, size_t begin, size_t n) {
+        for (size_t i = begin; i < n; ++i) {
+            if (a[i] != b[i]) return false;
+        }
+        return true;
+    }
+
+    int64_t sumIntScalar(const int64_t* in, size_t begin, size_t n, int64_t sum) {
+        for (size_t i = begin; i < n; ++i) sum = wrappingAdd(sum, in[i]);
+        return sum;
+    }
+
+    // Lane i accumulates elements i, i + 4, i + 8, ...; the lanes are then
+    // combined as (0 + 1) + (2 + 3), exactly as the AVX2 version does
+    double sumFloatLanes(const double* in, size_t n) {
+        double lanes[4] = {0.0, 0.0, 0.0, 0.0};
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            for (size_t lane = 0; lane < 4; ++lane) lanes[lane] += in[i + lane];
+        }
+        double sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+        for (; i < n; ++i) sum += in[i];
+        return sum;
+    }
+
+    int64_t minIntScalar(const int64_t* in, size_t begin, size_t n, int64_t best) {
+        for (size_t i = begin; i < n; ++i) best = in[i] < best ? in[i] : best;
+        return best;
+    }
+
+    int64_t maxIntScalar(const int64_t* in, size_t begin, size_t n, int64_t best) {
+        for (size_t i = begin; i < n; ++i) best = in[i] > best ? in[i] : best;
+        return best;
+    }
+
+    double minFloatScalar(const double* in, size_t begin, size_t n, double best) {
+        for (size_t i = begin; i < n; ++i) best = in[i] < best ? in[i] : best;
+        return best;
+    }
+
+    double maxFloatScalar(const double* in, size_t begin, size_t n, double best) {
+        for (size_t i = begin; i < n; ++i) best = in[i] > best ? in[i] : best;
+        return best;
+    }
+
+#ifdef MATHSEQ_AVX2
+    AVX2_TARGET void subIntAvx2(const int64_t* a, const int64_t* b, int64_t* out, size_t n) {
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+            __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_sub_epi64(x, y));
+        }
+        subIntScalar(a, b, out, i, n);
+    }
+
+    AVX2_TARGET void subFloatAvx2(const double* a, const double* b, double* out, size_t n) {
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            _mm256_storeu_pd(out + i, _mm256_sub_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+        }
+        subFloatScalar(a, b, out, i, n);
+    }
+
+    AVX2_TARGET void mulFloatAvx2(const double* a, const double* b, double* out, size_t n) {
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            _mm256_storeu_pd(out + i, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+        }
+        mulFloatScalar(a, b, out, i, n);
+    }
+
+    AVX2_TARGET void divFloatAvx2(const double* a, const double* b, double* out, size_t n) {
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            _mm256_storeu_pd(out + i, _mm256_div_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+        }
+        divFloatScalar(a, b, out, i, n);
+    }
+
+    AVX2_TARGET bool equalIntAvx2(const int64_t* a, const int64_t* b, size_t n) {
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+            __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+            if (_mm256_movemask_epi8(_mm256_cmpeq_epi64(x, y)) != -1) return false;
+        }
+        return equalIntScalar(a, b, i, n);
+    }
+
+    AVX2_TARGET int64_t sumIntAvx2(const int64_t* in, size_t n) {
+        __m256i acc = _mm256_setzero_si256();
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            acc = _mm256_add_epi64(acc, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i)));
+        }
+        alignas(32) int64_t lanes[4];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), acc);
+        int64_t sum = wrappingAdd(wrappingAdd(lanes[0], lanes[1]), wrappingAdd(lanes[2], lanes[3]));
+        return sumIntScalar(in, i, n, sum);
+    }
+
+    AVX2_TARGET double sumFloatAvx2(const double* in, size_t n) {
+        __m256d acc = _mm256_setzero_pd();
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            acc = _mm256_add_pd(acc, _mm256_loadu_pd(in + i));
+        }
+        alignas(32) double lanes[4];
+        _mm256_store_pd(lanes, acc);
+        double sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+        for (; i < n; ++i) sum += in[i];
+        return sum;
+    }
+
+    template <bool IsMax>
+    AVX2_TARGET int64_t extremeIntAvx2(const int64_t* in, size_t n) {
+        if (n < 4) {
+            return IsMax ? maxIntScalar(in, 1, n, in[0]) : minIntScalar(in, 1, n, in[0]);
+        }
+        __m256i best = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in));
+        size_t i = 4;
+        for (; i + 4 <= n; i += 4) {
+            __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+            __m256i better = IsMax ? _mm256_cmpgt_epi64(x, best) : _mm256_cmpgt_epi64(best, x);
+            best = _mm256_blendv_epi8(best, x, better);
+        }
+        alignas(32) int64_t lanes[4];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), best);
+        int64_t result = IsMax ? maxIntScalar(lanes, 1, 4, lanes[0]) : minIntScalar(lanes, 1, 4, lanes[0]);
+        return IsMax ? maxIntScalar(in, i, n, result) : minIntScalar(in, i, n, result);
+    }
+
+    template <bool IsMax>
+    AVX2_TARGET double extremeFloatAvx2(const double* in, size_t n) {
+        if (n < 4) {
+            return IsMax ? maxFloatScalar(in, 1, n, in[0]) : minFloatScalar(in, 1, n, in[0]);
+        }
+        __m256d best = _mm256_loadu_pd(in);
+        size_t i = 4;
+        for (; i + 4 <= n; i += 4) {
+            __m256d x = _mm256_loadu_pd(in + i);
+            best = IsMax ? _mm256_max_pd(x, best) : _mm256_min_pd(x, best);
+        }
+        alignas(32) double lanes[4];
+        _mm256_store_pd(lanes, best);
+        double result = IsMax ? maxFloatScalar(lanes, 1, 4, lanes[0]) : minFloatScalar(lanes, 1, 4, lanes[0]);
+        return IsMax ? maxFloatScalar(in, i, n, result) : minFloatScalar(in, i, n, result);
+    }
+#endif
+}
+
+bool Kernels::hasAvx2() {
+#ifdef MATHSEQ_AVX2
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+#else
+    return false;
+#endif
+}
+
+#ifdef MATHSEQ_AVX2
+#define DISPATCH_AVX2(call) \
+    if (hasAvx2()) return call
+#else
+#define DISPATCH_AVX2(call)
+#endif
+
+void Kernels::subInt(const int64_t* a, const int64_t* b, int64_t* out, size_t n) {
+    DISPATCH_AVX2(subIntAvx2(a, b, out, n));
+    subIntScalar(a, b, out, 0, n);
+}
+
+void Kernels::mulInt(const int64_t* a, const int64_t* b, int64_t* out, size_t n) {
+    // AVX2 has no 64-bit multiply
+    for (size_t i = 0; i < n; ++i) out[i] = wrappingMul(a[i], b[i]);
+}
+
+bool Kernels::divInt(const int64_t* a, const int64_t* b, int64_t* out, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        if (b[i] == 0) return false;
+        out[i] = a[i] / b[i];
+    }
+    return true;
+}
+
+void Kernels::subFloat(const double* a, const double* b, double* out, size_t n) {
+    DISPATCH_AVX2(subFloatAvx2(a, b, out, n));
+    subFloatScalar(a, b, out, 0, n);
+}
+
+void Kernels::mulFloat(const double* a, const double* b, double* out, size_t n) {
+    DISPATCH_AVX2(mulFloatAvx2(a, b, out, n));
+    mulFloatScalar(a, b, out, 0, n);
+}
+
+void Kernels::divFloat(const double* a, const double* b, double* out, size_t n) {
+    DISPATCH_AVX2(divFloatAvx2(a, b, out, n));
+    divFloatScalar(a, b, out, 0, n);
+}
+
+void Kernels::intToFloat(const int64_t* in, double* out, size_t n) {
+    for (size_t i = 0; i < n; ++i) out[i] = static_cast<double>(in[i]);
+}
+
+bool Kernels::equalInt(const int64_t* a, const int64_t* b, size_t n) {
+    DISPATCH_AVX2(equalIntAvx2(a, b, n));
+    return equalIntScalar(a, b, 0, n);
+}
+
+int64_t Kernels::sumInt(const int64_t* in, size_t n) {
+    DISPATCH_AVX2(sumIntAvx2(in, n));
+    return sumIntScalar(in, 0, n, 0);
+}
+
+int64_t Kernels::minInt(const int64_t* in, size_t n) {
+    DISPATCH_AVX2(extremeIntAvx2<false>(in, n));
+    return minIntScalar(in, 1, n, in[0]);
+}
+
+int64_t Kernels::maxInt(const int64_t* in, size_t n) {
+    DISPATCH_AVX2(extremeIntAvx2<true>(in, n));
+    return maxIntScalar(in, 1, n, in[0]);
+}
+
+double Kernels::sumFloat(const double* in, size_t n) {
+    DISPATCH_AVX2(sumFloatAvx2(in, n));
+    return sumFloatLanes(in, n);
+}
+
+double Kernels::minFloat(const double* in, size_t n) {
+    DISPATCH_AVX2(extremeFloatAvx2<false>(in, n));
+    return minFloatScalar(in, 1, n, in[0]);
+}
+
+double Kernels::maxFloat(const double* in, size_t n) {
+    DISPATCH_AVX2(extremeFloatAvx2<true>(in, n));
+    return maxFloatScalar(in, 1, n, in[0]);
+}
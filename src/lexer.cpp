@@ -1,29 +1,21 @@
 // Phase 1 of the Compiler
 
 #include "../include/token.h"
-#include <cctype>
+#include <cstring>
 #include <iostream>
 
-std::unordered_map<std::string, TokenType> Lexer::keywords = {
-    {"func", TokenType::FUNC},
-    {"let", TokenType::LET},
-    {"if", TokenType::IF},
-    {"else", TokenType::ELSE},
-    {"while", TokenType::WHILE},
-    {"return", TokenType::RETURN},
-    {"true", TokenType::TRUE},
-    {"false", TokenType::FALSE},
-    {"and", TokenType::AND},
-    {"or", TokenType::OR},
-    {"not", TokenType::NOT},
-    {"int", TokenType::INT},
-    {"float", TokenType::FLOAT_TYPE},
-    {"bool", TokenType::BOOL},
-    {"sequence", TokenType::SEQUENCE},
-    {"pattern", TokenType::PATTERN}
-};
-
-Lexer::Lexer(const std::string& source) 
+namespace {
+    // ASCII only, and without the locale lookups of <cctype>
+    inline bool isDigit(char c) {
+        return c >= '0' && c <= '9';
+    }
+
+    inline bool isAlpha(char c) {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+    }
+}
+
+Lexer::Lexer(std::string_view source) 
     : source(source), start(0), current(0), line(1), column(1) {}
 
 char Lexer::advance() {
@@ -40,12 +32,12 @@ char Lexer::peek() {
 
 
 char Lexer::peekNext() {
-    if (static_cast<size_t>(current + 1) >= source.length()) return '\0';
+    if (current + 1 >= source.length()) return '\0';
     return source[current + 1];
 }
 
 bool Lexer::isAtEnd() {
-    return static_cast<size_t>(current) >= source.length();
+    return current >= source.length();
 }
 
 bool Lexer::match(char expected) {
@@ -57,19 +49,25 @@ bool Lexer::match(char expected) {
 }
 
 void Lexer::skipWhitespace() {
-    while (!isAtEnd()) {
-        char c = peek();
+    // The hot loops index the buffer directly rather than going through
+    // peek() and advance()
+    const size_t size = source.size();
+    while (current < size) {
+        char c = source[current];
         if (c == ' ' || c == '\t' || c == '\r') {
-            advance();
+            current++;
+            column++;
         } else if (c == '\n') {
             line++;
             column = 1;
-            advance();
+            current++;
+            column++;
         } else if (c == '#') {
             // Skip comments until end of line
-            while (!isAtEnd() && peek() != '\n') {
-                advance();
-            }
+            size_t end = source.find('\n', current);
+            if (end == std::string_view::npos) end = size;
+            column += static_cast<int>(end - current);
+            current = end;
         } else {
             break;
         }
@@ -90,14 +88,13 @@ Token Lexer::stringLiteral() {
     }
     
     advance(); // Consume closing "
-    std::string value = source.substr(start + 1, current - start - 2);
-    return Token(TokenType::STRING, value, line, column);
+    return Token(TokenType::STRING, source.substr(start + 1, current - start - 2), line, column);
 }
 
 Token Lexer::number() {
     bool isFloat = false;
     
-    while (!isAtEnd() && (std::isdigit(peek()) || peek() == '.')) {
+    while (!isAtEnd() && (isDigit(peek()) || peek() == '.')) {
         if (peek() == '.') {
             if (isFloat) break; // Multiple decimal points
             isFloat = true;
@@ -105,32 +102,63 @@ Token Lexer::number() {
         advance();
     }
     
-    std::string value = source.substr(start, current - start);
-    return Token(isFloat ? TokenType::FLOAT : TokenType::NUMBER, value, line, column);
+    return Token(isFloat ? TokenType::FLOAT : TokenType::NUMBER, source.substr(start, current - start), line, column);
 }
 
-TokenType Lexer::checkKeyword(int start, int length, const char* rest, TokenType type) {
-    if (current - this->start == start + length &&
-        source.compare(this->start + start, length, rest) == 0) {
+TokenType Lexer::checkKeyword(size_t offset, size_t length, const char* rest, TokenType type) {
+    if (current - start == offset + length &&
+        std::memcmp(source.data() + start + offset, rest, length) == 0) {
         return type;
     }
     return TokenType::IDENTIFIER;
 }
 
-Token Lexer::identifier() {
-    while (!isAtEnd() && (std::isalnum(peek()) || peek() == '_')) {
-        advance();
+TokenType Lexer::identifierType() {
+    // Dispatch on the first letters, then compare the rest of at most one
+    // keyword
+    switch (source[start]) {
+        case 'a': return checkKeyword(1, 2, "nd", TokenType::AND);
+        case 'b': return checkKeyword(1, 3, "ool", TokenType::BOOL);
+        case 'e': return checkKeyword(1, 3, "lse", TokenType::ELSE);
+        case 'f':
+            if (current - start > 1) {
+                switch (source[start + 1]) {
+                    case 'a': return checkKeyword(2, 3, "lse", TokenType::FALSE);
+                    case 'l': return checkKeyword(2, 3, "oat", TokenType::FLOAT_TYPE);
+                    case 'u': return checkKeyword(2, 2, "nc", TokenType::FUNC);
+                }
+            }
+            break;
+        case 'i':
+            if (current - start > 1) {
+                switch (source[start + 1]) {
+                    case 'f': return checkKeyword(2, 0, "", TokenType::IF);
+                    case 'n': return checkKeyword(2, 1, "t", TokenType::INT);
+                }
+            }
+            break;
+        case 'l': return checkKeyword(1, 2, "et", TokenType::LET);
+        case 'n': return checkKeyword(1, 2, "ot", TokenType::NOT);
+        case 'o': return checkKeyword(1, 1, "r", TokenType::OR);
+        case 'p': return checkKeyword(1, 6, "attern", TokenType::PATTERN);
+        case 'r': return checkKeyword(1, 5, "eturn", TokenType::RETURN);
+        case 's': return checkKeyword(1, 7, "equence", TokenType::SEQUENCE);
+        case 't': return checkKeyword(1, 3, "rue", TokenType::TRUE);
+        case 'w': return checkKeyword(1, 4, "hile", TokenType::WHILE);
     }
-    
-    std::string text = source.substr(start, current - start);
-    TokenType type = TokenType::IDENTIFIER;
-    
-    auto it = keywords.find(text);
-    if (it != keywords.end()) {
-        type = it->second;
+    return TokenType::IDENTIFIER;
+}
+
+Token Lexer::identifier() {
+    const size_t size = source.size();
+    size_t end = current;
+    while (end < size && (isAlpha(source[end]) || isDigit(source[end]))) {
+        end++;
     }
+    column += static_cast<int>(end - current);
+    current = end;
     
-    return Token(type, text, line, column);
+    return Token(identifierType(), source.substr(start, current - start), line, column);
 }
 
 Token Lexer::nextToken() {
@@ -143,11 +171,11 @@ Token Lexer::nextToken() {
     
     char c = advance();
     
-    if (std::isalpha(c) || c == '_') {
+    if (isAlpha(c)) {
         return identifier();
     }
     
-    if (std::isdigit(c)) {
+    if (isDigit(c)) {
         return number();
     }
     
@@ -193,7 +221,7 @@ Token Lexer::nextToken() {
             return Token(TokenType::GREATER, ">", line, column);
     }
     
-    return Token(TokenType::ERROR, std::string(1, c), line, column);
+    return Token(TokenType::ERROR, source.substr(start, 1), line, column);
 }
 
 std::vector<Token> Lexer::tokenize() {
@@ -0,0 +1,579 @@
+#include "../include/loop.h"
+#include <algorithm>
+#include <climits>
+#include <unordered_set>
+
+namespace {
+    bool writesResult(TacOp op) {
+        return op == TacOp::ASSIGN || op == TacOp::NEW_SEQ || op == TacOp::CALL ||
+               isBinaryTacOp(op) || op == TacOp::NEG || op == TacOp::NOT;
+    }
+
+    bool updatesInPlace(TacOp op) {
+        return op == TacOp::STORE || op == TacOp::APPEND || op == TacOp::EXTEND;
+    }
+
+    bool readsArg(TacOp op, int k) {
+        if (k == 1) return isBinaryTacOp(op);
+        return op != TacOp::LABEL && op != TacOp::GOTO && op != TacOp::CALL && op != TacOp::NEW_SEQ;
+    }
+
+    bool isPure(TacOp op) {
+        return op == TacOp::ASSIGN || isBinaryTacOp(op) || op == TacOp::NEG || op == TacOp::NOT;
+    }
+
+    uint64_t siteKey(uint32_t block, uint32_t index) {
+        return (static_cast<uint64_t>(block) << 32) | index;
+    }
+}
+
+LoopOptimizer::Stats LoopOptimizer::run() {
+    inferKinds();
+
+    // Collect the headers once, smallest loop first so nests are done
+    // inside out; each is found again by label since preheaders shift
+    // the blocks
+    std::vector<uint32_t> idom = cfg.immediateDominators(cfg.reversePostorder());
+    std::vector<std::pair<size_t, Operand>> headers;
+    std::vector<bool> seen(cfg.blocks.size(), false);
+    for (uint32_t b = 0; b < cfg.blocks.size(); ++b) {
+        for (uint32_t successor : cfg.blocks[b].successors) {
+            if (seen[successor] || !dominates(idom, successor, b) || cfg.blocks[successor].label.empty()) continue;
+            seen[successor] = true;
+            headers.emplace_back(naturalLoop(successor, idom).blocks.size(), cfg.blocks[successor].label);
+        }
+    }
+    std::stable_sort(headers.begin(), headers.end(),
+                     [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    bool changed = false;
+    for (const auto& entry : headers) {
+        if (changed) {
+            idom = cfg.immediateDominators(cfg.reversePostorder());
+            changed = false;
+        }
+        uint32_t header = 0;
+        while (cfg.blocks[header].label != entry.second) ++header;
+        ++stats.loops;
+        changed = optimizeLoop(naturalLoop(header, idom), idom);
+    }
+    cfg.removeJumpsToNext();
+    return stats;
+}
+
+bool LoopOptimizer::dominates(const std::vector<uint32_t>& idom, uint32_t a, uint32_t b) {
+    while (b != a) {
+        if (b == 0 || idom[b] == UINT32_MAX) return false;
+        b = idom[b];
+    }
+    return true;
+}
+
+LoopOptimizer::Loop LoopOptimizer::naturalLoop(uint32_t header, const std::vector<uint32_t>& idom) const {
+    Loop loop{header, std::vector<bool>(cfg.blocks.size(), false), {header}};
+    loop.contains[header] = true;
+    std::vector<uint32_t> work;
+    for (uint32_t predecessor : cfg.blocks[header].predecessors) {
+        if (!loop.contains[predecessor] && dominates(idom, header, predecessor)) {
+            loop.contains[predecessor] = true;
+            work.push_back(predecessor);
+        }
+    }
+    while (!work.empty()) {
+        uint32_t b = work.back();
+        work.pop_back();
+        loop.blocks.push_back(b);
+        for (uint32_t predecessor : cfg.blocks[b].predecessors) {
+            if (!loop.contains[predecessor]) {
+                loop.contains[predecessor] = true;
+                work.push_back(predecessor);
+            }
+        }
+    }
+    std::sort(loop.blocks.begin(), loop.blocks.end());
+    return loop;
+}
+
+// --- Value kinds ---
+
+void LoopOptimizer::inferKinds() {
+    auto join = [](ValueKind a, ValueKind b) {
+        if (a == ValueKind::NONE) return b;
+        if (b == ValueKind::NONE) return a;
+        return a == b ? a : ValueKind::UNKNOWN;
+    };
+    auto numeric = [](ValueKind kind) {
+        return kind == ValueKind::INT || kind == ValueKind::FLOAT || kind == ValueKind::BOOL;
+    };
+
+    // Optimistic fixed point: a name starts with no kind and widens with
+    // each definition, so loop-carried counters come out as INT
+    kinds.clear();
+    for (const auto& block : cfg.blocks) {
+        for (const auto& instr : block.code) {
+            if (writesResult(instr.op) && instr.result.isValue()) kinds.emplace(instr.result, ValueKind::NONE);
+        }
+    }
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (const auto& block : cfg.blocks) {
+            for (const auto& instr : block.code) {
+                if (!writesResult(instr.op) || !instr.result.isValue()) continue;
+                ValueKind left = kindOf(instr.arg1);
+                ValueKind right = kindOf(instr.arg2);
+                ValueKind kind = ValueKind::UNKNOWN;
+                switch (instr.op) {
+                    case TacOp::ASSIGN: kind = left; break;
+                    case TacOp::NEW_SEQ: kind = ValueKind::SEQUENCE; break;
+                    case TacOp::CALL:
+                        if (module.name(instr.arg1) == "length") kind = ValueKind::INT;
+                        break;
+                    case TacOp::ADD:
+                    case TacOp::SUB:
+                    case TacOp::MUL:
+                    case TacOp::DIV:
+                    case TacOp::MOD:
+                        if (left == ValueKind::NONE || right == ValueKind::NONE) {
+                            kind = ValueKind::NONE;
+                        } else if (numeric(left) && numeric(right)) {
+                            bool floating = instr.op != TacOp::MOD &&
+                                            (left == ValueKind::FLOAT || right == ValueKind::FLOAT);
+                            kind = floating ? ValueKind::FLOAT : ValueKind::INT;
+                        } else if (instr.op == TacOp::ADD && left == ValueKind::SEQUENCE &&
+                                   right == ValueKind::SEQUENCE) {
+                            kind = ValueKind::SEQUENCE;
+                        }
+                        break;
+                    case TacOp::NEG:
+                        if (left == ValueKind::NONE || left == ValueKind::INT || left == ValueKind::FLOAT) kind = left;
+                        break;
+                    default:
+                        kind = ValueKind::BOOL;  // Comparisons and logic
+                        break;
+                }
+                ValueKind& slot = kinds[instr.result];
+                ValueKind joined = join(slot, kind);
+                if (joined != slot) {
+                    slot = joined;
+                    changed = true;
+                }
+            }
+        }
+    }
+}
+
+LoopOptimizer::ValueKind LoopOptimizer::kindOf(Operand operand) const {
+    if (operand.isConstant()) {
+        switch (module.constant(operand).kind) {
+            case TacConstant::Kind::INT: return ValueKind::INT;
+            case TacConstant::Kind::FLOAT: return ValueKind::FLOAT;
+            case TacConstant::Kind::BOOL: return ValueKind::BOOL;
+            case TacConstant::Kind::STRING:
+            case TacConstant::Kind::BIGINT: return ValueKind::UNKNOWN;
+        }
+    }
+    if (!operand.isValue()) return ValueKind::UNKNOWN;
+    auto it = kinds.find(operand);
+    // Never written here: a parameter or a callback name
+    return it == kinds.end() ? ValueKind::UNKNOWN : it->second;
+}
+
+// Whether running `instr` when the loop body would not have run is
+// harmless, i.e. no engine can raise on it given its operands' kinds.
+// Native and JIT code raise on int overflow, so int arithmetic only
+// qualifies with a float operand.
+bool LoopOptimizer::canSpeculate(const ThreeAddressCode& instr) const {
+    auto numeric = [](ValueKind kind) {
+        return kind == ValueKind::INT || kind == ValueKind::FLOAT || kind == ValueKind::BOOL;
+    };
+    auto safeDivisor = [this](Operand operand) {
+        if (!operand.isConstant()) return false;
+        const TacConstant& constant = module.constant(operand);
+        return constant.kind == TacConstant::Kind::INT && constant.intValue != 0 && constant.intValue != -1;
+    };
+    ValueKind left = kindOf(instr.arg1);
+    ValueKind right = kindOf(instr.arg2);
+
+    switch (instr.op) {
+        case TacOp::ASSIGN:
+        case TacOp::EQ:
+        case TacOp::NE:
+        case TacOp::AND:
+        case TacOp::OR:
+        case TacOp::NOT:
+            return true;
+        case TacOp::LT:
+        case TacOp::LE:
+        case TacOp::GT:
+        case TacOp::GE:
+            return numeric(left) && numeric(right);
+        case TacOp::ADD:
+        case TacOp::SUB:
+        case TacOp::MUL:
+            return numeric(left) && numeric(right) && (left == ValueKind::FLOAT || right == ValueKind::FLOAT);
+        case TacOp::DIV:
+            return numeric(left) && numeric(right) &&
+                   (left == ValueKind::FLOAT || right == ValueKind::FLOAT || safeDivisor(instr.arg2));
+        case TacOp::MOD:
+            return numeric(left) && numeric(right) && safeDivisor(instr.arg2);
+        case TacOp::NEG:
+            return left == ValueKind::FLOAT;
+        default:
+            return false;
+    }
+}
+
+// --- One loop ---
+
+bool LoopOptimizer::optimizeLoop(const Loop& loop, const std::vector<uint32_t>& idom) {
+    std::vector<BasicBlock>& blocks = cfg.blocks;
+    const Operand headerLabel = blocks[loop.header].label;
+
+    // Where the preheader goes: in the header's place when the one
+    // outside predecessor that falls through is right before it, or else
+    // right after an outside predecessor that jumps in
+    std::vector<uint32_t> outside;
+    for (uint32_t predecessor : blocks[loop.header].predecessors) {
+        if (!loop.contains[predecessor]) outside.push_back(predecessor);
+    }
+    uint32_t position = UINT32_MAX;
+    for (uint32_t predecessor : outside) {
+        if (blocks[predecessor].fallthrough == static_cast<int32_t>(loop.header)) position = loop.header;
+    }
+    for (uint32_t predecessor : outside) {
+        if (position != UINT32_MAX) break;
+        const auto& code = blocks[predecessor].code;
+        if (!code.empty() && code.back().op == TacOp::GOTO) position = predecessor + 1;
+    }
+    if (position == UINT32_MAX) return false;
+
+    // Reads and writes of each name, inside the loop and out
+    std::unordered_map<Operand, uint32_t, OperandHash> writes;
+    std::unordered_map<Operand, std::vector<Site>, OperandHash> reads;
+    std::unordered_map<Operand, std::vector<Site>, OperandHash> appends;
+    std::unordered_set<Operand, OperandHash> readOutside;
+    for (uint32_t b = 0; b < blocks.size(); ++b) {
+        bool inside = loop.contains[b];
+        const auto& code = blocks[b].code;
+        for (uint32_t i = 0; i < code.size(); ++i) {
+            const ThreeAddressCode& instr = code[i];
+            auto read = [&](Operand operand) {
+                if (!operand.isValue()) return;
+                if (inside) {
+                    reads[operand].push_back(Site{b, i});
+                } else {
+                    readOutside.insert(operand);
+                }
+            };
+            if (readsArg(instr.op, 0)) read(instr.arg1);
+            if (readsArg(instr.op, 1)) read(instr.arg2);
+            if (updatesInPlace(instr.op)) read(instr.result);
+            if (inside && instr.result.isValue() && (writesResult(instr.op) || updatesInPlace(instr.op))) {
+                ++writes[instr.result];
+                if (instr.op == TacOp::APPEND) appends[instr.result].push_back(Site{b, i});
+            }
+        }
+    }
+    auto invariant = [&](Operand operand) {
+        auto it = writes.find(operand);
+        return !operand.isValue() || it == writes.end() || it->second == 0;
+    };
+
+    enum Action : uint8_t { KEEP, HOIST, REMOVE };
+    std::vector<std::vector<Action>> actions(blocks.size());
+    for (uint32_t b : loop.blocks) actions[b].assign(blocks[b].code.size(), KEEP);
+    std::unordered_map<uint64_t, std::vector<ThreeAddressCode>> insertAfter;
+    std::vector<ThreeAddressCode> preheader;
+    size_t before = stats.invariantsHoisted + stats.strengthReduced + stats.lengthsReplaced;
+
+    // Invariant code motion. A definition moves when it is the name's
+    // only one in the loop, reads only invariants, dominates every read
+    // in the loop and is not read after it
+    for (bool progress = true; progress;) {
+        progress = false;
+        for (uint32_t b : loop.blocks) {
+            const auto& code = blocks[b].code;
+            for (uint32_t i = 0; i < code.size(); ++i) {
+                const ThreeAddressCode& instr = code[i];
+                if (actions[b][i] != KEEP || !isPure(instr.op) || !instr.result.isValue()) continue;
+                if (writes[instr.result] != 1 || readOutside.count(instr.result)) continue;
+                if (!invariant(instr.arg1) || !invariant(instr.arg2) || !canSpeculate(instr)) continue;
+                const auto& uses = reads[instr.result];
+                bool dominated = std::all_of(uses.begin(), uses.end(), [&](const Site& use) {
+                    return use.block == b ? use.index > i : dominates(idom, b, use.block);
+                });
+                if (!dominated) continue;
+
+                actions[b][i] = HOIST;
+                preheader.push_back(instr);
+                writes[instr.result] = 0;
+                ++stats.invariantsHoisted;
+                progress = true;
+            }
+        }
+    }
+
+    // Basic induction variables: integer names whose one write in the loop
+    // is i = i +/- c, or t = i +/- c; ...; i = t as the code generator emits
+    struct Induction {
+        Site update;
+        long long step;
+    };
+    std::unordered_map<Operand, Induction, OperandHash> inductions;
+    auto stepOf = [&](const ThreeAddressCode& instr, Operand variable, long long& step) {
+        if (instr.op != TacOp::ADD && instr.op != TacOp::SUB) return false;
+        Operand other;
+        if (instr.arg1 == variable) {
+            other = instr.arg2;
+        } else if (instr.op == TacOp::ADD && instr.arg2 == variable) {
+            other = instr.arg1;
+        } else {
+            return false;
+        }
+        if (!other.isConstant() || module.constant(other).kind != TacConstant::Kind::INT) return false;
+        step = module.constant(other).intValue;
+        if (instr.op == TacOp::SUB) {
+            if (step == LLONG_MIN) return false;
+            step = -step;
+        }
+        return true;
+    };
+    for (uint32_t b : loop.blocks) {
+        const auto& code = blocks[b].code;
+        for (uint32_t i = 0; i < code.size(); ++i) {
+            const ThreeAddressCode& instr = code[i];
+            Operand variable = instr.result;
+            if (actions[b][i] != KEEP || !variable.isValue() || writes[variable] != 1) continue;
+            if (kindOf(variable) != ValueKind::INT) continue;
+            long long step = 0;
+            bool found = stepOf(instr, variable, step);
+            if (!found && instr.op == TacOp::ASSIGN && instr.arg1.isValue() && writes[instr.arg1] == 1) {
+                for (uint32_t j = i; j-- > 0;) {
+                    if (code[j].result != instr.arg1) continue;
+                    found = (writesResult(code[j].op) || updatesInPlace(code[j].op)) && stepOf(code[j], variable, step);
+                    break;
+                }
+            }
+            if (found) inductions[variable] = Induction{Site{b, i}, step};
+        }
+    }
+
+    // The values an induction variable can hold wherever i * k is
+    // computed, stepped or set up, when they are known: it starts from
+    // int constants assigned outside the loop, and the header, which every
+    // iteration passes first, tests it against a constant bound it moves
+    // towards. The last step leaves it one step past the bound.
+    auto rangeOf = [&](Operand variable, const Induction& induction, long long& low, long long& high) {
+        if (induction.update.block == loop.header || induction.step == 0) return false;
+        bool anyStart = false;
+        for (uint32_t b = 0; b < blocks.size(); ++b) {
+            if (loop.contains[b]) continue;
+            for (const auto& instr : blocks[b].code) {
+                if (instr.result != variable || !(writesResult(instr.op) || updatesInPlace(instr.op))) continue;
+                if (instr.op != TacOp::ASSIGN || !instr.arg1.isConstant() ||
+                    module.constant(instr.arg1).kind != TacConstant::Kind::INT) {
+                    return false;
+                }
+                long long start = module.constant(instr.arg1).intValue;
+                low = anyStart ? std::min(low, start) : start;
+                high = anyStart ? std::max(high, start) : start;
+                anyStart = true;
+            }
+        }
+        if (!anyStart) return false;
+
+        // The header ends in a branch that stays in the loop while `test`
+        // holds
+        const auto& header = blocks[loop.header].code;
+        if (header.empty() || (header.back().op != TacOp::IF && header.back().op != TacOp::IF_FALSE)) return false;
+        const ThreeAddressCode& branch = header.back();
+        bool targetInside = false;
+        for (uint32_t b : loop.blocks) {
+            if (blocks[b].label == branch.result) targetInside = true;
+        }
+        if (targetInside != (branch.op == TacOp::IF)) return false;
+        const ThreeAddressCode* test = nullptr;
+        for (size_t i = header.size() - 1; i-- > 0;) {
+            if (header[i].result == branch.arg1) {
+                test = &header[i];
+                break;
+            }
+        }
+        if (!test) return false;
+
+        // As variable < bound, variable <= bound, variable > bound or
+        // variable >= bound
+        TacOp op = test->op;
+        Operand bound = test->arg2;
+        if (test->arg2 == variable) {
+            bound = test->arg1;
+            switch (op) {
+                case TacOp::LT: op = TacOp::GT; break;
+                case TacOp::LE: op = TacOp::GE; break;
+                case TacOp::GT: op = TacOp::LT; break;
+                case TacOp::GE: op = TacOp::LE; break;
+                default: return false;
+            }
+        } else if (test->arg1 != variable) {
+            return false;
+        }
+        if (!bound.isConstant() || module.constant(bound).kind != TacConstant::Kind::INT) return false;
+        long long limit = module.constant(bound).intValue;
+        long long last = 0;
+        if (induction.step > 0) {
+            if (op == TacOp::LT) {
+                if (limit == LLONG_MIN) return false;
+                limit -= 1;
+            } else if (op != TacOp::LE) {
+                return false;
+            }
+            if (__builtin_add_overflow(limit, induction.step, &last)) return false;
+            high = std::max(high, last);
+        } else {
+            if (op == TacOp::GT) {
+                if (limit == LLONG_MAX) return false;
+                limit += 1;
+            } else if (op != TacOp::GE) {
+                return false;
+            }
+            if (__builtin_add_overflow(limit, induction.step, &last)) return false;
+            low = std::min(low, last);
+        }
+        return true;
+    };
+
+    // i * k becomes a sum kept equal to it: set before the loop, stepped
+    // right after each update of i. The sum is stepped whether or not the
+    // product is needed, and once more on the way out, so this is done
+    // only when i * k cannot overflow over i's whole range.
+    struct Reduced {
+        Operand variable;
+        long long factor;
+        Operand sum;
+    };
+    std::vector<Reduced> reduced;
+    for (uint32_t b : loop.blocks) {
+        auto& code = blocks[b].code;
+        for (uint32_t i = 0; i < code.size(); ++i) {
+            ThreeAddressCode& instr = code[i];
+            if (actions[b][i] != KEEP || instr.op != TacOp::MUL || !instr.result.isValue()) continue;
+            Operand variable;
+            Operand factor;
+            if (inductions.count(instr.arg1)) {
+                variable = instr.arg1;
+                factor = instr.arg2;
+            } else if (inductions.count(instr.arg2)) {
+                variable = instr.arg2;
+                factor = instr.arg1;
+            } else {
+                continue;
+            }
+            if (!factor.isConstant() || module.constant(factor).kind != TacConstant::Kind::INT) continue;
+            long long k = module.constant(factor).intValue;
+            const Induction& induction = inductions[variable];
+            long long delta = 0;
+            long long low = 0;
+            long long high = 0;
+            long long product = 0;
+            if (__builtin_mul_overflow(induction.step, k, &delta) || !rangeOf(variable, induction, low, high) ||
+                __builtin_mul_overflow(low, k, &product) || __builtin_mul_overflow(high, k, &product)) {
+                continue;
+            }
+
+            auto it = std::find_if(reduced.begin(), reduced.end(), [&](const Reduced& r) {
+                return r.variable == variable && r.factor == k;
+            });
+            if (it == reduced.end()) {
+                Operand sum = module.newTemp();
+                preheader.push_back(ThreeAddressCode(TacOp::MUL, variable, factor, sum, instr.line));
+                insertAfter[siteKey(induction.update.block, induction.update.index)].push_back(
+                    ThreeAddressCode(TacOp::ADD, sum, module.intConstant(delta), sum, instr.line));
+                reduced.push_back(Reduced{variable, k, sum});
+                it = reduced.end() - 1;
+            }
+            instr = ThreeAddressCode(TacOp::ASSIGN, it->sum, Operand(), instr.result, instr.line);
+            ++stats.strengthReduced;
+        }
+    }
+
+    // length(s) of a sequence the loop only appends to becomes a counter.
+    // Computing it ahead of the loop is safe when s is known to be a
+    // sequence, or when the header asks for it first thing anyway
+    std::unordered_map<Operand, std::vector<Site>, OperandHash> lengthCalls;
+    std::vector<Operand> sequences;  // In first-seen order
+    std::unordered_set<Operand, OperandHash> safe;
+    for (uint32_t b : loop.blocks) {
+        const auto& code = blocks[b].code;
+        for (uint32_t i = 1; i < code.size(); ++i) {
+            const ThreeAddressCode& call = code[i];
+            const ThreeAddressCode& param = code[i - 1];
+            if (call.op != TacOp::CALL || actions[b][i] != KEEP || !call.result.isValue() ||
+                module.name(call.arg1) != "length" || call.arg2 != Operand::immediate(1)) continue;
+            if (param.op != TacOp::PARAM || actions[b][i - 1] != KEEP || !param.arg1.isValue()) continue;
+            Operand sequence = param.arg1;
+            auto found = appends.find(sequence);
+            size_t appended = found == appends.end() ? 0 : found->second.size();
+            if (writes[sequence] != appended) continue;
+            if (!lengthCalls.count(sequence)) sequences.push_back(sequence);
+            lengthCalls[sequence].push_back(Site{b, i});
+            if (kindOf(sequence) == ValueKind::SEQUENCE || (b == loop.header && i == 1)) safe.insert(sequence);
+        }
+    }
+    for (Operand sequence : sequences) {
+        if (!safe.count(sequence)) continue;
+        const auto& calls = lengthCalls[sequence];
+        const ThreeAddressCode& first = blocks[calls.front().block].code[calls.front().index];
+        Operand counter = module.newTemp();
+        preheader.push_back(ThreeAddressCode(TacOp::PARAM, sequence, Operand(), Operand(), first.line));
+        preheader.push_back(ThreeAddressCode(TacOp::CALL, first.arg1, first.arg2, counter, first.line));
+        for (const Site& site : appends[sequence]) {
+            insertAfter[siteKey(site.block, site.index)].push_back(
+                ThreeAddressCode(TacOp::ADD, counter, module.intConstant(1), counter, first.line));
+        }
+        for (const Site& site : calls) {
+            ThreeAddressCode& call = blocks[site.block].code[site.index];
+            call = ThreeAddressCode(TacOp::ASSIGN, counter, Operand(), call.result, call.line);
+            actions[site.block][site.index - 1] = REMOVE;
+            ++stats.lengthsReplaced;
+        }
+    }
+
+    if (stats.invariantsHoisted + stats.strengthReduced + stats.lengthsReplaced == before) return false;
+
+    // Apply the edits, then put the preheader in front of the header
+    for (uint32_t b : loop.blocks) {
+        auto& code = blocks[b].code;
+        std::vector<ThreeAddressCode> edited;
+        edited.reserve(code.size());
+        for (uint32_t i = 0; i < code.size(); ++i) {
+            if (actions[b][i] == KEEP) edited.push_back(code[i]);
+            auto inserted = insertAfter.find(siteKey(b, i));
+            if (inserted != insertAfter.end()) {
+                edited.insert(edited.end(), inserted->second.begin(), inserted->second.end());
+            }
+        }
+        code = std::move(edited);
+    }
+
+    BasicBlock block;
+    block.labelLine = blocks[loop.header].labelLine;
+    for (uint32_t predecessor : outside) {
+        auto& code = blocks[predecessor].code;
+        if (code.empty() || code.back().result != headerLabel) continue;
+        TacOp op = code.back().op;
+        if (op != TacOp::GOTO && op != TacOp::IF && op != TacOp::IF_FALSE) continue;
+        if (op == TacOp::GOTO && predecessor + 1 == position) {
+            code.pop_back();  // Falls into the preheader now
+            continue;
+        }
+        if (block.label.empty()) block.label = module.newLabel();
+        code.back().result = block.label;
+    }
+    block.code = std::move(preheader);
+    if (position != loop.header) {
+        block.code.push_back(ThreeAddressCode(TacOp::GOTO, Operand(), Operand(), headerLabel, block.labelLine));
+    }
+    blocks.insert(blocks.begin() + position, std::move(block));
+    cfg.computeEdges();
+    return true;
+}
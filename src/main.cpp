@@ -1,35 +1,61 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <iomanip>
 #include <vector>
+#include <memory>
+#include <algorithm>
+#include <thread>
 #include "../include/token.h"
+#include "../include/mapped_file.h"
 #include "../include/parser.h"
 #include "../include/semantic.h"
 #include "../include/codegen.h"
 #include "../include/optimizer.h"
+#include "../include/constant_folder.h"
 #include "../include/interpreter.h"
+#include "../include/thread_pool.h"
+#include "../include/memo.h"
+#include "../include/vm.h"
+#include "../include/native.h"
+#include "../include/stats.h"
+#include "../include/batch.h"
+#include "../include/compile_cache.h"
+#include "../include/bytecode_file.h"
+#include "../include/server.h"
+#include "../include/output.h"
+#include <cstdint>
+#include <cstdlib>
 
-std::string readFile(const std::string& filename) {
-    std::ifstream file(filename);
-    if (!file.is_open()) {
-        std::cerr << "Error: Could not open file '" << filename << "'" << std::endl;
-        return "";
+// What the driver does. FULL, chosen when no mode is named, shows every
+// phase and then runs the program; the others print only diagnostics and
+// what was asked for. SERVE answers requests until told to stop.
+enum class Mode { FULL, COMPILE, RUN, CHECK, SERVE };
+
+bool parseMode(const std::string& name, Mode& mode) {
+    if (name == "compile") {
+        mode = Mode::COMPILE;
+    } else if (name == "run") {
+        mode = Mode::RUN;
+    } else if (name == "check") {
+        mode = Mode::CHECK;
+    } else if (name == "serve") {
+        mode = Mode::SERVE;
+    } else {
+        return false;
     }
-    
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    return buffer.str();
+    return true;
 }
 
-void writeFile(const std::string& filename, const std::string& content) {
+bool writeFile(const std::string& filename, const std::string& content) {
     std::ofstream file(filename);
     if (!file.is_open()) {
         std::cerr << "Error: Could not create file '" << filename << "'" << std::endl;
-        return;
+        return false;
     }
     
     file << content;
-    std::cout << "Output written to '" << filename << "'" << std::endl;
+    return true;
 }
 
 void printTokens(const std::vector<Token>& tokens) {
@@ -49,6 +75,16 @@ void printAST(Program* program) {
     }
 }
 
+// One line per warning and error on stderr, for the quiet modes
+void printDiagnostics(const std::string& inputFile, SemanticAnalyzer& semantic) {
+    for (const auto& warning : semantic.getWarnings()) {
+        std::cerr << inputFile << ": " << warning << std::endl;
+    }
+    for (const auto& error : semantic.getErrors()) {
+        std::cerr << inputFile << ": " << error << std::endl;
+    }
+}
+
 void printSemanticResults(SemanticAnalyzer& semantic) {
     const auto& warnings = semantic.getWarnings();
     if (!warnings.empty()) {
@@ -71,69 +107,477 @@ void printSemanticResults(SemanticAnalyzer& semantic) {
     }
 }
 
+// A decimal option value in [minimum, maximum]; false for anything else,
+// including digit strings too long for any integer type
+bool parseCount(const std::string& text, uint64_t minimum, uint64_t maximum, uint64_t& value) {
+    if (text.empty() || text.find_first_not_of("0123456789") != std::string::npos) return false;
+    value = 0;
+    for (char digit : text) {
+        if (value > (UINT64_MAX - 9) / 10) return false;
+        value = value * 10 + static_cast<uint64_t>(digit - '0');
+        if (value > maximum) return false;
+    }
+    return value >= minimum;
+}
+
+// The "=text" / "=json" suffix of -stats and -time-phases, if any
+bool parseStatsFormat(const std::string& suffix, PhaseStats::Format& format) {
+    if (suffix.empty() || suffix == "=text") {
+        format = PhaseStats::Format::TEXT;
+    } else if (suffix == "=json") {
+        format = PhaseStats::Format::JSON;
+    } else {
+        std::cerr << "Error: Unknown statistics format '" << suffix.substr(1) << "' (expected text or json)" << std::endl;
+        return false;
+    }
+    return true;
+}
+
 int main(int argc, char* argv[]) {
-    if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " <input_file> [options]" << std::endl;
+    // A mode is followed by an input, except serve, which reads requests
+    Mode mode = Mode::FULL;
+    int first = 1;
+    if (argc > 1 && parseMode(argv[1], mode)) {
+        if (argc > 2 || mode == Mode::SERVE) {
+            first = 2;
+        } else {
+            mode = Mode::FULL;
+        }
+    }
+    
+    if (argc <= first && mode != Mode::SERVE) {
+        std::cerr << "Usage: " << argv[0] << " [compile|run|check] <input_file>... [options]" << std::endl;
+        std::cerr << "       " << argv[0] << " serve [options]" << std::endl;
+        std::cerr << "Modes:" << std::endl;
+        std::cerr << "  (none)     Show every phase, run the program and print the final listing" << std::endl;
+        std::cerr << "  compile    Write the optimized code to -output (or stdout), or build -native; never runs" << std::endl;
+        std::cerr << "  run        Run the program and print only its output; exits with its exit code" << std::endl;
+        std::cerr << "             The input may also be a file written by -emit-bytecode" << std::endl;
+        std::cerr << "  check      Parse and type-check only" << std::endl;
+        std::cerr << "  serve      Answer compile, check and run requests on stdin or -socket" << std::endl;
+        std::cerr << "compile and check take several inputs, handled in parallel; each listing goes to <stem>.asm" << std::endl;
         std::cerr << "Options:" << std::endl;
         std::cerr << "  -tokens    Print tokens" << std::endl;
         std::cerr << "  -ast       Print AST" << std::endl;
-        std::cerr << "  -no-opt    Disable optimization" << std::endl;
+        std::cerr << "  -O0 .. -O3 Optimization level (default: -O" << Optimizer::kDefaultLevel << ")" << std::endl;
+        std::cerr << "  -no-opt    Disable optimization, the same as -O0" << std::endl;
+        std::cerr << "  -enable-pass=<names> Run these passes on top of the level (comma-separated)" << std::endl;
+        std::cerr << "  -disable-pass=<names> Skip these passes; one of inline, simplify, ssa, loop, cleanup" << std::endl;
         std::cerr << "  -output <file> Output file for generated code" << std::endl;
+        std::cerr << "  -manifest=<file> Also take the inputs listed in a file, one per line" << std::endl;
+        std::cerr << "  -jobs=N    Inputs compiled at once (default: all cores)" << std::endl;
+        std::cerr << "  -output-dir=<dir> Where several inputs' listings go (default: next to each source)" << std::endl;
+        std::cerr << "  -cache-dir=<dir> Reuse the optimized code of unchanged functions (compile and run)" << std::endl;
+        std::cerr << "  -engine=<interp|vm|jit> Execution engine (default: interp); jit is the VM with hot functions compiled to machine code" << std::endl;
+        std::cerr << "  -jit-threshold=N Calls plus loop iterations before a function is compiled (default: " << JitCompiler::kDefaultThreshold << ")" << std::endl;
+        std::cerr << "  -bytecode  Print VM bytecode" << std::endl;
+        std::cerr << "  -threads=N Worker threads for map/filter (default: all cores)" << std::endl;
+        std::cerr << "  -memoize   Cache results of pure functions with scalar arguments" << std::endl;
+        std::cerr << "  -memo-size=N Memo cache entries (default: " << MemoCache::kDefaultCapacity << ")" << std::endl;
+        std::cerr << "  -memo-evict=<lru|fifo> Memo cache eviction policy (default: lru)" << std::endl;
+        std::cerr << "  -native=<exe> Compile to an x86-64 executable instead of running" << std::endl;
+        std::cerr << "  -runtime=<lib> Runtime library for -native (default: libmathseqrt.a next to mathseqc)" << std::endl;
+        std::cerr << "  -emit-bytecode=<file> Save the VM bytecode for a later run (compile)" << std::endl;
+        std::cerr << "  -stats[=text|json] Report time, memory and allocations per phase, and work counters" << std::endl;
+        std::cerr << "  -time-phases[=text|json] Report only wall and CPU time per phase" << std::endl;
+        std::cerr << "  -stats-file=<file> Write the -stats or -time-phases report to a file instead" << std::endl;
+        std::cerr << "  -print-fd=N Write the program's output to file descriptor N as it runs" << std::endl;
+        std::cerr << "  -batch-input Read input() without printing prompts" << std::endl;
+        std::cerr << "  -socket=<path> Serve on a Unix socket instead of stdin (serve)" << std::endl;
+        std::cerr << "  -timeout=<ms> Stop runs that take longer (serve; default: none)" << std::endl;
+        std::cerr << "  -program-cache=N Compiled programs kept (serve; default: " << CompileServer::kDefaultCapacity << ")" << std::endl;
         return 1;
     }
     
-    std::string inputFile = argv[1];
+    std::vector<std::string> inputs;
+    std::string manifest;
+    size_t jobs = std::max(1u, std::thread::hardware_concurrency());
+    std::string outputDirectory;
+    std::string cacheDirectory;
+    bool verbose = mode == Mode::FULL;
     bool printTokensFlag = false;
     bool printASTFlag = false;
-    bool enableOptimization = true;
+    int optimizationLevel = Optimizer::kDefaultLevel;
+    std::vector<std::pair<Optimizer::Pass, bool>> passOverrides;
+    bool printBytecodeFlag = false;
+    std::string engine = "interp";
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
     std::string outputFile;
+    bool memoize = false;
+    size_t memoSize = MemoCache::kDefaultCapacity;
+    MemoCache::Eviction memoEviction = MemoCache::Eviction::LRU;
+    std::string nativeFile;
+    std::string bytecodeFile;
+    uint32_t jitThreshold = JitCompiler::kDefaultThreshold;
+    std::string runtimeLibrary;
+    bool statsFlag = false;
+    bool timePhasesFlag = false;
+    PhaseStats::Format statsFormat = PhaseStats::Format::TEXT;
+    std::string statsFile;
+    std::string socketPath;
+    uint64_t timeoutMs = 0;
+    size_t programCapacity = CompileServer::kDefaultCapacity;
+    int printFd = -1;
+    bool batchInput = false;
     
     // Parse command line options
-    for (int i = 2; i < argc; ++i) {
+    for (int i = first; i < argc; ++i) {
         std::string arg = argv[i];
-        if (arg == "-tokens") {
+        if (arg.empty() || arg[0] != '-') {
+            inputs.push_back(arg);
+        } else if (arg == "-tokens") {
             printTokensFlag = true;
         } else if (arg == "-ast") {
             printASTFlag = true;
         } else if (arg == "-no-opt") {
-            enableOptimization = false;
+            optimizationLevel = 0;
+        } else if (arg.size() == 3 && arg.compare(0, 2, "-O") == 0 && arg[2] >= '0' && arg[2] <= '3') {
+            optimizationLevel = arg[2] - '0';
+        } else if (arg.rfind("-enable-pass=", 0) == 0 || arg.rfind("-disable-pass=", 0) == 0) {
+            bool enable = arg[1] == 'e';
+            std::stringstream names(arg.substr(arg.find('=') + 1));
+            std::string name;
+            while (std::getline(names, name, ',')) {
+                Optimizer::Pass pass;
+                if (!Optimizer::parsePass(name, pass)) {
+                    std::cerr << "Error: Unknown optimization pass '" << name
+                              << "' (expected inline, simplify, ssa, loop or cleanup)" << std::endl;
+                    return 1;
+                }
+                passOverrides.emplace_back(pass, enable);
+            }
         } else if (arg == "-output" && i + 1 < argc) {
             outputFile = argv[++i];
+        } else if (arg.rfind("-manifest=", 0) == 0) {
+            manifest = arg.substr(10);
+        } else if (arg.rfind("-cache-dir=", 0) == 0) {
+            cacheDirectory = arg.substr(11);
+        } else if (arg.rfind("-output-dir=", 0) == 0) {
+            outputDirectory = arg.substr(12);
+        } else if (arg.rfind("-jobs=", 0) == 0) {
+            std::string count = arg.substr(6);
+            uint64_t value = 0;
+            if (!parseCount(count, 1, SIZE_MAX, value)) {
+                std::cerr << "Error: Invalid job count '" << count << "'" << std::endl;
+                return 1;
+            }
+            jobs = static_cast<size_t>(value);
+        } else if (arg.rfind("-native=", 0) == 0) {
+            nativeFile = arg.substr(8);
+        } else if (arg.rfind("-emit-bytecode=", 0) == 0) {
+            bytecodeFile = arg.substr(15);
+        } else if (arg.rfind("-runtime=", 0) == 0) {
+            runtimeLibrary = arg.substr(9);
+        } else if (arg.rfind("-jit-threshold=", 0) == 0) {
+            std::string count = arg.substr(15);
+            uint64_t value = 0;
+            if (!parseCount(count, 0, UINT32_MAX, value)) {
+                std::cerr << "Error: Invalid JIT threshold '" << count << "'" << std::endl;
+                return 1;
+            }
+            jitThreshold = static_cast<uint32_t>(value);
+        } else if (arg.rfind("-engine=", 0) == 0) {
+            engine = arg.substr(8);
+        } else if (arg == "-bytecode") {
+            printBytecodeFlag = true;
+        } else if (arg.rfind("-threads=", 0) == 0) {
+            std::string count = arg.substr(9);
+            uint64_t value = 0;
+            if (!parseCount(count, 1, SIZE_MAX, value)) {
+                std::cerr << "Error: Invalid thread count '" << count << "'" << std::endl;
+                return 1;
+            }
+            threads = static_cast<size_t>(value);
+        } else if (arg == "-memoize") {
+            memoize = true;
+        } else if (arg.rfind("-memo-size=", 0) == 0) {
+            std::string count = arg.substr(11);
+            uint64_t value = 0;
+            if (!parseCount(count, 1, SIZE_MAX, value)) {
+                std::cerr << "Error: Invalid memo cache size '" << count << "'" << std::endl;
+                return 1;
+            }
+            memoSize = static_cast<size_t>(value);
+        } else if (arg.rfind("-stats", 0) == 0 && (arg.size() == 6 || arg[6] == '=')) {
+            statsFlag = true;
+            if (!parseStatsFormat(arg.substr(6), statsFormat)) return 1;
+        } else if (arg.rfind("-time-phases", 0) == 0 && (arg.size() == 12 || arg[12] == '=')) {
+            timePhasesFlag = true;
+            if (!parseStatsFormat(arg.substr(12), statsFormat)) return 1;
+        } else if (arg.rfind("-stats-file=", 0) == 0) {
+            statsFile = arg.substr(12);
+        } else if (arg.rfind("-print-fd=", 0) == 0) {
+            std::string fd = arg.substr(10);
+            if (fd.empty() || fd.size() > 9 || fd.find_first_not_of("0123456789") != std::string::npos) {
+                std::cerr << "Error: Invalid file descriptor '" << fd << "'" << std::endl;
+                return 1;
+            }
+            printFd = std::stoi(fd);
+        } else if (arg == "-batch-input") {
+            batchInput = true;
+        } else if (arg.rfind("-socket=", 0) == 0) {
+            socketPath = arg.substr(8);
+        } else if (arg.rfind("-timeout=", 0) == 0) {
+            std::string count = arg.substr(9);
+            if (count.empty() || count.size() > 18 || count.find_first_not_of("0123456789") != std::string::npos) {
+                std::cerr << "Error: Invalid timeout '" << count << "'" << std::endl;
+                return 1;
+            }
+            timeoutMs = std::stoull(count);
+        } else if (arg.rfind("-program-cache=", 0) == 0) {
+            std::string count = arg.substr(15);
+            uint64_t value = 0;
+            if (!parseCount(count, 1, SIZE_MAX, value)) {
+                std::cerr << "Error: Invalid program cache size '" << count << "'" << std::endl;
+                return 1;
+            }
+            programCapacity = static_cast<size_t>(value);
+        } else if (arg.rfind("-memo-evict=", 0) == 0) {
+            std::string policy = arg.substr(12);
+            if (!MemoCache::parseEviction(policy, memoEviction)) {
+                std::cerr << "Error: Unknown memo eviction policy '" << policy << "' (expected lru or fifo)" << std::endl;
+                return 1;
+            }
+        }
+    }
+    
+    if (engine != "interp" && engine != "vm" && engine != "jit") {
+        std::cerr << "Error: Unknown engine '" << engine << "' (expected interp, vm or jit)" << std::endl;
+        return 1;
+    }
+    if (mode == Mode::RUN && !nativeFile.empty()) {
+        std::cerr << "Error: -native builds an executable; use it with compile, not run" << std::endl;
+        return 1;
+    }
+    
+    if (!bytecodeFile.empty() && (mode != Mode::COMPILE || !nativeFile.empty())) {
+        std::cerr << "Error: -emit-bytecode needs the compile mode, without -native" << std::endl;
+        return 1;
+    }
+    
+    if (!cacheDirectory.empty() && mode == Mode::FULL) {
+        std::cerr << "Error: -cache-dir needs the compile or run mode" << std::endl;
+        return 1;
+    }
+    
+    if (printFd >= 0 && mode != Mode::FULL && mode != Mode::RUN) {
+        std::cerr << "Error: -print-fd needs a mode that runs the program" << std::endl;
+        return 1;
+    }
+    
+    // Serve reads input from requests and never prompts
+    if (batchInput) {
+        Builtins::redirectInput(std::cin, nullptr);
+    }
+    
+    if (mode == Mode::SERVE) {
+        if (!inputs.empty() || !manifest.empty()) {
+            std::cerr << "Error: serve takes its sources from requests, not the command line" << std::endl;
+            return 1;
+        }
+        if (engine == "jit") {
+            std::cerr << "Error: serve runs the interp or vm engine" << std::endl;
+            return 1;
+        }
+        CompileServer::Options options;
+        options.engine = engine;
+        options.optimizationLevel = optimizationLevel;
+        options.passOverrides = passOverrides;
+        options.threads = threads;
+        options.programCapacity = programCapacity;
+        options.timeoutMs = timeoutMs;
+        options.memoize = memoize;
+        options.memoSize = memoSize;
+        options.memoEviction = memoEviction;
+        CompileServer server(options);
+        if (socketPath.empty()) {
+            server.serve(std::cin, std::cout);
+            return 0;
+        }
+        std::string error;
+        if (!server.listen(socketPath, error)) {
+            std::cerr << "Error: " << error << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+    
+    if (!manifest.empty() && !BatchCompiler::readManifest(manifest, inputs)) {
+        std::cerr << "Error: Could not open file '" << manifest << "'" << std::endl;
+        return 1;
+    }
+    if (inputs.empty()) {
+        std::cerr << "Error: No input file" << std::endl;
+        return 1;
+    }
+    if (inputs.size() > 1 || !manifest.empty()) {
+        if (mode != Mode::COMPILE && mode != Mode::CHECK) {
+            std::cerr << "Error: Several inputs can only be compiled or checked" << std::endl;
+            return 1;
         }
+        if (!outputFile.empty() || !nativeFile.empty() || !bytecodeFile.empty() || statsFlag || timePhasesFlag ||
+            printTokensFlag || printASTFlag) {
+            std::cerr << "Error: -output, -native, -emit-bytecode, -stats, -time-phases, -tokens and -ast take a "
+                      << "single input" << std::endl;
+            return 1;
+        }
+        BatchCompiler::Options options;
+        options.checkOnly = mode == Mode::CHECK;
+        options.optimizationLevel = optimizationLevel;
+        options.passOverrides = passOverrides;
+        options.outputDirectory = outputDirectory;
+        options.cacheDirectory = cacheDirectory;
+        options.jobs = jobs;
+        size_t failures = BatchCompiler(options).run(inputs, std::cerr);
+        return failures == 0 ? 0 : 1;
     }
+    const std::string& inputFile = inputs.front();
+    
+    // Phases are timed from here; the report goes out just before the
+    // success line
+    PhaseStats stats(statsFlag || timePhasesFlag);
+    if (statsFlag) PhaseStats::countAllocations();
+    auto reportStatistics = [&]() {
+        stats.end();
+        if (!stats.enabled()) return;
+        if (statsFile.empty()) {
+            stats.print(std::cout, statsFormat, !statsFlag);
+            return;
+        }
+        std::ofstream file(statsFile);
+        if (!file.is_open()) {
+            std::cerr << "Error: Could not create file '" << statsFile << "'" << std::endl;
+            return;
+        }
+        stats.print(file, statsFormat, !statsFlag);
+        std::cout << "Statistics written to '" << statsFile << "'" << std::endl;
+    };
+    // The end of the run mode: what the program printed, and its exit code
+    // as ours
+    // Program output is streamed in the run mode, and with -print-fd;
+    // otherwise it is collected for the listing
+    std::unique_ptr<BufferedWriter> programOutput;
+    auto outputSink = [&]() -> OutputSink* {
+        if (mode != Mode::RUN && printFd < 0) return nullptr;
+        std::cout.flush();
+        programOutput.reset(new BufferedWriter(printFd < 0 ? 1 : printFd));
+        return programOutput.get();
+    };
+    auto finishOutput = [&]() {
+        if (!programOutput) return true;
+        programOutput->flush();
+        if (programOutput->good()) return true;
+        std::cerr << "Error: Could not write the program output" << std::endl;
+        return false;
+    };
+    // With -memoize, how well the cache did goes into the -stats counters
+    auto setMemoCounters = [&](const MemoCache& memo) {
+        if (!memoize) return;
+        const MemoCache::Stats& counts = memo.stats();
+        stats.setCounter("memo_hits", "Memo hits", counts.hits);
+        stats.setCounter("memo_misses", "Memo misses", counts.misses);
+        stats.setCounter("memo_evictions", "Memo evictions", counts.evictions);
+    };
+    auto finishRun = [&](const Interpreter::ExecutionResult& result) {
+        if (!finishOutput()) return 1;
+        if (!result.success) {
+            std::cerr << result.errorMessage << std::endl;
+            return 1;
+        }
+        reportStatistics();
+        return result.exitCode;
+    };
+    stats.begin("lex");
     
-    // Read source code
-    std::string source = readFile(inputFile);
-    if (source.empty()) {
+    // Map the source; tokens are views into it until the parser has
+    // interned what the AST keeps
+    MappedFile source;
+    if (!source.open(inputFile)) {
+        std::cerr << "Error: Could not open file '" << inputFile << "'" << std::endl;
+        return 1;
+    }
+    if (source.text().empty()) {
         return 1;
     }
     
-    std::cout << "Compiling: " << inputFile << std::endl;
-    std::cout << "=========================================" << std::endl;
+    // A file from -emit-bytecode skips every compiler phase
+    if (BytecodeFile::recognize(source.text())) {
+        if (mode != Mode::RUN) {
+            std::cerr << "Error: '" << inputFile << "' is compiled bytecode; use it with run" << std::endl;
+            return 1;
+        }
+        if (engine == "jit") {
+            std::cerr << "Error: -engine=jit needs the source; compiled bytecode runs on the VM" << std::endl;
+            return 1;
+        }
+        stats.begin("load");
+        std::unique_ptr<VirtualMachine> vm;
+        try {
+            vm.reset(new VirtualMachine(BytecodeFile::read(source.text())));
+        } catch (const std::exception& e) {
+            std::cerr << inputFile << ": " << e.what() << std::endl;
+            return 1;
+        }
+        if (printBytecodeFlag) {
+            std::cout << "Bytecode:" << std::endl;
+            std::cout << "=========" << std::endl;
+            vm->printBytecode(std::cout);
+            std::cout << std::endl;
+        }
+        ThreadPool pool(threads);
+        MemoCache memo(memoSize, memoEviction);
+        vm->setThreadPool(&pool);
+        if (memoize) vm->setMemoCache(&memo);
+        vm->setOutput(outputSink());
+        stats.begin("execute");
+        Interpreter::ExecutionResult executionResult = vm->run();
+        stats.end();
+        stats.setCounter("calls", "Calls", vm->calls());
+        stats.setCounter("sequence_copies", "Sequence copies", RuntimeValue::sequenceCopies());
+        setMemoCounters(memo);
+        return finishRun(executionResult);
+    }
+    
+    if (verbose) {
+        std::cout << "Compiling: " << inputFile << std::endl;
+        std::cout << "=========================================" << std::endl;
+    }
     
     try {
-        // Phase 1: Lexical Analysis
-        std::cout << "Phase 1: Lexical Analysis..." << std::endl;
-        Lexer lexer(source);
-        auto tokens = lexer.tokenize();
-        
+        // Phase 1: Lexical Analysis. The parser pulls tokens from the lexer
+        // as it goes; only -tokens materializes the whole list.
+        if (verbose) std::cout << "Phase 1: Lexical Analysis..." << std::endl;
         if (printTokensFlag) {
+            auto tokens = Lexer(source.text()).tokenize();
             printTokens(tokens);
-        }
-        
-        // Check for lexical errors
-        if (!tokens.empty() && tokens.back().type == TokenType::ERROR) {
-            std::cerr << "Lexical error: " << tokens.back().lexeme << std::endl;
-            return 1;
+            
+            // Check for lexical errors
+            if (!tokens.empty() && tokens.back().type == TokenType::ERROR) {
+                std::cerr << "Lexical error: " << tokens.back().lexeme << std::endl;
+                return 1;
+            }
+        } else if (stats.enabled()) {
+            // A pass of its own, so that lexing can be told apart from the
+            // parse that pulls the same tokens again
+            Lexer lexer(source.text());
+            TokenType type;
+            do {
+                type = lexer.nextToken().type;
+            } while (type != TokenType::END_OF_FILE && type != TokenType::ERROR);
         }
         
         // Phase 2: Syntax Analysis
-        std::cout << "Phase 2: Syntax Analysis..." << std::endl;
-        Parser parser(tokens);
+        stats.begin("parse");
+        if (verbose) std::cout << "Phase 2: Syntax Analysis..." << std::endl;
+        Lexer lexer(source.text());
+        Parser parser(lexer);
         
         std::unique_ptr<Program> program;
         try {
             program = parser.parse();
+        } catch (const LexicalError& e) {
+            std::cerr << "Lexical error: " << e.what() << std::endl;
+            return 1;
         } catch (const std::exception& e) {
             std::cerr << "Parse Error: " << e.what() << std::endl;
             return 1;
@@ -143,60 +587,223 @@ int main(int argc, char* argv[]) {
         }
         
         if (!program) {
-            std::cerr << "Parsing failed! (parser returned nullptr)" << std::endl;
+            std::cerr << "Parse Error: " << parser.error() << std::endl;
+            if (verbose) std::cerr << "Parsing failed! (parser returned nullptr)" << std::endl;
             return 1;
         }
+        stats.setCounter("tokens", "Tokens", parser.tokenCount());
         
         if (printASTFlag) {
             printAST(program.get());
         }
         
         // Phase 3: Semantic Analysis
-        std::cout << "Phase 3: Semantic Analysis..." << std::endl;
+        stats.begin("semantic");
+        if (verbose) std::cout << "Phase 3: Semantic Analysis..." << std::endl;
         SemanticAnalyzer semantic;
         bool semanticSuccess = semantic.analyze(program.get());
         
-        printSemanticResults(semantic);
+        if (verbose) {
+            printSemanticResults(semantic);
+        } else {
+            printDiagnostics(inputFile, semantic);
+        }
         
         if (!semanticSuccess) {
-            std::cerr << "Compilation failed due to semantic errors!" << std::endl;
+            if (verbose) std::cerr << "Compilation failed due to semantic errors!" << std::endl;
             return 1;
         }
         
-        // Phase 4: Intermediate Code Generation
-        std::cout << "Phase 4: Intermediate Code Generation..." << std::endl;
-        CodeGenerator codegen;
-        auto intermediateCode = codegen.generate(program.get());
+        if (mode == Mode::CHECK) {
+            reportStatistics();
+            return 0;
+        }
         
-        std::cout << "Generated Intermediate Code:" << std::endl;
-        std::cout << "============================" << std::endl;
-        codegen.printCode(std::cout);
-        std::cout << std::endl;
+        // Fold literal-only subexpressions before either engine sees the AST
+        if (optimizationLevel > 0) {
+            stats.begin("fold");
+            ConstantFolder folder;
+            size_t folded = folder.fold(program.get());
+            if (verbose) std::cout << "Constant folding: " << folded << " expression(s) folded" << std::endl << std::endl;
+        }
+        stats.setCounter("ast_nodes", "AST nodes", program->arena.nodeCount());
+        stats.setCounter("ast_bytes", "AST arena bytes", program->arena.bytesUsed());
         
-        // Phase 5: Optimization
-        std::vector<ThreeAddressCode> finalCode;
-        if (enableOptimization) {
-            std::cout << "Phase 5: Optimization..." << std::endl;
-            Optimizer optimizer(intermediateCode);
-            finalCode = optimizer.optimize();
-            optimizer.printOptimizedCode(std::cout);
-        } else {
-            finalCode = intermediateCode;
-            std::cout << "Optimization skipped." << std::endl;
+        // The interpreter runs the AST itself, so `run` only lowers the
+        // program when the VM needs it
+        TacModule finalCode;
+        if (!cacheDirectory.empty() && (mode != Mode::RUN || engine != "interp")) {
+            // Phases 4 and 5 for the functions not found in the cache
+            stats.begin("cache");
+            CompileCache cache(cacheDirectory);
+            finalCode = cache.compile(program.get(), optimizationLevel, passOverrides);
+            const CompileCache::Stats& cached = cache.statistics();
+            stats.setCounter("cache_hits", "Cache hits", cached.hits);
+            stats.setCounter("cache_misses", "Cache misses", cached.misses);
+            stats.setCounter("functions_lowered", "Functions lowered", cached.lowered);
+            stats.setCounter("tac_optimized", "TAC instructions after optimization", finalCode.code.size());
+        } else if (mode != Mode::RUN || engine != "interp") {
+            // Phase 4: Intermediate Code Generation
+            stats.begin("codegen");
+            if (verbose) std::cout << "Phase 4: Intermediate Code Generation..." << std::endl;
+            CodeGenerator codegen;
+            auto intermediateCode = codegen.generate(program.get());
+            stats.setCounter("tac_instructions", "TAC instructions", intermediateCode.code.size());
+            
+            if (verbose) {
+                std::cout << "Generated Intermediate Code:" << std::endl;
+                std::cout << "============================" << std::endl;
+                codegen.printCode(std::cout);
+                std::cout << std::endl;
+            }
+            
+            // Phase 5: Optimization
+            Optimizer optimizer(intermediateCode, optimizationLevel);
+            bool anyPass = false;
+            for (const auto& choice : passOverrides) {
+                optimizer.setPassEnabled(choice.first, choice.second);
+            }
+            for (size_t p = 0; p < static_cast<size_t>(Optimizer::Pass::COUNT); ++p) {
+                anyPass = anyPass || optimizer.isPassEnabled(static_cast<Optimizer::Pass>(p));
+            }
+            if (anyPass) {
+                stats.begin("optimize");
+                if (verbose) std::cout << "Phase 5: Optimization..." << std::endl;
+                finalCode = optimizer.optimize();
+                if (verbose) {
+                    optimizer.printPassStatistics(std::cout);
+                    std::cout << std::endl;
+                    optimizer.printOptimizedCode(std::cout);
+                }
+            } else {
+                finalCode = std::move(intermediateCode);
+                if (verbose) std::cout << "Optimization skipped." << std::endl;
+            }
+            if (verbose) std::cout << std::endl;
+            stats.setCounter("tac_optimized", "TAC instructions after optimization", finalCode.code.size());
         }
-        std::cout << std::endl;
         
         // Phase 6: Code Generation (Output)
-        std::cout << "Phase 6: Final Code Output..." << std::endl;
+        if (verbose) std::cout << "Phase 6: Final Code Output..." << std::endl;
+        
+        if (!nativeFile.empty()) {
+            stats.begin("native");
+            if (runtimeLibrary.empty()) {
+                std::string self = argv[0];
+                size_t slash = self.find_last_of('/');
+                runtimeLibrary = (slash == std::string::npos ? "" : self.substr(0, slash + 1)) + "libmathseqrt.a";
+            }
+            std::string assemblyFile = nativeFile + ".s";
+            NativeCodeGenerator native;
+            {
+                std::ofstream assembly(assemblyFile);
+                if (!assembly.is_open()) {
+                    std::cerr << "Error: Could not create file '" << assemblyFile << "'" << std::endl;
+                    return 1;
+                }
+                native.generate(finalCode, program.get(), assembly);
+            }
+            std::string command = "g++ \"" + assemblyFile + "\" \"" + runtimeLibrary + "\" -pthread -o \"" +
+                                  nativeFile + "\"";
+            if (std::system(command.c_str()) != 0) {
+                std::cerr << "Error: Could not link '" << nativeFile << "' against '" << runtimeLibrary << "'" << std::endl;
+                return 1;
+            }
+            if (verbose) {
+                const NativeCodeGenerator::Stats& stats = native.statistics();
+                std::cout << "Native code: " << stats.functions << " function(s), " << stats.inRegisters
+                          << " value(s) in registers, " << stats.spilled << " spilled, " << stats.boxed << " boxed"
+                          << std::endl;
+                std::cout << "Assembly written to '" << assemblyFile << "'" << std::endl;
+                std::cout << "Program execution skipped: compiled to native code '" << nativeFile << "'" << std::endl;
+                std::cout << std::endl;
+            }
+            reportStatistics();
+            if (verbose) std::cout << "✅ Compilation completed successfully!" << std::endl;
+            return 0;
+        }
+        
+        if (!bytecodeFile.empty()) {
+            stats.begin("bytecode");
+            BytecodeCompiler bytecodeCompiler;
+            BytecodeModule module = bytecodeCompiler.compile(finalCode, program.get());
+            std::ofstream file(bytecodeFile, std::ios::binary);
+            if (!file.is_open()) {
+                std::cerr << "Error: Could not create file '" << bytecodeFile << "'" << std::endl;
+                return 1;
+            }
+            BytecodeFile::write(module, file);
+            reportStatistics();
+            return 0;
+        }
+        
+        if (mode == Mode::COMPILE) {
+            // The listing alone; nothing is run
+            stats.begin("output");
+            std::stringstream listing;
+            BatchCompiler::writeListing(listing, inputFile, finalCode);
+            if (outputFile.empty()) {
+                std::cout << listing.str();
+            } else if (!writeFile(outputFile, listing.str())) {
+                return 1;
+            }
+            reportStatistics();
+            return 0;
+        }
+        
+        // Run the program to capture runtime output. The VM executes the
+        // final TAC; the AST interpreter is kept as the reference engine.
+        Interpreter::ExecutionResult executionResult;
+        ThreadPool pool(threads);
+        MemoCache memo(memoSize, memoEviction);
+        std::unique_ptr<JitCompiler> jit;
+        if (engine == "vm" || engine == "jit") {
+            stats.begin("bytecode");
+            BytecodeCompiler bytecodeCompiler;
+            VirtualMachine vm(bytecodeCompiler.compile(finalCode, program.get()));
+            if (printBytecodeFlag) {
+                std::cout << "Bytecode:" << std::endl;
+                std::cout << "=========" << std::endl;
+                vm.printBytecode(std::cout);
+                std::cout << std::endl;
+            }
+            vm.setThreadPool(&pool);
+            if (memoize) vm.setMemoCache(&memo);
+            if (engine == "jit") {
+                jit.reset(new JitCompiler(finalCode, program.get(), jitThreshold));
+                vm.setJit(jit.get());
+            }
+            vm.setOutput(outputSink());
+            stats.begin("execute");
+            executionResult = vm.run();
+            stats.setCounter("calls", "Calls", vm.calls());
+        } else {
+            OutputSink* sink = outputSink();
+            stats.begin("execute");
+            Interpreter interpreter(program.get());
+            interpreter.setThreadPool(&pool);
+            if (memoize) interpreter.setMemoCache(&memo);
+            interpreter.setOutput(sink);
+            executionResult = interpreter.run();
+            Interpreter::Counters work = interpreter.counters();
+            stats.setCounter("statements_executed", "Statements executed (interpreter only)", work.statements);
+            stats.setCounter("calls", "Calls", work.calls);
+        }
+        stats.end();
+        stats.setCounter("sequence_copies", "Sequence copies", RuntimeValue::sequenceCopies());
+        setMemoCounters(memo);
         
-        // Interpret program to capture runtime output
-        Interpreter interpreter(program.get());
-        auto executionResult = interpreter.run();
+        if (mode == Mode::RUN) {
+            return finishRun(executionResult);
+        }
         
+        if (!finishOutput()) return 1;
         if (executionResult.success) {
             std::cout << "Program Output:" << std::endl;
             std::cout << "===============" << std::endl;
-            if (executionResult.outputLog.empty()) {
+            if (programOutput) {
+                std::cout << "(written to file descriptor " << printFd << ")" << std::endl;
+            } else if (executionResult.outputLog.empty()) {
                 std::cout << "(no print statements)" << std::endl;
             } else {
                 for (const auto& line : executionResult.outputLog) {
@@ -208,21 +815,39 @@ int main(int argc, char* argv[]) {
         }
         std::cout << std::endl;
         
-        // Generate final output
-        std::stringstream finalOutput;
-        finalOutput << "; MathSeq Compiler Output" << std::endl;
-        finalOutput << "; Source: " << inputFile << std::endl;
-        finalOutput << "; =======================" << std::endl << std::endl;
+        if (jit) {
+            JitCompiler::Stats stats = jit->statistics();
+            std::cout << "JIT:" << std::endl;
+            std::cout << "====" << std::endl;
+            std::cout << "Compiled: " << stats.functions << " function(s) in " << stats.units << " unit(s), "
+                      << stats.rejected << " hot function(s) left to the VM" << std::endl;
+            std::cout << "Compile time: " << std::fixed << std::setprecision(3) << stats.milliseconds << " ms"
+                      << std::defaultfloat << std::endl;
+            std::cout << std::endl;
+        }
         
-        for (const auto& instr : finalCode) {
-            finalOutput << instr.toString() << std::endl;
+        if (memoize) {
+            const MemoCache::Stats& stats = memo.stats();
+            std::cout << "Memo Cache:" << std::endl;
+            std::cout << "===========" << std::endl;
+            std::cout << "Hits: " << stats.hits << ", Misses: " << stats.misses
+                      << ", Evictions: " << stats.evictions << std::endl;
+            std::cout << "Entries: " << memo.size() << "/" << memo.capacity() << std::endl;
+            std::cout << std::endl;
         }
         
+        // Generate final output
+        stats.begin("output");
+        std::stringstream finalOutput;
+        BatchCompiler::writeListing(finalOutput, inputFile, finalCode);
+        
         finalOutput << std::endl;
         finalOutput << "; Program Output" << std::endl;
         finalOutput << "; --------------" << std::endl;
         if (executionResult.success) {
-            if (executionResult.outputLog.empty()) {
+            if (programOutput) {
+                finalOutput << "; (written to file descriptor " << printFd << ")" << std::endl;
+            } else if (executionResult.outputLog.empty()) {
                 finalOutput << "; (no print statements)" << std::endl;
             } else {
                 for (const auto& line : executionResult.outputLog) {
@@ -236,14 +861,18 @@ int main(int argc, char* argv[]) {
         
         // Output results
         if (!outputFile.empty()) {
-            writeFile(outputFile, finalOutput.str());
+            if (writeFile(outputFile, finalOutput.str())) {
+                std::cout << "Output written to '" << outputFile << "'" << std::endl;
+            }
         } else {
             std::cout << "Final Output:" << std::endl;
             std::cout << "=============" << std::endl;
             std::cout << finalOutput.str();
         }
+        std::cout << std::endl;
         
-        std::cout << std::endl << "✅ Compilation completed successfully!" << std::endl;
+        reportStatistics();
+        std::cout << "✅ Compilation completed successfully!" << std::endl;
         
     } catch (const std::exception& e) {
         std::cerr << "Unexpected error during compilation: " << e.what() << std::endl;
@@ -251,4 +880,4 @@ int main(int argc, char* argv[]) {
     }
     
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,58 @@
+#include "../include/mapped_file.h"
+#include <fstream>
+#include <sstream>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const std::string& path) {
+    close();
+#ifndef _WIN32
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat info;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode)) {
+        if (info.st_size == 0) {
+            ::close(fd);
+            return true;
+        }
+        void* address = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (address != MAP_FAILED) {
+            ::close(fd);
+            // The lexer reads front to back
+            madvise(address, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+            data = static_cast<const char*>(address);
+            length = static_cast<size_t>(info.st_size);
+            isMapped = true;
+            return true;
+        }
+    }
+    ::close(fd);
+#endif
+    // Pipes, devices, and platforms without mmap
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) return false;
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    contents = buffer.str();
+    data = contents.data();
+    length = contents.size();
+    return true;
+}
+
+void MappedFile::close() {
+#ifndef _WIN32
+    if (isMapped) munmap(const_cast<char*>(data), length);
+#endif
+    isMapped = false;
+    contents.clear();
+    data = nullptr;
+    length = 0;
+}
@@ -0,0 +1,110 @@
+#include "../include/memo.h"
+#include <algorithm>
+#include <cstring>
+
+MemoCache::MemoCache(size_t capacity, Eviction eviction)
+    : limit(std::max<size_t>(capacity, 1)), eviction(eviction) {
+    index.reserve(std::min(limit, kDefaultCapacity));
+}
+
+bool MemoCache::isCandidate(const FunctionDecl& function) {
+    if (!function.isPure || function.parameters.size() > kMaxArguments) {
+        return false;
+    }
+    for (const auto& param : function.parameters) {
+        if (param.type != DataType::INT && param.type != DataType::FLOAT &&
+            param.type != DataType::BOOL) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool MemoCache::parseEviction(const std::string& name, Eviction& eviction) {
+    if (name == "lru") {
+        eviction = Eviction::LRU;
+    } else if (name == "fifo") {
+        eviction = Eviction::FIFO;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool MemoCache::Key::operator==(const Key& other) const {
+    if (function != other.function || count != other.count) return false;
+    for (uint32_t i = 0; i < count; ++i) {
+        if (kinds[i] != other.kinds[i] || bits[i] != other.bits[i]) return false;
+    }
+    return true;
+}
+
+size_t MemoCache::KeyHash::operator()(const Key& key) const {
+    uint64_t hash = 0x9E3779B97F4A7C15ull ^ (static_cast<uint64_t>(key.function) << 8) ^ key.count;
+    for (uint32_t i = 0; i < key.count; ++i) {
+        hash ^= key.bits[i] + 0x9E3779B97F4A7C15ull + (hash << 6) + (hash >> 2) + key.kinds[i];
+    }
+    return static_cast<size_t>(hash);
+}
+
+bool MemoCache::makeKey(uint32_t function, const RuntimeValue* args, size_t count, Key& key) {
+    if (count > kMaxArguments) return false;
+    key.function = function;
+    key.count = static_cast<uint32_t>(count);
+    for (size_t i = 0; i < count; ++i) {
+        const RuntimeValue& arg = args[i];
+        key.kinds[i] = static_cast<uint8_t>(arg.kind());
+        switch (arg.kind()) {
+            case RuntimeValue::Kind::INT:
+                key.bits[i] = static_cast<uint64_t>(arg.intValue());
+                break;
+            case RuntimeValue::Kind::FLOAT: {
+                double value = arg.floatValue();
+                std::memcpy(&key.bits[i], &value, sizeof(value));
+                break;
+            }
+            case RuntimeValue::Kind::BOOL:
+                key.bits[i] = arg.boolValue() ? 1 : 0;
+                break;
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+const RuntimeValue* MemoCache::find(uint32_t function, const RuntimeValue* args, size_t count) {
+    Key key;
+    if (!makeKey(function, args, count, key)) return nullptr;
+
+    auto it = index.find(key);
+    if (it == index.end()) {
+        ++counters.misses;
+        return nullptr;
+    }
+    ++counters.hits;
+    if (eviction == Eviction::LRU) {
+        entries.splice(entries.end(), entries, it->second);
+    }
+    return &it->second->result;
+}
+
+void MemoCache::insert(uint32_t function, const RuntimeValue* args, size_t count, RuntimeValue result) {
+    Key key;
+    if (!makeKey(function, args, count, key)) return;
+
+    // A recursive call may already have filled this key
+    auto existing = index.find(key);
+    if (existing != index.end()) {
+        existing->second->result = std::move(result);
+        return;
+    }
+
+    if (index.size() >= limit) {
+        index.erase(entries.front().key);
+        entries.pop_front();
+        ++counters.evictions;
+    }
+    entries.push_back(Entry{key, std::move(result)});
+    index.emplace(key, std::prev(entries.end()));
+}
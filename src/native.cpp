@@ -0,0 +1,1463 @@
+#include "../include/native.h"
+#include "../include/builtins.h"
+#include "../include/value.h"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+    using ValueKind = NativeCodeGenerator::ValueKind;
+
+    // Callee-saved, so raw values survive calls into the runtime
+    const char* const kRegisters[] = {"rbx", "r12", "r13", "r14", "r15"};
+    constexpr int kRegisterCount = 5;
+    // The (tag, payload) pair of each of the first three arguments
+    const char* const kArgumentRegisters[3][2] = {{"rdi", "rsi"}, {"rdx", "rcx"}, {"r8", "r9"}};
+    constexpr size_t kRegisterArguments = 3;
+    // rbx and r12-r15 are pushed right below the saved rbp
+    constexpr int32_t kSavedBytes = 40;
+    // Tags from STRING up own a reference
+    constexpr int kFirstCountedTag = static_cast<int>(RuntimeValue::Kind::STRING);
+
+    bool isFunctionEntry(const ThreeAddressCode& instr) {
+        return instr.op == TacOp::LABEL && instr.result.kind() == Operand::Kind::FUNCTION;
+    }
+
+    bool isJump(TacOp op) {
+        return op == TacOp::GOTO || op == TacOp::IF_FALSE || op == TacOp::IF;
+    }
+
+    bool isRawKind(ValueKind kind) {
+        return kind == ValueKind::INT || kind == ValueKind::BOOL;
+    }
+
+    ValueKind join(ValueKind left, ValueKind right) {
+        if (left == right || right == ValueKind::NONE) return left;
+        if (left == ValueKind::NONE) return right;
+        return ValueKind::BOXED;
+    }
+
+    ValueKind declaredKind(DataType type) {
+        if (type == DataType::INT) return ValueKind::INT;
+        return type == DataType::BOOL ? ValueKind::BOOL : ValueKind::BOXED;
+    }
+
+    int tagOf(ValueKind kind) {
+        return static_cast<int>(kind == ValueKind::BOOL ? RuntimeValue::Kind::BOOL : RuntimeValue::Kind::INT);
+    }
+
+    bool fitsImmediate(long long value) {
+        return value >= INT32_MIN && value <= INT32_MAX;
+    }
+
+    std::string memory(const std::string& address, int displacement = 0, const char* width = "qword") {
+        std::string text = std::string(width) + " ptr [" + address;
+        if (displacement != 0) text += "+" + std::to_string(displacement);
+        return text + "]";
+    }
+
+    std::string label(Operand operand) {
+        return ".LL" + std::to_string(operand.index());
+    }
+
+    // The operands an instruction reads; in-place sequence updates also
+    // read their target
+    template <typename Read>
+    void forEachRead(const ThreeAddressCode& instr, Read&& read) {
+        switch (instr.op) {
+            case TacOp::LABEL:
+            case TacOp::GOTO:
+            case TacOp::NEW_SEQ:
+            case TacOp::CALL:
+                return;
+            case TacOp::IF_FALSE:
+            case TacOp::IF:
+            case TacOp::PARAM:
+            case TacOp::RETURN:
+            case TacOp::ASSIGN:
+            case TacOp::NEG:
+            case TacOp::NOT:
+                read(instr.arg1);
+                return;
+            case TacOp::STORE:
+            case TacOp::APPEND:
+            case TacOp::EXTEND:
+                read(instr.arg1);
+                read(instr.result);
+                return;
+            default:
+                read(instr.arg1);
+                read(instr.arg2);
+                return;
+        }
+    }
+
+    Operand definition(const ThreeAddressCode& instr) {
+        switch (instr.op) {
+            case TacOp::LABEL:
+            case TacOp::GOTO:
+            case TacOp::IF_FALSE:
+            case TacOp::IF:
+            case TacOp::PARAM:
+            case TacOp::RETURN:
+                return Operand();
+            default:
+                return instr.result.isValue() ? instr.result : Operand();
+        }
+    }
+
+    // One bit per value of a function
+    struct Bits {
+        std::vector<uint64_t> words;
+
+        explicit Bits(size_t size = 0, bool value = false)
+            : words((size + 63) / 64, value ? ~uint64_t(0) : 0) {}
+        bool test(size_t i) const { return (words[i / 64] >> (i % 64)) & 1; }
+        void set(size_t i) { words[i / 64] |= uint64_t(1) << (i % 64); }
+        bool operator!=(const Bits& other) const { return words != other.words; }
+    };
+
+    std::string asciiLiteral(const std::string& text) {
+        static const char* const digits = "01234567";
+        std::string literal = "\"";
+        for (unsigned char c : text) {
+            if (c == '"' || c == '\\') {
+                literal += '\\';
+                literal += static_cast<char>(c);
+            } else if (c >= 0x20 && c < 0x7f) {
+                literal += static_cast<char>(c);
+            } else {
+                literal += '\\';
+                literal += digits[c >> 6];
+                literal += digits[(c >> 3) & 7];
+                literal += digits[c & 7];
+            }
+        }
+        return literal + "\"";
+    }
+}
+
+void NativeCodeGenerator::reset(const TacModule& module, std::ostream& output) {
+    tac = &module;
+    out = &output;
+    functions.clear();
+    functionIndex.clear();
+    strings.clear();
+    stringIndex.clear();
+    constantUsed.assign(module.constants.size(), false);
+    localLabels = 0;
+    stats = Stats();
+}
+
+void NativeCodeGenerator::analyze(Program* program) {
+    collectFunctions(program);
+    for (Function& function : functions) {
+        buildBlocks(function);
+        findUninitializedReads(function);
+    }
+    if (jit) {
+        for (Function& function : functions) {
+            const FunctionDecl& decl = *program->functions[function.id];
+            for (size_t k = 0; k < function.paramKinds.size(); ++k) {
+                function.paramKinds[k] = declaredKind(decl.parameters[k].type);
+            }
+        }
+    }
+    inferKinds();
+}
+
+void NativeCodeGenerator::generate(const TacModule& module, Program* program, std::ostream& output) {
+    reset(module, output);
+    jit = false;
+    if (!program) {
+        throw std::runtime_error("Native error: nothing to compile");
+    }
+    analyze(program);
+    if (!functionIndex.count("main")) {
+        throw std::runtime_error("Native error: No 'main' function found");
+    }
+    for (Function& function : functions) {
+        allocate(function);
+    }
+
+    output << "    .intel_syntax noprefix" << "\n";
+    output << "    .text" << "\n";
+    for (Function& function : functions) {
+        emitFunction(function);
+        emitCallbackAdapter(function);
+    }
+    emitData();
+    stats.functions = functions.size();
+}
+
+std::vector<uint32_t> NativeCodeGenerator::generateJit(const TacModule& module, Program* program, uint32_t root,
+                                                       std::ostream& output) {
+    reset(module, output);
+    jit = true;
+    if (!program || root >= program->functions.size()) return {};
+    analyze(program);
+
+    std::vector<std::vector<uint32_t>> callees;
+    std::vector<bool> compilable = findJitFunctions(program, callees);
+    if (!compilable[root]) return {};
+    std::vector<uint32_t> unit{root};
+    std::vector<bool> inUnit(functions.size(), false);
+    inUnit[root] = true;
+    for (size_t next = 0; next < unit.size(); ++next) {
+        for (uint32_t callee : callees[unit[next]]) {
+            if (!inUnit[callee]) {
+                inUnit[callee] = true;
+                unit.push_back(callee);
+            }
+        }
+    }
+
+    output << "    .intel_syntax noprefix" << "\n";
+    output << "    .text" << "\n";
+    for (uint32_t f : unit) {
+        allocate(functions[f]);
+        emitFunction(functions[f]);
+        emitJitEntry(functions[f]);
+    }
+    output << "\n    .data\n";
+    emit(".p2align 3");
+    output << "    .globl ms_jit_trap\nms_jit_trap:\n.Ljit_trap:\n";
+    emit(".quad 0");
+    output << "\n    .section .note.GNU-stack,\"\",@progbits\n";
+    stats.functions = unit.size();
+    return unit;
+}
+
+std::vector<bool> NativeCodeGenerator::findJitFunctions(Program* program,
+                                                        std::vector<std::vector<uint32_t>>& callees) const {
+    const std::vector<ThreeAddressCode>& code = tac->code;
+    std::vector<bool> compilable(functions.size(), false);
+    callees.assign(functions.size(), {});
+    for (const Function& function : functions) {
+        const FunctionDecl& decl = *program->functions[function.id];
+        bool ok = function.begin < function.end && isRawKind(function.returnKind) &&
+                  function.returnKind == declaredKind(decl.returnType);
+        for (ValueKind kind : function.paramKinds) ok = ok && isRawKind(kind);
+        for (ValueKind kind : function.kinds) ok = ok && isRawKind(kind);
+
+        std::vector<Operand> pending;
+        for (size_t i = function.begin; ok && i < function.end; ++i) {
+            const ThreeAddressCode& instr = code[i];
+            if (instr.op == TacOp::NEW_SEQ || instr.op == TacOp::STORE || instr.op == TacOp::APPEND ||
+                instr.op == TacOp::EXTEND) {
+                ok = false;
+                break;
+            }
+            forEachRead(instr, [&](Operand operand) {
+                if (!operand.empty() && !isRawKind(kindOf(function, operand))) ok = false;
+            });
+            if (instr.op == TacOp::PARAM) {
+                pending.push_back(instr.arg1);
+            } else if (instr.op == TacOp::CALL) {
+                size_t argCount = instr.arg2.empty() ? 0 : instr.arg2.index();
+                const std::string& name = tac->name(instr.arg1);
+                Builtin builtin;
+                auto it = functionIndex.find(name);
+                if (Builtins::find(name, builtin) || it == functionIndex.end() || argCount > pending.size()) {
+                    ok = false;
+                    break;
+                }
+                // A mismatch would hand the callee bits it reads as another kind
+                const Function& target = functions[it->second];
+                size_t base = pending.size() - argCount;
+                ok = argCount == target.params.size();
+                for (size_t k = 0; ok && k < argCount; ++k) {
+                    ok = kindOf(function, pending[base + k]) == target.paramKinds[k];
+                }
+                pending.resize(base);
+                callees[function.id].push_back(it->second);
+            }
+        }
+        compilable[function.id] = ok;
+    }
+
+    // A function only qualifies when everything it calls does
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t f = 0; f < functions.size(); ++f) {
+            if (!compilable[f]) continue;
+            for (uint32_t callee : callees[f]) {
+                if (!compilable[callee]) {
+                    compilable[f] = false;
+                    changed = true;
+                    break;
+                }
+            }
+        }
+    }
+    return compilable;
+}
+
+void NativeCodeGenerator::collectFunctions(Program* program) {
+    for (const auto& decl : program->functions) {
+        Function function;
+        function.name = decl->name.text();
+        function.id = static_cast<uint32_t>(functions.size());
+        function.pure = decl->isPure;
+        for (const auto& param : decl->parameters) {
+            int64_t name = tac->names.find("param_" + param.name.text());
+            function.params.push_back(name < 0 ? Operand()
+                                               : Operand::make(Operand::Kind::VARIABLE, static_cast<uint32_t>(name)));
+        }
+        function.paramKinds.assign(function.params.size(), ValueKind::NONE);
+        functionIndex[function.name] = function.id;
+        functions.push_back(std::move(function));
+    }
+
+    // Each body runs from its entry label to the next one, as in the VM
+    const std::vector<ThreeAddressCode>& code = tac->code;
+    std::vector<size_t> boundaries;
+    for (size_t i = 0; i < code.size(); ++i) {
+        if (isFunctionEntry(code[i])) boundaries.push_back(i);
+    }
+    boundaries.push_back(code.size());
+    std::vector<bool> placed(functions.size(), false);
+    for (size_t b = 0; b + 1 < boundaries.size(); ++b) {
+        auto it = functionIndex.find(tac->name(code[boundaries[b]].result));
+        if (it == functionIndex.end() || placed[it->second]) continue;
+        placed[it->second] = true;
+        functions[it->second].begin = boundaries[b] + 1;
+        functions[it->second].end = boundaries[b + 1];
+    }
+
+    for (Function& function : functions) {
+        std::unordered_map<Operand, bool, OperandHash> written;
+        for (size_t i = function.begin; i < function.end; ++i) {
+            Operand result = code[i].result;
+            if (result.isValue() && code[i].op != TacOp::LABEL) written[result] = true;
+        }
+        auto add = [&](Operand operand) {
+            if (!operand.isValue() || function.valueIndex.count(operand)) return;
+            // Names never written here that match a function are callbacks
+            if (operand.kind() == Operand::Kind::VARIABLE && !written.count(operand) &&
+                functionIndex.count(tac->name(operand))) return;
+            function.valueIndex.emplace(operand, static_cast<uint32_t>(function.values.size()));
+            function.values.push_back(operand);
+        };
+        for (Operand param : function.params) {
+            if (!param.empty() && !function.valueIndex.count(param)) {
+                function.valueIndex.emplace(param, static_cast<uint32_t>(function.values.size()));
+                function.values.push_back(param);
+            }
+        }
+        for (size_t i = function.begin; i < function.end; ++i) {
+            forEachRead(code[i], add);
+            add(definition(code[i]));
+        }
+        function.kinds.assign(function.values.size(), ValueKind::NONE);
+        function.forcedBoxed.assign(function.values.size(), false);
+
+        if (function.begin < function.end) {
+            TacOp last = code[function.end - 1].op;
+            function.fallsThrough = last != TacOp::RETURN && last != TacOp::GOTO;
+        }
+    }
+}
+
+void NativeCodeGenerator::buildBlocks(Function& function) {
+    const ThreeAddressCode* code = tac->code.data() + function.begin;
+    size_t size = function.end - function.begin;
+    function.blocks.clear();
+
+    std::unordered_map<Operand, uint32_t, OperandHash> labels;
+    for (size_t i = 0; i < size;) {
+        size_t end = i + 1;
+        while (end < size && code[end].op != TacOp::LABEL && !isJump(code[end - 1].op) &&
+               code[end - 1].op != TacOp::RETURN) {
+            ++end;
+        }
+        if (code[i].op == TacOp::LABEL) {
+            labels[code[i].result] = static_cast<uint32_t>(function.blocks.size());
+        }
+        function.blocks.push_back(Block{i, end, {}, {}});
+        i = end;
+    }
+    if (function.blocks.empty()) {
+        function.blocks.push_back(Block{0, 0, {}, {}});
+    }
+
+    for (uint32_t b = 0; b < function.blocks.size(); ++b) {
+        Block& block = function.blocks[b];
+        const ThreeAddressCode* last = block.end > block.begin ? &code[block.end - 1] : nullptr;
+        if (last && isJump(last->op)) {
+            auto it = labels.find(last->result);
+            if (it == labels.end()) {
+                throw std::runtime_error("Native error: Undefined label '" + tac->operandToString(last->result) + "'");
+            }
+            block.successors.push_back(it->second);
+        }
+        bool fallsThrough = !last || (last->op != TacOp::GOTO && last->op != TacOp::RETURN);
+        if (fallsThrough && b + 1 < function.blocks.size()) {
+            block.successors.push_back(b + 1);
+        }
+        for (uint32_t successor : block.successors) {
+            function.blocks[successor].predecessors.push_back(b);
+        }
+    }
+}
+
+void NativeCodeGenerator::findUninitializedReads(Function& function) {
+    // Every slot starts out void, as a VM register does; a value read on a
+    // path that has not written it must therefore stay boxed
+    const ThreeAddressCode* code = tac->code.data() + function.begin;
+    size_t count = function.values.size();
+    size_t blockCount = function.blocks.size();
+
+    Bits entry(count);
+    for (Operand param : function.params) {
+        if (!param.empty()) entry.set(function.valueIndex.at(param));
+    }
+    std::vector<Bits> defined(blockCount, Bits(count));
+    for (size_t b = 0; b < blockCount; ++b) {
+        for (size_t i = function.blocks[b].begin; i < function.blocks[b].end; ++i) {
+            Operand result = definition(code[i]);
+            if (!result.empty()) defined[b].set(function.valueIndex.at(result));
+        }
+    }
+
+    // Forward: a value is assigned at a block's start when it is on every
+    // incoming path
+    std::vector<Bits> in(blockCount, Bits(count, true));
+    std::vector<Bits> outSets(blockCount, Bits(count, true));
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t b = 0; b < blockCount; ++b) {
+            Bits state = b == 0 ? entry : Bits(count, true);
+            for (uint32_t predecessor : function.blocks[b].predecessors) {
+                for (size_t w = 0; w < state.words.size(); ++w) state.words[w] &= outSets[predecessor].words[w];
+            }
+            Bits after = state;
+            for (size_t w = 0; w < after.words.size(); ++w) after.words[w] |= defined[b].words[w];
+            in[b] = std::move(state);
+            if (after != outSets[b]) {
+                outSets[b] = std::move(after);
+                changed = true;
+            }
+        }
+    }
+
+    for (size_t b = 0; b < blockCount; ++b) {
+        Bits state = in[b];
+        for (size_t i = function.blocks[b].begin; i < function.blocks[b].end; ++i) {
+            const ThreeAddressCode& instr = code[i];
+            forEachRead(instr, [&](Operand operand) {
+                auto it = function.valueIndex.find(operand);
+                if (it != function.valueIndex.end() && !state.test(it->second)) function.forcedBoxed[it->second] = true;
+            });
+            bool inPlace = instr.op == TacOp::STORE || instr.op == TacOp::APPEND || instr.op == TacOp::EXTEND;
+            Operand result = definition(instr);
+            if (result.empty()) continue;
+            uint32_t index = function.valueIndex.at(result);
+            if (inPlace) function.forcedBoxed[index] = true;
+            state.set(index);
+        }
+    }
+    for (size_t v = 0; v < count; ++v) {
+        if (function.forcedBoxed[v]) function.kinds[v] = ValueKind::BOXED;
+    }
+}
+
+void NativeCodeGenerator::inferKinds() {
+    const std::vector<ThreeAddressCode>& code = tac->code;
+
+    // Functions reachable through map, filter and generate are called with
+    // one argument of any kind, and main with none; the JIT checks the
+    // declared kinds when it is called instead
+    auto main = functionIndex.find("main");
+    if (main != functionIndex.end() && !jit) {
+        functions[main->second].paramKinds.assign(functions[main->second].params.size(), ValueKind::BOXED);
+    }
+    for (const Function& function : functions) {
+        if (jit) break;
+        for (size_t i = function.begin; i < function.end; ++i) {
+            for (Operand operand : {code[i].arg1, code[i].arg2}) {
+                if (!isCallback(function, operand)) continue;
+                Function& callee = functions[functionIndex.at(tac->name(operand))];
+                callee.paramKinds.assign(callee.params.size(), ValueKind::BOXED);
+            }
+        }
+    }
+
+    bool changed = false;
+    auto raise = [&](ValueKind& kind, ValueKind with) {
+        ValueKind joined = join(kind, with);
+        if (joined != kind) {
+            kind = joined;
+            changed = true;
+        }
+    };
+    auto resultKind = [&](const Function& function, const ThreeAddressCode& instr) {
+        ValueKind left = kindOf(function, instr.arg1);
+        ValueKind right = isBinaryTacOp(instr.op) ? kindOf(function, instr.arg2) : ValueKind::NONE;
+        switch (instr.op) {
+            case TacOp::ASSIGN:
+                return left;
+            case TacOp::ADD:
+            case TacOp::SUB:
+            case TacOp::MUL:
+            case TacOp::DIV:
+                if (left == ValueKind::NONE || right == ValueKind::NONE) return ValueKind::NONE;
+                return isRawKind(left) && isRawKind(right) ? ValueKind::INT : ValueKind::BOXED;
+            case TacOp::NEG:
+                return left == ValueKind::INT || left == ValueKind::NONE ? left : ValueKind::BOXED;
+            case TacOp::MOD:
+                return ValueKind::INT;
+            case TacOp::EQ:
+            case TacOp::NE:
+            case TacOp::LT:
+            case TacOp::LE:
+            case TacOp::GT:
+            case TacOp::GE:
+            case TacOp::AND:
+            case TacOp::OR:
+            case TacOp::NOT:
+                return ValueKind::BOOL;
+            default:
+                return ValueKind::BOXED;
+        }
+    };
+
+    // Optimistic: start from NONE everywhere and raise until stable. What
+    // is still NONE then was never given a value (a call that never
+    // returns, say), so it is boxed and everything runs again
+    for (;;) {
+        do {
+            changed = false;
+            for (Function& function : functions) {
+                for (size_t k = 0; k < function.params.size(); ++k) {
+                    if (function.params[k].empty()) continue;
+                    raise(function.kinds[function.valueIndex.at(function.params[k])], function.paramKinds[k]);
+                }
+
+                std::vector<Operand> pending;
+                for (size_t i = function.begin; i < function.end; ++i) {
+                    const ThreeAddressCode& instr = code[i];
+                    if (instr.op == TacOp::PARAM) {
+                        pending.push_back(instr.arg1);
+                        continue;
+                    }
+                    if (instr.op == TacOp::RETURN) {
+                        raise(function.returnKind, instr.arg1.empty() ? ValueKind::BOXED : kindOf(function, instr.arg1));
+                        continue;
+                    }
+                    Operand result = definition(instr);
+                    if (instr.op == TacOp::CALL) {
+                        size_t argCount = instr.arg2.empty() ? 0 : instr.arg2.index();
+                        if (argCount > pending.size()) {
+                            throw std::runtime_error("Native error: call without its arguments");
+                        }
+                        size_t base = pending.size() - argCount;
+                        const std::string& callee = tac->name(instr.arg1);
+                        Builtin builtin;
+                        auto it = functionIndex.find(callee);
+                        ValueKind returned = ValueKind::BOXED;
+                        if (!Builtins::find(callee, builtin) && it != functionIndex.end()) {
+                            Function& target = functions[it->second];
+                            for (size_t k = 0; k < target.params.size() && !jit; ++k) {
+                                raise(target.paramKinds[k], k < argCount ? kindOf(function, pending[base + k])
+                                                                         : ValueKind::BOXED);
+                            }
+                            returned = target.returnKind;
+                        }
+                        pending.resize(base);
+                        if (!result.empty()) raise(function.kinds[function.valueIndex.at(result)], returned);
+                        continue;
+                    }
+                    if (!result.empty()) raise(function.kinds[function.valueIndex.at(result)], resultKind(function, instr));
+                }
+                if (function.fallsThrough) raise(function.returnKind, ValueKind::BOXED);
+            }
+        } while (changed);
+
+        bool unresolved = false;
+        auto settle = [&](ValueKind& kind) {
+            if (kind != ValueKind::NONE) return;
+            kind = ValueKind::BOXED;
+            unresolved = true;
+        };
+        for (Function& function : functions) {
+            for (ValueKind& kind : function.kinds) settle(kind);
+            for (ValueKind& kind : function.paramKinds) settle(kind);
+            settle(function.returnKind);
+        }
+        if (!unresolved) break;
+    }
+}
+
+void NativeCodeGenerator::allocate(Function& function) {
+    const ThreeAddressCode* code = tac->code.data() + function.begin;
+    size_t count = function.values.size();
+    size_t blockCount = function.blocks.size();
+
+    // Backward liveness over the blocks
+    std::vector<Bits> used(blockCount, Bits(count));
+    std::vector<Bits> defined(blockCount, Bits(count));
+    for (size_t b = 0; b < blockCount; ++b) {
+        for (size_t i = function.blocks[b].begin; i < function.blocks[b].end; ++i) {
+            forEachRead(code[i], [&](Operand operand) {
+                auto it = function.valueIndex.find(operand);
+                if (it != function.valueIndex.end() && !defined[b].test(it->second)) used[b].set(it->second);
+            });
+            Operand result = definition(code[i]);
+            if (!result.empty()) defined[b].set(function.valueIndex.at(result));
+        }
+    }
+    std::vector<Bits> liveIn(blockCount, Bits(count));
+    std::vector<Bits> liveOut(blockCount, Bits(count));
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t b = blockCount; b-- > 0;) {
+            Bits after(count);
+            for (uint32_t successor : function.blocks[b].successors) {
+                for (size_t w = 0; w < after.words.size(); ++w) after.words[w] |= liveIn[successor].words[w];
+            }
+            Bits before = used[b];
+            for (size_t w = 0; w < before.words.size(); ++w) {
+                before.words[w] |= after.words[w] & ~defined[b].words[w];
+            }
+            liveOut[b] = std::move(after);
+            if (before != liveIn[b]) {
+                liveIn[b] = std::move(before);
+                changed = true;
+            }
+        }
+    }
+
+    // Each raw value's interval is the hull of every point it is live at;
+    // parameters start before the first instruction
+    std::vector<long long> start(count, LLONG_MAX);
+    std::vector<long long> end(count, LLONG_MIN);
+    auto touch = [&](size_t v, long long position) {
+        start[v] = std::min(start[v], position);
+        end[v] = std::max(end[v], position);
+    };
+    for (Operand param : function.params) {
+        if (!param.empty()) touch(function.valueIndex.at(param), -1);
+    }
+    for (size_t b = 0; b < blockCount; ++b) {
+        const Block& block = function.blocks[b];
+        for (size_t v = 0; v < count; ++v) {
+            if (liveIn[b].test(v)) touch(v, static_cast<long long>(block.begin));
+            if (liveOut[b].test(v)) touch(v, static_cast<long long>(block.end) - 1);
+        }
+        for (size_t i = block.begin; i < block.end; ++i) {
+            forEachRead(code[i], [&](Operand operand) {
+                auto it = function.valueIndex.find(operand);
+                if (it != function.valueIndex.end()) touch(it->second, static_cast<long long>(i));
+            });
+            Operand result = definition(code[i]);
+            if (!result.empty()) touch(function.valueIndex.at(result), static_cast<long long>(i));
+        }
+    }
+
+    // Linear scan: when every register is taken, the interval that ends
+    // last goes to the stack
+    function.storage.assign(count, Storage());
+    std::vector<uint32_t> order;
+    for (uint32_t v = 0; v < count; ++v) {
+        function.storage[v].kind = function.kinds[v];
+        if (isRawKind(function.kinds[v]) && start[v] != LLONG_MAX) order.push_back(v);
+    }
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        return start[a] != start[b] ? start[a] < start[b] : a < b;
+    });
+    std::vector<uint32_t> active;
+    std::vector<int> freeRegisters;
+    for (int r = kRegisterCount - 1; r >= 0; --r) freeRegisters.push_back(r);
+    for (uint32_t v : order) {
+        for (auto it = active.begin(); it != active.end();) {
+            if (end[*it] < start[v]) {
+                freeRegisters.push_back(function.storage[*it].reg);
+                it = active.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        if (!freeRegisters.empty()) {
+            function.storage[v].reg = freeRegisters.back();
+            freeRegisters.pop_back();
+            active.push_back(v);
+            continue;
+        }
+        auto latest = std::max_element(active.begin(), active.end(),
+                                       [&](uint32_t a, uint32_t b) { return end[a] < end[b]; });
+        if (end[*latest] > end[v]) {
+            function.storage[v].reg = function.storage[*latest].reg;
+            function.storage[*latest].reg = -1;
+            *latest = v;
+        }
+    }
+
+    // Frame, downwards from the saved registers: scratch values, the
+    // return value, boxed slots, spill slots, outgoing arguments
+    int32_t cursor = kSavedBytes;
+    for (int32_t& scratch : function.scratch) {
+        cursor += 16;
+        scratch = cursor;
+    }
+    cursor += 16;
+    function.returnSlot = cursor;
+    for (uint32_t v = 0; v < count; ++v) {
+        Storage& storage = function.storage[v];
+        if (storage.kind == ValueKind::BOXED) {
+            cursor += 16;
+            storage.offset = cursor;
+            ++stats.boxed;
+        } else if (storage.reg < 0) {
+            cursor += 8;
+            storage.offset = cursor;
+            ++stats.spilled;
+        } else {
+            ++stats.inRegisters;
+        }
+    }
+    function.paramHomes.assign(function.params.size(), 0);
+    for (size_t k = 0; k < function.params.size(); ++k) {
+        if (function.params[k].empty() && function.paramKinds[k] == ValueKind::BOXED) {
+            cursor += 16;
+            function.paramHomes[k] = cursor;
+        }
+    }
+
+    size_t depth = 0;
+    size_t maxDepth = 0;
+    size_t stackArguments = 0;
+    for (size_t i = 0; i < function.end - function.begin; ++i) {
+        if (code[i].op == TacOp::PARAM) {
+            maxDepth = std::max(maxDepth, ++depth);
+        } else if (code[i].op == TacOp::CALL) {
+            size_t argCount = code[i].arg2.empty() ? 0 : code[i].arg2.index();
+            depth -= std::min(depth, argCount);
+            auto it = functionIndex.find(tac->name(code[i].arg1));
+            Builtin builtin;
+            if (it != functionIndex.end() && !Builtins::find(tac->name(code[i].arg1), builtin)) {
+                size_t params = functions[it->second].params.size();
+                if (params > kRegisterArguments) stackArguments = std::max(stackArguments, params - kRegisterArguments);
+            }
+        }
+    }
+    cursor += static_cast<int32_t>(16 * maxDepth);
+    function.argumentSlots = cursor;
+
+    // The five pushes leave rsp 8 bytes off a 16-byte boundary
+    int32_t frame = cursor - kSavedBytes + static_cast<int32_t>(16 * stackArguments);
+    function.frameSize = frame + ((24 - frame % 16) % 16);
+}
+
+int64_t NativeCodeGenerator::valueOf(Operand operand) const {
+    auto it = current->valueIndex.find(operand);
+    return it == current->valueIndex.end() ? -1 : it->second;
+}
+
+bool NativeCodeGenerator::isCallback(const Function& function, Operand operand) const {
+    return operand.kind() == Operand::Kind::VARIABLE && !function.valueIndex.count(operand) &&
+           functionIndex.count(tac->name(operand));
+}
+
+NativeCodeGenerator::ValueKind NativeCodeGenerator::kindOf(const Function& function, Operand operand) const {
+    if (operand.isConstant()) {
+        switch (tac->constant(operand).kind) {
+            case TacConstant::Kind::INT: return ValueKind::INT;
+            case TacConstant::Kind::BOOL: return ValueKind::BOOL;
+            default: return ValueKind::BOXED;
+        }
+    }
+    auto it = function.valueIndex.find(operand);
+    return it == function.valueIndex.end() ? ValueKind::BOXED : function.kinds[it->second];
+}
+
+bool NativeCodeGenerator::isRaw(Operand operand) const {
+    return isRawKind(kindOf(*current, operand));
+}
+
+long long NativeCodeGenerator::rawConstant(Operand operand) const {
+    return tac->constant(operand).intValue;
+}
+
+std::string NativeCodeGenerator::slot(int32_t offset) const {
+    return "rbp-" + std::to_string(offset);
+}
+
+std::string NativeCodeGenerator::rawOperand(Operand operand, const char* scratch) {
+    if (operand.isConstant()) {
+        long long value = rawConstant(operand);
+        if (fitsImmediate(value)) return std::to_string(value);
+        emit(std::string("movabs ") + scratch + ", " + std::to_string(value));
+        return scratch;
+    }
+    const Storage& storage = current->storage[valueOf(operand)];
+    if (!isRawKind(storage.kind)) {
+        throw std::runtime_error("Native error: '" + tac->operandToString(operand) + "' is not a raw value");
+    }
+    return storage.reg >= 0 ? kRegisters[storage.reg] : memory(slot(storage.offset));
+}
+
+void NativeCodeGenerator::loadRaw(const char* reg, Operand operand) {
+    std::string source = rawOperand(operand, reg);
+    if (source != reg) emit(std::string("mov ") + reg + ", " + source);
+}
+
+void NativeCodeGenerator::testRaw(Operand operand) {
+    std::string source = rawOperand(operand, "rax");
+    if (operand.isConstant() && source != "rax") {
+        emit("mov rax, " + source);
+        source = "rax";
+    }
+    emit(source.find('[') == std::string::npos ? "test " + source + ", " + source : "cmp " + source + ", 0");
+}
+
+void NativeCodeGenerator::storeRaw(Operand result, const char* reg, ValueKind produced) {
+    if (result.empty()) return;
+    const Storage& storage = current->storage[valueOf(result)];
+    if (storage.kind == ValueKind::BOXED) {
+        storePair(slot(storage.offset), std::to_string(tagOf(produced)), reg);
+    } else if (storage.reg >= 0) {
+        if (kRegisters[storage.reg] != std::string(reg)) emit(std::string("mov ") + kRegisters[storage.reg] + ", " + reg);
+    } else {
+        emit("mov " + memory(slot(storage.offset)) + ", " + reg);
+    }
+}
+
+std::string NativeCodeGenerator::boxedAddress(Operand operand, int scratch) {
+    if (operand.isConstant()) {
+        const TacConstant& constant = tac->constant(operand);
+        if (constant.kind == TacConstant::Kind::STRING) {
+            return "rip+ms_string_pool+" + std::to_string(16 * internString(constant.text));
+        }
+        constantUsed[operand.index()] = true;
+        return "rip+.LC" + std::to_string(operand.index());
+    }
+    if (isCallback(*current, operand)) {
+        return "rip+ms_string_pool+" + std::to_string(16 * internString(tac->name(operand)));
+    }
+    const Storage& storage = current->storage[valueOf(operand)];
+    if (storage.kind == ValueKind::BOXED) return slot(storage.offset);
+
+    std::string address = slot(current->scratch[scratch]);
+    emit("mov " + memory(address) + ", " + std::to_string(tagOf(storage.kind)));
+    if (storage.reg >= 0) {
+        emit("mov " + memory(address, 8) + ", " + kRegisters[storage.reg]);
+    } else {
+        emit("mov rax, " + memory(slot(storage.offset)));
+        emit("mov " + memory(address, 8) + ", rax");
+    }
+    return address;
+}
+
+uint32_t NativeCodeGenerator::internString(const std::string& text) {
+    auto it = stringIndex.find(text);
+    if (it != stringIndex.end()) return it->second;
+    uint32_t index = static_cast<uint32_t>(strings.size());
+    strings.push_back(text);
+    stringIndex.emplace(text, index);
+    return index;
+}
+
+void NativeCodeGenerator::emit(const std::string& text) {
+    *out << "    " << text << "\n";
+}
+
+std::string NativeCodeGenerator::newLocalLabel() {
+    return ".Lk" + std::to_string(localLabels++);
+}
+
+void NativeCodeGenerator::release(const std::string& address) {
+    std::string skip = newLocalLabel();
+    emit("cmp " + memory(address, 0, "byte") + ", " + std::to_string(kFirstCountedTag));
+    emit("jb " + skip);
+    emit("lea rdi, [" + address + "]");
+    emit("call ms_release");
+    *out << skip << ":\n";
+}
+
+void NativeCodeGenerator::storePair(const std::string& address, const std::string& tag, const std::string& bits) {
+    // The old value is released after the new one is in place, since
+    // releasing calls out and clobbers `bits`
+    std::string skip = newLocalLabel();
+    std::string old = slot(current->scratch[0]);
+    emit("mov r10, " + memory(address));
+    emit("mov r11, " + memory(address, 8));
+    emit("mov " + memory(address) + ", " + tag);
+    emit("mov " + memory(address, 8) + ", " + bits);
+    emit("cmp r10b, " + std::to_string(kFirstCountedTag));
+    emit("jb " + skip);
+    emit("mov " + memory(old) + ", r10");
+    emit("mov " + memory(old, 8) + ", r11");
+    emit("lea rdi, [" + old + "]");
+    emit("call ms_release");
+    *out << skip << ":\n";
+}
+
+void NativeCodeGenerator::copyInto(const std::string& address, const std::string& source) {
+    // `address` holds nothing that needs releasing
+    std::string skip = newLocalLabel();
+    emit("mov rax, " + memory(source));
+    emit("mov rdx, " + memory(source, 8));
+    emit("mov " + memory(address) + ", rax");
+    emit("mov " + memory(address, 8) + ", rdx");
+    emit("cmp al, " + std::to_string(kFirstCountedTag));
+    emit("jb " + skip);
+    emit("lea rdi, [" + address + "]");
+    emit("call ms_retain");
+    *out << skip << ":\n";
+}
+
+void NativeCodeGenerator::emitFunction(Function& function) {
+    current = &function;
+    std::string symbol = "ms_fn_" + function.name;
+    std::string prefix = ".Lf" + std::to_string(function.id);
+    // JIT units only export their entry points
+    *out << "\n";
+    if (!jit) *out << "    .globl " << symbol << "\n";
+    *out << "    .type " << symbol << ", @function\n";
+    *out << symbol << ":\n";
+    emit("push rbp");
+    emit("mov rbp, rsp");
+    for (const char* reg : kRegisters) emit(std::string("push ") + reg);
+    emit("sub rsp, " + std::to_string(function.frameSize));
+    // Machine code recursion is unbounded otherwise
+    if (jit) {
+        emit("cmp rsp, qword ptr fs:[ms_jit_stack_limit]");
+        emit("jb " + prefix + "_stack");
+    }
+
+    // Every boxed slot starts out void
+    std::vector<int32_t> boxedSlots;
+    for (const Storage& storage : function.storage) {
+        if (storage.kind == ValueKind::BOXED) boxedSlots.push_back(storage.offset);
+    }
+    for (int32_t home : function.paramHomes) {
+        if (home != 0) boxedSlots.push_back(home);
+    }
+    for (int32_t scratch : function.scratch) emit("mov " + memory(slot(scratch)) + ", 0");
+    for (int32_t offset : boxedSlots) emit("mov " + memory(slot(offset)) + ", 0");
+
+    // Arguments arrive as (tag, payload) pairs and are owned from here on
+    for (size_t k = 0; k < function.params.size(); ++k) {
+        std::string tag;
+        std::string bits;
+        if (k < kRegisterArguments) {
+            tag = kArgumentRegisters[k][0];
+            bits = kArgumentRegisters[k][1];
+        } else {
+            int32_t offset = static_cast<int32_t>(16 + 16 * (k - kRegisterArguments));
+            emit("mov r10, " + memory("rbp+" + std::to_string(offset)));
+            emit("mov r11, " + memory("rbp+" + std::to_string(offset), 8));
+            tag = "r10";
+            bits = "r11";
+        }
+        int32_t home = function.paramHomes[k];
+        if (function.params[k].empty()) {
+            if (home == 0) continue;
+            emit("mov " + memory(slot(home)) + ", " + tag);
+            emit("mov " + memory(slot(home), 8) + ", " + bits);
+            continue;
+        }
+        const Storage& storage = function.storage[function.valueIndex.at(function.params[k])];
+        if (storage.kind == ValueKind::BOXED) {
+            emit("mov " + memory(slot(storage.offset)) + ", " + tag);
+            emit("mov " + memory(slot(storage.offset), 8) + ", " + bits);
+        } else if (storage.reg >= 0) {
+            emit(std::string("mov ") + kRegisters[storage.reg] + ", " + bits);
+        } else {
+            emit("mov " + memory(slot(storage.offset)) + ", " + bits);
+        }
+    }
+
+    std::vector<Operand> pending;
+    for (size_t i = function.begin; i < function.end; ++i) {
+        emitInstruction(tac->code[i], pending);
+    }
+
+    // Falling off the end returns void
+    std::string result = slot(function.returnSlot);
+    emit("mov " + memory(result) + ", 0");
+    *out << prefix << "_ret:\n";
+    for (int32_t offset : boxedSlots) release(slot(offset));
+    emit("mov rax, " + memory(result));
+    emit("mov rdx, " + memory(result, 8));
+    emit("lea rsp, [rbp-" + std::to_string(kSavedBytes) + "]");
+    for (int r = kRegisterCount - 1; r >= 0; --r) emit(std::string("pop ") + kRegisters[r]);
+    emit("pop rbp");
+    emit("ret");
+    *out << prefix << "_zero:\n";
+    emit("xor edi, edi");
+    emit(jit ? "call qword ptr [rip+.Ljit_trap]" : "call ms_divide_by_zero");
+    *out << prefix << "_overflow:\n";
+    emit("mov edi, 1");
+    emit(jit ? "call qword ptr [rip+.Ljit_trap]" : "call ms_integer_overflow");
+    if (jit) {
+        *out << prefix << "_stack:\n";
+        emit("mov edi, 2");
+        emit("call qword ptr [rip+.Ljit_trap]");
+    }
+    *out << "    .size " << symbol << ", .-" << symbol << "\n";
+}
+
+void NativeCodeGenerator::emitInstruction(const ThreeAddressCode& instr, std::vector<Operand>& pending) {
+    Function& function = *current;
+    std::string prefix = ".Lf" + std::to_string(function.id);
+    auto boxedResult = [&]() -> std::string {
+        const Storage& storage = function.storage[valueOf(instr.result)];
+        if (storage.kind != ValueKind::BOXED) {
+            throw std::runtime_error("Native error: '" + tac->operandToString(instr.result) + "' is not boxed");
+        }
+        return slot(storage.offset);
+    };
+
+    switch (instr.op) {
+        case TacOp::LABEL:
+            *out << label(instr.result) << ":\n";
+            return;
+        case TacOp::GOTO:
+            emit("jmp " + label(instr.result));
+            return;
+        case TacOp::IF_FALSE:
+        case TacOp::IF: {
+            bool onTrue = instr.op == TacOp::IF;
+            if (instr.arg1.isConstant() && isRaw(instr.arg1)) {
+                if ((rawConstant(instr.arg1) != 0) == onTrue) emit("jmp " + label(instr.result));
+                return;
+            }
+            if (isRaw(instr.arg1)) {
+                testRaw(instr.arg1);
+            } else {
+                emit("lea rdi, [" + boxedAddress(instr.arg1, 0) + "]");
+                emit("call ms_truthy");
+                emit("test al, al");
+            }
+            emit((onTrue ? "jne " : "je ") + label(instr.result));
+            return;
+        }
+        case TacOp::PARAM: {
+            std::string argument = slot(function.argumentSlots - static_cast<int32_t>(16 * pending.size()));
+            pending.push_back(instr.arg1);
+            if (isRaw(instr.arg1)) {
+                emit("mov " + memory(argument) + ", " + std::to_string(tagOf(kindOf(function, instr.arg1))));
+                std::string bits = rawOperand(instr.arg1, "rax");
+                if (bits.find('[') != std::string::npos) {
+                    emit("mov rax, " + bits);
+                    bits = "rax";
+                }
+                emit("mov " + memory(argument, 8) + ", " + bits);
+            } else {
+                copyInto(argument, boxedAddress(instr.arg1, 0));
+            }
+            return;
+        }
+        case TacOp::CALL:
+            emitCall(instr, pending);
+            return;
+        case TacOp::RETURN: {
+            std::string result = slot(function.returnSlot);
+            if (instr.arg1.empty()) {
+                emit("mov " + memory(result) + ", 0");
+            } else if (isRaw(instr.arg1)) {
+                emit("mov " + memory(result) + ", " + std::to_string(tagOf(kindOf(function, instr.arg1))));
+                loadRaw("rax", instr.arg1);
+                emit("mov " + memory(result, 8) + ", rax");
+            } else if (valueOf(instr.arg1) >= 0) {
+                // The slot's reference moves to the caller
+                std::string source = boxedAddress(instr.arg1, 0);
+                emit("mov rax, " + memory(source));
+                emit("mov rdx, " + memory(source, 8));
+                emit("mov " + memory(result) + ", rax");
+                emit("mov " + memory(result, 8) + ", rdx");
+                emit("mov " + memory(source) + ", 0");
+            } else {
+                copyInto(result, boxedAddress(instr.arg1, 0));
+            }
+            emit("jmp " + prefix + "_ret");
+            return;
+        }
+        case TacOp::ASSIGN: {
+            if (instr.result.empty()) return;
+            const Storage& target = function.storage[valueOf(instr.result)];
+            if (target.kind != ValueKind::BOXED) {
+                std::string source = rawOperand(instr.arg1, "rax");
+                std::string destination = target.reg >= 0 ? kRegisters[target.reg] : memory(slot(target.offset));
+                if (source == destination) return;
+                if (target.reg < 0 && source.find('[') != std::string::npos) {
+                    emit("mov rax, " + source);
+                    source = "rax";
+                }
+                emit("mov " + destination + ", " + source);
+            } else if (isRaw(instr.arg1)) {
+                loadRaw("rax", instr.arg1);
+                storePair(slot(target.offset), std::to_string(tagOf(kindOf(function, instr.arg1))), "rax");
+            } else {
+                std::string source = boxedAddress(instr.arg1, 0);
+                if (source == slot(target.offset)) return;
+                emit("lea rdi, [" + slot(target.offset) + "]");
+                emit("lea rsi, [" + source + "]");
+                emit("call ms_assign");
+            }
+            return;
+        }
+        case TacOp::NEW_SEQ:
+            emit("lea rdi, [" + boxedResult() + "]");
+            emit("call ms_new_seq");
+            return;
+        case TacOp::STORE: {
+            std::string element = boxedAddress(instr.arg1, 0);
+            emit("lea rdi, [" + boxedResult() + "]");
+            emit("mov esi, " + std::to_string(instr.arg2.index()));
+            emit("lea rdx, [" + element + "]");
+            emit("call ms_store");
+            return;
+        }
+        case TacOp::APPEND:
+        case TacOp::EXTEND: {
+            std::string element = boxedAddress(instr.arg1, 0);
+            emit("mov edi, " + std::to_string(static_cast<int>(instr.op)));
+            emit("lea rsi, [" + boxedResult() + "]");
+            emit("lea rdx, [" + element + "]");
+            emit("call ms_append");
+            return;
+        }
+        case TacOp::NEG:
+        case TacOp::NOT: {
+            ValueKind operand = kindOf(function, instr.arg1);
+            if (instr.op == TacOp::NEG && operand == ValueKind::INT) {
+                loadRaw("rax", instr.arg1);
+                emit("neg rax");
+                emit("jo .Lf" + std::to_string(function.id) + "_overflow");
+                storeRaw(instr.result, "rax", ValueKind::INT);
+                return;
+            }
+            if (instr.op == TacOp::NOT && isRawKind(operand)) {
+                testRaw(instr.arg1);
+                emit("sete al");
+                emit("movzx eax, al");
+                storeRaw(instr.result, "rax", ValueKind::BOOL);
+                return;
+            }
+            std::string source = boxedAddress(instr.arg1, 0);
+            bool raw = !instr.result.empty() && isRaw(instr.result);
+            std::string result = raw || instr.result.empty() ? slot(function.scratch[2]) : boxedResult();
+            emit("mov edi, " + std::to_string(static_cast<int>(instr.op)));
+            emit("lea rsi, [" + result + "]");
+            emit("lea rdx, [" + source + "]");
+            emit("call ms_unary");
+            if (raw) {
+                emit("movzx eax, " + memory(result, 8, "byte"));
+                storeRaw(instr.result, "rax", ValueKind::BOOL);
+            } else if (instr.result.empty()) {
+                release(result);
+            }
+            return;
+        }
+        default:
+            if (!isBinaryTacOp(instr.op)) {
+                throw std::runtime_error("Native error: Unsupported instruction '" + tac->toString(instr) + "'");
+            }
+            emitBinary(instr);
+            return;
+    }
+}
+
+void NativeCodeGenerator::emitBinary(const ThreeAddressCode& instr) {
+    Function& function = *current;
+    ValueKind left = kindOf(function, instr.arg1);
+    ValueKind right = kindOf(function, instr.arg2);
+    bool equality = instr.op == TacOp::EQ || instr.op == TacOp::NE;
+
+    if (isRawKind(left) && isRawKind(right)) {
+        if (equality && left != right) {
+            // An int never equals a bool: the VM compares their printed forms
+            emit(std::string("mov eax, ") + (instr.op == TacOp::NE ? "1" : "0"));
+            storeRaw(instr.result, "rax", ValueKind::BOOL);
+            return;
+        }
+        const char* condition = nullptr;
+        switch (instr.op) {
+            case TacOp::ADD:
+            case TacOp::SUB:
+            case TacOp::MUL: {
+                loadRaw("rax", instr.arg1);
+                std::string operand = rawOperand(instr.arg2, "rcx");
+                if (instr.op == TacOp::MUL) {
+                    bool immediate = instr.arg2.isConstant() && operand != "rcx";
+                    emit(immediate ? "imul rax, rax, " + operand : "imul rax, " + operand);
+                } else {
+                    emit((instr.op == TacOp::ADD ? "add rax, " : "sub rax, ") + operand);
+                }
+                // Raw values have no room for a BigInt
+                emit("jo .Lf" + std::to_string(function.id) + "_overflow");
+                storeRaw(instr.result, "rax", ValueKind::INT);
+                return;
+            }
+            case TacOp::DIV:
+            case TacOp::MOD:
+                loadRaw("rax", instr.arg1);
+                loadRaw("rcx", instr.arg2);
+                if (!instr.arg2.isConstant() || rawConstant(instr.arg2) == 0) {
+                    emit("test rcx, rcx");
+                    emit("je .Lf" + std::to_string(function.id) + "_zero");
+                }
+                if (!instr.arg2.isConstant() || rawConstant(instr.arg2) == -1) {
+                    // idiv faults on INT64_MIN / -1; x / -1 is a negation
+                    // and x % -1 is 0
+                    std::string divide = newLocalLabel();
+                    std::string done = newLocalLabel();
+                    emit("cmp rcx, -1");
+                    emit("jne " + divide);
+                    if (instr.op == TacOp::DIV) {
+                        emit("neg rax");
+                        emit("jo .Lf" + std::to_string(function.id) + "_overflow");
+                    } else {
+                        emit("xor eax, eax");
+                    }
+                    emit("jmp " + done);
+                    *out << divide << ":\n";
+                    emit("cqo");
+                    emit("idiv rcx");
+                    if (instr.op == TacOp::MOD) emit("mov rax, rdx");
+                    *out << done << ":\n";
+                    storeRaw(instr.result, "rax", ValueKind::INT);
+                    return;
+                }
+                emit("cqo");
+                emit("idiv rcx");
+                storeRaw(instr.result, instr.op == TacOp::DIV ? "rax" : "rdx", ValueKind::INT);
+                return;
+            case TacOp::AND:
+            case TacOp::OR:
+                testRaw(instr.arg1);
+                emit("setne dl");
+                testRaw(instr.arg2);
+                emit("setne al");
+                emit(instr.op == TacOp::AND ? "and al, dl" : "or al, dl");
+                emit("movzx eax, al");
+                storeRaw(instr.result, "rax", ValueKind::BOOL);
+                return;
+            case TacOp::EQ: condition = "sete"; break;
+            case TacOp::NE: condition = "setne"; break;
+            case TacOp::LT: condition = "setl"; break;
+            case TacOp::LE: condition = "setle"; break;
+            case TacOp::GT: condition = "setg"; break;
+            default: condition = "setge"; break;
+        }
+        loadRaw("rax", instr.arg1);
+        emit("cmp rax, " + rawOperand(instr.arg2, "rcx"));
+        emit(std::string(condition) + " al");
+        emit("movzx eax, al");
+        storeRaw(instr.result, "rax", ValueKind::BOOL);
+        return;
+    }
+
+    // Anything else is the runtime's; a raw result can only be a bool or,
+    // from %, an int, and is read back from scratch
+    std::string leftAddress = boxedAddress(instr.arg1, 0);
+    std::string rightAddress = boxedAddress(instr.arg2, 1);
+    bool raw = !instr.result.empty() && isRaw(instr.result);
+    std::string result = raw || instr.result.empty() ? slot(function.scratch[2])
+                                                     : slot(function.storage[valueOf(instr.result)].offset);
+    emit("mov edi, " + std::to_string(static_cast<int>(instr.op)));
+    emit("lea rsi, [" + result + "]");
+    emit("lea rdx, [" + leftAddress + "]");
+    emit("lea rcx, [" + rightAddress + "]");
+    emit("call ms_binary");
+    if (raw) {
+        ValueKind produced = kindOf(function, instr.result);
+        emit(produced == ValueKind::BOOL ? "movzx eax, " + memory(result, 8, "byte") : "mov rax, " + memory(result, 8));
+        storeRaw(instr.result, "rax", produced);
+    } else if (instr.result.empty()) {
+        release(result);
+    }
+}
+
+void NativeCodeGenerator::emitCall(const ThreeAddressCode& instr, std::vector<Operand>& pending) {
+    Function& function = *current;
+    size_t argCount = instr.arg2.empty() ? 0 : instr.arg2.index();
+    size_t base = pending.size() - argCount;
+    pending.resize(base);
+    auto argument = [&](size_t k) {
+        return slot(function.argumentSlots - static_cast<int32_t>(16 * (base + k)));
+    };
+
+    const std::string& callee = tac->name(instr.arg1);
+    Builtin builtin;
+    if (Builtins::find(callee, builtin)) {
+        bool discard = instr.result.empty();
+        std::string result = discard ? slot(function.scratch[2]) : slot(function.storage[valueOf(instr.result)].offset);
+        emit("mov edi, " + std::to_string(static_cast<uint32_t>(builtin)));
+        emit("lea rsi, [" + result + "]");
+        emit("lea rdx, [" + argument(0) + "]");
+        emit("mov ecx, " + std::to_string(argCount));
+        emit("call ms_builtin");
+        if (discard) release(result);
+        return;
+    }
+
+    auto it = functionIndex.find(callee);
+    if (it == functionIndex.end()) {
+        throw std::runtime_error("Native error: Undefined function '" + callee + "'");
+    }
+    const Function& target = functions[it->second];
+    size_t params = target.params.size();
+
+    // Extra arguments are dropped, missing ones are void
+    for (size_t k = params; k < argCount; ++k) release(argument(k));
+    for (size_t k = kRegisterArguments; k < params; ++k) {
+        std::string stack = "rsp+" + std::to_string(16 * (k - kRegisterArguments));
+        if (k < argCount) {
+            emit("mov rax, " + memory(argument(k)));
+            emit("mov " + memory(stack) + ", rax");
+            emit("mov rax, " + memory(argument(k), 8));
+            emit("mov " + memory(stack, 8) + ", rax");
+        } else {
+            emit("mov " + memory(stack) + ", 0");
+        }
+    }
+    for (size_t k = 0; k < params && k < kRegisterArguments; ++k) {
+        if (k < argCount) {
+            emit(std::string("mov ") + kArgumentRegisters[k][0] + ", " + memory(argument(k)));
+            emit(std::string("mov ") + kArgumentRegisters[k][1] + ", " + memory(argument(k), 8));
+        } else {
+            emit(std::string("xor ") + kArgumentRegisters[k][0] + ", " + kArgumentRegisters[k][0]);
+        }
+    }
+    emit("call ms_fn_" + target.name);
+
+    if (instr.result.empty()) {
+        if (target.returnKind != ValueKind::BOXED) return;
+        std::string scratch = slot(function.scratch[0]);
+        emit("mov " + memory(scratch) + ", rax");
+        emit("mov " + memory(scratch, 8) + ", rdx");
+        release(scratch);
+        return;
+    }
+    const Storage& storage = function.storage[valueOf(instr.result)];
+    if (storage.kind == ValueKind::BOXED) {
+        storePair(slot(storage.offset), "rax", "rdx");
+    } else {
+        storeRaw(instr.result, "rdx", storage.kind);
+    }
+}
+
+void NativeCodeGenerator::emitCallbackAdapter(const Function& function) {
+    // map, filter and generate call through here with one argument
+    size_t params = function.params.size();
+    *out << "ms_cb_" << function.name << ":\n";
+    emit("push rbp");
+    emit("mov rbp, rsp");
+    if (params == 0) {
+        std::string skip = newLocalLabel();
+        emit("sub rsp, 16");
+        emit("mov qword ptr [rsp], rdi");
+        emit("mov qword ptr [rsp+8], rsi");
+        emit("cmp dil, " + std::to_string(kFirstCountedTag));
+        emit("jb " + skip);
+        emit("mov rdi, rsp");
+        emit("call ms_release");
+        *out << skip << ":\n";
+    }
+    for (size_t k = 1; k < params && k < kRegisterArguments; ++k) {
+        emit(std::string("xor ") + kArgumentRegisters[k][0] + ", " + kArgumentRegisters[k][0]);
+    }
+    if (params > kRegisterArguments) {
+        emit("sub rsp, " + std::to_string(16 * (params - kRegisterArguments)));
+        for (size_t k = kRegisterArguments; k < params; ++k) {
+            emit("mov " + memory("rsp+" + std::to_string(16 * (k - kRegisterArguments))) + ", 0");
+        }
+    }
+    emit("call ms_fn_" + function.name);
+    emit("leave");
+    emit("ret");
+}
+
+void NativeCodeGenerator::emitJitEntry(const Function& function) {
+    // Arguments arrive as an array of payloads; raw parameters never look
+    // at their tags
+    std::string symbol = "ms_jit_" + function.name;
+    size_t params = function.params.size();
+    *out << "    .globl " << symbol << "\n";
+    *out << "    .type " << symbol << ", @function\n";
+    *out << symbol << ":\n";
+    emit("push rbp");
+    emit("mov rbp, rsp");
+    emit("mov r10, rdi");
+    if (params > kRegisterArguments) {
+        emit("sub rsp, " + std::to_string(16 * (params - kRegisterArguments)));
+        for (size_t k = kRegisterArguments; k < params; ++k) {
+            emit("mov rax, " + memory("r10", static_cast<int>(8 * k)));
+            emit("mov " + memory("rsp", static_cast<int>(16 * (k - kRegisterArguments) + 8)) + ", rax");
+        }
+    }
+    for (size_t k = 0; k < params && k < kRegisterArguments; ++k) {
+        emit(std::string("mov ") + kArgumentRegisters[k][1] + ", " + memory("r10", static_cast<int>(8 * k)));
+    }
+    emit("call ms_fn_" + function.name);
+    emit("mov rax, rdx");
+    emit("leave");
+    emit("ret");
+    *out << "    .size " << symbol << ", .-" << symbol << "\n";
+}
+
+void NativeCodeGenerator::emitData() {
+    std::vector<uint32_t> names;
+    for (const Function& function : functions) names.push_back(internString(function.name));
+
+    *out << "\n    .section .rodata\n";
+    emit(".p2align 4");
+    for (size_t c = 0; c < tac->constants.size(); ++c) {
+        if (!constantUsed[c]) continue;
+        const TacConstant& constant = tac->constants[c];
+        if (constant.kind == TacConstant::Kind::BIGINT) {
+            throw std::runtime_error("Native error: integer literal " + constant.text +
+                                     " does not fit in 64 bits; run it with the interpreter or the VM");
+        }
+        uint64_t bits = static_cast<uint64_t>(constant.intValue);
+        RuntimeValue::Kind tag = RuntimeValue::Kind::INT;
+        if (constant.kind == TacConstant::Kind::FLOAT) {
+            std::memcpy(&bits, &constant.floatValue, sizeof(bits));
+            tag = RuntimeValue::Kind::FLOAT;
+        } else if (constant.kind == TacConstant::Kind::BOOL) {
+            tag = RuntimeValue::Kind::BOOL;
+        }
+        *out << ".LC" << c << ":\n";
+        emit(".quad " + std::to_string(static_cast<int>(tag)) + ", " + std::to_string(bits));
+    }
+    for (size_t s = 0; s < strings.size(); ++s) {
+        *out << ".LS" << s << ":\n";
+        emit(".ascii " + asciiLiteral(strings[s]));
+        emit(".byte 0");
+    }
+
+    // The runtime turns the texts into string values before main runs
+    *out << "\n    .data\n";
+    emit(".p2align 3");
+    auto table = [&](const char* symbol) {
+        *out << "    .globl " << symbol << "\n" << symbol << ":\n";
+    };
+    table("ms_string_count");
+    emit(".quad " + std::to_string(strings.size()));
+    table("ms_string_texts");
+    for (size_t s = 0; s < strings.size(); ++s) emit(".quad .LS" + std::to_string(s));
+    table("ms_string_lengths");
+    for (const std::string& text : strings) emit(".quad " + std::to_string(text.size()));
+    table("ms_function_count");
+    emit(".quad " + std::to_string(functions.size()));
+    table("ms_function_names");
+    for (uint32_t name : names) emit(".quad .LS" + std::to_string(name));
+    table("ms_function_table");
+    for (const Function& function : functions) emit(".quad ms_cb_" + function.name);
+    table("ms_function_pure");
+    for (const Function& function : functions) emit(std::string(".byte ") + (function.pure ? "1" : "0"));
+
+    *out << "\n    .bss\n";
+    emit(".p2align 4");
+    table("ms_string_pool");
+    emit(".zero " + std::to_string(16 * std::max<size_t>(strings.size(), 1)));
+    *out << "\n    .section .note.GNU-stack,\"\",@progbits\n";
+}
@@ -1,192 +1,248 @@
 #include "../include/optimizer.h"
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
 #include <iostream>
 #include <sstream>
-#include <algorithm>
-#include <cctype>
 
-std::vector<ThreeAddressCode> Optimizer::optimize() {
-    // Apply optimization passes
-    constantFolding();
-    constantPropagation();
-    algebraicSimplification();
-    removeRedundantAssignments();
-    deadCodeElimination();
-    
-    return code;
+namespace {
+    struct PassInfo {
+        const char* name;
+        bool fromLevel[4];  // Enabled at -O0 .. -O3
+    };
+
+    const PassInfo kPasses[] = {
+        {"inline", {false, false, true, true}},
+        {"simplify", {false, true, true, true}},
+        {"ssa", {false, true, true, true}},
+        {"loop", {false, false, true, true}},
+        {"cleanup", {false, true, true, true}},
+    };
+    static_assert(sizeof(kPasses) / sizeof(kPasses[0]) == static_cast<size_t>(Optimizer::Pass::COUNT),
+                  "every pass needs a name");
 }
 
-void Optimizer::constantFolding() {
-    for (auto& instr : code) {
-        if ((instr.op == "+" || instr.op == "-" || instr.op == "*" || instr.op == "/") &&
-            isConstant(instr.arg1) && isConstant(instr.arg2)) {
-            
-            int result = evaluateConstant(instr.op, instr.arg1, instr.arg2);
-            instr.op = "ASSIGN";
-            instr.arg1 = std::to_string(result);
-            instr.arg2 = "";
-        }
+Optimizer::Optimizer(TacModule module, int level)
+    : module(std::move(module)), optimizationLevel(std::max(0, std::min(level, 3))) {
+    maxRounds = optimizationLevel >= 3 ? 8 : optimizationLevel == 2 ? 4 : 1;
+    for (size_t p = 0; p < static_cast<size_t>(Pass::COUNT); ++p) {
+        enabledPasses[p] = kPasses[p].fromLevel[optimizationLevel];
     }
 }
 
-void Optimizer::constantPropagation() {
-    std::unordered_map<std::string, std::string> constantMap;
-    
-    for (auto& instr : code) {
-        // Update uses with known constants
-        if (constantMap.find(instr.arg1) != constantMap.end()) {
-            instr.arg1 = constantMap[instr.arg1];
-        }
-        if (constantMap.find(instr.arg2) != constantMap.end()) {
-            instr.arg2 = constantMap[instr.arg2];
-        }
-        
-        // Track new constants
-        if (instr.op == "ASSIGN" && isConstant(instr.arg1)) {
-            constantMap[instr.result] = instr.arg1;
-        } else if (instr.op != "ASSIGN") {
-            // If result is reassigned, remove from constant map
-            constantMap.erase(instr.result);
+const char* Optimizer::passName(Pass pass) {
+    return kPasses[static_cast<size_t>(pass)].name;
+}
+
+bool Optimizer::parsePass(const std::string& name, Pass& pass) {
+    for (size_t p = 0; p < static_cast<size_t>(Pass::COUNT); ++p) {
+        if (name == kPasses[p].name) {
+            pass = static_cast<Pass>(p);
+            return true;
         }
     }
+    return false;
 }
 
-void Optimizer::deadCodeElimination() {
-    std::unordered_set<std::string> usedTemps;
+TacModule Optimizer::optimize() {
+    runPass(Pass::INLINE);
     
-    // First pass: mark all used temporaries
-    for (const auto& instr : code) {
-        if (!instr.arg1.empty() && instr.arg1[0] == 't') {
-            usedTemps.insert(instr.arg1);
-        }
-        if (!instr.arg2.empty() && instr.arg2[0] == 't') {
-            usedTemps.insert(instr.arg2);
-        }
+    // Each loop rewrite leaves copies and constants for the scalar passes,
+    // which in turn can make more of a loop invariant; stop once a round
+    // changes nothing, and never end on a loop pass
+    for (size_t round = 0; round < maxRounds; ++round) {
+        size_t changed = runPass(Pass::SIMPLIFY) + runPass(Pass::SSA);
+        if (round > 0 && changed == 0) break;
+        if (round + 1 == maxRounds || runPass(Pass::LOOP) == 0) break;
     }
     
-    // Second pass: remove dead assignments
-    std::vector<ThreeAddressCode> optimized;
-    for (const auto& instr : code) {
-        if (instr.op == "ASSIGN" && !instr.result.empty() && instr.result[0] == 't' && 
-            usedTemps.find(instr.result) == usedTemps.end()) {
-            // Skip this dead assignment
-            continue;
-        }
-        optimized.push_back(instr);
+    runPass(Pass::CLEANUP);
+    return module;
+}
+
+size_t Optimizer::runPass(Pass pass) {
+    if (!isPassEnabled(pass)) return 0;
+    
+    auto start = std::chrono::steady_clock::now();
+    size_t before = module.code.size();
+    size_t changed = 0;
+    switch (pass) {
+        case Pass::INLINE: changed = inlineCalls(); break;
+        case Pass::SIMPLIFY: changed = algebraicSimplification(); break;
+        case Pass::SSA: changed = globalOptimization(); break;
+        case Pass::LOOP: changed = loopOptimization(); break;
+        case Pass::CLEANUP: changed = removeRedundantAssignments(); break;
+        case Pass::COUNT: break;
     }
     
-    code = std::move(optimized);
+    PassStats& stats = perPass[static_cast<size_t>(pass)];
+    ++stats.runs;
+    stats.milliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    size_t after = module.code.size();
+    if (after < before) {
+        stats.removed += before - after;
+    } else {
+        stats.added += after - before;
+    }
+    stats.changed += changed;
+    return changed;
 }
 
-void Optimizer::removeRedundantAssignments() {
-    std::vector<ThreeAddressCode> optimized;
-    std::unordered_map<std::string, std::string> valueMap;
+void Optimizer::forEachFunction(const std::function<void(ControlFlowGraph&)>& pass) {
+    auto isFunctionEntry = [](const ThreeAddressCode& instr) {
+        return instr.op == TacOp::LABEL && instr.result.kind() == Operand::Kind::FUNCTION;
+    };
     
-    for (const auto& instr : code) {
-        if (instr.op == "ASSIGN") {
-            // Check if this is a redundant assignment (x = x)
-            if (instr.arg1 == instr.result) {
-                continue; // Skip redundant assignment
-            }
-            
-            // Check if we can replace uses of result with arg1
-            valueMap[instr.result] = instr.arg1;
-        } else {
-            // Clear value map for non-assignment instructions
-            valueMap.clear();
+    std::vector<ThreeAddressCode> optimized;
+    optimized.reserve(module.code.size());
+    const ThreeAddressCode* code = module.code.data();
+    size_t size = module.code.size();
+    for (size_t begin = 0; begin < size;) {
+        size_t end = begin + 1;
+        while (end < size && !isFunctionEntry(code[end])) ++end;
+        if (!isFunctionEntry(code[begin])) {
+            optimized.insert(optimized.end(), code + begin, code + end);
+            begin = end;
+            continue;
         }
-        optimized.push_back(instr);
+        
+        optimized.push_back(code[begin]);
+        ControlFlowGraph cfg = ControlFlowGraph::build(code + begin + 1, code + end);
+        pass(cfg);
+        cfg.linearize(optimized);
+        begin = end;
     }
-    
-    code = std::move(optimized);
+    module.code = std::move(optimized);
 }
 
-void Optimizer::algebraicSimplification() {
-    for (auto& instr : code) {
+size_t Optimizer::inlineCalls() {
+    Inliner::Stats pass = optimizationLevel >= 3
+        ? Inliner(module, Inliner::kMaxCalleeSize * 4, Inliner::kMaxCallerSize * 4).run()
+        : Inliner(module).run();
+    inlineStats.callsInlined += pass.callsInlined;
+    return pass.callsInlined;
+}
+
+size_t Optimizer::globalOptimization() {
+    size_t changed = 0;
+    forEachFunction([&](ControlFlowGraph& cfg) {
+        SsaOptimizer::Stats pass = SsaOptimizer(module, cfg).run();
+        ssaStats.constantsPropagated += pass.constantsPropagated;
+        ssaStats.copiesPropagated += pass.copiesPropagated;
+        ssaStats.branchesFolded += pass.branchesFolded;
+        ssaStats.instructionsRemoved += pass.instructionsRemoved;
+        changed += pass.constantsPropagated + pass.copiesPropagated + pass.branchesFolded + pass.instructionsRemoved;
+    });
+    return changed;
+}
+
+size_t Optimizer::loopOptimization() {
+    size_t changed = 0;
+    size_t loops = 0;
+    forEachFunction([&](ControlFlowGraph& cfg) {
+        LoopOptimizer::Stats pass = LoopOptimizer(module, cfg).run();
+        loops += pass.loops;
+        loopStats.invariantsHoisted += pass.invariantsHoisted;
+        loopStats.strengthReduced += pass.strengthReduced;
+        loopStats.lengthsReplaced += pass.lengthsReplaced;
+        changed += pass.invariantsHoisted + pass.strengthReduced + pass.lengthsReplaced;
+    });
+    // Later rounds see the same loops again
+    loopStats.loops = std::max(loopStats.loops, loops);
+    return changed;
+}
+
+size_t Optimizer::removeRedundantAssignments() {
+    // x = x
+    size_t before = module.code.size();
+    module.code.erase(std::remove_if(module.code.begin(), module.code.end(),
+                                     [](const ThreeAddressCode& instr) {
+                                         return instr.op == TacOp::ASSIGN && instr.arg1 == instr.result;
+                                     }),
+                      module.code.end());
+    return before - module.code.size();
+}
+
+size_t Optimizer::algebraicSimplification() {
+    auto isInt = [this](Operand operand, long long value) { return module.isIntConstant(operand, value); };
+    
+    size_t changed = 0;
+    for (auto& instr : module.code) {
+        TacOp before = instr.op;
         // x + 0 → x
-        if (instr.op == "+" && instr.arg2 == "0") {
-            instr.op = "ASSIGN";
-            instr.arg2 = "";
+        if (instr.op == TacOp::ADD && isInt(instr.arg2, 0)) {
+            instr.op = TacOp::ASSIGN;
+            instr.arg2 = Operand();
         }
         // x - 0 → x
-        else if (instr.op == "-" && instr.arg2 == "0") {
-            instr.op = "ASSIGN";
-            instr.arg2 = "";
+        else if (instr.op == TacOp::SUB && isInt(instr.arg2, 0)) {
+            instr.op = TacOp::ASSIGN;
+            instr.arg2 = Operand();
         }
         // x * 1 → x
-        else if (instr.op == "*" && instr.arg2 == "1") {
-            instr.op = "ASSIGN";
-            instr.arg2 = "";
+        else if (instr.op == TacOp::MUL && isInt(instr.arg2, 1)) {
+            instr.op = TacOp::ASSIGN;
+            instr.arg2 = Operand();
         }
         // x * 0 → 0
-        else if (instr.op == "*" && (instr.arg1 == "0" || instr.arg2 == "0")) {
-            instr.op = "ASSIGN";
-            instr.arg1 = "0";
-            instr.arg2 = "";
+        else if (instr.op == TacOp::MUL && (isInt(instr.arg1, 0) || isInt(instr.arg2, 0))) {
+            instr.op = TacOp::ASSIGN;
+            instr.arg1 = module.intConstant(0);
+            instr.arg2 = Operand();
         }
         // 0 + x → x
-        else if (instr.op == "+" && instr.arg1 == "0") {
-            instr.op = "ASSIGN";
+        else if (instr.op == TacOp::ADD && isInt(instr.arg1, 0)) {
+            instr.op = TacOp::ASSIGN;
             instr.arg1 = instr.arg2;
-            instr.arg2 = "";
+            instr.arg2 = Operand();
         }
         // 1 * x → x
-        else if (instr.op == "*" && instr.arg1 == "1") {
-            instr.op = "ASSIGN";
+        else if (instr.op == TacOp::MUL && isInt(instr.arg1, 1)) {
+            instr.op = TacOp::ASSIGN;
             instr.arg1 = instr.arg2;
-            instr.arg2 = "";
+            instr.arg2 = Operand();
         }
+        // Every rewrite turns the instruction into a copy
+        if (instr.op != before) ++changed;
     }
+    return changed;
 }
 
-bool Optimizer::isConstant(const std::string& value) {
-    if (value.empty()) return false;
-    
-    size_t start = 0;
-    if (value[0] == '-' || value[0] == '+') {
-        if (value.length() == 1) return false;
-        start = 1;
-    }
-    
-    for (size_t i = start; i < value.length(); ++i) {
-        if (!std::isdigit(static_cast<unsigned char>(value[i]))) {
-            return false;
-        }
+void Optimizer::printPassStatistics(std::ostream& out) const {
+    out << "Optimization passes (-O" << optimizationLevel << "):" << std::endl;
+    for (size_t p = 0; p < static_cast<size_t>(Pass::COUNT); ++p) {
+        const PassStats& stats = perPass[p];
+        if (stats.runs == 0) continue;
+        std::ostringstream line;
+        line << "  " << std::left << std::setw(9) << kPasses[p].name << std::right
+             << std::setw(3) << stats.runs << " run(s) " << std::fixed << std::setprecision(3)
+             << std::setw(9) << stats.milliseconds << " ms " << std::setw(7) << stats.removed << " removed "
+             << std::setw(5) << stats.added << " added " << std::setw(7) << stats.changed << " changed";
+        switch (static_cast<Pass>(p)) {
+            case Pass::INLINE:
+                line << "  " << inlineStats.callsInlined << " call(s) inlined";
+                break;
+            case Pass::SSA:
+                line << "  " << ssaStats.constantsPropagated << " constant(s) and " << ssaStats.copiesPropagated
+                     << " copy(ies) propagated, " << ssaStats.branchesFolded << " branch(es) folded";
+                break;
+            case Pass::LOOP:
+                line << "  " << loopStats.loops << " loop(s), " << loopStats.invariantsHoisted
+                     << " invariant(s) hoisted, " << loopStats.strengthReduced
+                     << " multiplication(s) strength-reduced, " << loopStats.lengthsReplaced
+                     << " length call(s) replaced";
+                break;
+            default:
+                break;
+        }
+        out << line.str() << std::endl;
     }
-    
-    return true;
-}
-
-int Optimizer::evaluateConstant(const std::string& op, const std::string& left, const std::string& right) {
-    int leftVal = std::stoi(left);
-    int rightVal = std::stoi(right);
-    
-    if (op == "+") return leftVal + rightVal;
-    if (op == "-") return leftVal - rightVal;
-    if (op == "*") return leftVal * rightVal;
-    if (op == "/" && rightVal != 0) return leftVal / rightVal;
-    if (op == "%" && rightVal != 0) return leftVal % rightVal;
-    
-    return 0;
-}
-
-bool Optimizer::isDeadTemp(const std::string& temp, size_t currentIndex) {
-    if (temp.empty() || temp[0] != 't') return false;
-    
-    for (size_t i = currentIndex + 1; i < code.size(); ++i) {
-        if (code[i].arg1 == temp || code[i].arg2 == temp) {
-            return false; // Temp is used later
-        }
-        if (code[i].result == temp) {
-            break; // Temp is redefined
-        }
-    }
-    return true;
 }
 
 void Optimizer::printOptimizedCode(std::ostream& out) {
     out << "Optimized Intermediate Code:" << std::endl;
     out << "============================" << std::endl;
-    for (const auto& instr : code) {
-        out << instr.toString() << std::endl;
+    for (const auto& instr : module.code) {
+        out << module.toString(instr) << std::endl;
     }
-}
\ No newline at end of file
+}
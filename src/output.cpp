@@ -0,0 +1,75 @@
+#include "../include/output.h"
+#include <cerrno>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+BufferedWriter::BufferedWriter(int fd, size_t capacity, std::chrono::milliseconds interval)
+    : fd(fd), capacity(capacity), interval(interval) {
+    buffer.reserve(capacity + capacity / 8);
+    flusher = std::thread([this] { flushLoop(); });
+}
+
+BufferedWriter::~BufferedWriter() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    pending.notify_one();
+    flusher.join();
+    flush();
+}
+
+void BufferedWriter::writeLine(std::string_view line) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (failed) return;
+    bool wasEmpty = buffer.empty();
+    buffer += line;
+    buffer += '\n';
+    if (buffer.size() >= capacity) {
+        writeOut();
+    } else if (wasEmpty) {
+        // The flusher sleeps until there is something to time
+        firstLine = std::chrono::steady_clock::now();
+        pending.notify_one();
+    }
+}
+
+void BufferedWriter::flush() {
+    std::lock_guard<std::mutex> lock(mutex);
+    writeOut();
+}
+
+void BufferedWriter::flushLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stopping) {
+        if (buffer.empty()) {
+            pending.wait(lock);
+        } else if (std::chrono::steady_clock::now() >= firstLine + interval) {
+            writeOut();
+        } else {
+            pending.wait_until(lock, firstLine + interval);
+        }
+    }
+}
+
+void BufferedWriter::writeOut() {
+    size_t offset = 0;
+    while (offset < buffer.size() && !failed) {
+#ifdef _WIN32
+        int count = _write(fd, buffer.data() + offset, static_cast<unsigned int>(buffer.size() - offset));
+#else
+        ssize_t count = ::write(fd, buffer.data() + offset, buffer.size() - offset);
+#endif
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            failed = true;
+            break;
+        }
+        offset += static_cast<size_t>(count);
+    }
+    written += offset;
+    buffer.clear();
+}
@@ -3,31 +3,49 @@
 
 #define DEBUG_PARSER 0
 
-Parser::Parser(std::vector<Token> tokens) 
-    : tokens(tokens), current(0) {}
+Parser::Parser(Lexer& lexer) 
+    : lexer(lexer),
+      previousToken(TokenType::END_OF_FILE, ""),
+      currentToken(TokenType::END_OF_FILE, ""),
+      lookahead(TokenType::END_OF_FILE, "") {}
 
-Token Parser::advance() {
-    if (!isAtEnd()) current++;
-    return previous();
+Token Parser::pull() {
+    Token token = lexer.nextToken();
+    ++tokensRead;
+    if (token.type == TokenType::ERROR) {
+        throw LexicalError(std::string(token.lexeme));
+    }
+    return token;
 }
 
-Token Parser::peek() {
-    if (static_cast<size_t>(current) >= tokens.size()) {
-        return Token(TokenType::END_OF_FILE, "");
+const Token& Parser::advance() {
+    if (!isAtEnd()) {
+        previousToken = currentToken;
+        if (hasLookahead) {
+            currentToken = lookahead;
+            hasLookahead = false;
+        } else {
+            currentToken = pull();
+        }
     }
-    return tokens[current];
+    return previousToken;
 }
 
-Token Parser::peekNext() {
-    if (static_cast<size_t>(current + 1) >= tokens.size()) return Token(TokenType::END_OF_FILE, "");
-    return tokens[current + 1];
+const Token& Parser::peek() {
+    return currentToken;
 }
 
-Token Parser::previous() {
-    if (current == 0) {
-        return Token(TokenType::END_OF_FILE, "");
+const Token& Parser::peekNext() {
+    if (isAtEnd()) return currentToken;
+    if (!hasLookahead) {
+        lookahead = pull();
+        hasLookahead = true;
     }
-    return tokens[current - 1];
+    return lookahead;
+}
+
+const Token& Parser::previous() {
+    return previousToken;
 }
 
 bool Parser::check(TokenType type) {
@@ -35,6 +53,20 @@ bool Parser::check(TokenType type) {
     return peek().type == type;
 }
 
+bool Parser::checkType() {
+    switch (peek().type) {
+        case TokenType::INT:
+        case TokenType::FLOAT_TYPE:
+        case TokenType::BOOL:
+        case TokenType::SEQUENCE:
+        case TokenType::PATTERN:
+        case TokenType::IDENTIFIER:
+            return true;
+        default:
+            return false;
+    }
+}
+
 bool Parser::match(TokenType type) {
     if (check(type)) {
         advance();
@@ -43,7 +75,7 @@ bool Parser::match(TokenType type) {
     return false;
 }
 
-bool Parser::match(const std::vector<TokenType>& types) {
+bool Parser::match(std::initializer_list<TokenType> types) {
     for (TokenType type : types) {
         if (check(type)) {
             advance();
@@ -54,15 +86,22 @@ bool Parser::match(const std::vector<TokenType>& types) {
 }
 
 bool Parser::isAtEnd() {
-    return peek().type == TokenType::END_OF_FILE;
+    return currentToken.type == TokenType::END_OF_FILE;
 }
 
-Token Parser::consume(TokenType type, const std::string& message) {
+const Token& Parser::consume(TokenType type, const std::string& message) {
     if (check(type)) return advance();
     throw ParseError(message + " at line " + std::to_string(peek().line));
 }
 
-DataType Parser::tokenToDataType(Token token) {
+template <typename T>
+NodeList<T> Parser::finishList(std::vector<T>& pending, size_t first) {
+    NodeList<T> list = program->list(pending.data() + first, pending.size() - first);
+    pending.resize(first);
+    return list;
+}
+
+DataType Parser::tokenToDataType(const Token& token) {
     #if DEBUG_PARSER
     std::cout << "DEBUG: tokenToDataType - token: " << token.lexeme 
               << " type: " << static_cast<int>(token.type) << std::endl;
@@ -109,9 +148,10 @@ DataType Parser::tokenToDataType(Token token) {
 
 std::unique_ptr<Program> Parser::parse() {
     try {
+        currentToken = pull();
         return parseProgram();
     } catch (const ParseError& error) {
-        std::cerr << "Parse Error: " << error.what() << std::endl;
+        errorMessage = error.what();
         return nullptr;
     }
 }
@@ -121,7 +161,8 @@ std::unique_ptr<Program> Parser::parseProgram() {
     std::cout << "DEBUG: parseProgram() - starting, current: " << peek().lexeme << " at line " << peek().line << std::endl;
     #endif
     
-    auto program = std::make_unique<Program>();
+    auto built = std::make_unique<Program>();
+    program = built.get();
     
     while (!isAtEnd()) {
         #if DEBUG_PARSER
@@ -135,7 +176,7 @@ std::unique_ptr<Program> Parser::parseProgram() {
             try {
                 auto func = parseFunction();
                 if (func) {
-                    program->functions.push_back(std::move(func));
+                    program->functions.push_back(func);
                     #if DEBUG_PARSER
                     std::cout << "DEBUG: parseProgram() - parsed function, current: " << peek().lexeme << std::endl;
                     #endif
@@ -173,10 +214,11 @@ std::unique_ptr<Program> Parser::parseProgram() {
     std::cout << "DEBUG: parseProgram() - finished, parsed " << program->functions.size() << " functions" << std::endl;
     #endif
     
-    return program;
+    program = nullptr;
+    return built;
 }
 
-std::unique_ptr<FunctionDecl> Parser::parseFunction() {
+FunctionDecl* Parser::parseFunction() {
     #if DEBUG_PARSER
     std::cout << "DEBUG: parseFunction() - starting, current: " << peek().lexeme << " at line " << peek().line << std::endl;
     #endif
@@ -198,22 +240,11 @@ std::unique_ptr<FunctionDecl> Parser::parseFunction() {
     consume(TokenType::RPAREN, "Expected ')' after parameters");
     consume(TokenType::ARROW, "Expected '->' after function parameters");
     
-    // Parse return type - can be an identifier OR a type keyword
-    std::vector<TokenType> validTypeTokens = {
-        TokenType::INT, TokenType::FLOAT_TYPE, TokenType::BOOL, 
-        TokenType::SEQUENCE, TokenType::PATTERN, TokenType::IDENTIFIER
-    };
-    
-    bool isValidType = false;
-    for (TokenType validType : validTypeTokens) {
-        if (check(validType)) {
-            isValidType = true;
-            break;
-        }
-    }
+    // The type can be an identifier OR a type keyword
+    bool isValidType = checkType();
     
     if (!isValidType) {
-        throw ParseError("Expected return type, got: " + peek().lexeme);
+        throw ParseError("Expected return type, got: " + std::string(peek().lexeme));
     }
     
     Token returnTypeToken = advance();
@@ -229,7 +260,7 @@ std::unique_ptr<FunctionDecl> Parser::parseFunction() {
     std::cout << "DEBUG: parseFunction() - parsed body with " << body.size() << " statements, current: " << peek().lexeme << std::endl;
     #endif
     
-    auto func = std::make_unique<FunctionDecl>(name, std::move(parameters), returnType, std::move(body));
+    auto func = program->make<FunctionDecl>(intern(name), parameters, returnType, body, name.line);
     
     #if DEBUG_PARSER
     std::cout << "DEBUG: parseFunction() - created FunctionDecl for " << name.lexeme << std::endl;
@@ -238,8 +269,8 @@ std::unique_ptr<FunctionDecl> Parser::parseFunction() {
     return func;
 }
 
-std::vector<std::pair<Token, DataType>> Parser::parseParameters() {
-    std::vector<std::pair<Token, DataType>> parameters;
+NodeList<Parameter> Parser::parseParameters() {
+    std::vector<Parameter> parameters;
     
     #if DEBUG_PARSER
     std::cout << "DEBUG: parseParameters() - current token: " << peek().lexeme 
@@ -251,7 +282,7 @@ std::vector<std::pair<Token, DataType>> Parser::parseParameters() {
         #if DEBUG_PARSER
         std::cout << "DEBUG: Empty parameters (immediate RPAREN)" << std::endl;
         #endif
-        return parameters;
+        return NodeList<Parameter>();
     }
     
     do {
@@ -265,7 +296,7 @@ std::vector<std::pair<Token, DataType>> Parser::parseParameters() {
             std::cout << "DEBUG: Expected IDENTIFIER for param name, got: " << peek().lexeme 
                       << " type: " << static_cast<int>(peek().type) << std::endl;
             #endif
-            throw ParseError("Expected parameter name, got: " + peek().lexeme);
+            throw ParseError("Expected parameter name, got: " + std::string(peek().lexeme));
         }
         Token name = advance();
         
@@ -274,7 +305,7 @@ std::vector<std::pair<Token, DataType>> Parser::parseParameters() {
         #endif
         
         if (!match(TokenType::COLON)) {
-            throw ParseError("Expected ':' after parameter name '" + name.lexeme + "'");
+            throw ParseError("Expected ':' after parameter name '" + std::string(name.lexeme) + "'");
         }
         
         #if DEBUG_PARSER
@@ -282,26 +313,15 @@ std::vector<std::pair<Token, DataType>> Parser::parseParameters() {
                   << " type: " << static_cast<int>(peek().type) << std::endl;
         #endif
         
-        // Parse the type - can be an identifier OR a type keyword
-        std::vector<TokenType> validTypeTokens = {
-            TokenType::INT, TokenType::FLOAT_TYPE, TokenType::BOOL, 
-            TokenType::SEQUENCE, TokenType::PATTERN, TokenType::IDENTIFIER
-        };
-        
-        bool isValidType = false;
-        for (TokenType validType : validTypeTokens) {
-            if (check(validType)) {
-                isValidType = true;
-                break;
-            }
-        }
+        // The type can be an identifier OR a type keyword
+        bool isValidType = checkType();
         
         if (!isValidType) {
             #if DEBUG_PARSER
             std::cout << "DEBUG: Expected type token, got: " << peek().lexeme 
                       << " type: " << static_cast<int>(peek().type) << std::endl;
             #endif
-            throw ParseError("Expected parameter type after '" + name.lexeme + ":', got: " + peek().lexeme);
+            throw ParseError("Expected parameter type after '" + std::string(name.lexeme) + ":', got: " + std::string(peek().lexeme));
         }
         
         Token typeToken = advance();
@@ -318,10 +338,10 @@ std::vector<std::pair<Token, DataType>> Parser::parseParameters() {
         #endif
         
         if (type == DataType::UNKNOWN) {
-            throw ParseError("Unknown parameter type: '" + typeToken.lexeme + "'");
+            throw ParseError("Unknown parameter type: '" + std::string(typeToken.lexeme) + "'");
         }
         
-        parameters.emplace_back(name, type);
+        parameters.push_back(Parameter{intern(name), type, name.line});
         
         #if DEBUG_PARSER
         std::cout << "DEBUG: Successfully added parameter: " << name.lexeme << ":" << typeToken.lexeme << std::endl;
@@ -329,10 +349,10 @@ std::vector<std::pair<Token, DataType>> Parser::parseParameters() {
         
     } while (match(TokenType::COMMA));
     
-    return parameters;
+    return program->list(parameters);
 }
 
-std::unique_ptr<Stmt> Parser::parseStatement() {
+Stmt* Parser::parseStatement() {
     #if DEBUG_PARSER
     std::cout << "DEBUG: parseStatement() - current: " << peek().lexeme << " type: " << static_cast<int>(peek().type) << std::endl;
     #endif
@@ -360,14 +380,14 @@ std::unique_ptr<Stmt> Parser::parseStatement() {
             #if DEBUG_PARSER
             std::cout << "DEBUG: parseStatement() - detected assignment statement" << std::endl;
             #endif
-            Token name = advance();
+            advance();  // The name; parseAssignment takes it from previous()
             return parseAssignment();
         }
     }
     
     if (match(TokenType::LBRACE)) {
         auto stmts = parseBlock();
-        return std::make_unique<BlockStmt>(std::move(stmts));
+        return program->make<BlockStmt>(stmts);
     }
     
     #if DEBUG_PARSER
@@ -376,32 +396,21 @@ std::unique_ptr<Stmt> Parser::parseStatement() {
     return parseExpressionStatement();
 }
 
-std::unique_ptr<Stmt> Parser::parseDeclaration() {
+Stmt* Parser::parseDeclaration() {
     Token name = consume(TokenType::IDENTIFIER, "Expected variable name");
     consume(TokenType::COLON, "Expected ':' after variable name");
     
-    // Parse the type - can be an identifier OR a type keyword
-    std::vector<TokenType> validTypeTokens = {
-        TokenType::INT, TokenType::FLOAT_TYPE, TokenType::BOOL, 
-        TokenType::SEQUENCE, TokenType::PATTERN, TokenType::IDENTIFIER
-    };
-    
-    bool isValidType = false;
-    for (TokenType validType : validTypeTokens) {
-        if (check(validType)) {
-            isValidType = true;
-            break;
-        }
-    }
+    // The type can be an identifier OR a type keyword
+    bool isValidType = checkType();
     
     if (!isValidType) {
-        throw ParseError("Expected variable type after '" + name.lexeme + ":', got: " + peek().lexeme);
+        throw ParseError("Expected variable type after '" + std::string(name.lexeme) + ":', got: " + std::string(peek().lexeme));
     }
     
     Token typeToken = advance();
     DataType type = tokenToDataType(typeToken);
     
-    std::unique_ptr<Expr> initializer = nullptr;
+    Expr* initializer = nullptr;
     if (match(TokenType::ASSIGN)) {
         initializer = parseExpression();
     }
@@ -409,10 +418,10 @@ std::unique_ptr<Stmt> Parser::parseDeclaration() {
     // Optional semicolon - try to match it, but don't require it
     match(TokenType::SEMICOLON);
     
-    return std::make_unique<DeclarationStmt>(name, type, std::move(initializer));
+    return program->make<DeclarationStmt>(intern(name), type, initializer, name.line);
 }
 
-std::unique_ptr<Stmt> Parser::parseAssignment() {
+Stmt* Parser::parseAssignment() {
     #if DEBUG_PARSER
     std::cout << "DEBUG: parseAssignment() - starting, name: " << previous().lexeme << std::endl;
     #endif
@@ -438,7 +447,7 @@ std::unique_ptr<Stmt> Parser::parseAssignment() {
     #endif
     
     try {
-        auto assignStmt = std::make_unique<AssignmentStmt>(name, std::move(value));
+        auto assignStmt = program->make<AssignmentStmt>(intern(name), value, name.line);
         #if DEBUG_PARSER
         std::cout << "DEBUG: parseAssignment() - successfully created AssignmentStmt" << std::endl;
         #endif
@@ -456,12 +465,12 @@ std::unique_ptr<Stmt> Parser::parseAssignment() {
     }
 }
 
-std::unique_ptr<Stmt> Parser::parseIfStatement() {
+Stmt* Parser::parseIfStatement() {
     #if DEBUG_PARSER
     std::cout << "DEBUG: parseIfStatement() - current: " << peek().lexeme << " at line " << peek().line << std::endl;
     #endif
     
-    std::unique_ptr<Expr> condition = parseExpression();
+    Expr* condition = parseExpression();
     
     #if DEBUG_PARSER
     std::cout << "DEBUG: parseIfStatement() - parsed condition, current: " << peek().lexeme << std::endl;
@@ -473,7 +482,7 @@ std::unique_ptr<Stmt> Parser::parseIfStatement() {
     std::cout << "DEBUG: parseIfStatement() - parsed then branch, current: " << peek().lexeme << std::endl;
     #endif
     
-    std::vector<std::unique_ptr<Stmt>> elseBranch;
+    NodeList<Stmt*> elseBranch;
     if (match(TokenType::ELSE)) {
         #if DEBUG_PARSER
         std::cout << "DEBUG: parseIfStatement() - found else clause" << std::endl;
@@ -500,15 +509,10 @@ std::unique_ptr<Stmt> Parser::parseIfStatement() {
     
     try {
         #if DEBUG_PARSER
-        std::cout << "DEBUG: parseIfStatement() - calling make_unique<IfStmt>" << std::endl;
+        std::cout << "DEBUG: parseIfStatement() - allocating IfStmt" << std::endl;
         #endif
         
-        // Create IfStmt by moving the condition and branches
-        auto ifStmt = std::make_unique<IfStmt>(
-            std::move(condition), 
-            std::move(thenBranch), 
-            std::move(elseBranch)
-        );
+        auto ifStmt = program->make<IfStmt>(condition, thenBranch, elseBranch);
         
         #if DEBUG_PARSER
         std::cout << "DEBUG: parseIfStatement() - successfully created IfStmt" << std::endl;
@@ -533,12 +537,12 @@ std::unique_ptr<Stmt> Parser::parseIfStatement() {
     }
 }
 
-std::unique_ptr<Stmt> Parser::parseWhileStatement() {
+Stmt* Parser::parseWhileStatement() {
     #if DEBUG_PARSER
     std::cout << "DEBUG: parseWhileStatement() - current: " << peek().lexeme << " at line " << peek().line << std::endl;
     #endif
     
-    std::unique_ptr<Expr> condition = parseExpression();
+    Expr* condition = parseExpression();
     
     #if DEBUG_PARSER
     std::cout << "DEBUG: parseWhileStatement() - parsed condition, current: " << peek().lexeme << std::endl;
@@ -562,10 +566,10 @@ std::unique_ptr<Stmt> Parser::parseWhileStatement() {
     
     try {
         #if DEBUG_PARSER
-        std::cout << "DEBUG: parseWhileStatement() - calling make_unique<WhileStmt>" << std::endl;
+        std::cout << "DEBUG: parseWhileStatement() - allocating WhileStmt" << std::endl;
         #endif
         
-        auto whileStmt = std::make_unique<WhileStmt>(std::move(condition), std::move(body));
+        auto whileStmt = program->make<WhileStmt>(condition, body);
         
         #if DEBUG_PARSER
         std::cout << "DEBUG: parseWhileStatement() - successfully created WhileStmt" << std::endl;
@@ -590,8 +594,8 @@ std::unique_ptr<Stmt> Parser::parseWhileStatement() {
     }
 }
 
-std::unique_ptr<Stmt> Parser::parseReturnStatement() {
-    std::unique_ptr<Expr> value = nullptr;
+Stmt* Parser::parseReturnStatement() {
+    Expr* value = nullptr;
     if (!check(TokenType::SEMICOLON)) {
         value = parseExpression();
     }
@@ -599,10 +603,10 @@ std::unique_ptr<Stmt> Parser::parseReturnStatement() {
     // Optional semicolon
     match(TokenType::SEMICOLON);
     
-    return std::make_unique<ReturnStmt>(std::move(value));
+    return program->make<ReturnStmt>(value);
 }
 
-std::unique_ptr<Stmt> Parser::parsePrintStatement() {
+Stmt* Parser::parsePrintStatement() {
     #if DEBUG_PARSER
     std::cout << "DEBUG: parsePrintStatement() - current: " << peek().lexeme << " at line " << peek().line << std::endl;
     #endif
@@ -611,7 +615,7 @@ std::unique_ptr<Stmt> Parser::parsePrintStatement() {
     Token printToken = advance();
     
     // Parse all arguments until we hit a statement terminator
-    std::vector<std::unique_ptr<Expr>> arguments;
+    size_t firstArgument = pendingExpressions.size();
     
     // Parse arguments one by one until we hit a terminator
     // In print statements, arguments can be: literals, identifiers, function calls, sequences
@@ -669,7 +673,7 @@ std::unique_ptr<Stmt> Parser::parsePrintStatement() {
             std::cout << "DEBUG: parsePrintStatement - successfully parsed primary, current: " << peek().lexeme << std::endl;
             #endif
             
-            arguments.push_back(std::move(expr));
+            pendingExpressions.push_back(expr);
             
             // After parsing, check if we should stop
             if (isAtEnd()) {
@@ -758,35 +762,35 @@ std::unique_ptr<Stmt> Parser::parsePrintStatement() {
     }
     
     #if DEBUG_PARSER
-    std::cout << "DEBUG: parsePrintStatement - parsed " << arguments.size() << " arguments" << std::endl;
+    std::cout << "DEBUG: parsePrintStatement - parsed " << pendingExpressions.size() - firstArgument << " arguments" << std::endl;
     #endif
     
     // Create a function call expression for print
-    auto callExpr = std::make_unique<CallExpr>(printToken, std::move(arguments));
+    auto callExpr = program->make<CallExpr>(intern(printToken), finishList(pendingExpressions, firstArgument), printToken.line);
     
     // Optional semicolon
     match(TokenType::SEMICOLON);
     
-    return std::make_unique<ExpressionStmt>(std::move(callExpr));
+    return program->make<ExpressionStmt>(callExpr);
 }
 
-std::unique_ptr<Stmt> Parser::parseExpressionStatement() {
+Stmt* Parser::parseExpressionStatement() {
     auto expr = parseExpression();
     
     // Optional semicolon
     match(TokenType::SEMICOLON);
     
-    return std::make_unique<ExpressionStmt>(std::move(expr));
+    return program->make<ExpressionStmt>(expr);
 }
 
-std::vector<std::unique_ptr<Stmt>> Parser::parseBlock() {
+NodeList<Stmt*> Parser::parseBlock() {
     #if DEBUG_PARSER
     std::cout << "DEBUG: parseBlock() - current: " << peek().lexeme << " at line " << peek().line << std::endl;
     #endif
     
     consume(TokenType::LBRACE, "Expected '{' before block");
     
-    std::vector<std::unique_ptr<Stmt>> statements;
+    size_t firstStatement = pendingStatements.size();
     
     #if DEBUG_PARSER
     std::cout << "DEBUG: parseBlock() - entered block, current: " << peek().lexeme << std::endl;
@@ -800,7 +804,7 @@ std::vector<std::unique_ptr<Stmt>> Parser::parseBlock() {
         try {
             auto stmt = parseStatement();
             if (stmt) {
-                statements.push_back(std::move(stmt));
+                pendingStatements.push_back(stmt);
                 #if DEBUG_PARSER
                 std::cout << "DEBUG: parseBlock() - parsed statement, current: " << peek().lexeme << std::endl;
                 #endif
@@ -829,115 +833,129 @@ std::vector<std::unique_ptr<Stmt>> Parser::parseBlock() {
     }
     
     #if DEBUG_PARSER
-    std::cout << "DEBUG: parseBlock() - exiting block, current: " << peek().lexeme << ", parsed " << statements.size() << " statements" << std::endl;
+    std::cout << "DEBUG: parseBlock() - exiting block, current: " << peek().lexeme << ", parsed " << pendingStatements.size() - firstStatement << " statements" << std::endl;
     #endif
     
     consume(TokenType::RBRACE, "Expected '}' after block");
-    return statements;
+    return finishList(pendingStatements, firstStatement);
 }
 
-std::unique_ptr<Expr> Parser::parseExpression() {
+Expr* Parser::parseExpression() {
     return parseLogicalOr();
 }
 
-std::unique_ptr<Expr> Parser::parseLogicalOr() {
+Expr* Parser::parseLogicalOr() {
     auto expr = parseLogicalAnd();
     
     while (match(TokenType::OR)) {
         Token op = previous();
         auto right = parseLogicalAnd();
-        expr = std::make_unique<BinaryExpr>(std::move(expr), op, std::move(right));
+        expr = program->make<BinaryExpr>(expr, op.type, right, op.line);
     }
     
     return expr;
 }
 
-std::unique_ptr<Expr> Parser::parseLogicalAnd() {
+Expr* Parser::parseLogicalAnd() {
     auto expr = parseEquality();
     
     while (match(TokenType::AND)) {
         Token op = previous();
         auto right = parseEquality();
-        expr = std::make_unique<BinaryExpr>(std::move(expr), op, std::move(right));
+        expr = program->make<BinaryExpr>(expr, op.type, right, op.line);
     }
     
     return expr;
 }
 
-std::unique_ptr<Expr> Parser::parseEquality() {
+Expr* Parser::parseEquality() {
     auto expr = parseComparison();
     
     while (match({TokenType::EQUALS, TokenType::NOT_EQUALS})) {
         Token op = previous();
         auto right = parseComparison();
-        expr = std::make_unique<BinaryExpr>(std::move(expr), op, std::move(right));
+        expr = program->make<BinaryExpr>(expr, op.type, right, op.line);
     }
     
     return expr;
 }
 
-std::unique_ptr<Expr> Parser::parseComparison() {
+Expr* Parser::parseComparison() {
     auto expr = parseTerm();
     
     while (match({TokenType::LESS, TokenType::LESS_EQUAL, TokenType::GREATER, TokenType::GREATER_EQUAL})) {
         Token op = previous();
         auto right = parseTerm();
-        expr = std::make_unique<BinaryExpr>(std::move(expr), op, std::move(right));
+        expr = program->make<BinaryExpr>(expr, op.type, right, op.line);
     }
     
     return expr;
 }
 
-std::unique_ptr<Expr> Parser::parseTerm() {
+Expr* Parser::parseTerm() {
     auto expr = parseFactor();
     
     while (match({TokenType::PLUS, TokenType::MINUS})) {
         Token op = previous();
         auto right = parseFactor();
-        expr = std::make_unique<BinaryExpr>(std::move(expr), op, std::move(right));
+        expr = program->make<BinaryExpr>(expr, op.type, right, op.line);
     }
     
     return expr;
 }
 
-std::unique_ptr<Expr> Parser::parseFactor() {
+Expr* Parser::parseFactor() {
     auto expr = parseUnary();
     
     while (match({TokenType::MULTIPLY, TokenType::DIVIDE, TokenType::MODULO})) {
         Token op = previous();
         auto right = parseUnary();
-        expr = std::make_unique<BinaryExpr>(std::move(expr), op, std::move(right));
+        expr = program->make<BinaryExpr>(expr, op.type, right, op.line);
     }
     
     return expr;
 }
 
-std::unique_ptr<Expr> Parser::parseUnary() {
+Expr* Parser::parseUnary() {
     if (match({TokenType::MINUS, TokenType::NOT})) {
         Token op = previous();
         auto right = parseUnary();
-        return std::make_unique<UnaryExpr>(op, std::move(right));
+        return program->make<UnaryExpr>(op.type, right, op.line);
     }
     
     return parsePrimary();
 }
 
-std::unique_ptr<Expr> Parser::parsePrimary() {
-    if (match(TokenType::TRUE)) {
-        return std::make_unique<LiteralExpr>(previous());
-    }
-    if (match(TokenType::FALSE)) {
-        return std::make_unique<LiteralExpr>(previous());
+Expr* Parser::parsePrimary() {
+    if (match({TokenType::TRUE, TokenType::FALSE})) {
+        Token token = previous();
+        return program->make<LiteralExpr>(token.type, intern(token), token.line);
     }
     if (match({TokenType::NUMBER, TokenType::FLOAT, TokenType::STRING})) {
-        return std::make_unique<LiteralExpr>(previous());
+        Token token = previous();
+        auto literal = program->make<LiteralExpr>(token.type, intern(token), token.line);
+        try {
+            if (token.type == TokenType::NUMBER) {
+                try {
+                    literal->intValue = std::stoll(std::string(token.lexeme));
+                } catch (const std::out_of_range&) {
+                    literal->exceedsInt64 = true;
+                }
+            } else if (token.type == TokenType::FLOAT) {
+                literal->floatValue = std::stod(std::string(token.lexeme));
+            }
+        } catch (const std::logic_error&) {
+            throw ParseError("Number literal '" + std::string(token.lexeme) + "' out of range at line " +
+                             std::to_string(token.line));
+        }
+        return literal;
     }
     if (match(TokenType::IDENTIFIER)) {
         Token name = previous();
         
         if (match(TokenType::LPAREN)) {
             auto arguments = parseArguments();
-            return std::make_unique<CallExpr>(name, std::move(arguments));
+            return program->make<CallExpr>(intern(name), arguments, name.line);
         }
         
         // Check for array indexing
@@ -945,13 +963,13 @@ std::unique_ptr<Expr> Parser::parsePrimary() {
             auto index = parseExpression();
             consume(TokenType::RBRACKET, "Expected ']' after index");
             // For now, treat this as a function call to simplify
-            std::vector<std::unique_ptr<Expr>> args;
-            args.push_back(std::make_unique<VariableExpr>(name));
-            args.push_back(std::move(index));
-            return std::make_unique<CallExpr>(Token(TokenType::IDENTIFIER, "get", name.line, name.column), std::move(args));
+            size_t firstArgument = pendingExpressions.size();
+            pendingExpressions.push_back(program->make<VariableExpr>(intern(name), name.line));
+            pendingExpressions.push_back(index);
+            return program->make<CallExpr>(program->names.intern("get"), finishList(pendingExpressions, firstArgument), name.line);
         }
         
-        return std::make_unique<VariableExpr>(name);
+        return program->make<VariableExpr>(intern(name), name.line);
     }
     if (match(TokenType::LPAREN)) {
         auto expr = parseExpression();
@@ -965,14 +983,15 @@ std::unique_ptr<Expr> Parser::parsePrimary() {
     throw ParseError("Expected expression");
 }
 
-std::unique_ptr<Expr> Parser::parseSequence() {
-    std::vector<std::unique_ptr<Expr>> elements;
+Expr* Parser::parseSequence() {
+    size_t firstElement = pendingExpressions.size();
     
     // We already consumed the LBRACKET in parsePrimary()
     // Now parse the elements or check for empty sequence
     if (!check(TokenType::RBRACKET)) {
         do {
-            elements.push_back(parseExpression());
+            Expr* element = parseExpression();
+            pendingExpressions.push_back(element);
         } while (match(TokenType::COMMA) && !check(TokenType::RBRACKET));
     }
     
@@ -981,17 +1000,18 @@ std::unique_ptr<Expr> Parser::parseSequence() {
         throw ParseError("Expected ']' after sequence elements");
     }
     
-    return std::make_unique<SequenceExpr>(std::move(elements));
+    return program->make<SequenceExpr>(finishList(pendingExpressions, firstElement));
 }
 
-std::vector<std::unique_ptr<Expr>> Parser::parseArguments() {
-    std::vector<std::unique_ptr<Expr>> arguments;
+NodeList<Expr*> Parser::parseArguments() {
+    size_t firstArgument = pendingExpressions.size();
     
     // We already consumed the LPAREN in parsePrimary()
     // Now parse the arguments or check for empty arguments
     if (!check(TokenType::RPAREN)) {
         do {
-            arguments.push_back(parseExpression());
+            Expr* argument = parseExpression();
+            pendingExpressions.push_back(argument);
         } while (match(TokenType::COMMA) && !check(TokenType::RPAREN));
     }
     
@@ -1000,7 +1020,7 @@ std::vector<std::unique_ptr<Expr>> Parser::parseArguments() {
         throw ParseError("Expected ')' after function arguments");
     }
     
-    return arguments;
+    return finishList(pendingExpressions, firstArgument);
 }
 
 void Parser::synchronize() {
@@ -34,6 +34,10 @@ void SemanticAnalyzer::clear() {
     currentFunctionReturnType = DataType::VOID;
     inFunction = false;
     hasReturnStatement = false;
+    currentFunction = nullptr;
+    functionDecls.clear();
+    callees.clear();
+    impure.clear();
 }
 
 void SemanticAnalyzer::analyzeProgram(Program* program) {
@@ -45,136 +49,196 @@ void SemanticAnalyzer::analyzeProgram(Program* program) {
     symbolManager.declareSymbol("length", DataType::INT, true);
     symbolManager.declareSymbol("get", DataType::INT, true);  // For array indexing
     symbolManager.declareSymbol("input", DataType::INT, true);
+    symbolManager.declareSymbol("sum", DataType::INT, true);
+    symbolManager.declareSymbol("min", DataType::INT, true);
+    symbolManager.declareSymbol("max", DataType::INT, true);
+    symbolManager.declareSymbol("load", DataType::SEQUENCE, true);
+    symbolManager.declareSymbol("read_sequence", DataType::SEQUENCE, true);
     
     for (auto& function : program->functions) {
-        if (!symbolManager.declareSymbol(function->name.lexeme, function->returnType, true)) {
-            addError("Function '" + function->name.lexeme + "' already declared", function->name.line);
+        if (!symbolManager.declareSymbol(function->name.text(), function->returnType, true)) {
+            addError("Function '" + function->name.text() + "' already declared", function->line);
         }
+        functionDecls[function->name.text()] = function;
     }
     
     for (auto& function : program->functions) {
-        analyzeFunction(function.get());
+        analyzeFunction(function);
     }
     
     checkMainFunction(program);
+    inferPurity(program);
+}
+
+void SemanticAnalyzer::inferPurity(Program* program) {
+    // Impurity flows from callee to caller until nothing changes
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (auto& function : program->functions) {
+            if (impure.count(function)) continue;
+            for (FunctionDecl* callee : callees[function]) {
+                if (impure.count(callee)) {
+                    impure.insert(function);
+                    changed = true;
+                    break;
+                }
+            }
+        }
+    }
+    
+    for (auto& function : program->functions) {
+        function->isPure = !impure.count(function);
+    }
 }
 
 void SemanticAnalyzer::analyzeFunction(FunctionDecl* function) {
     symbolManager.enterScope();
+    symbolManager.beginFrame();
     inFunction = true;
+    currentFunction = function;
     hasReturnStatement = false;
     currentFunctionReturnType = function->returnType;
 
+    // Parameters take the first frame slots, in declaration order
     for (const auto& param : function->parameters) {
-        if (!symbolManager.declareSymbol(param.first.lexeme, param.second, true)) {
-            addError("Parameter '" + param.first.lexeme + "' already declared", param.first.line);
+        if (!symbolManager.declareLocal(param.name.text(), param.type, true)) {
+            addError("Parameter '" + param.name.text() + "' already declared", param.line);
         }
     }
     
     for (auto& stmt : function->body) {
-        analyzeStatement(stmt.get());
+        analyzeStatement(stmt);
     }
     
     if (function->returnType != DataType::VOID && !hasReturnStatement) {
-        addWarning("Function '" + function->name.lexeme + "' may not return a value", function->name.line);
+        addWarning("Function '" + function->name.text() + "' may not return a value", function->line);
     }
     
+    function->frameSize = symbolManager.getFrameSize();
     symbolManager.exitScope();
     inFunction = false;
 }
 
 void SemanticAnalyzer::analyzeStatement(Stmt* stmt) {
-    if (auto decl = dynamic_cast<DeclarationStmt*>(stmt)) {
-        analyzeDeclaration(decl);
-    } else if (auto assign = dynamic_cast<AssignmentStmt*>(stmt)) {
-        analyzeAssignment(assign);
-    } else if (auto ifStmt = dynamic_cast<IfStmt*>(stmt)) {
-        analyzeIfStatement(ifStmt);
-    } else if (auto whileStmt = dynamic_cast<WhileStmt*>(stmt)) {
-        analyzeWhileStatement(whileStmt);
-    } else if (auto returnStmt = dynamic_cast<ReturnStmt*>(stmt)) {
-        analyzeReturnStatement(returnStmt);
-    } else if (auto exprStmt = dynamic_cast<ExpressionStmt*>(stmt)) {
-        analyzeExpressionStatement(exprStmt);
-    } else if (auto blockStmt = dynamic_cast<BlockStmt*>(stmt)) {
-        symbolManager.enterScope();
-        for (auto& s : blockStmt->statements) {
-            analyzeStatement(s.get());
-        }
-        symbolManager.exitScope();
+    switch (stmt->kind) {
+        case NodeKind::DECLARATION:
+            analyzeDeclaration(static_cast<DeclarationStmt*>(stmt));
+            break;
+        case NodeKind::ASSIGNMENT:
+            analyzeAssignment(static_cast<AssignmentStmt*>(stmt));
+            break;
+        case NodeKind::IF:
+            analyzeIfStatement(static_cast<IfStmt*>(stmt));
+            break;
+        case NodeKind::WHILE:
+            analyzeWhileStatement(static_cast<WhileStmt*>(stmt));
+            break;
+        case NodeKind::RETURN:
+            analyzeReturnStatement(static_cast<ReturnStmt*>(stmt));
+            break;
+        case NodeKind::EXPRESSION:
+            analyzeExpressionStatement(static_cast<ExpressionStmt*>(stmt));
+            break;
+        case NodeKind::BLOCK:
+            symbolManager.enterScope();
+            for (Stmt* s : static_cast<BlockStmt*>(stmt)->statements) {
+                analyzeStatement(s);
+            }
+            symbolManager.exitScope();
+            break;
+        default:
+            break;
     }
 }
 
 void SemanticAnalyzer::analyzeDeclaration(DeclarationStmt* decl) {
-    if (!symbolManager.declareSymbol(decl->name.lexeme, decl->dataType)) {
-        addError("Variable '" + decl->name.lexeme + "' already declared in this scope", decl->name.line);
+    if (!symbolManager.declareLocal(decl->name.text(), decl->dataType)) {
+        addError("Variable '" + decl->name.text() + "' already declared in this scope", decl->line);
         return;
     }
     
+    Symbol* symbol = symbolManager.lookupSymbol(decl->name.text());
+    decl->depth = symbol->scopeDepth;
+    decl->slot = symbol->slot;
+    
     if (decl->initializer) {
-        DataType initType = analyzeExpression(decl->initializer.get());
+        DataType initType = analyzeExpression(decl->initializer);
         if (!isTypeCompatible(decl->dataType, initType, TokenType::ASSIGN)) {
-            addError("Type mismatch in initialization of '" + decl->name.lexeme + 
+            addError("Type mismatch in initialization of '" + decl->name.text() + 
                     "', expected " + dataTypeToString(decl->dataType) + 
-                    " but got " + dataTypeToString(initType), decl->name.line);
+                    " but got " + dataTypeToString(initType), decl->line);
         } else {
-            symbolManager.markSymbolInitialized(decl->name.lexeme);
+            symbolManager.markSymbolInitialized(decl->name.text());
         }
     }
 }
 
 void SemanticAnalyzer::analyzeAssignment(AssignmentStmt* assign) {
-    Symbol* symbol = symbolManager.lookupSymbol(assign->name.lexeme);
+    Symbol* symbol = symbolManager.lookupSymbol(assign->name.text());
     if (!symbol) {
-        addError("Undefined variable '" + assign->name.lexeme + "'", assign->name.line);
+        addError("Undefined variable '" + assign->name.text() + "'", assign->line);
         return;
     }
     
     if (symbol->isConstant) {
-        addError("Cannot assign to constant '" + assign->name.lexeme + "'", assign->name.line);
+        addError("Cannot assign to constant '" + assign->name.text() + "'", assign->line);
         return;
     }
     
-    DataType valueType = analyzeExpression(assign->value.get());
+    assign->depth = symbol->scopeDepth;
+    assign->slot = symbol->slot;
+    
+    DataType valueType = analyzeExpression(assign->value);
     if (!isTypeCompatible(symbol->type, valueType, TokenType::ASSIGN)) {
-        addError("Type mismatch in assignment to '" + assign->name.lexeme + 
+        addError("Type mismatch in assignment to '" + assign->name.text() + 
                 "', expected " + dataTypeToString(symbol->type) + 
-                " but got " + dataTypeToString(valueType), assign->name.line);
+                " but got " + dataTypeToString(valueType), assign->line);
     } else {
-        symbolManager.markSymbolInitialized(assign->name.lexeme);
+        symbolManager.markSymbolInitialized(assign->name.text());
+    }
+    
+    // `s = s + rhs` on a sequence can grow s in place instead of copying it
+    if (auto binary = nodeCast<BinaryExpr>(assign->value)) {
+        auto target = nodeCast<VariableExpr>(binary->left);
+        if (binary->op == TokenType::PLUS && target && assign->slot >= 0 &&
+            target->slot == assign->slot && symbol->type == DataType::SEQUENCE &&
+            binary->right->type == DataType::SEQUENCE) {
+            assign->appendsToSelf = true;
+        }
     }
 }
 
 void SemanticAnalyzer::analyzeIfStatement(IfStmt* ifStmt) {
-    DataType condType = analyzeExpression(ifStmt->condition.get());
+    DataType condType = analyzeExpression(ifStmt->condition);
     if (condType != DataType::BOOL && condType != DataType::UNKNOWN) {
         addError("Condition expression must be boolean", ifStmt->line);
     }
     
     symbolManager.enterScope();
     for (auto& stmt : ifStmt->thenBranch) {
-        analyzeStatement(stmt.get());
+        analyzeStatement(stmt);
     }
     symbolManager.exitScope();
     
     if (!ifStmt->elseBranch.empty()) {
         symbolManager.enterScope();
         for (auto& stmt : ifStmt->elseBranch) {
-            analyzeStatement(stmt.get());
+            analyzeStatement(stmt);
         }
         symbolManager.exitScope();
     }
 }
 
 void SemanticAnalyzer::analyzeWhileStatement(WhileStmt* whileStmt) {
-    DataType condType = analyzeExpression(whileStmt->condition.get());
+    DataType condType = analyzeExpression(whileStmt->condition);
     if (condType != DataType::BOOL && condType != DataType::UNKNOWN) {
         addError("Condition expression must be boolean", whileStmt->line);
     }
     
     symbolManager.enterScope();
     for (auto& stmt : whileStmt->body) {
-        analyzeStatement(stmt.get());
+        analyzeStatement(stmt);
     }
     symbolManager.exitScope();
 }
@@ -188,7 +252,7 @@ void SemanticAnalyzer::analyzeReturnStatement(ReturnStmt* returnStmt) {
     hasReturnStatement = true;
     
     if (returnStmt->value) {
-        DataType returnType = analyzeExpression(returnStmt->value.get());
+        DataType returnType = analyzeExpression(returnStmt->value);
         if (!isTypeCompatible(currentFunctionReturnType, returnType, TokenType::ASSIGN)) {
             addError("Return type mismatch, expected " + 
                     dataTypeToString(currentFunctionReturnType) + 
@@ -201,52 +265,50 @@ void SemanticAnalyzer::analyzeReturnStatement(ReturnStmt* returnStmt) {
 }
 
 void SemanticAnalyzer::analyzeExpressionStatement(ExpressionStmt* exprStmt) {
-    analyzeExpression(exprStmt->expression.get());
+    analyzeExpression(exprStmt->expression);
 }
 
 DataType SemanticAnalyzer::analyzeExpression(Expr* expr) {
-    if (auto binary = dynamic_cast<BinaryExpr*>(expr)) {
-        return analyzeBinaryExpression(binary);
-    } else if (auto unary = dynamic_cast<UnaryExpr*>(expr)) {
-        return analyzeUnaryExpression(unary);
-    } else if (auto literal = dynamic_cast<LiteralExpr*>(expr)) {
-        return analyzeLiteralExpression(literal);
-    } else if (auto variable = dynamic_cast<VariableExpr*>(expr)) {
-        return analyzeVariableExpression(variable);
-    } else if (auto call = dynamic_cast<CallExpr*>(expr)) {
-        return analyzeCallExpression(call);
-    } else if (auto sequence = dynamic_cast<SequenceExpr*>(expr)) {
-        return analyzeSequenceExpression(sequence);
-    }
-    return DataType::UNKNOWN;
+    DataType type = DataType::UNKNOWN;
+    switch (expr->kind) {
+        case NodeKind::BINARY: type = analyzeBinaryExpression(static_cast<BinaryExpr*>(expr)); break;
+        case NodeKind::UNARY: type = analyzeUnaryExpression(static_cast<UnaryExpr*>(expr)); break;
+        case NodeKind::LITERAL: type = analyzeLiteralExpression(static_cast<LiteralExpr*>(expr)); break;
+        case NodeKind::VARIABLE: type = analyzeVariableExpression(static_cast<VariableExpr*>(expr)); break;
+        case NodeKind::CALL: type = analyzeCallExpression(static_cast<CallExpr*>(expr)); break;
+        case NodeKind::SEQUENCE: type = analyzeSequenceExpression(static_cast<SequenceExpr*>(expr)); break;
+        default: break;
+    }
+    expr->type = type;
+    return type;
 }
 
 DataType SemanticAnalyzer::analyzeBinaryExpression(BinaryExpr* binaryExpr) {
-    DataType leftType = analyzeExpression(binaryExpr->left.get());
-    DataType rightType = analyzeExpression(binaryExpr->right.get());
+    DataType leftType = analyzeExpression(binaryExpr->left);
+    DataType rightType = analyzeExpression(binaryExpr->right);
     
-    if (!isTypeCompatible(leftType, rightType, binaryExpr->op.type)) {
-        addError("Type mismatch in binary operation '" + binaryExpr->op.lexeme + 
+    if (!isTypeCompatible(leftType, rightType, binaryExpr->op)) {
+        addError("Type mismatch in binary operation '" + std::string(operatorSpelling(binaryExpr->op)) + 
                 "', left: " + dataTypeToString(leftType) + 
-                ", right: " + dataTypeToString(rightType), binaryExpr->op.line);
+                ", right: " + dataTypeToString(rightType), binaryExpr->line);
         return DataType::UNKNOWN;
     }
     
-    if (!isValidOperation(leftType, binaryExpr->op.type)) {
-        addError("Invalid operation '" + binaryExpr->op.lexeme + 
-                "' for type " + dataTypeToString(leftType), binaryExpr->op.line);
+    bool sequences = leftType == DataType::SEQUENCE && rightType == DataType::SEQUENCE;
+    if (!sequences && !isValidOperation(leftType, binaryExpr->op)) {
+        addError("Invalid operation '" + std::string(operatorSpelling(binaryExpr->op)) + 
+                "' for type " + dataTypeToString(leftType), binaryExpr->line);
         return DataType::UNKNOWN;
     }
     
-    switch (binaryExpr->op.type) {
+    switch (binaryExpr->op) {
         case TokenType::PLUS:
-            if (leftType == DataType::SEQUENCE && rightType == DataType::SEQUENCE) {
-                return DataType::SEQUENCE;
-            }
-            [[fallthrough]];
         case TokenType::MINUS:
         case TokenType::MULTIPLY:
         case TokenType::DIVIDE:
+            if (sequences) {
+                return DataType::SEQUENCE;
+            }
             if (leftType == DataType::FLOAT || rightType == DataType::FLOAT) {
                 return DataType::FLOAT;
             }
@@ -271,15 +333,15 @@ DataType SemanticAnalyzer::analyzeBinaryExpression(BinaryExpr* binaryExpr) {
 }
 
 DataType SemanticAnalyzer::analyzeUnaryExpression(UnaryExpr* unaryExpr) {
-    DataType exprType = analyzeExpression(unaryExpr->right.get());
+    DataType exprType = analyzeExpression(unaryExpr->right);
     
-    if (!isValidOperation(exprType, unaryExpr->op.type)) {
-        addError("Invalid unary operation '" + unaryExpr->op.lexeme + 
-                "' for type " + dataTypeToString(exprType), unaryExpr->op.line);
+    if (!isValidOperation(exprType, unaryExpr->op)) {
+        addError("Invalid unary operation '" + std::string(operatorSpelling(unaryExpr->op)) + 
+                "' for type " + dataTypeToString(exprType), unaryExpr->line);
         return DataType::UNKNOWN;
     }
     
-    if (unaryExpr->op.type == TokenType::NOT) {
+    if (unaryExpr->op == TokenType::NOT) {
         return DataType::BOOL;
     }
     
@@ -287,7 +349,7 @@ DataType SemanticAnalyzer::analyzeUnaryExpression(UnaryExpr* unaryExpr) {
 }
 
 DataType SemanticAnalyzer::analyzeLiteralExpression(LiteralExpr* literalExpr) {
-    switch (literalExpr->value.type) {
+    switch (literalExpr->literal) {
         case TokenType::NUMBER:
             return DataType::INT;
         case TokenType::FLOAT:
@@ -303,94 +365,147 @@ DataType SemanticAnalyzer::analyzeLiteralExpression(LiteralExpr* literalExpr) {
 }
 
 DataType SemanticAnalyzer::analyzeVariableExpression(VariableExpr* varExpr) {
-    Symbol* symbol = symbolManager.lookupSymbol(varExpr->name.lexeme);
+    Symbol* symbol = symbolManager.lookupSymbol(varExpr->name.text());
     if (!symbol) {
-        addError("Undefined variable '" + varExpr->name.lexeme + "'", varExpr->name.line);
+        addError("Undefined variable '" + varExpr->name.text() + "'", varExpr->line);
         return DataType::UNKNOWN;
     }
     
+    varExpr->depth = symbol->scopeDepth;
+    varExpr->slot = symbol->slot;
+    
+    // A function name used as a value is a callback for map/filter/generate
+    if (symbol->slot < 0 && currentFunction) {
+        auto function = functionDecls.find(varExpr->name.text());
+        if (function != functionDecls.end()) {
+            callees[currentFunction].push_back(function->second);
+        }
+    }
+    
     if (!symbol->isInitialized) {
-        addWarning("Variable '" + varExpr->name.lexeme + "' may be uninitialized", varExpr->name.line);
+        addWarning("Variable '" + varExpr->name.text() + "' may be uninitialized", varExpr->line);
     }
     
     return symbol->type;
 }
 
 DataType SemanticAnalyzer::analyzeCallExpression(CallExpr* callExpr) {
-    std::string funcName = callExpr->callee.lexeme;
+    const std::string& funcName = callExpr->callee.text();
+    
+    // load and read_sequence see files and input that can change between calls
+    if ((funcName == "print" || funcName == "input" || funcName == "load" || funcName == "read_sequence") &&
+        currentFunction) {
+        impure.insert(currentFunction);
+    }
     
     if (funcName == "print") {
         for (auto& arg : callExpr->arguments) {
-            analyzeExpression(arg.get());
+            analyzeExpression(arg);
         }
         return DataType::VOID;
     } else if (funcName == "length") {
         if (callExpr->arguments.size() != 1) {
-            addError("Function 'length' expects 1 argument", callExpr->callee.line);
+            addError("Function 'length' expects 1 argument", callExpr->line);
             return DataType::INT;
         }
-        DataType argType = analyzeExpression(callExpr->arguments[0].get());
+        DataType argType = analyzeExpression(callExpr->arguments[0]);
         if (argType != DataType::SEQUENCE && argType != DataType::UNKNOWN) {
-            addError("Function 'length' expects a sequence argument", callExpr->callee.line);
+            addError("Function 'length' expects a sequence argument", callExpr->line);
         }
         return DataType::INT;
     } else if (funcName == "get") {
         // Array indexing: get(array, index)
         if (callExpr->arguments.size() != 2) {
-            addError("Array indexing requires array and index", callExpr->callee.line);
+            addError("Array indexing requires array and index", callExpr->line);
             return DataType::INT;
         }
-        DataType arrayType = analyzeExpression(callExpr->arguments[0].get());
-        DataType indexType = analyzeExpression(callExpr->arguments[1].get());
+        DataType arrayType = analyzeExpression(callExpr->arguments[0]);
+        DataType indexType = analyzeExpression(callExpr->arguments[1]);
         
         if (arrayType != DataType::SEQUENCE && arrayType != DataType::UNKNOWN) {
-            addError("Cannot index non-sequence type", callExpr->callee.line);
+            addError("Cannot index non-sequence type", callExpr->line);
         }
         if (indexType != DataType::INT && indexType != DataType::UNKNOWN) {
-            addError("Array index must be an integer", callExpr->callee.line);
+            addError("Array index must be an integer", callExpr->line);
         }
         return DataType::INT; // Assume sequences contain integers
     } else if (funcName == "map") {
         if (callExpr->arguments.size() != 2) {
-            addError("Function 'map' expects 2 arguments", callExpr->callee.line);
+            addError("Function 'map' expects 2 arguments", callExpr->line);
         } else {
-            analyzeExpression(callExpr->arguments[0].get());
-            analyzeExpression(callExpr->arguments[1].get());
+            analyzeExpression(callExpr->arguments[0]);
+            analyzeExpression(callExpr->arguments[1]);
         }
         return DataType::SEQUENCE;
     } else if (funcName == "filter") {
         if (callExpr->arguments.size() != 2) {
-            addError("Function 'filter' expects 2 arguments", callExpr->callee.line);
+            addError("Function 'filter' expects 2 arguments", callExpr->line);
         } else {
-            analyzeExpression(callExpr->arguments[0].get());
-            analyzeExpression(callExpr->arguments[1].get());
+            analyzeExpression(callExpr->arguments[0]);
+            analyzeExpression(callExpr->arguments[1]);
         }
         return DataType::SEQUENCE;
     } else if (funcName == "generate") {
-        for (auto& arg : callExpr->arguments) {
-            analyzeExpression(arg.get());
+        if (callExpr->arguments.size() != 3) {
+            addError("Function 'generate' expects 3 arguments", callExpr->line);
+        } else {
+            for (auto& arg : callExpr->arguments) {
+                analyzeExpression(arg);
+            }
         }
         return DataType::SEQUENCE;
+    } else if (funcName == "sum" || funcName == "min" || funcName == "max") {
+        if (callExpr->arguments.size() != 1) {
+            addError("Function '" + funcName + "' expects 1 argument", callExpr->line);
+            return DataType::INT;
+        }
+        DataType argType = analyzeExpression(callExpr->arguments[0]);
+        if (argType != DataType::SEQUENCE && argType != DataType::UNKNOWN) {
+            addError("Function '" + funcName + "' expects a sequence argument", callExpr->line);
+        }
+        return DataType::INT; // Like get, assume sequences contain integers
     } else if (funcName == "input") {
         if (callExpr->arguments.size() > 1) {
-            addError("Function 'input' expects 0 or 1 argument", callExpr->callee.line);
+            addError("Function 'input' expects 0 or 1 argument", callExpr->line);
         } else if (callExpr->arguments.size() == 1) {
-            DataType promptType = analyzeExpression(callExpr->arguments[0].get());
+            DataType promptType = analyzeExpression(callExpr->arguments[0]);
             if (promptType != DataType::SEQUENCE && promptType != DataType::UNKNOWN) {
-                addError("Function 'input' expects a string literal prompt", callExpr->callee.line);
+                addError("Function 'input' expects a string literal prompt", callExpr->line);
             }
         }
         return DataType::INT;
+    } else if (funcName == "load") {
+        if (callExpr->arguments.empty() || callExpr->arguments.size() > 2) {
+            addError("Function 'load' expects a path and an optional format", callExpr->line);
+        } else {
+            for (auto& arg : callExpr->arguments) {
+                DataType argType = analyzeExpression(arg);
+                if (argType != DataType::SEQUENCE && argType != DataType::UNKNOWN) {
+                    addError("Function 'load' expects string arguments", callExpr->line);
+                }
+            }
+        }
+        return DataType::SEQUENCE;
+    } else if (funcName == "read_sequence") {
+        if (!callExpr->arguments.empty()) {
+            addError("Function 'read_sequence' expects no arguments", callExpr->line);
+        }
+        return DataType::SEQUENCE;
     }
     
     Symbol* symbol = symbolManager.lookupSymbol(funcName);
     if (!symbol) {
-        addError("Undefined function '" + funcName + "'", callExpr->callee.line);
+        addError("Undefined function '" + funcName + "'", callExpr->line);
         return DataType::UNKNOWN;
     }
     
+    auto callee = functionDecls.find(funcName);
+    if (callee != functionDecls.end() && currentFunction) {
+        callees[currentFunction].push_back(callee->second);
+    }
+    
     for (auto& arg : callExpr->arguments) {
-        analyzeExpression(arg.get());
+        analyzeExpression(arg);
     }
     
     return symbol->type;
@@ -401,9 +516,9 @@ DataType SemanticAnalyzer::analyzeSequenceExpression(SequenceExpr* seqExpr) {
         return DataType::SEQUENCE;
     }
     
-    DataType firstType = analyzeExpression(seqExpr->elements[0].get());
+    DataType firstType = analyzeExpression(seqExpr->elements[0]);
     for (size_t i = 1; i < seqExpr->elements.size(); ++i) {
-        DataType elemType = analyzeExpression(seqExpr->elements[i].get());
+        DataType elemType = analyzeExpression(seqExpr->elements[i]);
         if (!isTypeCompatible(firstType, elemType, TokenType::ASSIGN) && 
             firstType != DataType::UNKNOWN && elemType != DataType::UNKNOWN) {
             addWarning("Inconsistent types in sequence", seqExpr->elements[i]->line);
@@ -423,13 +538,13 @@ bool SemanticAnalyzer::isTypeCompatible(DataType left, DataType right, TokenType
             return left == right || canCoerce(right, left);
             
         case TokenType::PLUS:
-            if (left == DataType::SEQUENCE && right == DataType::SEQUENCE) {
-                return true;
-            }
-            [[fallthrough]];
         case TokenType::MINUS:
         case TokenType::MULTIPLY:
         case TokenType::DIVIDE:
+            // Sequences concatenate with '+' and combine elementwise otherwise
+            if (left == DataType::SEQUENCE && right == DataType::SEQUENCE) {
+                return true;
+            }
             return (isNumericType(left) && isNumericType(right));
             
         case TokenType::MODULO:
@@ -478,7 +593,7 @@ bool SemanticAnalyzer::canCoerce(DataType from, DataType to) {
 void SemanticAnalyzer::checkMainFunction(Program* program) {
     bool hasMain = false;
     for (const auto& func : program->functions) {
-        if (func->name.lexeme == "main" && 
+        if (func->name.text() == "main" && 
             func->returnType == DataType::INT && 
             func->parameters.empty()) {
             hasMain = true;
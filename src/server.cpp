@@ -0,0 +1,466 @@
+#include "../include/server.h"
+#include "../include/builtins.h"
+#include "../include/codegen.h"
+#include "../include/constant_folder.h"
+#include "../include/interpreter.h"
+#include "../include/parser.h"
+#include "../include/semantic.h"
+#include "../include/stats.h"
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    // FNV-1a over the level and the source
+    uint64_t programKey(const std::string& source, int level) {
+        uint64_t hash = 1469598103934665603ULL;
+        auto mix = [&](unsigned char byte) {
+            hash ^= byte;
+            hash *= 1099511628211ULL;
+        };
+        mix(static_cast<unsigned char>(level));
+        for (char c : source) mix(static_cast<unsigned char>(c));
+        return hash;
+    }
+
+    bool parseCount(const std::string& text, uint64_t& value) {
+        if (text.empty() || text.size() > 18 || text.find_first_not_of("0123456789") != std::string::npos) {
+            return false;
+        }
+        value = std::stoull(text);
+        return true;
+    }
+
+    void writeStrings(std::ostream& out, const std::vector<std::string>& strings) {
+        out << "[";
+        for (size_t i = 0; i < strings.size(); ++i) {
+            out << (i > 0 ? ", " : "") << "\"" << escapeJson(strings[i]) << "\"";
+        }
+        out << "]";
+    }
+
+    std::string failure(const std::string& id, const std::string& error) {
+        std::ostringstream out;
+        out << "{";
+        if (!id.empty()) out << "\"id\": \"" << escapeJson(id) << "\", ";
+        out << "\"success\": false, \"exitCode\": 1, \"output\": [], \"error\": \"" << escapeJson(error) << "\"}";
+        return out.str();
+    }
+
+#ifndef _WIN32
+    // A connected socket as a stream buffer, read and written in blocks
+    class SocketBuffer : public std::streambuf {
+    public:
+        explicit SocketBuffer(int fd) : fd(fd), input(kBlock), output(kBlock) {
+            setg(input.data(), input.data(), input.data());
+            setp(output.data(), output.data() + output.size());
+        }
+        ~SocketBuffer() override { flush(); }
+
+    protected:
+        int_type underflow() override {
+            ssize_t received;
+            do {
+                received = ::read(fd, input.data(), input.size());
+            } while (received < 0 && errno == EINTR);
+            if (received <= 0) return traits_type::eof();
+            setg(input.data(), input.data(), input.data() + received);
+            return traits_type::to_int_type(input[0]);
+        }
+
+        int_type overflow(int_type c) override {
+            if (!flush()) return traits_type::eof();
+            if (!traits_type::eq_int_type(c, traits_type::eof())) {
+                *pptr() = traits_type::to_char_type(c);
+                pbump(1);
+            }
+            return traits_type::not_eof(c);
+        }
+
+        int sync() override { return flush() ? 0 : -1; }
+
+    private:
+        static constexpr size_t kBlock = 1 << 16;
+
+        int fd;
+        std::vector<char> input;
+        std::vector<char> output;
+
+        bool flush() {
+            const char* next = pbase();
+            while (next < pptr()) {
+                ssize_t sent = ::write(fd, next, static_cast<size_t>(pptr() - next));
+                if (sent < 0 && errno == EINTR) continue;
+                if (sent <= 0) return false;
+                next += sent;
+            }
+            setp(output.data(), output.data() + output.size());
+            return true;
+        }
+    };
+#endif
+}
+
+CompileServer::CompileServer(Options options) : options(std::move(options)), pool(this->options.threads) {}
+
+CompileServer::~CompileServer() {
+    {
+        std::lock_guard<std::mutex> lock(watchMutex);
+        stopping = true;
+    }
+    watchSignal.notify_one();
+    if (watchdog.joinable()) watchdog.join();
+}
+
+void CompileServer::serve(std::istream& in, std::ostream& out) {
+    session(in, out);
+}
+
+bool CompileServer::listen(const std::string& path, std::string& error) {
+#ifdef _WIN32
+    (void)path;
+    error = "Unix sockets are not available on this platform";
+    return false;
+#else
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+        error = "Invalid socket path '" + path + "'";
+        return false;
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size());
+
+    int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        error = std::string("Could not create a socket: ") + std::strerror(errno);
+        return false;
+    }
+    ::unlink(path.c_str());
+    if (::bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 ||
+        ::listen(listener, 16) != 0) {
+        error = "Could not listen on '" + path + "': " + std::strerror(errno);
+        ::close(listener);
+        return false;
+    }
+    // A client that hangs up early must not take the server with it
+    std::signal(SIGPIPE, SIG_IGN);
+
+    Outcome outcome = Outcome::CONTINUE;
+    while (outcome != Outcome::SHUTDOWN) {
+        int client = ::accept(listener, nullptr, nullptr);
+        if (client < 0) {
+            if (errno == EINTR) continue;
+            error = std::string("Could not accept a connection: ") + std::strerror(errno);
+            break;
+        }
+        {
+            SocketBuffer buffer(client);
+            std::istream in(&buffer);
+            std::ostream out(&buffer);
+            outcome = session(in, out);
+        }
+        ::close(client);
+    }
+    ::close(listener);
+    ::unlink(path.c_str());
+    return error.empty();
+#endif
+}
+
+CompileServer::Outcome CompileServer::session(std::istream& in, std::ostream& out) {
+    std::string line;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.find_first_not_of(" \t") == std::string::npos) continue;
+
+        Request request;
+        std::string error;
+        bool lost = false;
+        if (!readRequest(in, line, request, error, lost)) {
+            out << failure(request.id, "Request error: " + error) << std::endl;
+            if (lost) return Outcome::QUIT;
+            continue;
+        }
+        if (request.verb == "quit") return Outcome::QUIT;
+        if (request.verb == "shutdown") return Outcome::SHUTDOWN;
+        out << answer(request) << std::endl;
+    }
+    return Outcome::QUIT;
+}
+
+bool CompileServer::readRequest(std::istream& in, const std::string& line, Request& request, std::string& error,
+                                bool& lost) const {
+    std::istringstream words(line);
+    words >> request.verb;
+    std::vector<std::pair<std::string, std::string>> fields;
+    std::string word;
+    while (words >> word) {
+        size_t equals = word.find('=');
+        if (equals == std::string::npos) {
+            fields.emplace_back(word, "");
+        } else {
+            fields.emplace_back(word.substr(0, equals), word.substr(equals + 1));
+        }
+        if (fields.back().first == "id") request.id = fields.back().second;
+    }
+
+    // The payload first, so that a request with a bad field is still read
+    // through to its end
+    for (const auto& field : fields) {
+        if (field.first != "source" && field.first != "input") continue;
+        uint64_t size = 0;
+        if (!parseCount(field.second, size)) {
+            error = "Invalid length '" + field.second + "' for " + field.first;
+            lost = true;
+            return false;
+        }
+        std::string& payload = field.first == "source" ? request.source : request.input;
+        payload.resize(size);
+        if (size > 0 && !in.read(&payload[0], static_cast<std::streamsize>(size))) {
+            error = "Connection ended inside the " + field.first;
+            lost = true;
+            return false;
+        }
+    }
+
+    if (request.verb != "run" && request.verb != "compile" && request.verb != "check" && request.verb != "stats" &&
+        request.verb != "quit" && request.verb != "shutdown") {
+        error = "Unknown request '" + request.verb + "'";
+        return false;
+    }
+
+    request.engine = options.engine;
+    request.level = options.optimizationLevel;
+    request.timeoutMs = options.timeoutMs;
+    for (const auto& field : fields) {
+        const std::string& key = field.first;
+        const std::string& value = field.second;
+        if (key == "source" || key == "input" || key == "id") {
+            continue;
+        } else if (key == "engine") {
+            if (value != "interp" && value != "vm") {
+                error = "Unknown engine '" + value + "' (expected interp or vm)";
+                return false;
+            }
+            request.engine = value;
+        } else if (key == "O") {
+            if (value.size() != 1 || value[0] < '0' || value[0] > '3') {
+                error = "Invalid optimization level '" + value + "'";
+                return false;
+            }
+            request.level = value[0] - '0';
+        } else if (key == "timeout") {
+            if (!parseCount(value, request.timeoutMs)) {
+                error = "Invalid timeout '" + value + "'";
+                return false;
+            }
+        } else {
+            error = "Unknown field '" + key + "'";
+            return false;
+        }
+    }
+
+    return true;
+}
+
+std::string CompileServer::answer(const Request& request) {
+    auto start = std::chrono::steady_clock::now();
+    ++counters.requests;
+    std::ostringstream out;
+
+    if (request.verb == "stats") {
+        out << "{\"requests\": " << counters.requests << ", \"programs\": " << programs.size()
+            << ", \"capacity\": " << options.programCapacity << ", \"hits\": " << counters.hits
+            << ", \"misses\": " << counters.misses << ", \"evictions\": " << counters.evictions
+            << ", \"timeouts\": " << counters.timeouts << "}";
+        return out.str();
+    }
+
+    bool cached = false;
+    CompiledProgram& entry = lookup(request.source, request.level, cached);
+    Interpreter::ExecutionResult result;
+    bool timedOut = false;
+
+    if (!entry.valid) {
+        result.exitCode = 1;
+        result.errorMessage = "Compilation failed";
+    } else if (request.verb == "check") {
+        result.success = true;
+    } else {
+        std::istringstream input(request.input);
+        Builtins::redirectInput(input, nullptr);
+        const std::atomic<bool>* flag = nullptr;
+        if (request.verb == "run" && request.timeoutMs > 0) {
+            arm(request.timeoutMs);
+            flag = &interrupted;
+        }
+        try {
+            if (request.engine == "vm") {
+                const std::shared_ptr<const BytecodeModule>& module = bytecode(entry);
+                if (request.verb == "run") {
+                    VirtualMachine vm(module);
+                    vm.setThreadPool(&pool);
+                    if (entry.memo) vm.setMemoCache(entry.memo.get());
+                    vm.setInterrupt(flag);
+                    result = vm.run();
+                } else {
+                    result.success = true;
+                }
+            } else if (request.verb == "run") {
+                Interpreter interpreter(entry.program.get());
+                interpreter.setThreadPool(&pool);
+                if (entry.memo) interpreter.setMemoCache(entry.memo.get());
+                interpreter.setInterrupt(flag);
+                result = interpreter.run();
+            } else {
+                result.success = true;
+            }
+        } catch (const std::exception& e) {
+            result.success = false;
+            result.errorMessage = e.what();
+        }
+        if (flag) {
+            disarm();
+            if (!result.success && interrupted.load()) {
+                timedOut = true;
+                ++counters.timeouts;
+                result.errorMessage = "Runtime error: Timed out after " + std::to_string(request.timeoutMs) + " ms";
+            }
+        }
+        Builtins::redirectInput(std::cin, &std::cout);
+        if (!result.success && result.exitCode == 0) result.exitCode = 1;
+    }
+
+    double milliseconds =
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    out << "{";
+    if (!request.id.empty()) out << "\"id\": \"" << escapeJson(request.id) << "\", ";
+    out << "\"success\": " << (result.success ? "true" : "false") << ", \"exitCode\": " << result.exitCode
+        << ", \"output\": ";
+    writeStrings(out, result.outputLog);
+    out << ", \"error\": \"" << escapeJson(result.errorMessage) << "\", \"diagnostics\": ";
+    writeStrings(out, entry.diagnostics);
+    out << ", \"cached\": " << (cached ? "true" : "false") << ", \"timedOut\": " << (timedOut ? "true" : "false")
+        << ", \"ms\": " << milliseconds << "}";
+    return out.str();
+}
+
+CompileServer::CompiledProgram& CompileServer::lookup(const std::string& source, int level, bool& cached) {
+    uint64_t key = programKey(source, level);
+    auto it = index.find(key);
+    if (it != index.end()) {
+        if (it->second->source == source && it->second->level == level) {
+            programs.splice(programs.end(), programs, it->second);
+            ++counters.hits;
+            cached = true;
+            return programs.back();
+        }
+        // Another source with the same hash gives up its place
+        programs.erase(it->second);
+        index.erase(it);
+    }
+
+    ++counters.misses;
+    cached = false;
+    while (!programs.empty() && programs.size() >= options.programCapacity) {
+        index.erase(programs.front().key);
+        programs.pop_front();
+        ++counters.evictions;
+    }
+    programs.emplace_back();
+    CompiledProgram& entry = programs.back();
+    entry.key = key;
+    entry.source = source;
+    entry.level = level;
+    compile(entry);
+    index[key] = std::prev(programs.end());
+    return entry;
+}
+
+void CompileServer::compile(CompiledProgram& entry) const {
+    Lexer lexer(entry.source);
+    Parser parser(lexer);
+    try {
+        entry.program = parser.parse();
+    } catch (const LexicalError& e) {
+        entry.diagnostics.push_back(std::string("Lexical error: ") + e.what());
+        return;
+    } catch (const std::exception& e) {
+        entry.diagnostics.push_back(std::string("Parse Error: ") + e.what());
+        return;
+    }
+    if (!entry.program) {
+        entry.diagnostics.push_back("Parse Error: " + parser.error());
+        return;
+    }
+
+    SemanticAnalyzer semantic;
+    entry.valid = semantic.analyze(entry.program.get());
+    for (const auto& warning : semantic.getWarnings()) entry.diagnostics.push_back(warning);
+    for (const auto& error : semantic.getErrors()) entry.diagnostics.push_back(error);
+    if (!entry.valid) return;
+
+    if (entry.level > 0) {
+        ConstantFolder folder;
+        folder.fold(entry.program.get());
+    }
+    if (options.memoize) entry.memo.reset(new MemoCache(options.memoSize, options.memoEviction));
+}
+
+const std::shared_ptr<const BytecodeModule>& CompileServer::bytecode(CompiledProgram& entry) const {
+    if (entry.bytecode) return entry.bytecode;
+
+    CodeGenerator codegen;
+    TacModule code = codegen.generate(entry.program.get());
+    Optimizer optimizer(code, entry.level);
+    bool anyPass = false;
+    for (const auto& choice : options.passOverrides) {
+        optimizer.setPassEnabled(choice.first, choice.second);
+    }
+    for (size_t p = 0; p < static_cast<size_t>(Optimizer::Pass::COUNT); ++p) {
+        anyPass = anyPass || optimizer.isPassEnabled(static_cast<Optimizer::Pass>(p));
+    }
+    if (anyPass) code = optimizer.optimize();
+
+    BytecodeCompiler compiler;
+    entry.bytecode = std::make_shared<const BytecodeModule>(compiler.compile(code, entry.program.get()));
+    return entry.bytecode;
+}
+
+void CompileServer::arm(uint64_t milliseconds) {
+    std::lock_guard<std::mutex> lock(watchMutex);
+    if (!watchdog.joinable()) watchdog = std::thread(&CompileServer::watch, this);
+    interrupted.store(false);
+    deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(milliseconds);
+    armed = true;
+    watchSignal.notify_one();
+}
+
+void CompileServer::disarm() {
+    std::lock_guard<std::mutex> lock(watchMutex);
+    armed = false;
+    watchSignal.notify_one();
+}
+
+void CompileServer::watch() {
+    std::unique_lock<std::mutex> lock(watchMutex);
+    while (!stopping) {
+        if (!armed) {
+            watchSignal.wait(lock);
+        } else if (std::chrono::steady_clock::now() >= deadline) {
+            interrupted.store(true);
+            armed = false;
+        } else {
+            watchSignal.wait_until(lock, deadline);
+        }
+    }
+}
@@ -0,0 +1,603 @@
+#include "../include/ssa.h"
+#include "../include/operators.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+namespace {
+    uint64_t edgeKey(uint32_t from, uint32_t to) {
+        return (static_cast<uint64_t>(from) << 32) | to;
+    }
+
+    bool isBranch(TacOp op) {
+        return op == TacOp::IF || op == TacOp::IF_FALSE;
+    }
+}
+
+SsaOptimizer::Stats SsaOptimizer::run() {
+    stats.instructionsRemoved += cfg.removeUnreachable();
+    buildSsa();
+    propagateConstants();
+
+    std::vector<std::vector<bool>> removed(cfg.blocks.size());
+    for (uint32_t b = 0; b < cfg.blocks.size(); ++b) {
+        removed[b].assign(cfg.blocks[b].code.size(), false);
+    }
+    rewrite(removed);
+    compact(removed);
+    cfg.computeEdges();
+    eliminateDeadCode();
+    stats.instructionsRemoved += cfg.removeUnreachable();
+    stats.instructionsRemoved += cfg.removeJumpsToNext();
+    return stats;
+}
+
+bool SsaOptimizer::definesResult(TacOp op) {
+    return op == TacOp::ASSIGN || op == TacOp::NEW_SEQ || op == TacOp::CALL ||
+           isBinaryTacOp(op) || op == TacOp::NEG || op == TacOp::NOT;
+}
+
+bool SsaOptimizer::readsArg(TacOp op, int k) {
+    if (k == 1) return isBinaryTacOp(op);
+    return op != TacOp::LABEL && op != TacOp::GOTO && op != TacOp::CALL && op != TacOp::NEW_SEQ;
+}
+
+bool SsaOptimizer::versioned(Operand operand) const {
+    return operand.isValue() && !unversioned.count(operand);
+}
+
+// --- SSA construction ---
+
+void SsaOptimizer::buildSsa() {
+    for (const auto& block : cfg.blocks) {
+        for (const auto& instr : block.code) {
+            if (instr.op == TacOp::STORE || instr.op == TacOp::APPEND || instr.op == TacOp::EXTEND) {
+                unversioned.insert(instr.result);
+            }
+        }
+    }
+
+    info.resize(cfg.blocks.size());
+    for (uint32_t b = 0; b < cfg.blocks.size(); ++b) {
+        info[b].resize(cfg.blocks[b].code.size());
+    }
+    phis.resize(cfg.blocks.size());
+
+    std::vector<uint32_t> order = cfg.reversePostorder();
+    std::vector<uint32_t> idom = cfg.immediateDominators(order);
+    placePhis(cfg.dominanceFrontiers(idom));
+    rename(idom);
+}
+
+void SsaOptimizer::placePhis(const std::vector<std::vector<uint32_t>>& frontiers) {
+    // Definition sites per name, in first-definition order so phis come
+    // out in a stable order
+    std::unordered_map<Operand, uint32_t, OperandHash> nameIds;
+    std::vector<Operand> names;
+    std::vector<std::vector<uint32_t>> sites;
+    for (uint32_t b = 0; b < cfg.blocks.size(); ++b) {
+        for (const auto& instr : cfg.blocks[b].code) {
+            if (!definesResult(instr.op) || !versioned(instr.result)) continue;
+            auto inserted = nameIds.emplace(instr.result, static_cast<uint32_t>(names.size()));
+            if (inserted.second) {
+                names.push_back(instr.result);
+                sites.emplace_back();
+            }
+            auto& blocks = sites[inserted.first->second];
+            if (blocks.empty() || blocks.back() != b) blocks.push_back(b);
+        }
+    }
+
+    // Stamped with the name being placed, so neither needs clearing
+    std::vector<uint32_t> hasPhi(cfg.blocks.size(), UINT32_MAX);
+    std::vector<uint32_t> queued(cfg.blocks.size(), UINT32_MAX);
+    for (uint32_t n = 0; n < names.size(); ++n) {
+        // Minimal rather than pruned SSA: a phi nobody reads only costs
+        // memory, and DCE never sees it as live
+        std::vector<uint32_t> work = sites[n];
+        for (uint32_t b : work) queued[b] = n;
+        while (!work.empty()) {
+            uint32_t b = work.back();
+            work.pop_back();
+            for (uint32_t d : frontiers[b]) {
+                if (hasPhi[d] == n) continue;
+                hasPhi[d] = n;
+                phis[d].push_back(Phi{names[n], kNoValue, {}});
+                if (queued[d] != n) {
+                    queued[d] = n;
+                    work.push_back(d);
+                }
+            }
+        }
+    }
+}
+
+uint32_t SsaOptimizer::newValue(Operand base, uint32_t block, int32_t index, bool phi) {
+    uint32_t id = static_cast<uint32_t>(values.size());
+    values.push_back(Value{base, block, index, phi, false});
+    copySource.push_back(kNoValue);
+    return id;
+}
+
+uint32_t SsaOptimizer::current(Operand base) {
+    auto& stack = stacks[base];
+    if (!stack.empty()) return stack.back();
+    auto it = entryValues.find(base);
+    if (it != entryValues.end()) return it->second;
+    uint32_t id = newValue(base, 0, -1, false);
+    values[id].entry = true;
+    entryValues.emplace(base, id);
+    return id;
+}
+
+uint32_t SsaOptimizer::copyCandidate(uint32_t value) {
+    // Walk back through copies; the further source is usable as long as
+    // its name still holds it here
+    uint32_t best = kNoValue;
+    for (uint32_t source = copySource[value]; source != kNoValue; source = copySource[source]) {
+        if (current(values[source].base) == source) best = source;
+    }
+    return best;
+}
+
+void SsaOptimizer::rename(const std::vector<uint32_t>& idom) {
+    std::vector<std::vector<uint32_t>> children(cfg.blocks.size());
+    for (uint32_t b = 1; b < cfg.blocks.size(); ++b) {
+        if (idom[b] != UINT32_MAX) children[idom[b]].push_back(b);
+    }
+
+    struct Frame {
+        uint32_t block;
+        size_t child;
+        size_t pushed;  // Size of `defined` on entry
+    };
+    std::vector<Operand> defined;  // Names pushed, to pop on the way out
+    std::vector<Frame> frames;
+
+    auto enter = [&](uint32_t b) {
+        frames.push_back(Frame{b, 0, defined.size()});
+        for (uint32_t p = 0; p < phis[b].size(); ++p) {
+            Phi& phi = phis[b][p];
+            phi.value = newValue(phi.base, b, static_cast<int32_t>(p), true);
+            stacks[phi.base].push_back(phi.value);
+            defined.push_back(phi.base);
+        }
+
+        auto& code = cfg.blocks[b].code;
+        for (uint32_t i = 0; i < code.size(); ++i) {
+            const ThreeAddressCode& instr = code[i];
+            InstrValues& iv = info[b][i];
+            for (int k = 0; k < 2; ++k) {
+                Operand operand = k == 0 ? instr.arg1 : instr.arg2;
+                if (!readsArg(instr.op, k) || !versioned(operand)) continue;
+                iv.uses[k] = current(operand);
+                iv.copies[k] = copyCandidate(iv.uses[k]);
+            }
+            if (definesResult(instr.op) && versioned(instr.result)) {
+                iv.def = newValue(instr.result, b, static_cast<int32_t>(i), false);
+                if (instr.op == TacOp::ASSIGN) copySource[iv.def] = iv.uses[0];
+                stacks[instr.result].push_back(iv.def);
+                defined.push_back(instr.result);
+            }
+        }
+
+        for (uint32_t successor : cfg.blocks[b].successors) {
+            for (Phi& phi : phis[successor]) {
+                phi.args.emplace_back(b, current(phi.base));
+            }
+        }
+    };
+
+    enter(0);
+    while (!frames.empty()) {
+        Frame& top = frames.back();
+        if (top.child < children[top.block].size()) {
+            enter(children[top.block][top.child++]);
+            continue;
+        }
+        while (defined.size() > top.pushed) {
+            stacks[defined.back()].pop_back();
+            defined.pop_back();
+        }
+        frames.pop_back();
+    }
+}
+
+// --- Sparse conditional constant propagation ---
+
+void SsaOptimizer::propagateConstants() {
+    lattice.assign(values.size(), Lattice());
+    users.assign(values.size(), {});
+    for (uint32_t v = 0; v < values.size(); ++v) {
+        if (values[v].entry) lattice[v].state = Lattice::BOTTOM;
+    }
+    for (uint32_t b = 0; b < cfg.blocks.size(); ++b) {
+        for (uint32_t p = 0; p < phis[b].size(); ++p) {
+            for (const auto& arg : phis[b][p].args) users[arg.second].push_back(User{b, p, true});
+        }
+        for (uint32_t i = 0; i < info[b].size(); ++i) {
+            const InstrValues& iv = info[b][i];
+            for (uint32_t use : iv.uses) {
+                if (use != kNoValue) users[use].push_back(User{b, i, false});
+            }
+        }
+    }
+
+    blockExecutable.assign(cfg.blocks.size(), false);
+    std::vector<std::pair<uint32_t, uint32_t>> flowWork;
+    std::vector<uint32_t> ssaWork;
+
+    auto visitBlock = [&](uint32_t b) {
+        for (uint32_t p = 0; p < phis[b].size(); ++p) visitPhi(b, p, ssaWork);
+        for (uint32_t i = 0; i < cfg.blocks[b].code.size(); ++i) visitInstruction(b, i, ssaWork, flowWork);
+        visitTerminator(b, flowWork);
+    };
+
+    blockExecutable[0] = true;
+    visitBlock(0);
+    while (!flowWork.empty() || !ssaWork.empty()) {
+        while (!flowWork.empty()) {
+            auto edge = flowWork.back();
+            flowWork.pop_back();
+            if (!edgeExecutable.insert(edgeKey(edge.first, edge.second)).second) continue;
+            uint32_t b = edge.second;
+            if (!blockExecutable[b]) {
+                blockExecutable[b] = true;
+                visitBlock(b);
+            } else {
+                // Only the phis can see a new edge
+                for (uint32_t p = 0; p < phis[b].size(); ++p) visitPhi(b, p, ssaWork);
+            }
+        }
+        while (!ssaWork.empty()) {
+            uint32_t v = ssaWork.back();
+            ssaWork.pop_back();
+            for (const User& user : users[v]) {
+                if (!blockExecutable[user.block]) continue;
+                if (user.phi) {
+                    visitPhi(user.block, user.index, ssaWork);
+                } else {
+                    visitInstruction(user.block, user.index, ssaWork, flowWork);
+                }
+            }
+        }
+    }
+}
+
+SsaOptimizer::Lattice SsaOptimizer::operandValue(Operand operand, uint32_t value) const {
+    Lattice result;
+    if (operand.isConstant()) {
+        result.state = Lattice::CONSTANT;
+        result.constant = operand;
+    } else if (value != kNoValue) {
+        result = lattice[value];
+    } else {
+        result.state = Lattice::BOTTOM;
+    }
+    return result;
+}
+
+void SsaOptimizer::lower(uint32_t value, const Lattice& result, std::vector<uint32_t>& ssaWork) {
+    Lattice& old = lattice[value];
+    Lattice merged = old;
+    if (old.state == Lattice::TOP) {
+        merged = result;
+    } else if (old.state == Lattice::CONSTANT) {
+        if (result.state == Lattice::BOTTOM ||
+            (result.state == Lattice::CONSTANT && result.constant != old.constant)) {
+            merged.state = Lattice::BOTTOM;
+        }
+    }
+    if (merged.state != old.state) {
+        old = merged;
+        ssaWork.push_back(value);
+    }
+}
+
+void SsaOptimizer::visitPhi(uint32_t block, uint32_t index, std::vector<uint32_t>& ssaWork) {
+    const Phi& phi = phis[block][index];
+    Lattice result;
+    for (const auto& arg : phi.args) {
+        if (!edgeExecutable.count(edgeKey(arg.first, block))) continue;
+        const Lattice& value = lattice[arg.second];
+        if (value.state == Lattice::TOP) continue;
+        if (value.state == Lattice::BOTTOM ||
+            (result.state == Lattice::CONSTANT && result.constant != value.constant)) {
+            result.state = Lattice::BOTTOM;
+            break;
+        }
+        result = value;
+    }
+    lower(phi.value, result, ssaWork);
+}
+
+void SsaOptimizer::visitInstruction(uint32_t block, uint32_t index, std::vector<uint32_t>& ssaWork,
+                                    std::vector<std::pair<uint32_t, uint32_t>>& flowWork) {
+    const ThreeAddressCode& instr = cfg.blocks[block].code[index];
+    const InstrValues& iv = info[block][index];
+    if (iv.def != kNoValue) {
+        lower(iv.def, evaluate(instr, iv), ssaWork);
+    } else if (isBranch(instr.op)) {
+        visitTerminator(block, flowWork);
+    }
+}
+
+void SsaOptimizer::visitTerminator(uint32_t block, std::vector<std::pair<uint32_t, uint32_t>>& flowWork) {
+    const BasicBlock& b = cfg.blocks[block];
+    if (!b.code.empty() && isBranch(b.code.back().op)) {
+        const ThreeAddressCode& branch = b.code.back();
+        Lattice condition = operandValue(branch.arg1, info[block].back().uses[0]);
+        if (condition.state == Lattice::TOP) return;
+        if (condition.state == Lattice::CONSTANT &&
+            module.constant(condition.constant).kind == TacConstant::Kind::BOOL) {
+            bool taken = (module.constant(condition.constant).intValue != 0) == (branch.op == TacOp::IF);
+            int32_t next = taken ? b.target : b.fallthrough;
+            if (next >= 0) flowWork.emplace_back(block, next);
+            return;
+        }
+    }
+    for (uint32_t successor : b.successors) flowWork.emplace_back(block, successor);
+}
+
+SsaOptimizer::Lattice SsaOptimizer::evaluate(const ThreeAddressCode& instr, const InstrValues& iv) {
+    Lattice result;
+    result.state = Lattice::BOTTOM;
+    bool binary = isBinaryTacOp(instr.op);
+    if (instr.op == TacOp::ASSIGN) return operandValue(instr.arg1, iv.uses[0]);
+    if (!binary && instr.op != TacOp::NEG && instr.op != TacOp::NOT) return result;
+
+    Lattice left = operandValue(instr.arg1, iv.uses[0]);
+    Lattice right = binary ? operandValue(instr.arg2, iv.uses[1]) : left;
+    if (left.state == Lattice::BOTTOM || right.state == Lattice::BOTTOM) return result;
+    if (left.state == Lattice::TOP || right.state == Lattice::TOP) {
+        result.state = Lattice::TOP;
+        return result;
+    }
+
+    Operand folded;
+    bool ok = binary ? fold(instr.op, module.constant(left.constant), module.constant(right.constant), folded)
+                     : foldUnary(instr.op, module.constant(left.constant), folded);
+    if (ok) {
+        result.state = Lattice::CONSTANT;
+        result.constant = folded;
+    }
+    return result;
+}
+
+// Folds only what the VM would compute the same way and without raising:
+// no result beyond 64 bits, no division by zero, finite float results, and no operator
+// applied to a kind it rejects or silently converts.
+bool SsaOptimizer::fold(TacOp op, const TacConstant& left, const TacConstant& right, Operand& result) {
+    using Kind = TacConstant::Kind;
+    bool ints = left.kind == Kind::INT && right.kind == Kind::INT;
+    bool numbers = (left.kind == Kind::INT || left.kind == Kind::FLOAT) &&
+                   (right.kind == Kind::INT || right.kind == Kind::FLOAT);
+    bool bools = left.kind == Kind::BOOL && right.kind == Kind::BOOL;
+    auto asDouble = [](const TacConstant& c) {
+        return c.kind == Kind::FLOAT ? c.floatValue : static_cast<double>(c.intValue);
+    };
+
+    switch (op) {
+        case TacOp::ADD:
+        case TacOp::SUB:
+        case TacOp::MUL:
+        case TacOp::DIV: {
+            if (!numbers) return false;
+            if (ints) {
+                long long value = 0;
+                if (!Operators::checkedInteger(op, left.intValue, right.intValue, value)) return false;
+                result = module.intConstant(value);
+                return true;
+            }
+            double l = asDouble(left), r = asDouble(right), value = 0.0;
+            switch (op) {
+                case TacOp::ADD: value = l + r; break;
+                case TacOp::SUB: value = l - r; break;
+                case TacOp::MUL: value = l * r; break;
+                default: value = l / r; break;
+            }
+            if (!std::isfinite(value)) return false;
+            result = module.floatConstant(value);
+            return true;
+        }
+        case TacOp::MOD: {
+            long long value = 0;
+            if (!ints || !Operators::checkedInteger(op, left.intValue, right.intValue, value)) return false;
+            result = module.intConstant(value);
+            return true;
+        }
+        case TacOp::EQ:
+        case TacOp::NE:
+            if (!ints && !bools) return false;
+            result = module.boolConstant((left.intValue == right.intValue) == (op == TacOp::EQ));
+            return true;
+        case TacOp::LT:
+        case TacOp::LE:
+        case TacOp::GT:
+        case TacOp::GE: {
+            if (!numbers) return false;
+            bool value;
+            if (ints) {
+                long long l = left.intValue, r = right.intValue;
+                value = op == TacOp::LT ? l < r : op == TacOp::LE ? l <= r : op == TacOp::GT ? l > r : l >= r;
+            } else {
+                double l = asDouble(left), r = asDouble(right);
+                value = op == TacOp::LT ? l < r : op == TacOp::LE ? l <= r : op == TacOp::GT ? l > r : l >= r;
+            }
+            result = module.boolConstant(value);
+            return true;
+        }
+        case TacOp::AND:
+        case TacOp::OR:
+            if (!bools) return false;
+            result = module.boolConstant(op == TacOp::AND ? left.intValue && right.intValue
+                                                          : left.intValue || right.intValue);
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool SsaOptimizer::foldUnary(TacOp op, const TacConstant& operand, Operand& result) {
+    using Kind = TacConstant::Kind;
+    if (op == TacOp::NOT) {
+        if (operand.kind != Kind::BOOL) return false;
+        result = module.boolConstant(operand.intValue == 0);
+        return true;
+    }
+    if (operand.kind == Kind::INT && operand.intValue != LLONG_MIN) {
+        result = module.intConstant(-operand.intValue);
+        return true;
+    }
+    if (operand.kind == Kind::FLOAT) {
+        result = module.floatConstant(-operand.floatValue);
+        return true;
+    }
+    return false;
+}
+
+// --- Rewriting and dead code elimination ---
+
+void SsaOptimizer::rewrite(std::vector<std::vector<bool>>& removed) {
+    defUses.assign(values.size(), Uses());
+    for (uint32_t b = 0; b < cfg.blocks.size(); ++b) {
+        auto& code = cfg.blocks[b].code;
+        for (uint32_t i = 0; i < code.size(); ++i) {
+            ThreeAddressCode& instr = code[i];
+            InstrValues& iv = info[b][i];
+
+            // Blocks SCCP never reached are left alone; unless something
+            // else jumps there, they go with the unreachable code
+            if (blockExecutable[b]) {
+                for (int k = 0; k < 2; ++k) {
+                    if (iv.uses[k] == kNoValue) continue;
+                    Operand& operand = k == 0 ? instr.arg1 : instr.arg2;
+                    const Lattice& value = lattice[iv.uses[k]];
+                    if (value.state == Lattice::CONSTANT) {
+                        operand = value.constant;
+                        iv.uses[k] = kNoValue;
+                        ++stats.constantsPropagated;
+                    } else if (iv.copies[k] != kNoValue) {
+                        operand = values[iv.copies[k]].base;
+                        iv.uses[k] = iv.copies[k];
+                        ++stats.copiesPropagated;
+                    }
+                }
+
+                if (iv.def != kNoValue && instr.op != TacOp::ASSIGN &&
+                    lattice[iv.def].state == Lattice::CONSTANT &&
+                    (isBinaryTacOp(instr.op) || instr.op == TacOp::NEG || instr.op == TacOp::NOT)) {
+                    instr = ThreeAddressCode(TacOp::ASSIGN, lattice[iv.def].constant, Operand(), instr.result, instr.line);
+                    iv.uses[0] = iv.uses[1] = kNoValue;
+                    ++stats.constantsPropagated;
+                }
+
+                if (isBranch(instr.op) && instr.arg1.isConstant() &&
+                    module.constant(instr.arg1).kind == TacConstant::Kind::BOOL) {
+                    bool taken = (module.constant(instr.arg1).intValue != 0) == (instr.op == TacOp::IF);
+                    if (taken) {
+                        instr = ThreeAddressCode(TacOp::GOTO, Operand(), Operand(), instr.result, instr.line);
+                    } else {
+                        removed[b][i] = true;
+                    }
+                    iv.uses[0] = kNoValue;
+                    ++stats.branchesFolded;
+                }
+            }
+
+            if (iv.def != kNoValue) {
+                defUses[iv.def].values[0] = iv.uses[0];
+                defUses[iv.def].values[1] = iv.uses[1];
+            }
+        }
+    }
+}
+
+void SsaOptimizer::compact(const std::vector<std::vector<bool>>& removed) {
+    for (uint32_t b = 0; b < cfg.blocks.size(); ++b) {
+        auto& code = cfg.blocks[b].code;
+        size_t kept = 0;
+        for (size_t i = 0; i < code.size(); ++i) {
+            if (removed[b][i]) continue;
+            code[kept] = code[i];
+            info[b][kept] = info[b][i];
+            ++kept;
+        }
+        code.resize(kept, ThreeAddressCode(TacOp::LABEL, Operand(), Operand(), Operand()));
+        info[b].resize(kept);
+    }
+}
+
+// Mark and sweep over SSA values: everything with an effect is live, and
+// so is whatever a live instruction or phi reads. Only copies and fresh
+// sequences whose value is never read are removed.
+void SsaOptimizer::eliminateDeadCode() {
+    std::vector<bool> reachable(cfg.blocks.size(), false);
+    std::vector<uint32_t> blockWork{0};
+    reachable[0] = true;
+    while (!blockWork.empty()) {
+        uint32_t b = blockWork.back();
+        blockWork.pop_back();
+        for (uint32_t successor : cfg.blocks[b].successors) {
+            if (!reachable[successor]) {
+                reachable[successor] = true;
+                blockWork.push_back(successor);
+            }
+        }
+    }
+
+    auto removable = [](const ThreeAddressCode& instr, const InstrValues& iv) {
+        return iv.def != kNoValue && (instr.op == TacOp::ASSIGN || instr.op == TacOp::NEW_SEQ);
+    };
+
+    std::vector<bool> live(values.size(), false);
+    std::vector<uint32_t> work;
+    auto mark = [&](uint32_t value) {
+        if (value == kNoValue || live[value]) return;
+        live[value] = true;
+        work.push_back(value);
+    };
+
+    for (uint32_t b = 0; b < cfg.blocks.size(); ++b) {
+        if (!reachable[b]) continue;
+        const auto& code = cfg.blocks[b].code;
+        for (uint32_t i = 0; i < code.size(); ++i) {
+            if (removable(code[i], info[b][i])) continue;
+            mark(info[b][i].uses[0]);
+            mark(info[b][i].uses[1]);
+            mark(info[b][i].def);
+        }
+    }
+
+    while (!work.empty()) {
+        uint32_t v = work.back();
+        work.pop_back();
+        const Value& value = values[v];
+        if (value.entry) continue;
+        if (value.phi) {
+            for (const auto& arg : phis[value.block][value.index].args) {
+                if (reachable[arg.first]) mark(arg.second);
+            }
+        } else {
+            mark(defUses[v].values[0]);
+            mark(defUses[v].values[1]);
+        }
+    }
+
+    for (uint32_t b = 0; b < cfg.blocks.size(); ++b) {
+        if (!reachable[b]) continue;
+        auto& code = cfg.blocks[b].code;
+        size_t kept = 0;
+        for (size_t i = 0; i < code.size(); ++i) {
+            if (removable(code[i], info[b][i]) && !live[info[b][i].def]) {
+                ++stats.instructionsRemoved;
+                continue;
+            }
+            code[kept] = code[i];
+            info[b][kept] = info[b][i];
+            ++kept;
+        }
+        code.resize(kept, ThreeAddressCode(TacOp::LABEL, Operand(), Operand(), Operand()));
+        info[b].resize(kept);
+    }
+}
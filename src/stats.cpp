@@ -0,0 +1,226 @@
+#include "../include/stats.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <iomanip>
+#include <new>
+#ifndef _WIN32
+#include <sys/resource.h>
+#include <time.h>
+#endif
+
+namespace {
+    std::atomic<bool> counting{false};
+    std::atomic<uint64_t> allocationCount{0};
+    std::atomic<uint64_t> allocationBytes{0};
+
+    void* allocate(std::size_t size) {
+        if (counting.load(std::memory_order_relaxed)) {
+            allocationCount.fetch_add(1, std::memory_order_relaxed);
+            allocationBytes.fetch_add(size, std::memory_order_relaxed);
+        }
+        if (size == 0) size = 1;
+        for (;;) {
+            if (void* memory = std::malloc(size)) return memory;
+            std::new_handler handler = std::get_new_handler();
+            if (!handler) throw std::bad_alloc();
+            handler();
+        }
+    }
+}
+
+std::string escapeJson(const std::string& text) {
+    std::string result;
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            result += '\\';
+            result += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escape[8];
+            std::snprintf(escape, sizeof(escape), "\\u%04x", static_cast<unsigned>(c));
+            result += escape;
+        } else {
+            result += c;
+        }
+    }
+    return result;
+}
+
+// The library's nothrow forms forward to these, so they are counted too;
+// over-aligned allocations are not
+void* operator new(std::size_t size) {
+    return allocate(size);
+}
+
+void* operator new[](std::size_t size) {
+    return allocate(size);
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void* memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+ResourceSample ResourceSample::now() {
+    ResourceSample sample;
+    sample.wallMs = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#ifndef _WIN32
+    timespec cpu;
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu) == 0) {
+        sample.cpuMs = static_cast<double>(cpu.tv_sec) * 1000.0 + static_cast<double>(cpu.tv_nsec) / 1e6;
+    }
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef __APPLE__
+        sample.peakRssKb = static_cast<uint64_t>(usage.ru_maxrss) / 1024;  // Bytes there
+#else
+        sample.peakRssKb = static_cast<uint64_t>(usage.ru_maxrss);
+#endif
+    }
+#else
+    sample.cpuMs = 1000.0 * static_cast<double>(std::clock()) / CLOCKS_PER_SEC;
+#endif
+    sample.allocations = allocationCount.load(std::memory_order_relaxed);
+    sample.allocatedBytes = allocationBytes.load(std::memory_order_relaxed);
+    return sample;
+}
+
+PhaseStats::PhaseStats(bool enabled) : active(enabled) {}
+
+void PhaseStats::countAllocations() {
+    counting.store(true, std::memory_order_relaxed);
+}
+
+void PhaseStats::begin(const std::string& phase) {
+    if (!active) return;
+    end();
+    phaseStart = ResourceSample::now();
+    if (phases.empty()) start = phaseStart;
+    Phase record;
+    record.name = phase;
+    phases.push_back(record);
+    inPhase = true;
+}
+
+void PhaseStats::end() {
+    if (!active || !inPhase) return;
+    finish = ResourceSample::now();
+    Phase& phase = phases.back();
+    phase.wallMs = finish.wallMs - phaseStart.wallMs;
+    phase.cpuMs = finish.cpuMs - phaseStart.cpuMs;
+    phase.peakRssKb = finish.peakRssKb;
+    phase.allocations = finish.allocations - phaseStart.allocations;
+    phase.allocatedBytes = finish.allocatedBytes - phaseStart.allocatedBytes;
+    inPhase = false;
+}
+
+void PhaseStats::setCounter(const std::string& key, const std::string& label, uint64_t value) {
+    if (!active) return;
+    for (auto& counter : counters) {
+        if (counter.key == key) {
+            counter.value = value;
+            return;
+        }
+    }
+    counters.push_back(Counter{key, label, value});
+}
+
+void PhaseStats::print(std::ostream& out, Format format, bool timesOnly) const {
+    if (!active || phases.empty()) return;
+    if (format == Format::JSON) {
+        printJson(out, timesOnly);
+    } else {
+        printText(out, timesOnly);
+    }
+}
+
+void PhaseStats::printText(std::ostream& out, bool timesOnly) const {
+    Phase total;
+    total.name = "total";
+    total.wallMs = finish.wallMs - start.wallMs;
+    total.cpuMs = finish.cpuMs - start.cpuMs;
+    total.peakRssKb = finish.peakRssKb;
+    total.allocations = finish.allocations - start.allocations;
+    total.allocatedBytes = finish.allocatedBytes - start.allocatedBytes;
+
+    out << (timesOnly ? "Phase Times:" : "Statistics:") << std::endl;
+    out << (timesOnly ? "============" : "===========") << std::endl;
+    out << std::left << std::setw(12) << "Phase" << std::right << std::setw(12) << "Wall ms" << std::setw(12)
+        << "CPU ms";
+    if (!timesOnly) {
+        out << std::setw(14) << "Peak RSS KB" << std::setw(14) << "Allocations" << std::setw(16) << "Bytes";
+    }
+    out << std::endl;
+
+    auto row = [&](const Phase& phase) {
+        out << std::left << std::setw(12) << phase.name << std::right << std::fixed << std::setprecision(3)
+            << std::setw(12) << phase.wallMs << std::setw(12) << phase.cpuMs << std::defaultfloat;
+        if (!timesOnly) {
+            out << std::setw(14) << phase.peakRssKb << std::setw(14) << phase.allocations << std::setw(16)
+                << phase.allocatedBytes;
+        }
+        out << std::endl;
+    };
+    for (const auto& phase : phases) row(phase);
+    row(total);
+
+    if (!timesOnly && !counters.empty()) {
+        out << std::endl;
+        for (const auto& counter : counters) {
+            out << counter.label << ": " << counter.value << std::endl;
+        }
+    }
+    out << std::endl;
+}
+
+void PhaseStats::printJson(std::ostream& out, bool timesOnly) const {
+    auto number = [&](double value) {
+        out << std::fixed << std::setprecision(3) << value << std::defaultfloat;
+    };
+
+    out << "{\"phases\": [";
+    for (size_t i = 0; i < phases.size(); ++i) {
+        const Phase& phase = phases[i];
+        out << (i > 0 ? ", " : "") << "{\"name\": \"" << escapeJson(phase.name) << "\", \"wall_ms\": ";
+        number(phase.wallMs);
+        out << ", \"cpu_ms\": ";
+        number(phase.cpuMs);
+        if (!timesOnly) {
+            out << ", \"peak_rss_kb\": " << phase.peakRssKb << ", \"allocations\": " << phase.allocations
+                << ", \"allocated_bytes\": " << phase.allocatedBytes;
+        }
+        out << "}";
+    }
+    out << "], \"total\": {\"wall_ms\": ";
+    number(finish.wallMs - start.wallMs);
+    out << ", \"cpu_ms\": ";
+    number(finish.cpuMs - start.cpuMs);
+    if (!timesOnly) {
+        out << ", \"peak_rss_kb\": " << finish.peakRssKb << ", \"allocations\": "
+            << finish.allocations - start.allocations << ", \"allocated_bytes\": "
+            << finish.allocatedBytes - start.allocatedBytes;
+    }
+    out << "}";
+    if (!timesOnly) {
+        out << ", \"counters\": {";
+        for (size_t i = 0; i < counters.size(); ++i) {
+            out << (i > 0 ? ", " : "") << "\"" << escapeJson(counters[i].key) << "\": " << counters[i].value;
+        }
+        out << "}";
+    }
+    out << "}" << std::endl;
+}
@@ -0,0 +1,164 @@
+#include "../include/tac.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+const char* tacOpSymbol(TacOp op) {
+    switch (op) {
+        case TacOp::ADD: return "+";
+        case TacOp::SUB: return "-";
+        case TacOp::MUL: return "*";
+        case TacOp::DIV: return "/";
+        case TacOp::MOD: return "%";
+        case TacOp::EQ: return "==";
+        case TacOp::NE: return "!=";
+        case TacOp::LT: return "<";
+        case TacOp::LE: return "<=";
+        case TacOp::GT: return ">";
+        case TacOp::GE: return ">=";
+        case TacOp::AND: return "&&";
+        case TacOp::OR: return "||";
+        case TacOp::NEG: return "-";
+        case TacOp::NOT: return "!";
+        case TacOp::STORE: return "STORE";
+        default: return "?";
+    }
+}
+
+bool isBinaryTacOp(TacOp op) {
+    return op >= TacOp::ADD && op <= TacOp::OR;
+}
+
+std::string formatFloatLiteral(double value) {
+    char buffer[32];
+    for (int precision = 1; precision <= 17; ++precision) {
+        std::snprintf(buffer, sizeof(buffer), "%.*g", precision, value);
+        if (std::strtod(buffer, nullptr) == value) break;
+    }
+    std::string text = buffer;
+    if (text.find('.') == std::string::npos) {
+        size_t exponent = text.find('e');
+        text.insert(exponent == std::string::npos ? text.size() : exponent, ".0");
+    }
+    return text;
+}
+
+uint32_t StringInterner::intern(const std::string& text) {
+    auto it = index.find(text);
+    if (it != index.end()) return it->second;
+    uint32_t id = static_cast<uint32_t>(strings.size());
+    strings.push_back(text);
+    index.emplace(text, id);
+    return id;
+}
+
+int64_t StringInterner::find(const std::string& text) const {
+    auto it = index.find(text);
+    return it == index.end() ? -1 : static_cast<int64_t>(it->second);
+}
+
+Operand TacModule::variable(const std::string& name) {
+    return Operand::make(Operand::Kind::VARIABLE, names.intern(name));
+}
+
+Operand TacModule::function(const std::string& name) {
+    return Operand::make(Operand::Kind::FUNCTION, names.intern(name));
+}
+
+Operand TacModule::addConstant(TacConstant constant, const std::string& key) {
+    auto it = constantIndex.find(key);
+    if (it != constantIndex.end()) {
+        return Operand::make(Operand::Kind::CONSTANT, it->second);
+    }
+    uint32_t id = static_cast<uint32_t>(constants.size());
+    constants.push_back(std::move(constant));
+    constantIndex.emplace(key, id);
+    return Operand::make(Operand::Kind::CONSTANT, id);
+}
+
+Operand TacModule::intConstant(long long value, const std::string& text) {
+    TacConstant constant{TacConstant::Kind::INT, value, 0.0, text};
+    return addConstant(std::move(constant), "i" + std::to_string(value));
+}
+
+Operand TacModule::floatConstant(double value, const std::string& text) {
+    // Keyed by bit pattern, so 0.0 and -0.0 stay distinct
+    uint64_t bits = 0;
+    std::memcpy(&bits, &value, sizeof(bits));
+    TacConstant constant{TacConstant::Kind::FLOAT, 0, value, text};
+    return addConstant(std::move(constant), "f" + std::to_string(bits));
+}
+
+Operand TacModule::boolConstant(bool value) {
+    TacConstant constant{TacConstant::Kind::BOOL, value ? 1 : 0, 0.0, value ? "true" : "false"};
+    return addConstant(std::move(constant), value ? "btrue" : "bfalse");
+}
+
+Operand TacModule::stringConstant(const std::string& value) {
+    TacConstant constant{TacConstant::Kind::STRING, 0, 0.0, value};
+    return addConstant(std::move(constant), "s" + value);
+}
+
+Operand TacModule::bigIntConstant(const std::string& digits) {
+    TacConstant constant{TacConstant::Kind::BIGINT, 0, 0.0, digits};
+    return addConstant(std::move(constant), "n" + digits);
+}
+
+bool TacModule::isIntConstant(Operand operand, long long value) const {
+    if (!operand.isConstant()) return false;
+    const TacConstant& constant = constants[operand.index()];
+    return constant.kind == TacConstant::Kind::INT && constant.intValue == value;
+}
+
+std::string TacModule::operandToString(Operand operand) const {
+    switch (operand.kind()) {
+        case Operand::Kind::NONE: return "";
+        case Operand::Kind::TEMP: return "t" + std::to_string(operand.index());
+        case Operand::Kind::LABEL: return "L" + std::to_string(operand.index());
+        case Operand::Kind::IMMEDIATE: return std::to_string(operand.index());
+        case Operand::Kind::VARIABLE:
+        case Operand::Kind::FUNCTION: return names.text(operand.index());
+        case Operand::Kind::CONSTANT: {
+            const TacConstant& constant = constants[operand.index()];
+            if (constant.kind == TacConstant::Kind::STRING) {
+                return "\"" + constant.text + "\"";
+            }
+            return constant.text;
+        }
+    }
+    return "";
+}
+
+std::string TacModule::toString(const ThreeAddressCode& instr) const {
+    std::string result = operandToString(instr.result);
+    std::string arg1 = operandToString(instr.arg1);
+    switch (instr.op) {
+        case TacOp::LABEL:
+            return result + ":";
+        case TacOp::GOTO:
+            return "goto " + result;
+        case TacOp::IF_FALSE:
+            return "ifFalse " + arg1 + " goto " + result;
+        case TacOp::IF:
+            return "if " + arg1 + " goto " + result;
+        case TacOp::PARAM:
+            return "param " + arg1;
+        case TacOp::CALL:
+            if (instr.arg2.empty()) {
+                return result + " = call " + arg1;
+            }
+            return result + " = call " + arg1 + ", " + operandToString(instr.arg2);
+        case TacOp::RETURN:
+            return instr.arg1.empty() ? "return" : "return " + arg1;
+        case TacOp::ASSIGN:
+            return result + " = " + arg1;
+        case TacOp::NEW_SEQ:
+            return result + " = []";
+        case TacOp::APPEND:
+            return "append " + result + ", " + arg1;
+        case TacOp::EXTEND:
+            return "extend " + result + ", " + arg1;
+        default:
+            return result + " = " + arg1 + " " + tacOpSymbol(instr.op) + " " + operandToString(instr.arg2);
+    }
+}
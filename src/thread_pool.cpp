@@ -0,0 +1,105 @@
+#include "../include/thread_pool.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool(size_t threads)
+    : threadCount(std::max<size_t>(threads, 1)) {
+    for (size_t i = 0; i < threadCount; ++i) {
+        queues.push_back(std::make_unique<WorkQueue>());
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+void ThreadPool::run(size_t count, const Task& task) {
+    if (threadCount == 1 || count <= 1) {
+        for (size_t i = 0; i < count; ++i) task(0, i);
+        return;
+    }
+
+    if (threads.empty()) {
+        for (size_t worker = 1; worker < threadCount; ++worker) {
+            threads.emplace_back(&ThreadPool::workerLoop, this, worker);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        current = &task;
+        remaining = count;
+        for (size_t worker = 0; worker < threadCount; ++worker) {
+            std::lock_guard<std::mutex> queueLock(queues[worker]->mutex);
+            size_t begin = count * worker / threadCount;
+            size_t end = count * (worker + 1) / threadCount;
+            for (size_t i = begin; i < end; ++i) {
+                queues[worker]->tasks.push_back(i);
+            }
+        }
+        ++generation;
+    }
+    wake.notify_all();
+
+    while (runOne(0)) {
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [this] { return remaining == 0; });
+    current = nullptr;
+}
+
+void ThreadPool::workerLoop(size_t worker) {
+    uint64_t seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+        }
+        while (runOne(worker)) {
+        }
+    }
+}
+
+bool ThreadPool::runOne(size_t worker) {
+    size_t index = 0;
+    bool found = false;
+
+    {
+        WorkQueue& own = *queues[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            index = own.tasks.back();
+            own.tasks.pop_back();
+            found = true;
+        }
+    }
+
+    for (size_t offset = 1; !found && offset < threadCount; ++offset) {
+        WorkQueue& victim = *queues[(worker + offset) % threadCount];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            index = victim.tasks.front();
+            victim.tasks.pop_front();
+            found = true;
+        }
+    }
+
+    if (!found) return false;
+
+    (*current)(worker, index);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (--remaining == 0) {
+        finished.notify_all();
+    }
+    return true;
+}
@@ -0,0 +1,296 @@
+#include "../include/value.h"
+#include <atomic>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <stdexcept>
+
+namespace {
+    std::atomic<uint64_t> clonedSequences{0};
+}
+
+RuntimeValue RuntimeValue::FromInt(long long value) {
+    RuntimeValue v;
+    v.tag = Kind::INT;
+    v.payload.intValue = value;
+    return v;
+}
+
+RuntimeValue RuntimeValue::FromFloat(double value) {
+    RuntimeValue v;
+    v.tag = Kind::FLOAT;
+    v.payload.floatValue = value;
+    return v;
+}
+
+RuntimeValue RuntimeValue::FromBool(bool value) {
+    RuntimeValue v;
+    v.tag = Kind::BOOL;
+    v.payload.boolValue = value;
+    return v;
+}
+
+RuntimeValue RuntimeValue::FromString(std::string value) {
+    RuntimeValue v;
+    v.payload.string = new StringData{1, std::move(value)};
+    v.tag = Kind::STRING;
+    return v;
+}
+
+RuntimeValue RuntimeValue::FromSequence(std::vector<RuntimeValue> values) {
+    if (!values.empty()) {
+        Kind first = values.front().kind();
+        bool homogeneous = first == Kind::INT || first == Kind::FLOAT;
+        for (size_t i = 1; homogeneous && i < values.size(); ++i) {
+            homogeneous = values[i].kind() == first;
+        }
+        if (homogeneous && first == Kind::INT) {
+            std::vector<int64_t> ints(values.size());
+            for (size_t i = 0; i < values.size(); ++i) ints[i] = values[i].intValue();
+            return FromInts(std::move(ints));
+        }
+        if (homogeneous) {
+            std::vector<double> floats(values.size());
+            for (size_t i = 0; i < values.size(); ++i) floats[i] = values[i].floatValue();
+            return FromFloats(std::move(floats));
+        }
+    }
+    
+    RuntimeValue v;
+    v.payload.sequence = new SequenceData{1, SequenceLayout::BOXED, std::move(values), {}, {}};
+    v.tag = Kind::SEQUENCE;
+    return v;
+}
+
+RuntimeValue RuntimeValue::FromInts(std::vector<int64_t> values) {
+    RuntimeValue v;
+    v.payload.sequence = new SequenceData{1, SequenceLayout::INT64, {}, std::move(values), {}};
+    v.tag = Kind::SEQUENCE;
+    return v;
+}
+
+RuntimeValue RuntimeValue::FromFloats(std::vector<double> values) {
+    RuntimeValue v;
+    v.payload.sequence = new SequenceData{1, SequenceLayout::FLOAT64, {}, {}, std::move(values)};
+    v.tag = Kind::SEQUENCE;
+    return v;
+}
+
+RuntimeValue::SequenceData& RuntimeValue::uniqueSequence() {
+    if (payload.sequence->refCount > 1) {
+        SequenceData* copy = new SequenceData(*payload.sequence);
+        clonedSequences.fetch_add(1, std::memory_order_relaxed);
+        copy->refCount = 1;
+        --payload.sequence->refCount;
+        payload.sequence = copy;
+    }
+    return *payload.sequence;
+}
+
+uint64_t RuntimeValue::sequenceCopies() {
+    return clonedSequences.load(std::memory_order_relaxed);
+}
+
+void RuntimeValue::boxSequence() const {
+    // Same elements, different storage: every value sharing the block sees
+    // the same sequence before and after
+    SequenceData& data = *payload.sequence;
+    if (data.layout == SequenceLayout::INT64) {
+        data.elements.reserve(data.ints.size());
+        for (int64_t value : data.ints) data.elements.push_back(FromInt(value));
+        std::vector<int64_t>().swap(data.ints);
+    } else if (data.layout == SequenceLayout::FLOAT64) {
+        data.elements.reserve(data.floats.size());
+        for (double value : data.floats) data.elements.push_back(FromFloat(value));
+        std::vector<double>().swap(data.floats);
+    }
+    data.layout = SequenceLayout::BOXED;
+}
+
+void RuntimeValue::appendElement(RuntimeValue element) {
+    SequenceData& data = uniqueSequence();
+    if (data.layout == SequenceLayout::BOXED && data.elements.empty()) {
+        if (element.kind() == Kind::INT) data.layout = SequenceLayout::INT64;
+        if (element.kind() == Kind::FLOAT) data.layout = SequenceLayout::FLOAT64;
+    }
+    
+    if (data.layout == SequenceLayout::INT64 && element.kind() == Kind::INT) {
+        data.ints.push_back(element.intValue());
+    } else if (data.layout == SequenceLayout::FLOAT64 && element.kind() == Kind::FLOAT) {
+        data.floats.push_back(element.floatValue());
+    } else {
+        boxSequence();
+        data.elements.push_back(std::move(element));
+    }
+}
+
+void RuntimeValue::appendSequence(const RuntimeValue& tail) {
+    // Holding a reference makes `s += s` copy s before it is written
+    RuntimeValue extra = tail;
+    if (extra.sequenceSize() == 0) return;
+    if (sequenceSize() == 0) {
+        *this = std::move(extra);
+        return;
+    }
+    
+    SequenceData& data = uniqueSequence();
+    SequenceLayout layout = extra.sequenceLayout();
+    if (data.layout == SequenceLayout::INT64 && layout == SequenceLayout::INT64) {
+        data.ints.insert(data.ints.end(), extra.intElements().begin(), extra.intElements().end());
+    } else if (data.layout == SequenceLayout::FLOAT64 && layout == SequenceLayout::FLOAT64) {
+        data.floats.insert(data.floats.end(), extra.floatElements().begin(), extra.floatElements().end());
+    } else {
+        boxSequence();
+        data.elements.reserve(data.elements.size() + extra.sequenceSize());
+        for (size_t i = 0; i < extra.sequenceSize(); ++i) {
+            data.elements.push_back(extra.sequenceAt(i));
+        }
+    }
+}
+
+RuntimeValue RuntimeValue::FromBigInt(BigInt value) {
+    if (value.fitsInt64()) return FromInt(value.toInt64());
+    RuntimeValue v;
+    v.payload.bigInt = new BigIntData{1, std::move(value)};
+    v.tag = Kind::BIGINT;
+    return v;
+}
+
+RuntimeValue RuntimeValue::FromLazy(LazySequence* lazy) {
+    RuntimeValue v;
+    v.payload.lazy = lazy;
+    v.tag = Kind::LAZY;
+    return v;
+}
+
+double RuntimeValue::asFloat() const {
+    if (tag == Kind::FLOAT) return payload.floatValue;
+    if (tag == Kind::INT) return static_cast<double>(payload.intValue);
+    if (tag == Kind::BOOL) return payload.boolValue ? 1.0 : 0.0;
+    if (tag == Kind::BIGINT) return bigIntValue().toDouble();
+    throw std::runtime_error("Runtime error: value is not numeric");
+}
+
+long long RuntimeValue::asInt() const {
+    if (tag == Kind::INT) return payload.intValue;
+    if (tag == Kind::FLOAT) return static_cast<long long>(payload.floatValue);
+    if (tag == Kind::BOOL) return payload.boolValue ? 1LL : 0LL;
+    if (tag == Kind::BIGINT) throw std::runtime_error("Runtime error: integer out of range");
+    throw std::runtime_error("Runtime error: value is not an integer");
+}
+
+BigInt RuntimeValue::asBigInt() const {
+    if (tag == Kind::BIGINT) return bigIntValue();
+    if (tag == Kind::INT) return BigInt(payload.intValue);
+    if (tag == Kind::BOOL) return BigInt(payload.boolValue ? 1 : 0);
+    throw std::runtime_error("Runtime error: value is not an integer");
+}
+
+bool RuntimeValue::asBool() const {
+    if (tag == Kind::BOOL) return payload.boolValue;
+    if (isNumeric()) return asFloat() != 0.0;
+    return isTruthy();
+}
+
+bool RuntimeValue::isTruthy() const {
+    switch (tag) {
+        case Kind::VOID:
+            return false;
+        case Kind::BOOL:
+            return payload.boolValue;
+        case Kind::INT:
+            return payload.intValue != 0;
+        case Kind::FLOAT:
+            return std::abs(payload.floatValue) > 1e-9;
+        case Kind::STRING:
+            return !stringValue().empty();
+        case Kind::SEQUENCE:
+            return sequenceSize() != 0;
+        case Kind::LAZY:
+            return lazyValue().materialized.isTruthy();
+        case Kind::BIGINT:
+            return true;
+    }
+    return false;
+}
+
+namespace {
+    void appendInt(std::string& out, int64_t value) {
+        char digits[24];
+        auto end = std::to_chars(digits, digits + sizeof(digits), value).ptr;
+        out.append(digits, end);
+    }
+
+    // The default stream formatting, six significant digits
+    void appendFloat(std::string& out, double value) {
+        char digits[32];
+        int length = std::snprintf(digits, sizeof(digits), "%g", value);
+        out.append(digits, static_cast<size_t>(length));
+    }
+}
+
+std::string RuntimeValue::toString() const {
+    std::string result;
+    appendTo(result);
+    return result;
+}
+
+void RuntimeValue::appendTo(std::string& out) const {
+    switch (tag) {
+        case Kind::VOID:
+            out += "void";
+            return;
+        case Kind::INT:
+            appendInt(out, payload.intValue);
+            return;
+        case Kind::FLOAT:
+            appendFloat(out, payload.floatValue);
+            return;
+        case Kind::BOOL:
+            out += payload.boolValue ? "true" : "false";
+            return;
+        case Kind::STRING:
+            out += stringValue();
+            return;
+        case Kind::SEQUENCE: {
+            out += '[';
+            switch (sequenceLayout()) {
+                case SequenceLayout::INT64: {
+                    const std::vector<int64_t>& ints = intElements();
+                    for (size_t i = 0; i < ints.size(); ++i) {
+                        if (i > 0) out += ", ";
+                        appendInt(out, ints[i]);
+                    }
+                    break;
+                }
+                case SequenceLayout::FLOAT64: {
+                    const std::vector<double>& floats = floatElements();
+                    for (size_t i = 0; i < floats.size(); ++i) {
+                        if (i > 0) out += ", ";
+                        appendFloat(out, floats[i]);
+                    }
+                    break;
+                }
+                case SequenceLayout::BOXED:
+                    for (size_t i = 0; i < sequenceSize(); ++i) {
+                        if (i > 0) out += ", ";
+                        sequenceValue()[i].appendTo(out);
+                    }
+                    break;
+            }
+            out += ']';
+            return;
+        }
+        case Kind::LAZY:
+            // Engines format lazy sequences through Builtins::format
+            if (lazyValue().materialized.kind() == Kind::SEQUENCE) {
+                lazyValue().materialized.appendTo(out);
+                return;
+            }
+            out += "<lazy sequence>";
+            return;
+        case Kind::BIGINT:
+            bigIntValue().appendTo(out);
+            return;
+    }
+}
@@ -0,0 +1,880 @@
+#include "../include/vm.h"
+#include "../include/operators.h"
+#include <cctype>
+#include <iomanip>
+#include <iterator>
+#include <stdexcept>
+#include <unordered_set>
+
+namespace {
+    using RuntimeValue = Interpreter::RuntimeValue;
+    using Kind = RuntimeValue::Kind;
+
+    OpCode binaryOpCode(TacOp op) {
+        switch (op) {
+            case TacOp::ADD: return OpCode::ADD;
+            case TacOp::SUB: return OpCode::SUB;
+            case TacOp::MUL: return OpCode::MUL;
+            case TacOp::DIV: return OpCode::DIV;
+            case TacOp::MOD: return OpCode::MOD;
+            case TacOp::EQ: return OpCode::EQ;
+            case TacOp::NE: return OpCode::NE;
+            case TacOp::LT: return OpCode::LT;
+            case TacOp::LE: return OpCode::LE;
+            case TacOp::GT: return OpCode::GT;
+            case TacOp::GE: return OpCode::GE;
+            case TacOp::AND: return OpCode::AND;
+            default: return OpCode::OR;
+        }
+    }
+
+    const char* opCodeName(OpCode op) {
+        switch (op) {
+            case OpCode::MOVE: return "MOVE";
+            case OpCode::NEW_SEQ: return "NEW_SEQ";
+            case OpCode::SEQ_STORE: return "SEQ_STORE";
+            case OpCode::APPEND: return "APPEND";
+            case OpCode::EXTEND: return "EXTEND";
+            case OpCode::ADD: return "ADD";
+            case OpCode::SUB: return "SUB";
+            case OpCode::MUL: return "MUL";
+            case OpCode::DIV: return "DIV";
+            case OpCode::MOD: return "MOD";
+            case OpCode::EQ: return "EQ";
+            case OpCode::NE: return "NE";
+            case OpCode::LT: return "LT";
+            case OpCode::LE: return "LE";
+            case OpCode::GT: return "GT";
+            case OpCode::GE: return "GE";
+            case OpCode::AND: return "AND";
+            case OpCode::OR: return "OR";
+            case OpCode::NEG: return "NEG";
+            case OpCode::NOT: return "NOT";
+            case OpCode::JUMP: return "JUMP";
+            case OpCode::JUMP_IF_FALSE: return "JUMP_IF_FALSE";
+            case OpCode::JUMP_IF_TRUE: return "JUMP_IF_TRUE";
+            case OpCode::PARAM: return "PARAM";
+            case OpCode::CALL: return "CALL";
+            case OpCode::CALL_BUILTIN: return "CALL_BUILTIN";
+            case OpCode::RETURN: return "RETURN";
+            case OpCode::RETURN_VOID: return "RETURN_VOID";
+        }
+        return "?";
+    }
+
+    // The arithmetic and comparison opcodes are declared in TacOp's order
+    TacOp tacOp(OpCode op) {
+        return static_cast<TacOp>(static_cast<uint8_t>(op) - static_cast<uint8_t>(OpCode::ADD) +
+                                  static_cast<uint8_t>(TacOp::ADD));
+    }
+    static_assert(static_cast<int>(OpCode::OR) - static_cast<int>(OpCode::ADD) ==
+                      static_cast<int>(TacOp::OR) - static_cast<int>(TacOp::ADD),
+                  "OpCode and TacOp operators must line up");
+}
+
+BytecodeModule BytecodeCompiler::compile(const TacModule& tac, Program* program) {
+    module = BytecodeModule();
+    if (!program) return module;
+
+    for (auto& function : program->functions) {
+        module.functionIndex[function->name.text()] = static_cast<uint32_t>(module.functions.size());
+        module.functions.emplace_back();
+        module.functions.back().name = function->name.text();
+    }
+
+    // Locate each function's entry label; its body runs until the next one
+    const std::vector<ThreeAddressCode>& code = tac.code;
+    std::vector<size_t> starts(program->functions.size(), code.size());
+    std::vector<size_t> boundaries;
+    for (size_t i = 0; i < code.size(); ++i) {
+        if (code[i].op != TacOp::LABEL || code[i].result.kind() != Operand::Kind::FUNCTION) continue;
+        auto it = module.functionIndex.find(tac.name(code[i].result));
+        if (it != module.functionIndex.end() && starts[it->second] == code.size()) {
+            starts[it->second] = i;
+            boundaries.push_back(i);
+        }
+    }
+    boundaries.push_back(code.size());
+
+    for (size_t f = 0; f < program->functions.size(); ++f) {
+        size_t begin = starts[f];
+        size_t end = code.size();
+        for (size_t boundary : boundaries) {
+            if (boundary > begin) {
+                end = boundary;
+                break;
+            }
+        }
+        if (begin == code.size()) {
+            begin = end = code.size();
+        } else {
+            ++begin;
+        }
+        compileFunction(program->functions[f], tac, begin, end);
+    }
+
+    markParallelSafe(program);
+    for (auto& function : module.functions) {
+        function.inlineCallback = buildInlineCallback(function);
+    }
+    return module;
+}
+
+std::shared_ptr<const InlineCallback> BytecodeCompiler::buildInlineCallback(const BytecodeFunction& function) {
+    if (function.numParams != 1) return nullptr;
+
+    auto callback = std::make_shared<InlineCallback>();
+    callback->registers = std::max<uint32_t>(function.numRegisters, 1);
+    std::vector<bool> written(callback->registers, false);
+    written[0] = true;
+    std::unordered_map<uint32_t, uint32_t> constants;
+
+    // Registers start out void, so each must be written before it is read
+    auto operand = [&](uint32_t source, uint32_t& target) -> bool {
+        if (!(source & VirtualMachine::kConstantBit)) {
+            target = source;
+            return written[source];
+        }
+        const RuntimeValue& value = function.constants[source & ~VirtualMachine::kConstantBit];
+        if (value.kind() != Kind::INT && value.kind() != Kind::FLOAT && value.kind() != Kind::BOOL) return false;
+        auto it = constants.find(source);
+        if (it == constants.end()) {
+            it = constants.emplace(source, static_cast<uint32_t>(callback->constants.size()) |
+                                               InlineCallback::kConstantBit).first;
+            callback->constants.push_back(value);
+        }
+        target = it->second;
+        return true;
+    };
+
+    using Op = InlineCallback::Op;
+    for (const Instruction& instr : function.code) {
+        Op op;
+        switch (instr.op) {
+            case OpCode::MOVE: op = Op::MOVE; break;
+            case OpCode::ADD: op = Op::ADD; break;
+            case OpCode::SUB: op = Op::SUB; break;
+            case OpCode::MUL: op = Op::MUL; break;
+            case OpCode::DIV: op = Op::DIV; break;
+            case OpCode::MOD: op = Op::MOD; break;
+            case OpCode::EQ: op = Op::EQ; break;
+            case OpCode::NE: op = Op::NE; break;
+            case OpCode::LT: op = Op::LT; break;
+            case OpCode::LE: op = Op::LE; break;
+            case OpCode::GT: op = Op::GT; break;
+            case OpCode::GE: op = Op::GE; break;
+            case OpCode::AND: op = Op::AND; break;
+            case OpCode::OR: op = Op::OR; break;
+            case OpCode::NEG: op = Op::NEG; break;
+            case OpCode::NOT: op = Op::NOT; break;
+            case OpCode::RETURN:
+                // Nothing jumps, so whatever follows is never reached
+                if (!operand(instr.b, callback->result)) return nullptr;
+                return callback;
+            default:
+                return nullptr;
+        }
+        InlineCallback::Step step{op, instr.a, 0, 0};
+        bool unary = op == Op::MOVE || op == Op::NEG || op == Op::NOT;
+        if (!operand(instr.b, step.left) || (!unary && !operand(instr.c, step.right))) return nullptr;
+        written[instr.a] = true;
+        callback->steps.push_back(step);
+    }
+    return nullptr;
+}
+
+void BytecodeCompiler::markParallelSafe(Program* program) {
+    // String, sequence, big integer and function-reference constants are
+    // shared by every VM running this module, and copying one touches its
+    // reference count
+    for (size_t f = 0; f < module.functions.size(); ++f) {
+        BytecodeFunction& function = module.functions[f];
+        function.pure = program->functions[f]->isPure;
+        function.parallelSafe = function.pure;
+        for (const auto& constant : function.constants) {
+            if (constant.kind() == Kind::STRING || constant.kind() == Kind::SEQUENCE || constant.kind() == Kind::BIGINT) {
+                function.parallelSafe = false;
+            }
+        }
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (auto& function : module.functions) {
+            if (!function.parallelSafe) continue;
+            for (const auto& instr : function.code) {
+                if (instr.op == OpCode::CALL && !module.functions[instr.b].parallelSafe) {
+                    function.parallelSafe = false;
+                    changed = true;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+void BytecodeCompiler::compileFunction(FunctionDecl* function, const TacModule& tac,
+                                       size_t begin, size_t end) {
+    BytecodeFunction& target = module.functions[module.functionIndex[function->name.text()]];
+    const std::vector<ThreeAddressCode>& code = tac.code;
+    std::unordered_map<Operand, uint32_t, OperandHash> registerMap;
+    std::unordered_map<uint32_t, uint32_t> constantMap;
+    std::unordered_map<uint32_t, uint32_t> callbackMap;
+    std::unordered_map<Operand, size_t, OperandHash> labels;
+    std::vector<std::pair<size_t, Operand>> jumpFixups;
+
+    auto reg = [&](Operand name) -> uint32_t {
+        auto it = registerMap.find(name);
+        if (it != registerMap.end()) return it->second;
+        uint32_t index = static_cast<uint32_t>(target.registerNames.size());
+        target.registerNames.push_back(tac.operandToString(name));
+        registerMap[name] = index;
+        return index;
+    };
+
+    // Parameters arrive in the first registers, in declaration order
+    for (const auto& param : function->parameters) {
+        int64_t name = tac.names.find("param_" + param.name.text());
+        if (name < 0) {
+            // Never read; the register still has to be reserved
+            target.registerNames.push_back("param_" + param.name.text());
+            continue;
+        }
+        reg(Operand::make(Operand::Kind::VARIABLE, static_cast<uint32_t>(name)));
+    }
+    target.numParams = static_cast<uint32_t>(function->parameters.size());
+    target.memoizable = MemoCache::isCandidate(*function);
+
+    std::unordered_set<Operand, OperandHash> assigned;
+    for (size_t i = begin; i < end; ++i) {
+        if (code[i].result.isValue()) {
+            assigned.insert(code[i].result);
+        }
+    }
+
+    auto constant = [&](std::unordered_map<uint32_t, uint32_t>& pool, uint32_t key,
+                        const RuntimeValue& value) -> uint32_t {
+        auto it = pool.find(key);
+        if (it != pool.end()) return it->second;
+        uint32_t index = static_cast<uint32_t>(target.constants.size()) | VirtualMachine::kConstantBit;
+        target.constants.push_back(value);
+        pool[key] = index;
+        return index;
+    };
+
+    auto operand = [&](Operand source) -> uint32_t {
+        if (source.empty()) return 0;
+        if (source.isConstant()) {
+            const TacConstant& value = tac.constant(source);
+            switch (value.kind) {
+                case TacConstant::Kind::INT:
+                    return constant(constantMap, source.index(), RuntimeValue::FromInt(value.intValue));
+                case TacConstant::Kind::FLOAT:
+                    return constant(constantMap, source.index(), RuntimeValue::FromFloat(value.floatValue));
+                case TacConstant::Kind::BOOL:
+                    return constant(constantMap, source.index(), RuntimeValue::FromBool(value.intValue != 0));
+                case TacConstant::Kind::STRING:
+                    return constant(constantMap, source.index(), RuntimeValue::FromString(value.text));
+                case TacConstant::Kind::BIGINT:
+                    return constant(constantMap, source.index(),
+                                    RuntimeValue::FromBigInt(BigInt::fromString(value.text)));
+            }
+        }
+        // Names that are never written in this function but match a
+        // function declaration are callbacks passed to map/filter
+        if (source.kind() == Operand::Kind::VARIABLE && !registerMap.count(source) && !assigned.count(source) &&
+            module.functionIndex.count(tac.name(source))) {
+            return constant(callbackMap, source.index(), RuntimeValue::FromString(tac.name(source)));
+        }
+        return reg(source);
+    };
+
+    auto emit = [&](OpCode op, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0) {
+        target.code.push_back(Instruction{op, a, b, c});
+    };
+
+    for (size_t i = begin; i < end; ++i) {
+        const ThreeAddressCode& instr = code[i];
+
+        switch (instr.op) {
+            case TacOp::LABEL:
+                labels[instr.result] = target.code.size();
+                break;
+            case TacOp::GOTO:
+                jumpFixups.emplace_back(target.code.size(), instr.result);
+                emit(OpCode::JUMP);
+                break;
+            case TacOp::IF_FALSE:
+            case TacOp::IF:
+                jumpFixups.emplace_back(target.code.size(), instr.result);
+                emit(instr.op == TacOp::IF ? OpCode::JUMP_IF_TRUE : OpCode::JUMP_IF_FALSE, 0, operand(instr.arg1));
+                break;
+            case TacOp::ASSIGN: {
+                uint32_t source = operand(instr.arg1);
+                emit(OpCode::MOVE, reg(instr.result), source);
+                break;
+            }
+            case TacOp::NEW_SEQ:
+                emit(OpCode::NEW_SEQ, reg(instr.result));
+                break;
+            case TacOp::STORE: {
+                uint32_t element = operand(instr.arg1);
+                emit(OpCode::SEQ_STORE, reg(instr.result), element, instr.arg2.index());
+                break;
+            }
+            case TacOp::APPEND:
+            case TacOp::EXTEND: {
+                uint32_t source = operand(instr.arg1);
+                emit(instr.op == TacOp::APPEND ? OpCode::APPEND : OpCode::EXTEND, reg(instr.result), source);
+                break;
+            }
+            case TacOp::PARAM:
+                emit(OpCode::PARAM, 0, operand(instr.arg1));
+                break;
+            case TacOp::CALL: {
+                uint32_t argCount = instr.arg2.empty() ? 0 : instr.arg2.index();
+                const std::string& callee = tac.name(instr.arg1);
+                Builtin builtin;
+                if (Builtins::find(callee, builtin)) {
+                    emit(OpCode::CALL_BUILTIN, reg(instr.result), static_cast<uint32_t>(builtin), argCount);
+                } else {
+                    auto index = module.functionIndex.find(callee);
+                    if (index == module.functionIndex.end()) {
+                        throw std::runtime_error("Bytecode error: Undefined function '" + callee + "'");
+                    }
+                    emit(OpCode::CALL, reg(instr.result), index->second, argCount);
+                }
+                break;
+            }
+            case TacOp::RETURN:
+                if (instr.arg1.empty()) {
+                    emit(OpCode::RETURN_VOID);
+                } else {
+                    emit(OpCode::RETURN, 0, operand(instr.arg1));
+                }
+                break;
+            case TacOp::NEG:
+            case TacOp::NOT: {
+                uint32_t source = operand(instr.arg1);
+                emit(instr.op == TacOp::NEG ? OpCode::NEG : OpCode::NOT, reg(instr.result), source);
+                break;
+            }
+            default: {
+                if (!isBinaryTacOp(instr.op)) {
+                    throw std::runtime_error("Bytecode error: Unsupported instruction '" + tac.toString(instr) + "'");
+                }
+                uint32_t left = operand(instr.arg1);
+                uint32_t right = operand(instr.arg2);
+                emit(binaryOpCode(instr.op), reg(instr.result), left, right);
+                break;
+            }
+        }
+    }
+
+    // Falling off the end of a function returns void, as in the interpreter
+    emit(OpCode::RETURN_VOID);
+
+    for (const auto& fixup : jumpFixups) {
+        auto it = labels.find(fixup.second);
+        if (it == labels.end()) {
+            throw std::runtime_error("Bytecode error: Undefined label '" + tac.operandToString(fixup.second) + "'");
+        }
+        target.code[fixup.first].a = static_cast<uint32_t>(it->second);
+    }
+
+    target.numRegisters = static_cast<uint32_t>(target.registerNames.size());
+}
+
+VirtualMachine::VirtualMachine(BytecodeModule module)
+    : module(std::make_shared<const BytecodeModule>(std::move(module))) {}
+
+VirtualMachine::VirtualMachine(std::shared_ptr<const BytecodeModule> module)
+    : module(std::move(module)) {}
+
+VirtualMachine::ExecutionResult VirtualMachine::run() {
+    ExecutionResult result;
+
+    auto it = module->functionIndex.find("main");
+    if (it == module->functionIndex.end()) {
+        result.errorMessage = "No 'main' function found";
+        return result;
+    }
+
+    try {
+        log.clear();
+        registers.clear();
+        argStack.clear();
+        frameTop = 0;
+        RuntimeValue returnValue = execute(it->second, 0, 0);
+        result.success = true;
+        if (returnValue.kind() == Kind::VOID) {
+            result.exitCode = 0;
+        } else {
+            result.exitCode = static_cast<int>(returnValue.asInt());
+        }
+        result.outputLog = log.take();
+    } catch (const std::exception& e) {
+        result.errorMessage = e.what();
+        result.outputLog = log.take();
+    }
+
+    return result;
+}
+
+void VirtualMachine::setJit(JitCompiler* compiler) {
+    jit = compiler;
+    hotness.assign(module->functions.size(), 0);
+    compiled.assign(module->functions.size(), nullptr);
+    promoted.assign(module->functions.size(), false);
+}
+
+bool VirtualMachine::callCompiled(uint32_t functionIndex, size_t argBase, uint32_t argCount, RuntimeValue& result) {
+    const std::vector<Kind>& kinds = jit->parameterKinds(functionIndex);
+    if (argCount != kinds.size()) return false;
+    int64_t args[JitCompiler::kMaxArguments];
+    for (uint32_t i = 0; i < argCount; ++i) {
+        const RuntimeValue& arg = argStack[argBase + i];
+        if (arg.kind() != kinds[i]) return false;
+        args[i] = kinds[i] == Kind::BOOL ? (arg.boolValue() ? 1 : 0) : arg.intValue();
+    }
+    // Compiled code gets what is left of the budget execute checks against
+    uintptr_t base = reinterpret_cast<uintptr_t>(stackBase);
+    uintptr_t limit = base > Interpreter::stackBudget() ? base - Interpreter::stackBudget() : 0;
+    int64_t bits = 0;
+    switch (JitCompiler::run(compiled[functionIndex], args, reinterpret_cast<const char*>(limit), bits)) {
+        case JitCompiler::Outcome::DONE:
+            break;
+        case JitCompiler::Outcome::DIVIDED_BY_ZERO:
+            throw std::runtime_error("Runtime error: division by zero");
+        case JitCompiler::Outcome::STACK_EXHAUSTED:
+            throw std::runtime_error("Runtime error: call depth exceeds the stack limit (in compiled code)");
+        case JitCompiler::Outcome::OVERFLOWED:
+            // Its values outgrow machine integers; the bytecode promotes
+            compiled[functionIndex] = nullptr;
+            return false;
+    }
+    argStack.resize(argBase);
+    result = jit->resultKind(functionIndex) == Kind::BOOL ? RuntimeValue::FromBool(bits != 0)
+                                                          : RuntimeValue::FromInt(bits);
+    return true;
+}
+
+VirtualMachine::RuntimeValue VirtualMachine::execute(uint32_t functionIndex, size_t argBase, uint32_t argCount) {
+    const BytecodeFunction& function = module->functions[functionIndex];
+    if (interrupt && interrupt->load(std::memory_order_relaxed)) {
+        throw std::runtime_error("Runtime error: Execution interrupted");
+    }
+    ++callsEntered;
+    char marker;
+    if (callDepth == 0) {
+        stackBase = &marker;
+    } else {
+        Interpreter::checkStack(stackBase, callDepth);
+    }
+    if (jit) {
+        if (!promoted[functionIndex] && ++hotness[functionIndex] >= jit->threshold()) {
+            promoted[functionIndex] = true;
+            compiled[functionIndex] = jit->entry(functionIndex);
+        }
+        RuntimeValue result;
+        if (compiled[functionIndex] && callCompiled(functionIndex, argBase, argCount, result)) {
+            return result;
+        }
+    }
+    const size_t base = frameTop;
+    frameTop += function.numRegisters;
+    if (registers.size() < frameTop) {
+        registers.resize(frameTop);
+    }
+
+    for (uint32_t i = 0; i < function.numRegisters; ++i) {
+        registers[base + i] = RuntimeValue::Void();
+    }
+    for (uint32_t i = 0; i < function.numParams && i < argCount; ++i) {
+        registers[base + i] = std::move(argStack[argBase + i]);
+    }
+    argStack.resize(argBase);
+
+    struct FrameGuard {
+        size_t& top;
+        size_t base;
+        size_t& depth;
+        ~FrameGuard() {
+            top = base;
+            --depth;
+        }
+    } guard{frameTop, base, callDepth};
+    ++callDepth;
+
+    const Instruction* code = function.code.data();
+    const RuntimeValue* constants = function.constants.data();
+    RuntimeValue* regs = registers.data() + base;
+    size_t pc = 0;
+
+    auto value = [&](uint32_t operand) -> const RuntimeValue& {
+        return (operand & kConstantBit) ? constants[operand & ~kConstantBit] : regs[operand];
+    };
+
+    // Operators need strict values: a register holding a lazy sequence is
+    // replaced by its elements, which may run callbacks (and move regs)
+    auto force = [&](uint32_t operand) {
+        if (!(operand & kConstantBit) && regs[operand].kind() == Kind::LAZY) {
+            RuntimeValue elements = builtins.strict(regs[operand]);
+            regs = registers.data() + base;
+            regs[operand] = std::move(elements);
+        }
+    };
+
+    // Loops are what the JIT counts, and where an interrupt is noticed
+    auto backEdge = [&]() {
+        if (jit) ++hotness[functionIndex];
+        if (interrupt && interrupt->load(std::memory_order_relaxed)) {
+            throw std::runtime_error("Runtime error: Execution interrupted");
+        }
+    };
+
+    for (;;) {
+        const Instruction& instr = code[pc++];
+        switch (instr.op) {
+            case OpCode::MOVE:
+                regs[instr.a] = value(instr.b);
+                break;
+            case OpCode::NEW_SEQ:
+                regs[instr.a] = RuntimeValue::FromSequence({});
+                break;
+            case OpCode::SEQ_STORE: {
+                force(instr.b);
+                // Literals store their elements in order, which keeps an
+                // all-int or all-float literal unboxed
+                if (instr.c == regs[instr.a].sequenceSize()) {
+                    regs[instr.a].appendElement(value(instr.b));
+                    break;
+                }
+                auto& elements = regs[instr.a].mutableSequence();
+                if (instr.c >= elements.size()) {
+                    elements.resize(instr.c + 1);
+                }
+                elements[instr.c] = value(instr.b);
+                break;
+            }
+            case OpCode::APPEND: {
+                // Take the element first: appending s to itself must not
+                // make the sequence contain its own storage
+                force(instr.a);
+                force(instr.b);
+                RuntimeValue element = value(instr.b);
+                if (regs[instr.a].kind() != Kind::SEQUENCE) {
+                    throw std::runtime_error("Runtime error: value is not numeric");
+                }
+                regs[instr.a].appendElement(std::move(element));
+                break;
+            }
+            case OpCode::EXTEND: {
+                force(instr.a);
+                force(instr.b);
+                RuntimeValue tail = value(instr.b);
+                if (regs[instr.a].kind() != Kind::SEQUENCE || tail.kind() != Kind::SEQUENCE) {
+                    throw std::runtime_error("Runtime error: value is not numeric");
+                }
+                regs[instr.a].appendSequence(tail);
+                break;
+            }
+            case OpCode::ADD:
+            case OpCode::SUB:
+            case OpCode::MUL:
+            case OpCode::DIV:
+            case OpCode::MOD:
+                force(instr.b);
+                force(instr.c);
+                regs[instr.a] = Operators::arithmetic(tacOp(instr.op), value(instr.b), value(instr.c));
+                break;
+            case OpCode::EQ:
+                force(instr.b);
+                force(instr.c);
+                regs[instr.a] = RuntimeValue::FromBool(Builtins::equal(value(instr.b), value(instr.c)));
+                break;
+            case OpCode::NE:
+                force(instr.b);
+                force(instr.c);
+                regs[instr.a] = RuntimeValue::FromBool(!Builtins::equal(value(instr.b), value(instr.c)));
+                break;
+            case OpCode::LT:
+            case OpCode::LE:
+            case OpCode::GT:
+            case OpCode::GE:
+                force(instr.b);
+                force(instr.c);
+                regs[instr.a] = RuntimeValue::FromBool(Operators::compare(tacOp(instr.op), value(instr.b), value(instr.c)));
+                break;
+            case OpCode::AND:
+                force(instr.b);
+                force(instr.c);
+                regs[instr.a] = RuntimeValue::FromBool(value(instr.b).asBool() && value(instr.c).asBool());
+                break;
+            case OpCode::OR:
+                force(instr.b);
+                force(instr.c);
+                regs[instr.a] = RuntimeValue::FromBool(value(instr.b).asBool() || value(instr.c).asBool());
+                break;
+            case OpCode::NEG:
+                force(instr.b);
+                regs[instr.a] = Operators::negate(value(instr.b));
+                break;
+            case OpCode::NOT:
+                force(instr.b);
+                regs[instr.a] = RuntimeValue::FromBool(!value(instr.b).asBool());
+                break;
+            case OpCode::JUMP:
+                if (instr.a < pc) backEdge();
+                pc = instr.a;
+                break;
+            case OpCode::JUMP_IF_FALSE:
+                force(instr.b);
+                if (!value(instr.b).asBool()) {
+                    if (instr.a < pc) backEdge();
+                    pc = instr.a;
+                }
+                break;
+            case OpCode::JUMP_IF_TRUE:
+                force(instr.b);
+                if (value(instr.b).asBool()) {
+                    if (instr.a < pc) backEdge();
+                    pc = instr.a;
+                }
+                break;
+            case OpCode::PARAM:
+                argStack.push_back(value(instr.b));
+                break;
+            case OpCode::CALL:
+            case OpCode::CALL_BUILTIN: {
+                size_t callArgBase = argStack.size() - instr.c;
+                RuntimeValue returned = instr.op == OpCode::CALL
+                    ? call(instr.b, callArgBase, instr.c)
+                    : callBuiltin(static_cast<Builtin>(instr.b), callArgBase, instr.c);
+                // The callee may have grown the register file
+                regs = registers.data() + base;
+                regs[instr.a] = std::move(returned);
+                break;
+            }
+            case OpCode::RETURN:
+                return value(instr.b);
+            case OpCode::RETURN_VOID:
+                return RuntimeValue::Void();
+        }
+    }
+}
+
+uint32_t VirtualMachine::lookupFunction(const RuntimeValue& reference) {
+    if (reference.kind() != Kind::STRING) {
+        throw std::runtime_error("Runtime error: expected function identifier");
+    }
+    auto it = module->functionIndex.find(reference.stringValue());
+    if (it == module->functionIndex.end()) {
+        throw std::runtime_error("Runtime error: Undefined function '" + reference.stringValue() + "'");
+    }
+    return it->second;
+}
+
+VirtualMachine::RuntimeValue VirtualMachine::invoke(uint32_t function, const RuntimeValue& argument) {
+    size_t callBase = argStack.size();
+    argStack.push_back(argument);
+    return call(function, callBase, 1);
+}
+
+VirtualMachine::RuntimeValue VirtualMachine::call(uint32_t functionIndex, size_t argBase, uint32_t argCount) {
+    if (!memo || !module->functions[functionIndex].memoizable || argCount > MemoCache::kMaxArguments) {
+        return execute(functionIndex, argBase, argCount);
+    }
+    if (const RuntimeValue* cached = memo->find(functionIndex, &argStack[argBase], argCount)) {
+        RuntimeValue result = *cached;
+        argStack.resize(argBase);
+        return result;
+    }
+    // execute moves the arguments into the callee's registers
+    RuntimeValue key[MemoCache::kMaxArguments];
+    for (uint32_t i = 0; i < argCount; ++i) {
+        key[i] = argStack[argBase + i];
+    }
+    RuntimeValue result = execute(functionIndex, argBase, argCount);
+    memo->insert(functionIndex, key, argCount, result);
+    return result;
+}
+
+bool VirtualMachine::isParallelSafe(uint32_t function) const {
+    return module->functions[function].parallelSafe;
+}
+
+uint64_t VirtualMachine::calls() const {
+    uint64_t total = callsEntered;
+    for (const VirtualMachine* worker : forks) {
+        total += worker->calls();
+    }
+    return total;
+}
+
+bool VirtualMachine::isPure(uint32_t function) const {
+    return module->functions[function].pure;
+}
+
+std::unique_ptr<FunctionInvoker> VirtualMachine::fork() {
+    std::unique_ptr<VirtualMachine> worker(new VirtualMachine(module));
+    if (jit) worker->setJit(jit);
+    worker->setInterrupt(interrupt);
+    forks.push_back(worker.get());
+    return std::unique_ptr<FunctionInvoker>(std::move(worker));
+}
+
+const InlineCallback* VirtualMachine::inlineCallback(uint32_t function) const {
+    const BytecodeFunction& target = module->functions[function];
+    // Running it inline would bypass the cache and its statistics
+    if (memo && target.memoizable) return nullptr;
+    return target.inlineCallback.get();
+}
+
+VirtualMachine::RuntimeValue VirtualMachine::callBuiltin(Builtin builtin, size_t argBase, uint32_t argCount) {
+    // Builtins may call back into user code, which pushes onto argStack,
+    // so the arguments are moved off it before anything runs
+    if (builtin == Builtin::PRINT) {
+        std::vector<RuntimeValue> values(std::make_move_iterator(argStack.begin() + argBase),
+                                         std::make_move_iterator(argStack.end()));
+        argStack.resize(argBase);
+        std::string line = std::move(printBuffer);
+        line.clear();
+        for (uint32_t i = 0; i < argCount; ++i) {
+            if (i > 0) line += ' ';
+            builtins.formatTo(values[i], line);
+        }
+        (output ? *output : log).writeLine(line);
+        printBuffer = std::move(line);
+        return RuntimeValue::Void();
+    }
+
+    RuntimeValue args[3];
+    for (uint32_t i = 0; i < argCount && i < 3; ++i) {
+        args[i] = std::move(argStack[argBase + i]);
+    }
+    argStack.resize(argBase);
+
+    switch (builtin) {
+        case Builtin::PRINT:
+            break;
+        case Builtin::LENGTH:
+            if (argCount != 1) {
+                throw std::runtime_error("Runtime error: length expects 1 argument");
+            }
+            return builtins.length(args[0]);
+        case Builtin::GET:
+            if (argCount != 2) {
+                throw std::runtime_error("Runtime error: get expects 2 arguments");
+            }
+            return builtins.get(args[0], builtins.strict(args[1]));
+        case Builtin::MAP:
+            if (argCount != 2) {
+                throw std::runtime_error("Runtime error: map expects 2 arguments");
+            }
+            return builtins.map(args[0], lookupFunction(args[1]));
+        case Builtin::FILTER:
+            if (argCount != 2) {
+                throw std::runtime_error("Runtime error: filter expects 2 arguments");
+            }
+            return builtins.filter(args[0], lookupFunction(args[1]));
+        case Builtin::GENERATE:
+            if (argCount != 3) {
+                throw std::runtime_error("Runtime error: generate expects 3 arguments");
+            }
+            return builtins.generate(args[0], lookupFunction(args[1]), builtins.strict(args[2]));
+        case Builtin::SUM:
+        case Builtin::MIN:
+        case Builtin::MAX: {
+            const char* name = builtin == Builtin::SUM ? "sum" : builtin == Builtin::MIN ? "min" : "max";
+            if (argCount != 1) {
+                throw std::runtime_error(std::string("Runtime error: ") + name + " expects 1 argument");
+            }
+            if (builtin == Builtin::SUM) return builtins.sum(args[0]);
+            return builtin == Builtin::MIN ? builtins.min(args[0]) : builtins.max(args[0]);
+        }
+        case Builtin::INPUT: {
+            if (argCount > 1) {
+                throw std::runtime_error("Runtime error: input expects at most 1 argument");
+            }
+            std::string promptText = argCount == 1 ? builtins.format(args[0]) : "";
+            if (output) output->flush();
+            return Builtins::readInput(promptText);
+        }
+        case Builtin::LOAD:
+            if (argCount < 1 || argCount > 2) {
+                throw std::runtime_error("Runtime error: load expects 1 or 2 arguments");
+            }
+            return Builtins::load(builtins.format(args[0]), argCount == 2 ? builtins.format(args[1]) : "text");
+        case Builtin::READ_SEQUENCE:
+            if (argCount != 0) {
+                throw std::runtime_error("Runtime error: read_sequence expects no arguments");
+            }
+            if (output) output->flush();
+            return Builtins::readSequence();
+    }
+    return RuntimeValue::Void();
+}
+
+void VirtualMachine::printBytecode(std::ostream& out) const {
+    auto operandText = [](uint32_t operand) {
+        if (operand & kConstantBit) {
+            return "k" + std::to_string(operand & ~kConstantBit);
+        }
+        return "r" + std::to_string(operand);
+    };
+
+    for (const auto& function : module->functions) {
+        out << function.name << ": params=" << function.numParams
+            << " registers=" << function.numRegisters << std::endl;
+        for (size_t i = 0; i < function.constants.size(); ++i) {
+            out << "  k" << i << " = " << function.constants[i].toString() << std::endl;
+        }
+        for (size_t i = 0; i < function.code.size(); ++i) {
+            const Instruction& instr = function.code[i];
+            out << "  " << std::setw(4) << std::setfill('0') << i << std::setfill(' ')
+                << "  " << opCodeName(instr.op);
+            switch (instr.op) {
+                case OpCode::JUMP:
+                    out << " " << instr.a;
+                    break;
+                case OpCode::JUMP_IF_FALSE:
+                case OpCode::JUMP_IF_TRUE:
+                    out << " " << operandText(instr.b) << ", " << instr.a;
+                    break;
+                case OpCode::PARAM:
+                case OpCode::RETURN:
+                    out << " " << operandText(instr.b);
+                    break;
+                case OpCode::RETURN_VOID:
+                    break;
+                case OpCode::NEW_SEQ:
+                    out << " " << operandText(instr.a);
+                    break;
+                case OpCode::MOVE:
+                case OpCode::APPEND:
+                case OpCode::EXTEND:
+                case OpCode::NEG:
+                case OpCode::NOT:
+                    out << " " << operandText(instr.a) << ", " << operandText(instr.b);
+                    break;
+                case OpCode::SEQ_STORE:
+                    out << " " << operandText(instr.a) << "[" << instr.c << "], " << operandText(instr.b);
+                    break;
+                case OpCode::CALL:
+                    out << " " << operandText(instr.a) << ", " << module->functions[instr.b].name
+                        << ", " << instr.c;
+                    break;
+                case OpCode::CALL_BUILTIN:
+                    out << " " << operandText(instr.a) << ", #" << instr.b << ", " << instr.c;
+                    break;
+                default:
+                    out << " " << operandText(instr.a) << ", " << operandText(instr.b)
+                        << ", " << operandText(instr.c);
+                    break;
+            }
+            out << std::endl;
+        }
+    }
+}